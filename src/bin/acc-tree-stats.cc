@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "tree/context-dep.h"
 #include "tree/build-tree-utils.h"
+#include "tree/compact-tree-stats.h"
 #include "hmm/transition-model.h"
 #include "hmm/tree-accu.h"
 
@@ -41,13 +42,17 @@ int main(int argc, char *argv[]) {
         "e.g.: \n"
         " acc-tree-stats 1.mdl scp:train.scp ark:1.ali 1.tacc\n";
     ParseOptions po(usage);
-    bool binary = true;
+    bool binary = true, compact = false;
     float var_floor = 0.01;
     string ci_phones_str;
     std::string phone_map_rxfilename;
     int N = 3;
     int P = 1;
     po.Register("binary", &binary, "Write output in binary mode");
+    po.Register("compact", &compact, "If true, write the stats in the compact "
+                "format (see CompactTreeStats); this is smaller and faster to "
+                "read and sum, and is accepted by sum-tree-stats, build-tree "
+                "and the other programs that read tree stats.");
     po.Register("var-floor", &var_floor, "Variance floor for tree clustering.");
     po.Register("ci-phones", &ci_phones_str, "Colon-separated list of integer "
                 "indices of context-independent phones (after mapping, if "
@@ -144,7 +149,13 @@ int main(int argc, char *argv[]) {
 
     {
       Output ko(accs_out_wxfilename, binary);
-      WriteBuildTreeStats(ko.Stream(), binary, stats);
+      if (compact) {
+        CompactTreeStats compact_stats;
+        compact_stats.CopyFromBuildTreeStats(stats);
+        compact_stats.Write(ko.Stream(), binary);
+      } else {
+        WriteBuildTreeStats(ko.Stream(), binary, stats);
+      }
     }
     KALDI_LOG << "Accumulated stats for " << num_done << " files, "
               << num_no_alignment << " failed due to no alignment, "
@@ -61,6 +61,8 @@ int main(int argc, char *argv[]) {
     po.Register("batch-size", &batch_size,
                 "Number of FSTs to compile at a time (more -> faster but uses "
                 "more memory.  E.g. 500");
+    po.Register("num-threads", &gopts.num_threads, "Number of threads used "
+                "to compile each batch of graphs");
     po.Register("read-disambig-syms", &disambig_rxfilename, "File containing "
                 "list of disambiguation symbols in phone symbol table");
     
@@ -22,6 +22,7 @@
 #include "tree/context-dep.h"
 #include "tree/clusterable-classes.h"
 #include "tree/build-tree-utils.h"
+#include "tree/compact-tree-stats.h"
 
 int main(int argc, char *argv[]) {
   using namespace kaldi;
@@ -34,9 +35,13 @@ int main(int argc, char *argv[]) {
         " sum-tree-stats treeacc 1.treeacc 2.treeacc 3.treeacc\n";
 
     ParseOptions po(usage);
-    bool binary = true;
+    bool binary = true, compact = false;
 
     po.Register("binary", &binary, "Write output in binary mode");
+    po.Register("compact", &compact, "If true, write the stats in the compact "
+                "format (see CompactTreeStats); this is smaller and faster to "
+                "read and sum, and is accepted by build-tree and the other "
+                "programs that read tree stats.");
     po.Read(argc, argv);
 
     if (po.NumArgs() < 2) {
@@ -44,50 +49,36 @@ int main(int argc, char *argv[]) {
       exit(1);
     }
 
-    std::map<EventType, Clusterable*> tree_stats;
-    
     std::string tree_stats_wxfilename = po.GetArg(1);
 
-    // A reminder on what BuildTreeStatsType is:
-    // typedef std::vector<std::pair<EventType, Clusterable*> > BuildTreeStatsType;
-    
+    // The inputs may be in either the compact format or the format written by
+    // WriteBuildTreeStats(); we sum them in the compact form, which is a
+    // merge of sorted lists and avoids allocating an object per event.
+    CompactTreeStats tree_stats;
     for (int32 arg = 2; arg <= po.NumArgs(); arg++) {
       std::string tree_stats_rxfilename = po.GetArg(arg);
       bool binary_in;
       Input ki(tree_stats_rxfilename, &binary_in);
-      BuildTreeStatsType stats_array;
-      GaussClusterable example; // Lets ReadBuildTreeStats know which type to read..
-      ReadBuildTreeStats(ki.Stream(), binary_in, example, &stats_array);
-      for (BuildTreeStatsType::iterator iter = stats_array.begin();
-           iter != stats_array.end(); ++iter) {
-        EventType e = iter->first;
-        Clusterable *c = iter->second;
-        std::map<EventType, Clusterable*>::iterator map_iter = tree_stats.find(e);
-        if (map_iter == tree_stats.end()) { // Not already present.
-          tree_stats[e] = c;
-        } else {
-          map_iter->second->Add(*c);
-          delete c;
-        }
-      }
+      CompactTreeStats stats;
+      stats.Read(ki.Stream(), binary_in);
+      if (arg == 2) tree_stats.Swap(&stats);
+      else tree_stats.Add(stats);
     }
 
-    BuildTreeStatsType stats;  // vectorized form.
-
-    for (std::map<EventType, Clusterable*>::const_iterator iter = tree_stats.begin();  
-        iter != tree_stats.end();
-        iter++ ) {
-      stats.push_back(std::make_pair(iter->first, iter->second));
-    }
-    tree_stats.clear();
-
+    int32 num_stats = tree_stats.NumEvents();
     {
       Output ko(tree_stats_wxfilename, binary);
-      WriteBuildTreeStats(ko.Stream(), binary, stats);
+      if (compact) {
+        tree_stats.Write(ko.Stream(), binary);
+      } else {
+        BuildTreeStatsType stats;  // vectorized form.
+        tree_stats.GetBuildTreeStats(&stats);
+        WriteBuildTreeStats(ko.Stream(), binary, stats);
+        DeleteBuildTreeStats(&stats);
+      }
     }
-    KALDI_LOG << "Wrote summed accs ( " << stats.size() << " individual stats)";
-    DeleteBuildTreeStats(&stats);
-    return (stats.size() != 0 ? 0 : 1);
+    KALDI_LOG << "Wrote summed accs ( " << num_stats << " individual stats)";
+    return (num_stats != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
     return -1;
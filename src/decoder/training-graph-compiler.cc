@@ -16,7 +16,8 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 #include "decoder/training-graph-compiler.h"
-#include "hmm/hmm-utils.h" // for GetHTransducer
+#include "hmm/hmm-utils.h" // for GetHmmAsFst
+#include "thread/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -40,15 +41,15 @@ TrainingGraphCompiler::TrainingGraphCompiler(const TransitionModel &trans_model,
       KALDI_ERR << "Disambiguation symbol " << disambig_syms_[i]
                 << " is also a phone.";
   
-  int32 subseq_symbol = 1 + phone_syms.back();
-  if (!disambig_syms_.empty() && subseq_symbol <= disambig_syms_.back())
-    subseq_symbol = 1 + disambig_syms_.back();
+  subseq_symbol_ = 1 + phone_syms.back();
+  if (!disambig_syms_.empty() && subseq_symbol_ <= disambig_syms_.back())
+    subseq_symbol_ = 1 + disambig_syms_.back();
 
   {
     int32 N = ctx_dep.ContextWidth(),
         P = ctx_dep.CentralPosition();
     if (P != N-1)
-      AddSubsequentialLoop(subseq_symbol, lex_fst_);  // This is needed for
+      AddSubsequentialLoop(subseq_symbol_, lex_fst_);  // This is needed for
     // systems with right-context or we will not successfully compose
     // with C.
   }
@@ -57,78 +58,190 @@ TrainingGraphCompiler::TrainingGraphCompiler(const TransitionModel &trans_model,
     fst::OLabelCompare<fst::StdArc> olabel_comp;
     fst::ArcSort(lex_fst_, olabel_comp);
   }
+  InitStates(1);
 }
 
-bool TrainingGraphCompiler::CompileGraphFromText(
-    const std::vector<int32> &transcript,
-    fst::VectorFst<fst::StdArc> *out_fst) {
-  using namespace fst;
-  VectorFst<StdArc> word_fst;
-  MakeLinearAcceptor(transcript, &word_fst);
-  return CompileGraph(word_fst, out_fst);
+TrainingGraphCompiler::~TrainingGraphCompiler() {
+  for (size_t i = 0; i < states_.size(); i++) {
+    if (i != 0)
+      delete states_[i]->lex_fst;  // a copy of lex_fst_.
+    delete states_[i]->cfst;
+    delete states_[i]->h_fst;
+    delete states_[i]->h_cache;
+    for (HmmCacheType::iterator iter = states_[i]->hmm_cache.begin();
+         iter != states_[i]->hmm_cache.end(); ++iter)
+      delete iter->second;
+    delete states_[i];
+  }
+  delete lex_fst_;
 }
 
-bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word_fst,
-                                         fst::VectorFst<fst::StdArc> *out_fst) {
+void TrainingGraphCompiler::InitStates(int32 num_states) {
   using namespace fst;
-  KALDI_ASSERT(lex_fst_ !=NULL);
-  KALDI_ASSERT(out_fst != NULL);
+  while (static_cast<int32>(states_.size()) < num_states) {
+    CompilerState *state = new CompilerState();
+    if (states_.empty()) {
+      state->lex_fst = lex_fst_;
+    } else {
+      // The copy constructor of VectorFst would share the implementation
+      // (and its non-thread-safe reference count) with lex_fst_; constructing
+      // from the Fst<Arc> base class makes a real copy.
+      const Fst<StdArc> &lex_fst = *lex_fst_;
+      state->lex_fst = new VectorFst<StdArc>(lex_fst);
+    }
+    state->cfst = new ContextFst<StdArc>(subseq_symbol_,
+                                         trans_model_.GetPhones(),
+                                         disambig_syms_,
+                                         ctx_dep_.ContextWidth(),
+                                         ctx_dep_.CentralPosition());
+    states_.push_back(state);
+  }
+}
 
+void TrainingGraphCompiler::ComposeLexAndContext(
+    CompilerState *state,
+    const fst::VectorFst<fst::StdArc> &word_fst,
+    fst::VectorFst<fst::StdArc> *ctx2word_fst) {
+  using namespace fst;
   VectorFst<StdArc> phone2word_fst;
   // TableCompose more efficient than compose.
-  TableCompose(*lex_fst_, word_fst, &phone2word_fst, &lex_cache_);
-
-  KALDI_ASSERT(phone2word_fst.Start() != kNoStateId);
-
-  ContextFst<StdArc> *cfst = NULL;
-  {  // make cfst [ it's expanded on the fly ]
-    const std::vector<int32> &phone_syms = trans_model_.GetPhones();  // needed to create context fst.
-    int32 subseq_symbol = phone_syms.back() + 1;
-    if (!disambig_syms_.empty() && subseq_symbol <= disambig_syms_.back())
-      subseq_symbol = 1 + disambig_syms_.back();
-
-    cfst = new ContextFst<StdArc>(subseq_symbol,
-                                  phone_syms,
-                                  disambig_syms_,
-                                  ctx_dep_.ContextWidth(),
-                                  ctx_dep_.CentralPosition());
-  }
+  TableCompose(*(state->lex_fst), word_fst, &phone2word_fst,
+               &(state->lex_cache));
+
+  KALDI_ASSERT(phone2word_fst.Start() != kNoStateId &&
+               "Perhaps you have words missing in your lexicon?");
 
-  VectorFst<StdArc> ctx2word_fst;
-  ComposeContextFst(*cfst, phone2word_fst, &ctx2word_fst);
+  ComposeContextFst(*(state->cfst), phone2word_fst, ctx2word_fst);
   // ComposeContextFst is like Compose but faster for this particular Fst type.
   // [and doesn't expand too many arcs in the ContextFst.]
 
-  KALDI_ASSERT(ctx2word_fst.Start() != kNoStateId);
+  KALDI_ASSERT(ctx2word_fst->Start() != kNoStateId);
+}
+
+// This adds to "h_fst" the loop for ilabel "ilabel" of H, whose HMM is "hmm",
+// in exactly the way that MakeLoopFst() would; "hmm_arcs" plays the role of
+// the cache in MakeLoopFst(), for HMMs shared by more than one ilabel.
+static void AddHmmToLoopFst(
+    const fst::VectorFst<fst::StdArc> &hmm,
+    int32 ilabel,
+    std::map<const fst::VectorFst<fst::StdArc>*, fst::StdArc> *hmm_arcs,
+    fst::VectorFst<fst::StdArc> *h_fst) {
+  using namespace fst;
+  typedef StdArc::StateId StateId;
+  typedef StdArc::Weight Weight;
+  const StateId loop_state = 0;
+  std::map<const VectorFst<StdArc>*, StdArc>::iterator iter =
+      hmm_arcs->find(&hmm);
+  if (iter != hmm_arcs->end()) {
+    StdArc arc = iter->second;
+    arc.olabel = ilabel;
+    h_fst->AddArc(loop_state, arc);
+    return;
+  }
+  KALDI_ASSERT(hmm.Properties(kAcceptor, true) == kAcceptor);
+  StateId num_states = hmm.NumStates(), start_state = hmm.Start();
+  if (start_state == kNoStateId)
+    return;
+  bool share_start_state =
+      hmm.Properties(kInitialAcyclic, true) == kInitialAcyclic
+      && hmm.NumArcs(start_state) == 1
+      && hmm.Final(start_state) == Weight::Zero();
+  std::vector<StateId> state_map(num_states);
+  for (StateId s = 0; s < num_states; s++) {
+    if (s == start_state && share_start_state) state_map[s] = loop_state;
+    else state_map[s] = h_fst->AddState();
+  }
+  if (!share_start_state) {
+    StdArc arc(0, ilabel, Weight::One(), state_map[start_state]);
+    (*hmm_arcs)[&hmm] = arc;
+    h_fst->AddArc(loop_state, arc);
+  }
+  for (StateId s = 0; s < num_states; s++) {
+    for (ArcIterator<VectorFst<StdArc> > aiter(hmm, s); !aiter.Done();
+         aiter.Next()) {
+      const StdArc &arc = aiter.Value();
+      bool from_loop = (s == start_state && share_start_state);
+      StdArc new_arc(arc.ilabel, (from_loop ? ilabel : 0), arc.weight,
+                     state_map[arc.nextstate]);
+      h_fst->AddArc(state_map[s], new_arc);
+      if (from_loop)
+        (*hmm_arcs)[&hmm] = new_arc;
+    }
+    if (hmm.Final(s) != Weight::Zero())
+      h_fst->AddArc(state_map[s], StdArc(0, 0, hmm.Final(s), loop_state));
+  }
+}
+
+void TrainingGraphCompiler::UpdateHTransducer(CompilerState *state) {
+  using namespace fst;
+  const std::vector<std::vector<int32> > &ilabel_info =
+      state->cfst->ILabelInfo();
+  size_t num_ilabels = ilabel_info.size();
+  if (state->h_fst != NULL && state->h_num_ilabels == num_ilabels)
+    return;  // No new phones-in-context since we last extended H.
+  KALDI_ASSERT(num_ilabels >= 1 && ilabel_info[0].empty());
+
+  if (state->h_fst == NULL) {
+    // The loop state; ilabel zero is epsilon and has no loop.
+    state->h_fst = new VectorFst<StdArc>();
+    state->h_fst->AddState();
+    state->h_fst->SetStart(0);
+    state->h_fst->SetFinal(0, StdArc::Weight::One());
+    state->h_num_ilabels = 1;
+  }
+  // The matcher in the cache would not see the new arcs.
+  delete state->h_cache;
+  state->h_cache = NULL;
 
   HTransducerConfig h_cfg;
   h_cfg.transition_scale = opts_.transition_scale;
+  // As in GetHTransducer(), the disambiguation symbols on the input side are
+  // numbered consecutively after the transition-ids.
+  int32 first_disambig_sym = trans_model_.NumTransitionIds() + 1;
+
+  for (size_t j = state->h_num_ilabels; j < num_ilabels; j++) {
+    KALDI_ASSERT(!ilabel_info[j].empty());
+    if (ilabel_info[j].size() == 1 && ilabel_info[j][0] <= 0) {
+      // Disambiguation symbol: a loop with one arc through a new state.
+      int32 disambig_sym = first_disambig_sym + state->disambig_syms_h.size();
+      state->disambig_syms_h.push_back(disambig_sym);
+      StdArc::StateId s = state->h_fst->AddState();
+      state->h_fst->AddArc(0, StdArc(disambig_sym, j,
+                                     StdArc::Weight::One(), s));
+      state->h_fst->AddArc(s, StdArc(0, 0, StdArc::Weight::One(), 0));
+    } else {
+      const VectorFst<StdArc> *hmm = GetHmmAsFst(ilabel_info[j], ctx_dep_,
+                                                 trans_model_, h_cfg,
+                                                 &(state->hmm_cache));
+      AddHmmToLoopFst(*hmm, j, &(state->hmm_arcs), state->h_fst);
+    }
+  }
+  state->h_num_ilabels = num_ilabels;
+  state->h_cache = new TableComposeCache<Fst<StdArc> >();
+}
+
+void TrainingGraphCompiler::CompileFromContextGraph(
+    CompilerState *state,
+    fst::VectorFst<fst::StdArc> *graph) {
+  using namespace fst;
+  KALDI_ASSERT(state->h_fst != NULL &&
+               state->h_num_ilabels == state->cfst->ILabelInfo().size());
+  VectorFst<StdArc> trans2word_fst;  // transition-id to word.
+  TableCompose(*(state->h_fst), *graph, &trans2word_fst, state->h_cache);
 
-  std::vector<int32> disambig_syms_h; // disambiguation symbols on
-  // input side of H.
-  VectorFst<StdArc> *H = GetHTransducer(cfst->ILabelInfo(),
-                                        ctx_dep_,
-                                        trans_model_,
-                                        h_cfg,
-                                        &disambig_syms_h);
-  
-  VectorFst<StdArc> &trans2word_fst = *out_fst;  // transition-id to word.
-  TableCompose(*H, ctx2word_fst, &trans2word_fst);
-  
   KALDI_ASSERT(trans2word_fst.Start() != kNoStateId);
 
   // Epsilon-removal and determinization combined. This will fail if not determinizable.
   DeterminizeStarInLog(&trans2word_fst);
 
-  if (!disambig_syms_h.empty()) {
-    RemoveSomeInputSymbols(disambig_syms_h, &trans2word_fst);
+  if (!state->disambig_syms_h.empty()) {
+    RemoveSomeInputSymbols(state->disambig_syms_h, &trans2word_fst);
     // we elect not to remove epsilons after this phase, as it is
     // a little slow.
     if (opts_.rm_eps)
       RemoveEpsLocal(&trans2word_fst);
   }
 
-  
   // Encoded minimization.
   MinimizeEncoded(&trans2word_fst);
 
@@ -139,8 +252,31 @@ bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word
                opts_.reorder,
                &trans2word_fst);
 
-  delete H;
-  delete cfst;
+  KALDI_ASSERT(trans2word_fst.Start() != kNoStateId);
+
+  *graph = trans2word_fst;
+}
+
+bool TrainingGraphCompiler::CompileGraphFromText(
+    const std::vector<int32> &transcript,
+    fst::VectorFst<fst::StdArc> *out_fst) {
+  using namespace fst;
+  VectorFst<StdArc> word_fst;
+  MakeLinearAcceptor(transcript, &word_fst);
+  return CompileGraph(word_fst, out_fst);
+}
+
+bool TrainingGraphCompiler::CompileGraph(const fst::VectorFst<fst::StdArc> &word_fst,
+                                         fst::VectorFst<fst::StdArc> *out_fst) {
+  KALDI_ASSERT(lex_fst_ !=NULL);
+  KALDI_ASSERT(out_fst != NULL);
+  // Because we keep the ContextFst and H between calls, compiling graphs one
+  // at a time (as the align-* programs do) does not have to rebuild them for
+  // each utterance.
+  CompilerState *state = states_[0];
+  ComposeLexAndContext(state, word_fst, out_fst);
+  UpdateHTransducer(state);
+  CompileFromContextGraph(state, out_fst);
   return true;
 }
 
@@ -161,89 +297,57 @@ bool TrainingGraphCompiler::CompileGraphsFromText(
   return ans;
 }
 
+// This class compiles the graphs with index thread_id_, thread_id_ +
+// num_threads_, and so on, using the CompilerState with index thread_id_.
+// The assignment of graphs to threads is fixed, so the output does not depend
+// on timing.
+class TrainingGraphCompiler::CompileGraphsClass: public MultiThreadable {
+ public:
+  CompileGraphsClass(
+      TrainingGraphCompiler *compiler,
+      const std::vector<const fst::VectorFst<fst::StdArc>* > &word_fsts,
+      std::vector<fst::VectorFst<fst::StdArc>* > *out_fsts):
+      compiler_(compiler), word_fsts_(&word_fsts), out_fsts_(out_fsts) { }
+
+  void operator () () {
+    using namespace fst;
+    CompilerState *state = compiler_->states_[thread_id_];
+    size_t num_fsts = word_fsts_->size();
+    for (size_t i = thread_id_; i < num_fsts; i += num_threads_) {
+      VectorFst<StdArc> *ctx2word_fst = new VectorFst<StdArc>();
+      compiler_->ComposeLexAndContext(state, *((*word_fsts_)[i]),
+                                      ctx2word_fst);
+      (*out_fsts_)[i] = ctx2word_fst;  // For now this contains the FST with
+      // symbols representing phones-in-context.
+    }
+    // We extend H once for the whole batch, after all the phones-in-context
+    // have been seen.
+    compiler_->UpdateHTransducer(state);
+    for (size_t i = thread_id_; i < num_fsts; i += num_threads_)
+      compiler_->CompileFromContextGraph(state, (*out_fsts_)[i]);
+  }
+ private:
+  TrainingGraphCompiler *compiler_;
+  const std::vector<const fst::VectorFst<fst::StdArc>* > *word_fsts_;
+  std::vector<fst::VectorFst<fst::StdArc>* > *out_fsts_;
+};
+
 bool TrainingGraphCompiler::CompileGraphs(
     const std::vector<const fst::VectorFst<fst::StdArc>* > &word_fsts,
     std::vector<fst::VectorFst<fst::StdArc>* > *out_fsts) {
-
-  using namespace fst;
   KALDI_ASSERT(lex_fst_ !=NULL);
   KALDI_ASSERT(out_fsts != NULL && out_fsts->empty());
   out_fsts->resize(word_fsts.size(), NULL);
   if (word_fsts.empty()) return true;
 
-  ContextFst<StdArc> *cfst = NULL;
-  {  // make cfst [ it's expanded on the fly ]
-    const std::vector<int32> &phone_syms = trans_model_.GetPhones();  // needed to create context fst.
-    int32 subseq_symbol = phone_syms.back() + 1;
-    if (!disambig_syms_.empty() && subseq_symbol <= disambig_syms_.back())
-      subseq_symbol = 1 + disambig_syms_.back();
-
-    cfst = new ContextFst<StdArc>(subseq_symbol,
-                                  phone_syms,
-                                  disambig_syms_,
-                                  ctx_dep_.ContextWidth(),
-                                  ctx_dep_.CentralPosition());
-  }
-
-  for (size_t i = 0; i < word_fsts.size(); i++) {
-    VectorFst<StdArc> phone2word_fst;
-    // TableCompose more efficient than compose.
-    TableCompose(*lex_fst_, *(word_fsts[i]), &phone2word_fst, &lex_cache_);
-
-    KALDI_ASSERT(phone2word_fst.Start() != kNoStateId &&
-                 "Perhaps you have words missing in your lexicon?");
-    
-    VectorFst<StdArc> ctx2word_fst;
-    ComposeContextFst(*cfst, phone2word_fst, &ctx2word_fst);
-    // ComposeContextFst is like Compose but faster for this particular Fst type.
-    // [and doesn't expand too many arcs in the ContextFst.]
-
-    KALDI_ASSERT(ctx2word_fst.Start() != kNoStateId);
-
-    (*out_fsts)[i] = ctx2word_fst.Copy();  // For now this contains the FST with symbols
-    // representing phones-in-context.
-  }
-
-  HTransducerConfig h_cfg;
-  h_cfg.transition_scale = opts_.transition_scale;
-
-  std::vector<int32> disambig_syms_h;
-  VectorFst<StdArc> *H = GetHTransducer(cfst->ILabelInfo(),
-                                        ctx_dep_,
-                                        trans_model_,
-                                        h_cfg,
-                                        &disambig_syms_h);
-
-  for (size_t i = 0; i < out_fsts->size(); i++) {
-    VectorFst<StdArc> &ctx2word_fst = *((*out_fsts)[i]);
-    VectorFst<StdArc> trans2word_fst;
-    TableCompose(*H, ctx2word_fst, &trans2word_fst);
-
-    DeterminizeStarInLog(&trans2word_fst);
-
-    if (!disambig_syms_h.empty()) {
-      RemoveSomeInputSymbols(disambig_syms_h, &trans2word_fst);
-      if (opts_.rm_eps)
-        RemoveEpsLocal(&trans2word_fst);
-    }
-    
-    // Encoded minimization.
-    MinimizeEncoded(&trans2word_fst);
-
-    std::vector<int32> disambig;
-    AddSelfLoops(trans_model_,
-                 disambig,
-                 opts_.self_loop_scale,
-                 opts_.reorder,
-                 &trans2word_fst);
-
-    KALDI_ASSERT(trans2word_fst.Start() != kNoStateId);
-
-    *((*out_fsts)[i]) = trans2word_fst;
-  }
-
-  delete H;
-  delete cfst;
+  int32 num_threads = std::max<int32>(1, opts_.num_threads);
+  if (num_threads > static_cast<int32>(word_fsts.size()))
+    num_threads = word_fsts.size();
+  InitStates(num_threads);
+  CompileGraphsClass c(this, word_fsts, out_fsts);
+  // With one thread, num_threads == 0 tells MultiThreader to run it in
+  // this thread.
+  MultiThreader<CompileGraphsClass> m(num_threads == 1 ? 0 : num_threads, c);
   return true;
 }
 
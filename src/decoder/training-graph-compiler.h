@@ -21,6 +21,7 @@
 
 #include "base/kaldi-common.h"
 #include "hmm/transition-model.h"
+#include "hmm/hmm-utils.h"
 #include "fst/fstlib.h"
 #include "fstext/fstext-lib.h"
 
@@ -33,6 +34,8 @@ struct TrainingGraphCompilerOptions {
   BaseFloat self_loop_scale;
   bool rm_eps;
   bool reorder;  // (Dan-style graphs)
+  int32 num_threads;  // used by CompileGraphs(); not registered by
+                      // Register(), as only the batch programs use it.
 
   explicit TrainingGraphCompilerOptions(BaseFloat transition_scale = 1.0,
                                         BaseFloat self_loop_scale = 1.0,
@@ -40,7 +43,8 @@ struct TrainingGraphCompilerOptions {
       transition_scale(transition_scale),
       self_loop_scale(self_loop_scale),
       rm_eps(false),
-      reorder(b) { }
+      reorder(b),
+      num_threads(1) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("transition-scale", &transition_scale, "Scale of transition "
@@ -74,7 +78,11 @@ class TrainingGraphCompiler {
                     fst::VectorFst<fst::StdArc> *out_fst);
   
   // CompileGraphs allows you to compile a number of graphs at the same
-  // time.  This consumes more memory but is faster.
+  // time.  This consumes more memory but is faster.  If opts.num_threads > 1,
+  // the graphs are divided among that many threads, each of which has its
+  // own copy of the lexicon, ContextFst and H transducer; the output graphs
+  // are equivalent to (but may not be numbered identically to) those
+  // obtained with one thread.
   bool CompileGraphs(
       const std::vector<const fst::VectorFst<fst::StdArc> *> &word_fsts,
       std::vector<fst::VectorFst<fst::StdArc> *> *out_fsts);
@@ -89,18 +97,70 @@ class TrainingGraphCompiler {
       std::vector<fst::VectorFst<fst::StdArc> *> *out_fsts);
   
   
-  ~TrainingGraphCompiler() { delete lex_fst_; }
+  ~TrainingGraphCompiler();
  private:
+  // The things we cache between calls to CompileGraph() and CompileGraphs().
+  // None of these objects is safe to use from more than one thread at a time,
+  // so we keep one CompilerState per thread.
+  struct CompilerState {
+    // The lexicon; for state 0 this is lex_fst_, for the others it is a
+    // (deep) copy that this object owns.
+    const fst::VectorFst<fst::StdArc> *lex_fst;
+    fst::TableComposeCache<fst::Fst<fst::StdArc> > lex_cache;  // stores
+    // matcher.. this is one of Dan's extensions.
+    // The ContextFst is expanded on the fly; we keep it between utterances
+    // so that the phones-in-context we have seen keep the same ilabels.
+    fst::ContextFst<fst::StdArc> *cfst;
+    // The H transducer for the ilabels of "cfst"; when "cfst" acquires new
+    // ilabels we add the loops for them, so it is always identical to what
+    // GetHTransducer() would return for cfst->ILabelInfo().
+    fst::VectorFst<fst::StdArc> *h_fst;
+    std::vector<int32> disambig_syms_h;  // disambiguation symbols on input
+    // side of H.
+    size_t h_num_ilabels;  // number of ilabels that h_fst covers.
+    // The HMMs in h_fst, from GetHmmAsFst(); owned here.
+    HmmCacheType hmm_cache;
+    // For each HMM in hmm_cache, the arc out of the loop state of h_fst that
+    // we added for the first ilabel that used it (as in MakeLoopFst()).
+    std::map<const fst::VectorFst<fst::StdArc>*, fst::StdArc> hmm_arcs;
+    // stores the matcher for composing with h_fst.
+    fst::TableComposeCache<fst::Fst<fst::StdArc> > *h_cache;
+    CompilerState(): lex_fst(NULL), cfst(NULL), h_fst(NULL),
+                     h_num_ilabels(0), h_cache(NULL) { }
+  };
+  class CompileGraphsClass;
+
+  // Makes sure there are at least "num_states" elements of states_.
+  void InitStates(int32 num_states);
+
+  // Composes the lexicon and the ContextFst with "word_fst"; the output has
+  // phones-in-context (ilabels of state->cfst) on the input side.
+  void ComposeLexAndContext(CompilerState *state,
+                            const fst::VectorFst<fst::StdArc> &word_fst,
+                            fst::VectorFst<fst::StdArc> *ctx2word_fst);
+
+  // Extends state->h_fst with the ilabels the ContextFst has acquired since
+  // the last call.
+  void UpdateHTransducer(CompilerState *state);
+
+  // Composes H with the output of ComposeLexAndContext(), and
+  // determinizes, minimizes and adds self-loops.  "graph" is both input and
+  // output.
+  void CompileFromContextGraph(CompilerState *state,
+                               fst::VectorFst<fst::StdArc> *graph);
+
   const TransitionModel &trans_model_;
   const ContextDependency &ctx_dep_;
   fst::VectorFst<fst::StdArc> *lex_fst_; // lexicon FST (an input; we take
   // ownership as we need to modify it).
   std::vector<int32> disambig_syms_; // disambig symbols (if any) in the phone
   // symbol table.
-  fst::TableComposeCache<fst::Fst<fst::StdArc> > lex_cache_;  // stores matcher..
-  // this is one of Dan's extensions.
+  int32 subseq_symbol_;
+  std::vector<CompilerState*> states_;  // one per thread; states_[0] is used
+  // by CompileGraph().
 
   TrainingGraphCompilerOptions opts_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(TrainingGraphCompiler);
 };
 
 
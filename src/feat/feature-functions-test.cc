@@ -32,6 +32,8 @@ namespace kaldi {
 void UnitTestOnlineCmvn() {
   for (int32 i = 0; i < 1000; i++) {
     int32 num_frames = 1 + (Rand() % 10 * 10);
+    if (i % 100 == 0)  // Test more than one block of frames.
+      num_frames += 2000 + Rand() % 1000;
     int32 dim = 1 + Rand() % 10;
     SlidingWindowCmnOptions opts;
     opts.center = (Rand() % 2 == 0);
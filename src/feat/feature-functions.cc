@@ -432,88 +432,123 @@ void SlidingWindowCmnOptions::Check() const {
   // else ignored so value doesn't matter.
 }
 
+// Works out the window of frames used to normalize frame t: frames
+// *window_start to *window_end - 1.
+static void GetSlidingWindowCmnWindow(const SlidingWindowCmnOptions &opts,
+                                      int32 t, int32 num_frames,
+                                      int32 *window_start_out,
+                                      int32 *window_end_out) {
+  int32 window_start, window_end; // note: window_end will be one
+  // past the end of the window we use for normalization.
+  if (opts.center) {
+    window_start = t - (opts.cmn_window / 2);
+    window_end = window_start + opts.cmn_window;
+  } else {
+    window_start = t - opts.cmn_window;
+    window_end = t + 1;
+  }
+  if (window_start < 0) { // shift window right if starts <0.
+    window_end -= window_start;
+    window_start = 0; // or: window_start -= window_start
+  }
+  if (!opts.center) {
+    if (window_end > t)
+      window_end = std::max(t + 1, opts.min_window);
+  }
+  if (window_end > num_frames) {
+    window_start -= (window_end - num_frames);
+    window_end = num_frames;
+    if (window_start < 0) window_start = 0;
+  }
+  *window_start_out = window_start;
+  *window_end_out = window_end;
+}
+
 // Internal version of SlidingWindowCmn with double-precision arguments.
+// We process the frames in blocks.  For each block we compute prefix sums of
+// the input over all the frames its windows cover, so the sums over the window
+// of each frame are the difference of two rows.
 void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
                               const MatrixBase<double> &input,
                               MatrixBase<double> *output) {
   opts.Check();
   int32 num_frames = input.NumRows(), dim = input.NumCols();
-
-  int32 last_window_start = -1, last_window_end = -1;
-  Vector<double> cur_sum(dim), cur_sumsq(dim);
-
-  for (int32 t = 0; t < num_frames; t++) {
-    int32 window_start, window_end; // note: window_end will be one
-    // past the end of the window we use for normalization.
-    if (opts.center) {
-      window_start = t - (opts.cmn_window / 2);
-      window_end = window_start + opts.cmn_window;
-    } else {
-      window_start = t - opts.cmn_window;
-      window_end = t + 1;
-    }
-    if (window_start < 0) { // shift window right if starts <0.
-      window_end -= window_start;
-      window_start = 0; // or: window_start -= window_start
-    }
-    if (!opts.center) {
-      if (window_end > t)
-        window_end = std::max(t + 1, opts.min_window);
-    }
-    if (window_end > num_frames) {
-      window_start -= (window_end - num_frames);
-      window_end = num_frames;
-      if (window_start < 0) window_start = 0;
+  const int32 block_size = 1024;
+
+  for (int32 block_start = 0; block_start < num_frames;
+       block_start += block_size) {
+    int32 this_block_size = std::min(block_size, num_frames - block_start);
+    std::vector<int32> window_start(this_block_size),
+        window_end(this_block_size);
+    for (int32 i = 0; i < this_block_size; i++)
+      GetSlidingWindowCmnWindow(opts, block_start + i, num_frames,
+                                &(window_start[i]), &(window_end[i]));
+    // The windows move right monotonically, so the frames they cover are
+    // span_start ... span_end - 1.
+    int32 span_start = window_start[0],
+        span_end = window_end[this_block_size - 1],
+        span_size = span_end - span_start;
+    // Row j of prefix_sum is the sum of input frames span_start through
+    // span_start + j - 1, and the same for prefix_sumsq with the squares.
+    Matrix<double> prefix_sum(span_size + 1, dim, kUndefined), prefix_sumsq;
+    prefix_sum.Row(0).SetZero();
+    if (opts.normalize_variance) {
+      prefix_sumsq.Resize(span_size + 1, dim, kUndefined);
+      prefix_sumsq.Row(0).SetZero();
     }
-    if (last_window_start == -1) {
-      SubMatrix<double> input_part(input,
-                                      window_start, window_end - window_start,
-                                      0, dim);
-      cur_sum.AddRowSumMat(1.0, input_part , 0.0);
-      if (opts.normalize_variance)
-        cur_sumsq.AddDiagMat2(1.0, input_part, kTrans, 0.0);
-    } else {
-      if (window_start > last_window_start) {
-        KALDI_ASSERT(window_start == last_window_start + 1);
-        SubVector<double> frame_to_remove(input, last_window_start);
-        cur_sum.AddVec(-1.0, frame_to_remove);
-        if (opts.normalize_variance)
-          cur_sumsq.AddVec2(-1.0, frame_to_remove);
-      }
-      if (window_end > last_window_end) {
-        KALDI_ASSERT(window_end == last_window_end + 1);
-        SubVector<double> frame_to_add(input, last_window_end);
-        cur_sum.AddVec(1.0, frame_to_add);
-        if (opts.normalize_variance)
-          cur_sumsq.AddVec2(1.0, frame_to_add);
+    for (int32 j = 0; j < span_size; j++) {
+      const double *input_data = input.RowData(span_start + j),
+          *prev_sum = prefix_sum.RowData(j);
+      double *this_sum = prefix_sum.RowData(j + 1);
+      for (int32 d = 0; d < dim; d++)
+        this_sum[d] = prev_sum[d] + input_data[d];
+      if (opts.normalize_variance) {
+        const double *prev_sumsq = prefix_sumsq.RowData(j);
+        double *this_sumsq = prefix_sumsq.RowData(j + 1);
+        for (int32 d = 0; d < dim; d++)
+          this_sumsq[d] = prev_sumsq[d] + input_data[d] * input_data[d];
       }
     }
-    int32 window_frames = window_end - window_start;
-    last_window_start = window_start;
-    last_window_end = window_end;
-
-    KALDI_ASSERT(window_frames > 0);
-    SubVector<double> input_frame(input, t),
-        output_frame(*output, t);
-    output_frame.CopyFromVec(input_frame);
-    output_frame.AddVec(-1.0 / window_frames, cur_sum);
 
-    if (opts.normalize_variance) {
-      if (window_frames == 1) {
-        output_frame.Set(0.0);
+    for (int32 i = 0; i < this_block_size; i++) {
+      int32 t = block_start + i,
+          start = window_start[i] - span_start,
+          end = window_end[i] - span_start,
+          window_frames = end - start;
+      KALDI_ASSERT(window_frames > 0);
+      double inv_count = 1.0 / window_frames;
+      const double *input_data = input.RowData(t),
+          *start_sum = prefix_sum.RowData(start),
+          *end_sum = prefix_sum.RowData(end);
+      double *output_data = output->RowData(t);
+      if (!opts.normalize_variance) {
+        for (int32 d = 0; d < dim; d++)
+          output_data[d] = input_data[d] -
+                           (end_sum[d] - start_sum[d]) * inv_count;
+      } else if (window_frames == 1) {
+        for (int32 d = 0; d < dim; d++)
+          output_data[d] = 0.0;
       } else {
-        Vector<double> variance(cur_sumsq);
-        variance.Scale(1.0 / window_frames);
-        variance.AddVec2(-1.0 / (window_frames * window_frames), cur_sum);
-        // now "variance" is the variance of the features in the window,
-        // around their own mean.
-        int32 num_floored = variance.ApplyFloor(1.0e-10);
+        const double *start_sumsq = prefix_sumsq.RowData(start),
+            *end_sumsq = prefix_sumsq.RowData(end);
+        int32 num_floored = 0;
+        for (int32 d = 0; d < dim; d++) {
+          double mean = (end_sum[d] - start_sum[d]) * inv_count,
+              // the variance of the features in the window, around their own
+              // mean.
+              variance = (end_sumsq[d] - start_sumsq[d]) * inv_count -
+                         mean * mean;
+          if (variance < 1.0e-10) {
+            variance = 1.0e-10;
+            num_floored++;
+          }
+          output_data[d] = (input_data[d] - mean) / std::sqrt(variance);
+        }
         if (num_floored > 0 && num_frames > 1) {
-          KALDI_WARN << "Flooring variance When normalizing variance, floored " << num_floored
-                     << " elements; num-frames was " << window_frames;
+          KALDI_WARN << "Flooring variance When normalizing variance, floored "
+                     << num_floored << " elements; num-frames was "
+                     << window_frames;
         }
-        variance.ApplyPow(-0.5); // get inverse standard deviation.
-        output_frame.MulElements(variance);
       }
     }
   }
@@ -22,6 +22,7 @@
 #ifndef KALDI_FEAT_FEATURE_FUNCTIONS_H_
 #define KALDI_FEAT_FEATURE_FUNCTIONS_H_
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -186,6 +187,94 @@ inline void MaxNormalizeEnergy(Matrix<BaseFloat> *feats) {
 }
 
 
+/// This class computes features for segments of recordings, as
+/// compute-mfcc-feats and friends do with the --segments option, where
+/// successive segments often overlap.  It keeps the features of the previous
+/// segment, and any frames of the next segment that are also frames of the
+/// previous one (i.e. the same samples of the same recording, which requires
+/// snip_edges == true) are copied rather than computed.  Since each frame
+/// only depends on its own samples, the result is as if all the frames had
+/// been computed, except for dithering.  C is Mfcc, Fbank or Plp.
+template<class C>
+class SegmentFeatureComputer {
+ public:
+  SegmentFeatureComputer(const FrameExtractionOptions &frame_opts,
+                         C *computer):
+      frame_opts_(frame_opts), computer_(computer), prev_channel_(-1),
+      prev_start_samp_(0), prev_vtln_warp_(1.0), num_frames_reused_(0),
+      num_frames_computed_(0) { }
+
+  /// Computes the features of "wave", which is the segment of channel
+  /// "channel" of recording "recording" that starts at sample "start_samp",
+  /// as computer->Compute(wave, vtln_warp, output) would.  Throws on error.
+  void Compute(const std::string &recording, int32 channel, int32 start_samp,
+               const VectorBase<BaseFloat> &wave, BaseFloat vtln_warp,
+               Matrix<BaseFloat> *output) {
+    int32 num_frames = NumFrames(wave.Dim(), frame_opts_),
+        shift = frame_opts_.WindowShift();
+    // Frame f of this segment is frame f + offset of the previous one, for
+    // reuse_begin <= f < reuse_end.
+    int32 offset = 0, reuse_begin = 0, reuse_end = 0;
+    if (frame_opts_.snip_edges && recording == prev_recording_ &&
+        channel == prev_channel_ && vtln_warp == prev_vtln_warp_ &&
+        (start_samp - prev_start_samp_) % shift == 0) {
+      offset = (start_samp - prev_start_samp_) / shift;
+      reuse_begin = std::max(0, -offset);
+      reuse_end = std::min(num_frames, prev_features_.NumRows() - offset);
+    }
+    if (reuse_end <= reuse_begin) {
+      computer_->Compute(wave, vtln_warp, output);
+      num_frames_computed_ += output->NumRows();
+    } else {
+      int32 num_reused = reuse_end - reuse_begin;
+      output->Resize(num_frames, prev_features_.NumCols(), kUndefined);
+      output->RowRange(reuse_begin, num_reused).CopyFromMat(
+          prev_features_.RowRange(reuse_begin + offset, num_reused));
+      ComputeFrames(wave, vtln_warp, 0, reuse_begin, output);
+      ComputeFrames(wave, vtln_warp, reuse_end, num_frames, output);
+      num_frames_reused_ += num_reused;
+    }
+    prev_recording_ = recording;
+    prev_channel_ = channel;
+    prev_start_samp_ = start_samp;
+    prev_vtln_warp_ = vtln_warp;
+    prev_features_ = *output;
+  }
+
+  int64 NumFramesReused() const { return num_frames_reused_; }
+
+  int64 NumFramesComputed() const { return num_frames_computed_; }
+
+ private:
+  // Computes frames begin ... end - 1 of "wave" into the same rows of
+  // "output".
+  void ComputeFrames(const VectorBase<BaseFloat> &wave, BaseFloat vtln_warp,
+                     int32 begin, int32 end, Matrix<BaseFloat> *output) {
+    if (begin >= end) return;
+    int32 shift = frame_opts_.WindowShift();
+    SubVector<BaseFloat> frames_wave(
+        wave, begin * shift, (end - 1 - begin) * shift +
+        frame_opts_.WindowSize());
+    Matrix<BaseFloat> features;
+    computer_->Compute(frames_wave, vtln_warp, &features);
+    KALDI_ASSERT(features.NumRows() == end - begin);
+    output->RowRange(begin, end - begin).CopyFromMat(features);
+    num_frames_computed_ += end - begin;
+  }
+
+  FrameExtractionOptions frame_opts_;
+  C *computer_;
+  std::string prev_recording_;
+  int32 prev_channel_;
+  int32 prev_start_samp_;
+  BaseFloat prev_vtln_warp_;
+  Matrix<BaseFloat> prev_features_;
+  int64 num_frames_reused_;
+  int64 num_frames_computed_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SegmentFeatureComputer);
+};
+
+
 
 
 
@@ -64,6 +64,25 @@ void GetOutput(OnlineFeatureInterface *a,
   cache.ClearCache();
 }
 
+// Checks that GetFrames() on random ranges of frames, called directly and via
+// an OnlineCacheFeature, gives the same features as "output", which was
+// obtained with GetFrame().
+void CheckGetFrames(OnlineFeatureInterface *a,
+                    const Matrix<BaseFloat> &output) {
+  int32 num_frames = output.NumRows(), dim = output.NumCols();
+  OnlineCacheFeature cache(a);
+  for (int32 i = 0; i < 10; i++) {
+    int32 frame = rand() % num_frames,
+        n = 1 + rand() % (num_frames - frame);
+    Matrix<BaseFloat> feats1(n, dim), feats2(n, dim),
+        ref(output.Range(frame, n, 0, dim));
+    a->GetFrames(frame, n, &feats1);
+    cache.GetFrames(frame, n, &feats2);
+    AssertEqual(feats1, ref);
+    AssertEqual(feats2, ref);
+  }
+}
+
 // Only generate random length for each piece
 bool RandomSplit(int32 wav_dim,
                  std::vector<int32> *piece_dim,
@@ -103,6 +122,7 @@ void TestOnlineMatrixCacheFeature() {
   Matrix<BaseFloat> output_feats;
   GetOutput(&matrix_feats, &output_feats);
   AssertEqual(input_feats, output_feats);
+  CheckGetFrames(&matrix_feats, output_feats);
 }
 
 void TestOnlineDeltaFeature() {
@@ -122,6 +142,7 @@ void TestOnlineDeltaFeature() {
 
   Matrix<BaseFloat> output_feats1;
   GetOutput(&delta_feats, &output_feats1);
+  CheckGetFrames(&delta_feats, output_feats1);
 
   Matrix<BaseFloat> output_feats2(num_frames, output_dim);
   ComputeDeltas(opts, input_feats, &output_feats2);
@@ -146,6 +167,7 @@ void TestOnlineSpliceFrames() {
 
   Matrix<BaseFloat> output_feats1;
   GetOutput(&splice_frame, &output_feats1);
+  CheckGetFrames(&splice_frame, output_feats1);
 
   Matrix<BaseFloat> output_feats2(num_frames, output_dim);
   SpliceFrames(input_feats, opts.left_context, opts.right_context,
@@ -154,6 +176,54 @@ void TestOnlineSpliceFrames() {
   KALDI_ASSERT(output_feats1.ApproxEqual(output_feats2));
 }
 
+void TestOnlineCmvn() {
+  int32 dim = 2 + rand() % 5;  // dimension of features.
+  int32 num_frames = 100 + rand() % 1000;
+  OnlineCmvnOptions opts;
+  opts.normalize_variance = (rand() % 2 == 0);
+  opts.cmn_window = 10 + rand() % 200;
+  opts.speaker_frames = std::min(opts.speaker_frames, opts.cmn_window);
+  opts.global_frames = std::min(opts.global_frames, opts.speaker_frames);
+
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+  Matrix<double> global_stats(2, dim + 1);
+  for (int32 d = 0; d < dim; d++) {
+    global_stats(0, d) = 10.0 * RandGauss();
+    global_stats(1, d) = 100.0 +
+        global_stats(0, d) * global_stats(0, d) / 100.0;
+  }
+  global_stats(0, dim) = 100.0;
+  OnlineCmvnState state(global_stats);
+
+  OnlineMatrixFeature matrix_feats(input_feats);
+  OnlineCmvn cmvn1(opts, state, &matrix_feats),
+      cmvn2(opts, state, &matrix_feats);
+
+  Matrix<BaseFloat> output_feats1(num_frames, dim),
+      output_feats2(num_frames, dim);
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> row(output_feats1, t);
+    cmvn1.GetFrame(t, &row);
+  }
+  // Get the frames in blocks of random size; we also get some of them a
+  // second time, out of order.
+  for (int32 t = 0; t < num_frames; ) {
+    int32 n = std::min(num_frames - t, 1 + rand() % 100);
+    SubMatrix<BaseFloat> block(output_feats2, t, n, 0, dim);
+    cmvn2.GetFrames(t, n, &block);
+    t += n;
+    if (rand() % 3 == 0) {
+      int32 t2 = rand() % t, n2 = 1 + rand() % (t - t2);
+      Matrix<BaseFloat> block2(n2, dim);
+      cmvn2.GetFrames(t2, n2, &block2);
+      SubMatrix<BaseFloat> ref(output_feats2, t2, n2, 0, dim);
+      KALDI_ASSERT(block2.ApproxEqual(ref, 1.0e-05));
+    }
+  }
+  KALDI_ASSERT(output_feats1.ApproxEqual(output_feats2, 1.0e-05));
+}
+
 void TestOnlineMfcc() {
   std::ifstream is("../feat/test_data/test.wav", std::ios_base::binary);
   WaveData wave;
@@ -285,6 +355,7 @@ void TestOnlineTransform() {
 
   Matrix<BaseFloat> trans_feats;
   GetOutput(&online_trans, &trans_feats);
+  CheckGetFrames(&online_trans, trans_feats);
 
   Matrix<BaseFloat> output_feats(mfcc_feats.NumRows(), mfcc_feats.NumCols());
   for (int32 i = 0; i < mfcc_feats.NumRows(); i++) {
@@ -361,6 +432,7 @@ void TestOnlineAppendFeature() {
 
     Matrix<BaseFloat> online_mfcc_plp_feats;
     GetOutput(&online_mfcc_plp, &online_mfcc_plp_feats);
+    CheckGetFrames(&online_mfcc_plp, online_mfcc_plp_feats);
 
     // compare mfcc_feats & plp_features with online_mfcc_plp_feats
     KALDI_ASSERT(mfcc_feats.NumRows() == online_mfcc_plp_feats.NumRows()
@@ -392,6 +464,7 @@ int main() {
     TestOnlineMatrixCacheFeature();
     TestOnlineDeltaFeature();
     TestOnlineSpliceFrames();
+    TestOnlineCmvn();
     TestOnlineMfcc();
     TestOnlinePlp();
     TestOnlineTransform();
@@ -33,6 +33,14 @@ void OnlineGenericBaseFeature<C>::GetFrame(int32 frame,
   feat->CopyFromVec(features_.Row(frame));
 };
 
+template<class C>
+void OnlineGenericBaseFeature<C>::GetFrames(int32 frame, int32 num_frames,
+                                            MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(frame >= 0 && frame + num_frames <= num_frames_);
+  if (num_frames == 0) return;
+  feats->CopyFromMat(features_.Range(frame, num_frames, 0, Dim()));
+}
+
 template<class C>
 bool OnlineGenericBaseFeature<C>::IsLastFrame(int32 frame) const {
   return (frame == num_frames_ - 1 && input_finished_);
@@ -330,6 +338,79 @@ void OnlineCmvn::GetFrame(int32 frame,
   feat->CopyFromVec(feat_mat.Row(0));
 }
 
+void OnlineCmvn::GetFrames(int32 frame, int32 num_frames,
+                           MatrixBase<BaseFloat> *feats) {
+  int32 dim = this->Dim();
+  KALDI_ASSERT(feats->NumRows() == num_frames && feats->NumCols() == dim);
+  if (num_frames == 0) return;
+  src_->GetFrames(frame, num_frames, feats);
+  if (!opts_.normalize_mean) {
+    KALDI_ASSERT(!opts_.normalize_variance);
+    return;
+  }
+  Matrix<double> stats(2, dim + 1);
+  if (frozen_state_.NumRows() != 0) {  // the CMVN state has been frozen, so
+                                       // all the frames use the same stats.
+    stats.CopyFromMat(frozen_state_);
+    if (!skip_dims_.empty())
+      FakeStatsForSomeDims(skip_dims_, &stats);
+    ApplyCmvn(stats, opts_.normalize_variance, feats);
+    return;
+  }
+
+  // Get the raw stats for the first frame; for the following frames we update
+  // them incrementally, in the same way as ComputeStatsForFrame() does, so the
+  // results are identical to those of GetFrame().
+  this->ComputeStatsForFrame(frame, &stats);
+  // The frames that leave the window while we go through the block are
+  // remove_begin ... remove_end - 1.
+  int32 remove_begin = std::max(0, frame + 1 - opts_.cmn_window),
+      remove_end = frame + num_frames - opts_.cmn_window;
+  Matrix<BaseFloat> removed_feats;
+  if (remove_end > remove_begin) {
+    removed_feats.Resize(remove_end - remove_begin, dim, kUndefined);
+    src_->GetFrames(remove_begin, remove_end - remove_begin, &removed_feats);
+  }
+
+  Vector<double> feats_dbl(dim);
+  Matrix<double> smoothed_stats(2, dim + 1);
+  for (int32 i = 0; i < num_frames; i++) {
+    int32 t = frame + i;
+    SubMatrix<BaseFloat> this_feat(*feats, i, 1, 0, dim);
+    if (i > 0) {
+      feats_dbl.CopyFromVec(this_feat.Row(0));
+      stats.Row(0).Range(0, dim).AddVec(1.0, feats_dbl);
+      stats.Row(1).Range(0, dim).AddVec2(1.0, feats_dbl);
+      stats(0, dim) += 1.0;
+      int32 prev_frame = t - opts_.cmn_window;
+      if (prev_frame >= 0) {
+        feats_dbl.CopyFromVec(removed_feats.Row(prev_frame - remove_begin));
+        stats.Row(0).Range(0, dim).AddVec(-1.0, feats_dbl);
+        stats.Row(1).Range(0, dim).AddVec2(-1.0, feats_dbl);
+        stats(0, dim) -= 1.0;
+      }
+      // We only cache the stats that are needed for later calls to be
+      // efficient: those that go in cached_stats_modulo_ (if they are not
+      // there already), and those for the last frame, which will go in the
+      // ring buffer.
+      if (t % opts_.modulus == 0) {
+        if (t / opts_.modulus == cached_stats_modulo_.size())
+          CacheFrame(t, stats);
+      } else if (i + 1 == num_frames) {
+        CacheFrame(t, stats);
+      }
+    }
+    smoothed_stats.CopyFromMat(stats);
+    SmoothOnlineCmvnStats(orig_state_.speaker_cmvn_stats,
+                          orig_state_.global_cmvn_stats,
+                          opts_,
+                          &smoothed_stats);
+    if (!skip_dims_.empty())
+      FakeStatsForSomeDims(skip_dims_, &smoothed_stats);
+    ApplyCmvn(smoothed_stats, opts_.normalize_variance, &this_feat);
+  }
+}
+
 void OnlineCmvn::Freeze(int32 cur_frame) {
   int32 dim = this->Dim();
   Matrix<double> stats(2, dim + 1);
@@ -397,6 +478,39 @@ void OnlineSpliceFrames::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   }
 }
 
+void OnlineSpliceFrames::GetFrames(int32 frame, int32 num_frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(left_context_ >= 0 && right_context_ >= 0);
+  KALDI_ASSERT(frame >= 0 && frame + num_frames <= NumFramesReady());
+  int32 dim_in = src_->Dim();
+  KALDI_ASSERT(feats->NumRows() == num_frames &&
+               feats->NumCols() == dim_in * (1 + left_context_ +
+                                             right_context_));
+  if (num_frames == 0) return;
+  int32 T = src_->NumFramesReady();
+  // The source frames we need are src_begin ... src_end - 1.
+  int32 src_begin = std::max(0, frame - left_context_),
+      src_end = std::min(T, frame + num_frames + right_context_);
+  Matrix<BaseFloat> src_feats(src_end - src_begin, dim_in, kUndefined);
+  src_->GetFrames(src_begin, src_end - src_begin, &src_feats);
+  for (int32 n = 0; n <= left_context_ + right_context_; n++) {
+    // Row i of this part of the output is source frame offset + i, limited
+    // to the range [0, T - 1].
+    int32 offset = frame - left_context_ + n,
+        i_begin = std::min(num_frames, std::max(0, -offset)),
+        i_end = std::max(i_begin, std::min(num_frames, T - offset));
+    SubMatrix<BaseFloat> part(*feats, 0, num_frames, n * dim_in, dim_in);
+    if (i_end > i_begin)
+      part.Range(i_begin, i_end - i_begin, 0, dim_in).CopyFromMat(
+          src_feats.Range(offset + i_begin - src_begin, i_end - i_begin,
+                          0, dim_in));
+    for (int32 i = 0; i < i_begin; i++)
+      part.Row(i).CopyFromVec(src_feats.Row(0));
+    for (int32 i = i_end; i < num_frames; i++)
+      part.Row(i).CopyFromVec(src_feats.Row(T - 1 - src_begin));
+  }
+}
+
 OnlineTransform::OnlineTransform(const MatrixBase<BaseFloat> &transform,
                                  OnlineFeatureInterface *src):
     src_(src) {
@@ -421,6 +535,17 @@ void OnlineTransform::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   feat->AddMatVec(1.0, linear_term_, kNoTrans, input_feat, 1.0);
 }
 
+void OnlineTransform::GetFrames(int32 frame, int32 num_frames,
+                                MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(feats->NumRows() == num_frames && feats->NumCols() == Dim());
+  if (num_frames == 0) return;
+  Matrix<BaseFloat> input_feats(num_frames, linear_term_.NumCols(),
+                                kUndefined);
+  src_->GetFrames(frame, num_frames, &input_feats);
+  feats->CopyRowsFromVec(offset_);
+  feats->AddMatMat(1.0, input_feats, kNoTrans, linear_term_, kTrans, 1.0);
+}
+
 
 int32 OnlineDeltaFeature::Dim() const {
   int32 src_dim = src_->Dim();
@@ -464,6 +589,29 @@ void OnlineDeltaFeature::GetFrame(int32 frame,
   delta_features_.Process(temp_src, temp_t, feat);
 }
 
+void OnlineDeltaFeature::GetFrames(int32 frame, int32 num_frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(frame >= 0 && frame + num_frames <= NumFramesReady());
+  KALDI_ASSERT(feats->NumRows() == num_frames && feats->NumCols() == Dim());
+  if (num_frames == 0) return;
+  // As in GetFrame(), but the temporary matrix covers the context of all the
+  // frames in the range.
+  int32 context = opts_.order * opts_.window;
+  int32 left_frame = std::max(0, frame - context),
+      right_frame = std::min(src_->NumFramesReady() - 1,
+                             frame + num_frames - 1 + context);
+  KALDI_ASSERT(right_frame >= left_frame);
+  Matrix<BaseFloat> temp_src(right_frame + 1 - left_frame, src_->Dim(),
+                             kUndefined);
+  src_->GetFrames(left_frame, temp_src.NumRows(), &temp_src);
+  // Process() only looks at the frames within "context" of the frame it is
+  // computing, so giving it the whole range changes nothing.
+  for (int32 i = 0; i < num_frames; i++) {
+    SubVector<BaseFloat> feat(*feats, i);
+    delta_features_.Process(temp_src, frame + i - left_frame, &feat);
+  }
+}
+
 
 OnlineDeltaFeature::OnlineDeltaFeature(const DeltaFeaturesOptions &opts,
                                        OnlineFeatureInterface *src):
@@ -484,6 +632,32 @@ void OnlineCacheFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   }
 }
 
+void OnlineCacheFeature::GetFrames(int32 frame, int32 num_frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(frame >= 0 && feats->NumRows() == num_frames);
+  if (static_cast<size_t>(frame + num_frames) > cache_.size())
+    cache_.resize(frame + num_frames, NULL);
+  int32 dim = this->Dim();
+  for (int32 i = 0; i < num_frames; ) {
+    if (cache_[frame + i] != NULL) {
+      feats->CopyRowFromVec(*(cache_[frame + i]), i);
+      i++;
+    } else {
+      // Get this frame and any following ones that are not cached from the
+      // source, in one call.
+      int32 n = 1;
+      while (i + n < num_frames && cache_[frame + i + n] == NULL)
+        n++;
+      SubMatrix<BaseFloat> part(*feats, i, n, 0, dim);
+      // The following call will crash if the frames are not ready.
+      src_->GetFrames(frame + i, n, &part);
+      for (int32 j = i; j < i + n; j++)
+        cache_[frame + j] = new Vector<BaseFloat>(feats->Row(j));
+      i += n;
+    }
+  }
+}
+
 void OnlineCacheFeature::ClearCache() {
   for (size_t i = 0; i < cache_.size(); i++)
     delete cache_[i];
@@ -501,5 +675,15 @@ void OnlineAppendFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   src2_->GetFrame(frame, &feat2);
 };
 
+void OnlineAppendFeature::GetFrames(int32 frame, int32 num_frames,
+                                    MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(feats->NumRows() == num_frames && feats->NumCols() == Dim());
+  if (num_frames == 0) return;
+  SubMatrix<BaseFloat> feats1(*feats, 0, num_frames, 0, src1_->Dim()),
+      feats2(*feats, 0, num_frames, src1_->Dim(), src2_->Dim());
+  src1_->GetFrames(frame, num_frames, &feats1);
+  src2_->GetFrames(frame, num_frames, &feats2);
+}
+
 
 }  // namespace kaldi
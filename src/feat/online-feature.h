@@ -57,6 +57,8 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
   virtual bool IsLastFrame(int32 frame) const;
   virtual int32 NumFramesReady() const { return num_frames_; }
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats);
 
   //
   // Next, functions that are not in the interface.
@@ -125,6 +127,12 @@ class OnlineMatrixFeature: public OnlineFeatureInterface {
     feat->CopyFromVec(mat_.Row(frame));
   }
 
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats) {
+    if (num_frames != 0)
+      feats->CopyFromMat(mat_.Range(frame, num_frames, 0, mat_.NumCols()));
+  }
+
   virtual bool IsLastFrame(int32 frame) const {
     return (frame + 1 == mat_.NumRows());
   }
@@ -276,6 +284,13 @@ class OnlineCmvn: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  /// This is more efficient than calling GetFrame() for each frame: the
+  /// window statistics are updated incrementally from one frame to the next,
+  /// and the frames that leave the window are obtained from the source in one
+  /// call.  The results are the same as from GetFrame().
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats);
+
 
   //
   // Next, functions that are not in the interface.
@@ -405,6 +420,11 @@ class OnlineSpliceFrames: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  /// Gets the source frames that the range needs with one call, and splices
+  /// them with block copies.
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -435,6 +455,10 @@ class OnlineTransform: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  /// Transforms the whole range with one matrix multiplication.
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -466,6 +490,9 @@ class OnlineDeltaFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -494,6 +521,11 @@ class OnlineCacheFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  /// Gets any frames in the range that are not cached yet from the source,
+  /// in as few calls as possible.
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats);
+
   virtual ~OnlineCacheFeature() { ClearCache(); }
 
   // Things that are not in the shared interface:
@@ -527,6 +559,9 @@ class OnlineAppendFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats);
+
   virtual ~OnlineAppendFeature() {  }
 
   OnlineAppendFeature(OnlineFeatureInterface *src1,
@@ -201,6 +201,47 @@ static void UnitTestDelay() {
 
 extern bool pitch_use_naive_search; // was declared in pitch-functions.cc
 
+// declared in pitch-functions.cc
+void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
+                        int32 first_lag, int32 last_lag,
+                        int32 nccf_window_size,
+                        VectorBase<BaseFloat> *inner_prod,
+                        VectorBase<BaseFloat> *norm_prod);
+
+// Compare ComputeCorrelation() with a direct computation of the dot products
+// for each lag.
+static void UnitTestComputeCorrelation() {
+  KALDI_LOG << "=== UnitTestComputeCorrelation() ===\n";
+  for (int32 n = 0; n < 20; n++) {
+    int32 window_size = 10 + rand() % 200,
+        first_lag = 1 + rand() % 20,
+        last_lag = first_lag + rand() % 100;
+    Vector<BaseFloat> wave(window_size + last_lag);
+    wave.SetRandn();
+    wave.Scale(1000.0);
+    wave.Add(100.0 * RandGauss());
+
+    int32 num_lags = last_lag + 1 - first_lag;
+    Vector<BaseFloat> inner_prod(num_lags), norm_prod(num_lags);
+    ComputeCorrelation(wave, first_lag, last_lag, window_size,
+                       &inner_prod, &norm_prod);
+
+    Vector<double> zero_mean_wave(wave);
+    SubVector<double> wave_part(zero_mean_wave, 0, window_size);
+    zero_mean_wave.Add(-wave_part.Sum() / window_size);
+    Vector<BaseFloat> inner_prod_ref(num_lags), norm_prod_ref(num_lags);
+    for (int32 lag = first_lag; lag <= last_lag; lag++) {
+      SubVector<double> vec1(zero_mean_wave, 0, window_size),
+          vec2(zero_mean_wave, lag, window_size);
+      inner_prod_ref(lag - first_lag) = VecVec(vec1, vec2);
+      norm_prod_ref(lag - first_lag) = VecVec(vec1, vec1) * VecVec(vec2, vec2);
+    }
+    AssertEqual(inner_prod, inner_prod_ref, 1.0e-03);
+    AssertEqual(norm_prod, norm_prod_ref, 1.0e-03);
+  }
+  KALDI_LOG << "Test passed :)\n";
+}
+
 // Make sure that doing a calculation on the whole waveform gives
 // the same results as doing on the waveform broken into pieces.
 static void UnitTestSearch() {
@@ -515,6 +556,7 @@ static void UnitTestFeatNoKeele() {
   UnitTestPieces();
   UnitTestDelay();
   UnitTestSearch();
+  UnitTestComputeCorrelation();
 }
 
 static void UnitTestFeatWithKeele() {
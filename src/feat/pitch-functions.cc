@@ -98,6 +98,10 @@ BaseFloat NccfToPov(BaseFloat n) {
    e1 is the dot-product of the un-shifted window with itself,
    and d2 is the dot-product of the window shifted by "lag"
    with itself.
+   Rather than computing two dot products for each lag, we accumulate the
+   inner products for all the lags at once, one sample of the un-shifted
+   window at a time (each step is a vector operation over the lags), and we
+   update e2 incrementally as the window is shifted.
  */
 void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
                         int32 first_lag, int32 last_lag,
@@ -109,14 +113,29 @@ void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
   SubVector<BaseFloat> wave_part(wave, 0, nccf_window_size);
   // subtract mean-frame from wave
   zero_mean_wave.Add(-wave_part.Sum() / nccf_window_size);
-  BaseFloat e1, e2, sum;
+  int32 num_lags = last_lag + 1 - first_lag;
   SubVector<BaseFloat> sub_vec1(zero_mean_wave, 0, nccf_window_size);
-  e1 = VecVec(sub_vec1, sub_vec1);
+  BaseFloat e1 = VecVec(sub_vec1, sub_vec1);
+
+  inner_prod->SetZero();
+  for (int32 i = 0; i < nccf_window_size; i++) {
+    SubVector<BaseFloat> lagged_samples(zero_mean_wave, first_lag + i,
+                                        num_lags);
+    inner_prod->AddVec(sub_vec1(i), lagged_samples);
+  }
+
+  // e2 is accumulated in double, as it is updated by adding and subtracting
+  // the energies of individual samples.
+  const BaseFloat *data = zero_mean_wave.Data();
+  SubVector<BaseFloat> sub_vec2(zero_mean_wave, first_lag, nccf_window_size);
+  double e2 = VecVec(sub_vec2, sub_vec2);
   for (int32 lag = first_lag; lag <= last_lag; lag++) {
-    SubVector<BaseFloat> sub_vec2(zero_mean_wave, lag, nccf_window_size);
-    e2 = VecVec(sub_vec2, sub_vec2);
-    sum = VecVec(sub_vec1, sub_vec2);
-    (*inner_prod)(lag - first_lag) = sum;
+    if (lag > first_lag) {
+      double sample_out = data[lag - 1],
+          sample_in = data[lag + nccf_window_size - 1];
+      e2 += sample_in * sample_in - sample_out * sample_out;
+      if (e2 < 0.0) e2 = 0.0;  // Guard against roundoff.
+    }
     (*norm_prod)(lag - first_lag) = e1 * e2;
   }
 }
@@ -136,7 +155,7 @@ void ComputeNccf(const VectorBase<BaseFloat> &inner_prod,
                inner_prod.Dim() == nccf_vec->Dim());
   for (int32 lag = 0; lag < inner_prod.Dim(); lag++) {
     BaseFloat numerator = inner_prod(lag),
-        denominator = pow(norm_prod(lag) + nccf_ballast, 0.5),
+        denominator = std::sqrt(norm_prod(lag) + nccf_ballast),
         nccf;
     if (denominator != 0.0) {
       nccf = numerator / denominator;
@@ -190,6 +209,21 @@ void ComputeLocalCost(const VectorBase<BaseFloat> &nccf_pitch,
   local_cost->AddVecVec(opts.soft_min_f0, lags, nccf_pitch, 1.0);
 }
 
+/**
+   This version of ComputeLocalCost() does the same for a block of frames, one
+   per row of "nccf_pitch" and "local_cost".
+*/
+void ComputeLocalCost(const MatrixBase<BaseFloat> &nccf_pitch,
+                      const VectorBase<BaseFloat> &lags,
+                      const PitchExtractionOptions &opts,
+                      MatrixBase<BaseFloat> *local_cost) {
+  KALDI_ASSERT(SameDim(nccf_pitch, *local_cost));
+  for (int32 r = 0; r < nccf_pitch.NumRows(); r++) {
+    SubVector<BaseFloat> local_cost_row(*local_cost, r);
+    ComputeLocalCost(nccf_pitch.Row(r), lags, opts, &local_cost_row);
+  }
+}
+
 
 
 // class PitchFrameInfo is used inside class OnlinePitchFeatureImpl.
@@ -239,20 +273,16 @@ class PitchFrameInfo {
   /// This constructor is used for frames apart from frame -1; the bulk of
   /// the Viterbi computation takes place inside this constructor.
   ///  @param  opts         The options as provided by the user
-  ///  @param  nccf_pitch   The nccf as computed for the pitch computation
-  ///                       (with ballast).
-  ///  @param  nccf_pov     The nccf as computed for the POV computation
-  ///                       (without ballast).
-  ///  @param  lags         The log-spaced lags at which nccf_pitch and
-  ///                       nccf_pov are sampled.
+  ///  @param  local_cost   The local cost for this frame, as computed by
+  ///                       ComputeLocalCost() from the nccf for the pitch
+  ///                       computation (with ballast).
   ///  @param  prev_frame_forward_cost   The forward-cost vector for the
   ///                       previous frame.
   ///  @param  index_info   A pointer to a temporary vector used by this function
   ///  @param  this_forward_cost   The forward-cost vector for this frame
   ///                       (to be computed).
   void ComputeBacktraces(const PitchExtractionOptions &opts,
-                         const VectorBase<BaseFloat> &nccf_pitch, 
-                         const VectorBase<BaseFloat> &lags,
+                         const VectorBase<BaseFloat> &local_cost,
                          const VectorBase<BaseFloat> &prev_forward_cost,
                          std::vector<std::pair<int32, int32> > *index_info,
                          VectorBase<BaseFloat> *this_forward_cost);
@@ -305,15 +335,11 @@ void PitchFrameInfo::SetNccfPov(const VectorBase<BaseFloat> &nccf_pov) {
 
 void PitchFrameInfo::ComputeBacktraces(
     const PitchExtractionOptions &opts,
-    const VectorBase<BaseFloat> &nccf_pitch, 
-    const VectorBase<BaseFloat> &lags,
+    const VectorBase<BaseFloat> &local_cost,
     const VectorBase<BaseFloat> &prev_forward_cost_vec,
     std::vector<std::pair<int32, int32> > *index_info,
     VectorBase<BaseFloat> *this_forward_cost_vec) {
-  int32 num_states = nccf_pitch.Dim();
-
-  Vector<BaseFloat> local_cost(num_states, kUndefined);
-  ComputeLocalCost(nccf_pitch, lags, opts, &local_cost);
+  int32 num_states = local_cost.Dim();
 
   const BaseFloat delta_pitch_sq = pow(Log(1.0 + opts.delta_pitch), 2.0),
       inter_frame_factor = delta_pitch_sq * opts.penalty_factor;
@@ -949,7 +975,7 @@ void OnlinePitchFeatureImpl::RecomputeBacktraces() {
   
   double forward_cost_remainder = 0.0;
   Vector<BaseFloat> forward_cost(num_states),  // start off at zero.
-      next_forward_cost(forward_cost);
+      next_forward_cost(forward_cost), local_cost(num_states);
   std::vector<std::pair<int32, int32 > > index_info;
   
   for (int32 frame = 0; frame < num_frames; frame++) {
@@ -972,10 +998,11 @@ void OnlinePitchFeatureImpl::RecomputeBacktraces() {
     // we save the overhead of the NCCF resampling, which is a considerable part
     // of the whole computation.
     nccf_info.nccf_pitch_resampled.Scale(nccf_scale);
-    
+    ComputeLocalCost(nccf_info.nccf_pitch_resampled, lags_, opts_,
+                     &local_cost);
+
     frame_info_[frame + 1]->ComputeBacktraces(
-        opts_, nccf_info.nccf_pitch_resampled, lags_,
-        forward_cost, &index_info, &next_forward_cost);
+        opts_, local_cost, forward_cost, &index_info, &next_forward_cost);
 
     forward_cost.Swap(&next_forward_cost);
     BaseFloat remainder = forward_cost.Min();
@@ -1117,6 +1144,11 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
   Matrix<BaseFloat> nccf_pov_resampled(num_new_frames, num_resampled_lags);
   nccf_resampler_->Resample(nccf_pov, &nccf_pov_resampled);
   nccf_pov.Resize(0, 0);  // no longer needed.
+  // The local costs for the Viterbi computation are computed for all the new
+  // frames at once.
+  Matrix<BaseFloat> local_cost(num_new_frames, num_resampled_lags,
+                               kUndefined);
+  ComputeLocalCost(nccf_pitch_resampled, lags_, opts_, &local_cost);
 
   // We've finished dealing with the waveform so we can call UpdateRemainder
   // now; we need to call it before we possibly call RecomputeBacktraces()
@@ -1130,8 +1162,8 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
     PitchFrameInfo *prev_info = frame_info_.back(),
         *cur_info = new PitchFrameInfo(prev_info);
     cur_info->SetNccfPov(nccf_pov_resampled.Row(frame_idx));
-    cur_info->ComputeBacktraces(opts_, nccf_pitch_resampled.Row(frame_idx),
-                                lags_, forward_cost_, &index_info,
+    cur_info->ComputeBacktraces(opts_, local_cost.Row(frame_idx),
+                                forward_cost_, &index_info,
                                 &cur_forward_cost);
     forward_cost_.Swap(&cur_forward_cost);
     // Renormalize forward_cost so smallest element is zero.
@@ -103,10 +103,13 @@ int64 LinearResample::GetNumOutputSamples(int64 input_num_samp,
 
 void LinearResample::SetIndexesAndWeights() {
   first_index_.resize(output_samples_in_unit_);
-  weights_.resize(output_samples_in_unit_);
+  num_weights_.resize(output_samples_in_unit_);
 
   double window_width = num_zeros_ / (2.0 * filter_cutoff_);
 
+  // The number of weights may differ by one between phases; the first pass
+  // works out the indexes, so we can size weights_.
+  int32 max_num_weights = 0;
   for (int32 i = 0; i < output_samples_in_unit_; i++) {
     double output_t = i / static_cast<double>(samp_rate_out_);
     double min_t = output_t - window_width, max_t = output_t + window_width;
@@ -121,13 +124,18 @@ void LinearResample::SetIndexesAndWeights() {
         max_input_index = floor(max_t * samp_rate_in_),
         num_indices = max_input_index - min_input_index + 1;
     first_index_[i] = min_input_index;
-    weights_[i].Resize(num_indices);
-    for (int32 j = 0; j < num_indices; j++) {
-      int32 input_index = min_input_index + j;
+    num_weights_[i] = num_indices;
+    max_num_weights = std::max(max_num_weights, num_indices);
+  }
+  weights_.Resize(output_samples_in_unit_, max_num_weights);
+  for (int32 i = 0; i < output_samples_in_unit_; i++) {
+    double output_t = i / static_cast<double>(samp_rate_out_);
+    for (int32 j = 0; j < num_weights_[i]; j++) {
+      int32 input_index = first_index_[i] + j;
       double input_t = input_index / static_cast<double>(samp_rate_in_),
           delta_t = input_t - output_t;
       // sign of delta_t doesn't matter.
-      weights_[i](j) = FilterFunc(delta_t) / samp_rate_in_;
+      weights_(i, j) = FilterFunc(delta_t) / samp_rate_in_;
     }
   }
 }
@@ -149,6 +157,25 @@ void LinearResample::GetIndexes(int64 samp_out,
 }
 
 
+// Returns the dot product of a and b, which have dimension "dim".  We use
+// several partial sums as this is faster than one (and than a BLAS call, for
+// vectors this short).
+static inline BaseFloat ShortDotProduct(const BaseFloat *a,
+                                        const BaseFloat *b,
+                                        int32 dim) {
+  BaseFloat sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+  int32 i = 0;
+  for (; i + 4 <= dim; i += 4) {
+    sum0 += a[i] * b[i];
+    sum1 += a[i + 1] * b[i + 1];
+    sum2 += a[i + 2] * b[i + 2];
+    sum3 += a[i + 3] * b[i + 3];
+  }
+  for (; i < dim; i++)
+    sum0 += a[i] * b[i];
+  return (sum0 + sum1) + (sum2 + sum3);
+}
+
 void LinearResample::Resample(const VectorBase<BaseFloat> &input,
                               bool flush,
                               Vector<BaseFloat> *output) {
@@ -160,34 +187,44 @@ void LinearResample::Resample(const VectorBase<BaseFloat> &input,
 
   output->Resize(tot_output_samp - output_sample_offset_);
 
+  const BaseFloat *input_data = input.Data();
+  BaseFloat *output_data = output->Data();
+
   // samp_out is the index into the total output signal, not just the part
-  // of it we are producing here.
+  // of it we are producing here.  We work out the phase (samp_out_wrapped)
+  // and the first input sample for the first output sample, and after that
+  // we just step through the phases.
+  int64 first_samp_in;
+  int32 samp_out_wrapped;
+  GetIndexes(output_sample_offset_, &first_samp_in, &samp_out_wrapped);
+  // unit_start is the input-sample index of the start of the current unit,
+  // relative to the start of "input".
+  int64 unit_start = first_samp_in - first_index_[samp_out_wrapped] -
+      input_sample_offset_;
   for (int64 samp_out = output_sample_offset_;
        samp_out < tot_output_samp;
        samp_out++) {
-    int64 first_samp_in;
-    int32 samp_out_wrapped;
-    GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
-    const Vector<BaseFloat> &weights = weights_[samp_out_wrapped];
+    const BaseFloat *weights = weights_.RowData(samp_out_wrapped);
+    int32 num_weights = num_weights_[samp_out_wrapped];
     // first_input_index is the first index into "input" that we have a weight
     // for.
-    int32 first_input_index = static_cast<int32>(first_samp_in -
-                                                 input_sample_offset_);
+    int32 first_input_index = static_cast<int32>(
+        unit_start + first_index_[samp_out_wrapped]);
     BaseFloat this_output;
     if (first_input_index >= 0 &&
-        first_input_index + weights.Dim() <= input_dim) {
-      SubVector<BaseFloat> input_part(input, first_input_index, weights.Dim());
-      this_output = VecVec(input_part, weights);
+        first_input_index + num_weights <= input_dim) {
+      this_output = ShortDotProduct(input_data + first_input_index, weights,
+                                    num_weights);
     } else {  // Handle edge cases.
       this_output = 0.0;
-      for (int32 i = 0; i < weights.Dim(); i++) {
-        BaseFloat weight = weights(i);
+      for (int32 i = 0; i < num_weights; i++) {
+        BaseFloat weight = weights[i];
         int32 input_index = first_input_index + i;
         if (input_index < 0 && input_remainder_.Dim() + input_index >= 0) {
           this_output += weight *
               input_remainder_(input_remainder_.Dim() + input_index);
         } else if (input_index >= 0 && input_index < input_dim) {
-          this_output += weight * input(input_index);
+          this_output += weight * input_data[input_index];
         } else if (input_index >= input_dim) {
           // We're past the end of the input and are adding zero; should only
           // happen if the user specified flush == true, or else we would not
@@ -196,8 +233,11 @@ void LinearResample::Resample(const VectorBase<BaseFloat> &input,
         }
       }
     }
-    int32 output_index = static_cast<int32>(samp_out - output_sample_offset_);
-    (*output)(output_index) = this_output;
+    output_data[samp_out - output_sample_offset_] = this_output;
+    if (++samp_out_wrapped == output_samples_in_unit_) {
+      samp_out_wrapped = 0;
+      unit_start += input_samples_in_unit_;
+    }
   }
 
   if (flush) {
@@ -210,7 +250,6 @@ void LinearResample::Resample(const VectorBase<BaseFloat> &input,
 }
 
 void LinearResample::SetRemainder(const VectorBase<BaseFloat> &input) {
-  Vector<BaseFloat> old_remainder(input_remainder_);
   // max_remainder_needed is the width of the filter from side to side,
   // measured in input samples.  you might think it should be half that,
   // but you have to consider that you might be wanting to output samples
@@ -218,6 +257,15 @@ void LinearResample::SetRemainder(const VectorBase<BaseFloat> &input) {
   // input... anyway, storing more remainder than needed is not harmful.
   int32 max_remainder_needed = ceil(samp_rate_in_ * num_zeros_ /
                                     filter_cutoff_);
+  if (input.Dim() >= max_remainder_needed) {
+    // The normal case when streaming: the remainder is just the end of the
+    // latest input, and we don't need the old remainder.
+    input_remainder_.Resize(max_remainder_needed, kUndefined);
+    input_remainder_.CopyFromVec(input.Range(input.Dim() - max_remainder_needed,
+                                             max_remainder_needed));
+    return;
+  }
+  Vector<BaseFloat> old_remainder(input_remainder_);
   input_remainder_.Resize(max_remainder_needed);
   for (int32 index = - input_remainder_.Dim(); index < 0; index++) {
     // we interpret "index" as an offset from the end of "input" and
@@ -286,15 +334,22 @@ void ArbitraryResample::Resample(const MatrixBase<BaseFloat> &input,
                input.NumCols() == num_samples_in_ &&
                output->NumCols() == weights_.size());
 
-  Vector<BaseFloat> output_col(output->NumRows());
-  for (int32 i = 0; i < NumSamplesOut(); i++) {
-    SubMatrix<BaseFloat> input_part(input, 0, input.NumRows(),
-                                    first_index_[i],
-                                    weights_[i].Dim());
-    const Vector<BaseFloat> &weight_vec(weights_[i]);
-    output_col.AddMatVec(1.0, input_part,
-                         kNoTrans, weight_vec, 0.0);
-    output->CopyColFromVec(output_col, i);
+  // We process a row at a time, rather than an output sample (a column) at a
+  // time, so that we access the input and output in memory order; the filters
+  // are short, so there is little to gain from BLAS here.
+  int32 num_rows = input.NumRows(), num_samples_out = NumSamplesOut();
+  for (int32 r = 0; r < num_rows; r++) {
+    const BaseFloat *input_row = input.RowData(r);
+    BaseFloat *output_row = output->RowData(r);
+    for (int32 i = 0; i < num_samples_out; i++) {
+      const BaseFloat *input_part = input_row + first_index_[i],
+          *weight_data = weights_[i].Data();
+      int32 num_weights = weights_[i].Dim();
+      BaseFloat sum = 0.0;
+      for (int32 j = 0; j < num_weights; j++)
+        sum += input_part[j] * weight_data[j];
+      output_row[i] = sum;
+    }
   }
 }
 
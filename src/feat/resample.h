@@ -140,6 +140,12 @@ class ArbitraryResample {
    upsample or downsample the signal).  It is more efficient than
    ArbitraryResample because we can construct it just once.
 
+   It is a polyphase filter: the weights repeat every output_samples_in_unit_
+   output samples (the "phases"), and the weights for all the phases are
+   stored together in one matrix, so the inner loop over output samples just
+   steps through the phases and the input, without any per-sample index
+   computation or memory allocation.
+
    We require that the input and output sampling rate be specified as
    integers, as this is an easy way to specify that their ratio be rational.
 */
@@ -199,7 +205,7 @@ class LinearResample {
 
   /// Given an output-sample index, this function outputs to *first_samp_in the
   /// first input-sample index that we have a weight on (may be negative),
-  /// and to *samp_out_wrapped the index into weights_ where we can get the
+  /// and to *samp_out_wrapped the row of weights_ where we can get the
   /// corresponding weights on the input.
   inline void GetIndexes(int64 samp_out,
                          int64 *first_samp_in,
@@ -233,8 +239,10 @@ class LinearResample {
   /// extrapolate the correct input-sample index for arbitrary output samples.
   std::vector<int32> first_index_;
 
-  /// Weights on the input samples, for this output-sample index.
-  std::vector<Vector<BaseFloat> > weights_;
+  /// Weights on the input samples, for this output-sample index: row i has
+  /// num_weights_[i] weights (padded with zeros to the width of the matrix).
+  Matrix<BaseFloat> weights_;
+  std::vector<int32> num_weights_;
 
   // the following variables keep track of where we are in a particular signal,
   // if it is being provided over multiple calls to Resample().
@@ -0,0 +1,162 @@
+// feat/wave-reader-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "feat/wave-reader.h"
+
+namespace kaldi {
+
+// Makes random wave data with integer values, as we'd read from a file.
+static void GetRandomWave(int32 num_chan, int32 num_samp, WaveData *wave) {
+  Matrix<BaseFloat> data(num_chan, num_samp);
+  for (int32 c = 0; c < num_chan; c++)
+    for (int32 i = 0; i < num_samp; i++)
+      data(c, i) = RandInt(-32768, 32767);
+  *wave = WaveData(16000, data);
+}
+
+void UnitTestWaveFileRangeReader() {
+  for (int32 n = 0; n < 10; n++) {
+    WaveData wave;
+    GetRandomWave(RandInt(1, 2), RandInt(1, 20000), &wave);
+    {
+      Output ko("tmp.wav", true, false);
+      wave.Write(ko.Stream());
+    }
+    WaveFileRangeReader reader;
+    KALDI_ASSERT(reader.Open("tmp.wav"));
+    KALDI_ASSERT(reader.Info().SampFreq() == wave.SampFreq() &&
+                 reader.Info().NumChannels() == wave.Data().NumRows() &&
+                 reader.NumSamples() == wave.Data().NumCols());
+    for (int32 i = 0; i < 10; i++) {
+      int32 start = RandInt(0, reader.NumSamples() - 1),
+          num = RandInt(1, reader.NumSamples() - start);
+      Matrix<BaseFloat> data;
+      reader.ReadRange(start, num, &data);
+      SubMatrix<BaseFloat> ref(wave.Data(), 0, wave.Data().NumRows(),
+                               start, num);
+      AssertEqual(data, ref);
+    }
+  }
+  unlink("tmp.wav");
+}
+
+void UnitTestRandomAccessWaveRangeReader() {
+  // Two recordings in one archive, and an scp that refers to them by offset,
+  // by file name and by command.
+  WaveData wave1, wave2;
+  GetRandomWave(1, RandInt(1, 20000), &wave1);
+  GetRandomWave(2, RandInt(1, 20000), &wave2);
+  {
+    TableWriter<WaveHolder> writer("ark,scp:tmp.ark,tmp.scp");
+    writer.Write("a", wave1);
+    writer.Write("b", wave2);
+  }
+  {
+    Output ko("tmp.wav", true, false);
+    wave2.Write(ko.Stream());
+  }
+  {
+    std::vector<std::pair<std::string, std::string> > script;
+    KALDI_ASSERT(ReadScriptFile("tmp.scp", true, &script));
+    script.push_back(std::make_pair("c", "tmp.wav"));
+    script.push_back(std::make_pair("d", "cat tmp.wav |"));
+    KALDI_ASSERT(WriteScriptFile("tmp.scp", script));
+  }
+  const char *rspecifiers[] = { "scp:tmp.scp", "ark:tmp.ark" };
+  for (int32 r = 0; r < 2; r++) {
+    RandomAccessWaveRangeReader reader(rspecifiers[r]);
+    KALDI_ASSERT(!reader.HasKey("e"));
+    const char *keys[] = { "a", "b", "c", "d" };
+    for (int32 k = 0; k < (r == 0 ? 4 : 2); k++) {
+      const WaveData &wave = (k == 0 ? wave1 : wave2);
+      KALDI_ASSERT(reader.HasKey(keys[k]));
+      int32 num_chan = reader.NumChannels(keys[k]),
+          num_samp = reader.NumSamples(keys[k]);
+      KALDI_ASSERT(num_chan == wave.Data().NumRows() &&
+                   num_samp == wave.Data().NumCols() &&
+                   reader.SampFreq(keys[k]) == wave.SampFreq());
+      for (int32 i = 0; i < 5; i++) {
+        int32 channel = RandInt(-1, num_chan - 1),
+            start = RandInt(0, num_samp - 1),
+            num = RandInt(1, num_samp - start);
+        Matrix<BaseFloat> data;
+        reader.ReadRange(keys[k], channel, start, num, &data);
+        SubMatrix<BaseFloat> ref(wave.Data(), (channel == -1 ? 0 : channel),
+                                 (channel == -1 ? num_chan : 1), start, num);
+        AssertEqual(data, ref);
+      }
+    }
+  }
+  unlink("tmp.ark");
+  unlink("tmp.scp");
+  unlink("tmp.wav");
+}
+
+void UnitTestSequentialWaveSegmentReader() {
+  WaveData wave;
+  GetRandomWave(2, 16000 * 10, &wave);
+  {
+    Output ko("tmp.wav", true, false);
+    wave.Write(ko.Stream());
+  }
+  KALDI_ASSERT(WriteScriptFile("tmp.scp", std::vector<std::pair<std::string,
+                               std::string> >(1, std::make_pair("rec",
+                                                                "tmp.wav"))));
+  {
+    Output ko("tmp.segments", false, false);
+    ko.Stream() << "seg1 rec 0.5 1.5 0\n"
+                << "seg2 rec 1.0 2.0 1\n"
+                << "seg3 rec 9.8 10.2 1\n"  // truncated to the end.
+                << "seg4 rec 3.0 2.0 1\n"  // invalid.
+                << "seg5 rec 9.0 -1\n"  // all channels, to the end.
+                << "seg6 other 0.0 1.0 0\n";  // no such recording.
+  }
+  WaveSegmentOptions opts;
+  SequentialWaveSegmentReader reader("tmp.segments", "scp:tmp.scp", opts);
+  const char *keys[] = { "seg1", "seg2", "seg3", "seg5" };
+  int32 channels[] = { 0, 1, 1, -1 },
+      starts[] = { 8000, 16000, 156800, 144000 },
+      ends[] = { 24000, 32000, 160000, 160000 };
+  for (int32 i = 0; i < 4; i++, reader.Next()) {
+    KALDI_ASSERT(!reader.Done() && reader.Key() == keys[i] &&
+                 reader.Recording() == "rec" &&
+                 reader.Channel() == channels[i] &&
+                 reader.StartSample() == starts[i]);
+    SubMatrix<BaseFloat> ref(wave.Data(), std::max(channels[i], 0),
+                             (channels[i] == -1 ? 2 : 1), starts[i],
+                             ends[i] - starts[i]);
+    AssertEqual(reader.Value().Data(), ref);
+  }
+  KALDI_ASSERT(reader.Done() && reader.NumLines() == 6);
+  unlink("tmp.segments");
+  unlink("tmp.scp");
+  unlink("tmp.wav");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestWaveFileRangeReader();
+  UnitTestRandomAccessWaveRangeReader();
+  UnitTestSequentialWaveSegmentReader();
+  std::cout << "Tests succeeded.\n";
+}
@@ -19,19 +19,26 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cstdio>
 #include <limits>
 #include <sstream>
 #include <vector>
 
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "feat/wave-reader.h"
 #include "base/kaldi-error.h"
 #include "base/kaldi-utils.h"
+#include "util/text-utils.h"
 
 namespace kaldi {
 
-// static
-void WaveData::Expect4ByteTag(std::istream &is, const char *expected) {
+static void Expect4ByteTag(std::istream &is, const char *expected) {
   char tmp[5];
   tmp[4] = '\0';
   is.read(tmp, 4);
@@ -41,7 +48,7 @@ void WaveData::Expect4ByteTag(std::istream &is, const char *expected) {
     KALDI_ERR << "WaveData: expected " << expected << ", got " << tmp;
 }
 
-uint32 WaveData::ReadUint32(std::istream &is, bool swap) {
+static uint32 ReadUint32(std::istream &is, bool swap) {
   union {
     char result[4];
     uint32 ans;
@@ -55,7 +62,7 @@ uint32 WaveData::ReadUint32(std::istream &is, bool swap) {
 }
 
 
-uint16 WaveData::ReadUint16(std::istream &is, bool swap) {
+static uint16 ReadUint16(std::istream &is, bool swap) {
   union {
     char result[2];
     int16 ans;
@@ -68,8 +75,7 @@ uint16 WaveData::ReadUint16(std::istream &is, bool swap) {
   return u.ans;
 }
 
-// static
-void WaveData::Read4ByteTag(std::istream &is, char *dest) {
+static void Read4ByteTag(std::istream &is, char *dest) {
   is.read(dest, 4);
   if (is.fail())
     KALDI_ERR << "WaveData: expected 4-byte chunk-name, got read errror";
@@ -106,9 +112,7 @@ void WaveData::WriteUint16(std::ostream &os, int16 i) {
 
 
 
-void WaveData::Read(std::istream &is) {
-  data_.Resize(0, 0);  // clear the data.
-
+void WaveInfo::Read(std::istream &is) {
   char tmp[5];
   tmp[4] = '\0';
   Read4ByteTag(is, &tmp[0]);
@@ -123,6 +127,7 @@ void WaveData::Read(std::istream &is) {
 #else
   bool swap = is_rifx;
 #endif
+  reverse_bytes_ = swap;
 
   uint32 riff_chunk_size = ReadUint32(is, swap);
   Expect4ByteTag(is, "WAVE");
@@ -176,6 +181,8 @@ void WaveData::Read(std::istream &is) {
   if (num_channels <= 0)
     KALDI_ERR << "WaveData: no channels present";
   samp_freq_ = static_cast<BaseFloat>(sample_rate);
+  num_channels_ = num_channels;
+  bits_per_sample_ = bits_per_sample;
   if (bits_per_sample != 8 && bits_per_sample != 16 && bits_per_sample != 32)
     KALDI_ERR << "WaveData: bits_per_sample is " << bits_per_sample;
   if (byte_rate != sample_rate * bits_per_sample/8 * num_channels)
@@ -233,6 +240,58 @@ void WaveData::Read(std::istream &is) {
               << "(we do not support reading multiple data chunks).";
   }
 
+  data_bytes_ = data_chunk_size;
+}
+
+void WaveInfo::ConvertSamples(const char *data, int32 num_samp,
+                              MatrixBase<BaseFloat> *out) const {
+  KALDI_ASSERT(out->NumRows() == num_channels_ && out->NumCols() >= num_samp);
+  BaseFloat *out_data = out->Data();
+  MatrixIndexT stride = out->Stride();
+  for (int32 i = 0; i < num_samp; i++) {
+    for (int32 j = 0; j < num_channels_; j++) {
+      switch (bits_per_sample_) {
+        case 8:
+          out_data[j * stride + i] = *data;
+          data++;
+          break;
+        case 16:
+          {
+            // memcpy because "data" need not be aligned if it points into a
+            // memory-mapped file.
+            int16 k;
+            memcpy(&k, data, 2);
+            if (reverse_bytes_)
+              KALDI_SWAP2(k);
+            out_data[j * stride + i] = k;
+            data += 2;
+            break;
+          }
+        case 32:
+          {
+            int32 k;
+            memcpy(&k, data, 4);
+            if (reverse_bytes_)
+              KALDI_SWAP4(k);
+            out_data[j * stride + i] = k;
+            data += 4;
+            break;
+          }
+        default:
+          KALDI_ERR << "bits per sample is " << bits_per_sample_;  // already checked this.
+      }
+    }
+  }
+}
+
+void WaveData::Read(std::istream &is) {
+  data_.Resize(0, 0);  // clear the data.
+
+  WaveInfo info;
+  info.Read(is);
+  samp_freq_ = info.SampFreq();
+  uint32 data_chunk_size = info.DataBytes();
+
   std::vector<char*> data_pointer_vec;
   std::vector<int> data_size_vec;
   uint32 num_bytes_read = 0;
@@ -271,38 +330,9 @@ void WaveData::Read(std::istream &is) {
   if (data_chunk_size == 0)
     KALDI_ERR << "WaveData: empty file (no data)";
 
-  uint32 num_samp = num_bytes_read / block_align;
-  data_.Resize(num_channels, num_samp);
-  for (uint32 i = 0; i < num_samp; i++) {
-    for (uint32 j = 0; j < num_channels; j++) {
-      switch (bits_per_sample) {
-        case 8:
-          data_(j, i) = *data_ptr;
-          data_ptr++;
-          break;
-        case 16:
-          {
-            int16 k = *reinterpret_cast<uint16*>(data_ptr);
-            if (swap)
-              KALDI_SWAP2(k);
-            data_(j, i) =  k;
-            data_ptr += 2;
-            break;
-          }
-        case 32:
-          {
-            int32 k = *reinterpret_cast<uint32*>(data_ptr);
-            if (swap)
-              KALDI_SWAP4(k);
-            data_(j, i) =  k;
-            data_ptr += 4;
-            break;
-          }
-        default:
-          KALDI_ERR << "bits per sample is " << bits_per_sample;  // already checked this.
-      }
-    }
-  }
+  uint32 num_samp = num_bytes_read / info.BlockAlign();
+  data_.Resize(info.NumChannels(), num_samp);
+  info.ConvertSamples(data_ptr, num_samp, &data_);
 }
 
 
@@ -368,4 +398,360 @@ void WaveData::Write(std::ostream &os) const {
 }
 
 
+WaveFileRangeReader::WaveFileRangeReader():
+    data_offset_(0), num_samp_(0), map_data_(NULL), map_size_(0),
+    map_samples_(NULL) { }
+
+bool WaveFileRangeReader::Open(const std::string &filename, int64 offset) {
+  Close();
+  is_.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!is_.is_open()) {
+    KALDI_WARN << "Could not open wave file " << filename;
+    return false;
+  }
+  try {
+    if (offset != 0)
+      is_.seekg(offset);
+    info_.Read(is_);  // throws exception on failure.
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error reading header of wave file " << filename;
+    if (!IsKaldiError(e.what())) { std::cerr << e.what(); }
+    Close();
+    return false;
+  }
+  data_offset_ = is_.tellg();
+  is_.seekg(0, std::ios_base::end);
+  int64 file_size = is_.tellg();
+  if (data_offset_ < 0 || file_size < data_offset_) {
+    KALDI_WARN << "Could not get the size of wave file " << filename;
+    Close();
+    return false;
+  }
+  int64 data_bytes = std::min<int64>(info_.DataBytes(),
+                                     file_size - data_offset_);
+  if (data_bytes < info_.DataBytes())
+    KALDI_WARN << "Wave file " << filename << " has fewer bytes than specified "
+               << "in the header: " << data_bytes << " < "
+               << info_.DataBytes();
+  num_samp_ = data_bytes / info_.BlockAlign();
+  if (num_samp_ == 0) {
+    KALDI_WARN << "Wave file " << filename << " is empty (no data)";
+    Close();
+    return false;
+  }
+#if !defined(_MSC_VER)
+  // mmap() needs the offset to be a multiple of the page size.
+  int64 page_size = sysconf(_SC_PAGESIZE),
+      map_begin = data_offset_ - data_offset_ % page_size;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    size_t map_size = data_offset_ + data_bytes - map_begin;
+    void *p = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, map_begin);
+    close(fd);  // The mapping stays valid.
+    if (p != MAP_FAILED) {
+      map_data_ = static_cast<char*>(p);
+      map_size_ = map_size;
+      map_samples_ = map_data_ + (data_offset_ - map_begin);
+    }
+  }
+#endif
+  return true;
+}
+
+void WaveFileRangeReader::Close() {
+#if !defined(_MSC_VER)
+  if (map_data_ != NULL)
+    munmap(map_data_, map_size_);
+#endif
+  map_data_ = NULL;
+  map_size_ = 0;
+  map_samples_ = NULL;
+  if (is_.is_open())
+    is_.close();
+  is_.clear();
+  num_samp_ = 0;
+}
+
+void WaveFileRangeReader::ReadRange(int32 start_samp, int32 num_samp,
+                                    Matrix<BaseFloat> *data) {
+  KALDI_ASSERT(IsOpen() && start_samp >= 0 && num_samp > 0 &&
+               start_samp + num_samp <= num_samp_);
+  data->Resize(info_.NumChannels(), num_samp, kUndefined);
+  int64 block_align = info_.BlockAlign();
+  const char *samples;
+  if (map_data_ != NULL) {
+    samples = map_samples_ + start_samp * block_align;
+  } else {
+    buffer_.resize(num_samp * block_align);
+    is_.clear();
+    is_.seekg(data_offset_ + start_samp * block_align);
+    is_.read(&(buffer_[0]), buffer_.size());
+    if (is_.fail())
+      KALDI_ERR << "Error reading samples " << start_samp << " to "
+                << (start_samp + num_samp) << " of wave file.";
+    samples = &(buffer_[0]);
+  }
+  info_.ConvertSamples(samples, num_samp, data);
+}
+
+
+RandomAccessWaveRangeReader::RandomAccessWaveRangeReader(
+    const std::string &wav_rspecifier): archive_reader_(NULL), cur_ok_(false) {
+  std::string rxfilename;
+  RspecifierOptions opts;
+  if (ClassifyRspecifier(wav_rspecifier, &rxfilename, &opts) ==
+      kScriptRspecifier) {
+    std::vector<std::pair<std::string, std::string> > script;
+    if (!ReadScriptFile(rxfilename, true, &script))
+      KALDI_ERR << "Could not read script file "
+                << PrintableRxfilename(rxfilename);
+    for (size_t i = 0; i < script.size(); i++)
+      script_[script[i].first] = script[i].second;
+  } else {
+    archive_reader_ = new RandomAccessTableReader<WaveHolder>(wav_rspecifier);
+  }
+}
+
+RandomAccessWaveRangeReader::~RandomAccessWaveRangeReader() {
+  delete archive_reader_;
+}
+
+bool RandomAccessWaveRangeReader::Open(const std::string &recording) {
+  if (recording == cur_recording_)
+    return cur_ok_;
+  cur_recording_ = recording;
+  cur_ok_ = false;
+  file_reader_.Close();
+  wave_.Clear();
+  if (archive_reader_ != NULL) {
+    if (archive_reader_->HasKey(recording)) {
+      wave_ = archive_reader_->Value(recording);
+      cur_ok_ = true;
+    }
+    return cur_ok_;
+  }
+  std::map<std::string, std::string>::const_iterator iter =
+      script_.find(recording);
+  if (iter == script_.end())
+    return false;
+  const std::string &rxfilename = iter->second;
+  InputType type = ClassifyRxfilename(rxfilename);
+  if (type == kFileInput) {
+    cur_ok_ = file_reader_.Open(rxfilename);
+  } else if (type == kOffsetFileInput) {
+    // The rxfilename is like some_file:12345.
+    size_t pos = rxfilename.find_last_of(':');
+    int64 offset;
+    if (ConvertStringToInteger(rxfilename.substr(pos + 1), &offset))
+      cur_ok_ = file_reader_.Open(rxfilename.substr(0, pos), offset);
+    else
+      KALDI_WARN << "Invalid offset in rxfilename " << rxfilename;
+  } else {
+    Input ki;
+    WaveHolder holder;
+    if (ki.Open(rxfilename) && holder.Read(ki.Stream())) {
+      wave_ = holder.Value();
+      cur_ok_ = true;
+    } else {
+      KALDI_WARN << "Could not read wave data from "
+                 << PrintableRxfilename(rxfilename);
+    }
+  }
+  return cur_ok_;
+}
+
+bool RandomAccessWaveRangeReader::HasKey(const std::string &recording) {
+  return Open(recording);
+}
+
+BaseFloat RandomAccessWaveRangeReader::SampFreq(const std::string &recording) {
+  if (!Open(recording))
+    KALDI_ERR << "Could not read recording " << recording;
+  return (file_reader_.IsOpen() ? file_reader_.Info().SampFreq() :
+          wave_.SampFreq());
+}
+
+int32 RandomAccessWaveRangeReader::NumChannels(const std::string &recording) {
+  if (!Open(recording))
+    KALDI_ERR << "Could not read recording " << recording;
+  return (file_reader_.IsOpen() ? file_reader_.Info().NumChannels() :
+          wave_.Data().NumRows());
+}
+
+int32 RandomAccessWaveRangeReader::NumSamples(const std::string &recording) {
+  if (!Open(recording))
+    KALDI_ERR << "Could not read recording " << recording;
+  return (file_reader_.IsOpen() ? file_reader_.NumSamples() :
+          wave_.Data().NumCols());
+}
+
+void RandomAccessWaveRangeReader::ReadRange(const std::string &recording,
+                                            int32 channel, int32 start_samp,
+                                            int32 num_samp,
+                                            Matrix<BaseFloat> *data) {
+  int32 num_chan = NumChannels(recording);  // also opens it.
+  KALDI_ASSERT(channel >= -1 && channel < num_chan);
+  if (file_reader_.IsOpen()) {
+    file_reader_.ReadRange(start_samp, num_samp, data);
+    if (channel != -1 && num_chan != 1) {
+      Matrix<BaseFloat> this_channel(SubMatrix<BaseFloat>(
+          *data, channel, 1, 0, num_samp));
+      data->Swap(&this_channel);
+    }
+  } else {
+    KALDI_ASSERT(start_samp >= 0 && num_samp > 0 &&
+                 start_samp + num_samp <= wave_.Data().NumCols());
+    if (channel == -1)
+      *data = SubMatrix<BaseFloat>(wave_.Data(), 0, num_chan,
+                                   start_samp, num_samp);
+    else
+      *data = SubMatrix<BaseFloat>(wave_.Data(), channel, 1,
+                                   start_samp, num_samp);
+  }
+}
+
+
+SequentialWaveSegmentReader::SequentialWaveSegmentReader(
+    const std::string &segments_rxfilename,
+    const std::string &wav_rspecifier,
+    const WaveSegmentOptions &opts):
+    opts_(opts), wav_reader_(NULL), range_reader_(NULL), done_(false),
+    num_lines_(0), start_samp_(0), channel_(-1) {
+  if (segments_rxfilename == "") {
+    wav_reader_ = new SequentialTableReader<WaveHolder>(wav_rspecifier);
+    done_ = wav_reader_->Done();
+    if (!done_)
+      key_ = recording_ = wav_reader_->Key();
+  } else {
+    if (!segments_input_.Open(segments_rxfilename))
+      KALDI_ERR << "Could not open segments file "
+                << PrintableRxfilename(segments_rxfilename);
+    range_reader_ = new RandomAccessWaveRangeReader(wav_rspecifier);
+    Next();
+  }
+}
+
+SequentialWaveSegmentReader::~SequentialWaveSegmentReader() {
+  delete wav_reader_;
+  delete range_reader_;
+}
+
+void SequentialWaveSegmentReader::Next() {
+  if (wav_reader_ != NULL) {
+    wav_reader_->Next();
+    done_ = wav_reader_->Done();
+    if (!done_)
+      key_ = recording_ = wav_reader_->Key();
+    return;
+  }
+  std::string line;
+  while (std::getline(segments_input_.Stream(), line)) {
+    num_lines_++;
+    if (ReadSegment(line))
+      return;
+  }
+  done_ = true;
+  wave_.Clear();
+}
+
+const WaveData &SequentialWaveSegmentReader::Value() {
+  KALDI_ASSERT(!done_);
+  return (wav_reader_ != NULL ? wav_reader_->Value() : wave_);
+}
+
+bool SequentialWaveSegmentReader::ReadSegment(const std::string &line) {
+  std::vector<std::string> split_line;
+  // Split the line by space or tab and check the number of fields in each
+  // line. There must be 4 fields--segment name, recording wav file name,
+  // start time, end time; 5th field (channel info) is optional.
+  SplitStringToVector(line, " \t\r", true, &split_line);
+  if (split_line.size() != 4 && split_line.size() != 5) {
+    KALDI_WARN << "Invalid line in segments file: " << line;
+    return false;
+  }
+  const std::string &segment = split_line[0],
+      &recording = split_line[1];
+  // Convert the start time and end time to real from string. Segment is
+  // ignored if start or end time cannot be converted to real.
+  double start, end;
+  if (!ConvertStringToReal(split_line[2], &start)) {
+    KALDI_WARN << "Invalid line in segments file [bad start]: " << line;
+    return false;
+  }
+  if (!ConvertStringToReal(split_line[3], &end)) {
+    KALDI_WARN << "Invalid line in segments file [bad end]: " << line;
+    return false;
+  }
+  // start time must not be negative; start time must not be greater than
+  // end time, except if end time is -1
+  if (start < 0 || (end != -1.0 && end <= 0) ||
+      ((start >= end) && (end > 0))) {
+    KALDI_WARN << "Invalid line in segments file [empty or invalid segment]: "
+               << line;
+    return false;
+  }
+  int32 channel = -1;  // means channel info is unspecified.
+  // if each line has 5 elements then 5th element must be channel identifier
+  if (split_line.size() == 5) {
+    if (!ConvertStringToInteger(split_line[4], &channel) || channel < 0) {
+      KALDI_WARN << "Invalid line in segments file [bad channel]: " << line;
+      return false;
+    }
+  }
+  if (!range_reader_->HasKey(recording)) {
+    KALDI_WARN << "Could not find recording " << recording
+               << ", skipping segment " << segment;
+    return false;
+  }
+  BaseFloat samp_freq = range_reader_->SampFreq(recording);
+  int32 num_samp = range_reader_->NumSamples(recording),
+      num_chan = range_reader_->NumChannels(recording);
+
+  // Convert starting time of the segment to corresponding sample number.
+  // If end time is -1 then use the whole file starting from start time.
+  int32 start_samp = start * samp_freq,
+      end_samp = (end != -1) ? (end * samp_freq) : num_samp;
+  KALDI_ASSERT(start_samp >= 0 && end_samp > 0 && "Invalid start or end.");
+
+  // start sample must be less than total number of samples,
+  // otherwise skip the segment
+  if (start_samp >= num_samp) {
+    KALDI_WARN << "Start sample out of range " << start_samp << " [length:] "
+               << num_samp << ", skipping segment " << segment;
+    return false;
+  }
+  // end sample must be less than total number samples, otherwise skip the
+  // segment
+  if (end_samp > num_samp) {
+    if (end_samp >=
+        num_samp + static_cast<int32>(opts_.max_overshoot * samp_freq)) {
+      KALDI_WARN << "End sample too far out of range " << end_samp
+                 << " [length:] " << num_samp << ", skipping segment "
+                 << segment;
+      return false;
+    }
+    end_samp = num_samp;  // for small differences, just truncate.
+  }
+  // Skip if segment size is less than minimum segment length (default 0.1s)
+  if (end_samp <=
+      start_samp + static_cast<int32>(opts_.min_segment_length * samp_freq)) {
+    KALDI_WARN << "Segment " << segment << " too short, skipping it.";
+    return false;
+  }
+  if (channel >= num_chan) {
+    KALDI_WARN << "Invalid channel " << channel << " >= " << num_chan
+               << ", processing segment " << segment;
+    return false;
+  }
+  Matrix<BaseFloat> data;
+  range_reader_->ReadRange(recording, channel, start_samp,
+                           end_samp - start_samp, &data);
+  wave_ = WaveData(samp_freq, data);
+  key_ = segment;
+  recording_ = recording;
+  start_samp_ = start_samp;
+  channel_ = (num_chan == 1 ? 0 : channel);
+  return true;
+}
+
 }  // end namespace kaldi
@@ -44,10 +44,16 @@
 #define KALDI_FEAT_WAVE_READER_H_
 
 #include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
 
 #include "base/kaldi-types.h"
+#include "itf/options-itf.h"
 #include "matrix/kaldi-vector.h"
 #include "matrix/kaldi-matrix.h"
+#include "util/kaldi-table.h"
 
 
 namespace kaldi {
@@ -56,6 +62,48 @@ namespace kaldi {
 /// (2^15-1)*[-1, 1], not the usual default DSP range [-1, 1].
 const BaseFloat kWaveSampleMax = 32768.0;
 
+/// This class reads the header of a wave file, i.e. everything before the
+/// samples, and knows how to convert the samples to floating point.  It's
+/// used by WaveData, and by WaveFileRangeReader to read parts of files.
+class WaveInfo {
+ public:
+  WaveInfo(): samp_freq_(0.0), num_channels_(0), bits_per_sample_(0),
+              data_bytes_(0), reverse_bytes_(false) { }
+
+  /// Reads the header, leaving "is" positioned at the first sample.  Throws
+  /// on error.  "is" should be opened in binary mode.
+  void Read(std::istream &is);
+
+  BaseFloat SampFreq() const { return samp_freq_; }
+
+  int32 NumChannels() const { return num_channels_; }
+
+  int32 BitsPerSample() const { return bits_per_sample_; }
+
+  /// The number of bytes per sample, for all channels.
+  int32 BlockAlign() const { return num_channels_ * bits_per_sample_ / 8; }
+
+  /// The size of the data as specified in the header, in bytes.
+  uint32 DataBytes() const { return data_bytes_; }
+
+  /// The number of samples (per channel) as specified in the header; the file
+  /// may actually be shorter.
+  int32 NumSamples() const { return data_bytes_ / BlockAlign(); }
+
+  /// Converts "num_samp" samples of all channels, which start at "data" and
+  /// are as in the file (i.e. interleaved), to the first "num_samp" columns of
+  /// "out", which should have NumChannels() rows.
+  void ConvertSamples(const char *data, int32 num_samp,
+                      MatrixBase<BaseFloat> *out) const;
+
+ private:
+  BaseFloat samp_freq_;
+  int32 num_channels_;
+  int32 bits_per_sample_;
+  uint32 data_bytes_;
+  bool reverse_bytes_;  // True if the data is of the other endianness.
+};
+
 /// This class's purpose is to read in Wave files.
 class WaveData {
  public:
@@ -96,10 +144,6 @@ class WaveData {
   static const uint32 kBlockSize = 1024 * 1024;  // Use 1M bytes.
   Matrix<BaseFloat> data_;
   BaseFloat samp_freq_;
-  static void Expect4ByteTag(std::istream &is, const char *expected);
-  uint32 ReadUint32(std::istream &is, bool swap);
-  uint16 ReadUint16(std::istream &is, bool swap);
-  static void Read4ByteTag(std::istream &is, char *dest);
 
   static void WriteUint32(std::ostream &os, int32 i);
   static void WriteUint16(std::ostream &os, int16 i);
@@ -158,6 +202,180 @@ class WaveHolder {
 };
 
 
+/// This class gives access to ranges of samples of a wave file on disk.
+/// Open() reads just the header, and ReadRange() reads just the samples asked
+/// for, so that short segments can be taken from long recordings without
+/// reading all of them.  Where possible the file is memory-mapped, so the
+/// samples are converted directly from the page cache; otherwise we seek in
+/// the file.
+class WaveFileRangeReader {
+ public:
+  WaveFileRangeReader();
+
+  /// Opens a wave file, which starts at byte "offset" of file "filename", and
+  /// reads its header.  Returns false, with a warning, on error.
+  bool Open(const std::string &filename, int64 offset = 0);
+
+  bool IsOpen() const { return is_.is_open(); }
+
+  void Close();
+
+  const WaveInfo &Info() const { return info_; }
+
+  /// The number of samples (per channel) in the file; this may be fewer than
+  /// the header says, if the file is truncated.
+  int32 NumSamples() const { return num_samp_; }
+
+  /// Outputs samples start_samp ... start_samp + num_samp - 1 (with
+  /// num_samp > 0) of all the channels to "data", which is resized to
+  /// NumChannels() by num_samp.  Throws on read error.
+  void ReadRange(int32 start_samp, int32 num_samp, Matrix<BaseFloat> *data);
+
+  ~WaveFileRangeReader() { Close(); }
+
+ private:
+  std::ifstream is_;
+  WaveInfo info_;
+  int64 data_offset_;  // Offset of the first sample in the file.
+  int32 num_samp_;
+  // The memory-mapped part of the file, if we could map it, else NULL;
+  // map_samples_ points to the first sample in it.
+  char *map_data_;
+  size_t map_size_;
+  const char *map_samples_;
+  std::vector<char> buffer_;  // Used if the file is not memory-mapped.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(WaveFileRangeReader);
+};
+
+
+/// This class gives random access, by recording id, to ranges of samples of
+/// the recordings in a wave rspecifier, as extract-segments needs.  For
+/// recordings that are files in an scp (including "file:offset" entries)
+/// only the header and the samples asked for are read (see
+/// WaveFileRangeReader).  Other recordings (e.g. commands, or archives) are
+/// read in full, and kept while the same recording is asked for, so it
+/// helps if the segments are sorted by recording.
+class RandomAccessWaveRangeReader {
+ public:
+  explicit RandomAccessWaveRangeReader(const std::string &wav_rspecifier);
+
+  /// Returns true if the recording exists and its header (or the whole of it,
+  /// if it's not a file) could be read.
+  bool HasKey(const std::string &recording);
+
+  /// The following functions require HasKey(recording) to be true.
+  BaseFloat SampFreq(const std::string &recording);
+
+  int32 NumChannels(const std::string &recording);
+
+  int32 NumSamples(const std::string &recording);
+
+  /// Outputs samples start_samp ... start_samp + num_samp - 1 (with
+  /// num_samp > 0) of channel "channel" (or all channels, if channel == -1)
+  /// of the recording to "data", which is resized.  Throws on error.
+  void ReadRange(const std::string &recording, int32 channel,
+                 int32 start_samp, int32 num_samp, Matrix<BaseFloat> *data);
+
+  ~RandomAccessWaveRangeReader();
+
+ private:
+  // Makes "recording" the current recording, opening or reading it if it's
+  // not already; returns false on error.
+  bool Open(const std::string &recording);
+
+  // Used if the rspecifier is not an scp.
+  RandomAccessTableReader<WaveHolder> *archive_reader_;
+  // Maps recording id to rxfilename, if the rspecifier is an scp.
+  std::map<std::string, std::string> script_;
+
+  std::string cur_recording_;
+  bool cur_ok_;
+  // We read the current recording using file_reader_ if it's a file, else
+  // it's in wave_.
+  WaveFileRangeReader file_reader_;
+  WaveData wave_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RandomAccessWaveRangeReader);
+};
+
+
+struct WaveSegmentOptions {
+  BaseFloat min_segment_length;  // Minimum segment length in seconds.
+  BaseFloat max_overshoot;  // Max time by which last segment can overshoot.
+
+  WaveSegmentOptions(): min_segment_length(0.1), max_overshoot(0.5) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("min-segment-length", &min_segment_length,
+                   "Minimum segment length in seconds (reject shorter "
+                   "segments)");
+    opts->Register("max-overshoot", &max_overshoot,
+                   "End segments overshooting audio by less than this (in "
+                   "seconds) are truncated, else rejected.");
+  }
+};
+
+/// This class reads the segments listed in a segments file (see
+/// extract-segments for the format), in the order of the file, with the same
+/// interface as SequentialTableReader<WaveHolder>: the key is the segment id
+/// and the value its samples.  The segments are read with
+/// RandomAccessWaveRangeReader from the recordings in "wav_rspecifier", which
+/// are indexed by recording id.  If the segments file is "", it just reads
+/// the recordings, each as one segment, so that programs can support both
+/// with the same code.  Invalid segments are skipped with a warning.
+class SequentialWaveSegmentReader {
+ public:
+  SequentialWaveSegmentReader(const std::string &segments_rxfilename,
+                              const std::string &wav_rspecifier,
+                              const WaveSegmentOptions &opts);
+
+  bool Done() const { return done_; }
+
+  void Next();
+
+  const std::string &Key() const { return key_; }
+
+  /// The samples of the segment.  They are of all the channels of the
+  /// recording, unless the segments file specifies the channel.
+  const WaveData &Value();
+
+  /// The recording id of the current segment.
+  const std::string &Recording() const { return recording_; }
+
+  /// The sample of the recording the current segment starts at.
+  int32 StartSample() const { return start_samp_; }
+
+  /// The channel of the recording the current segment is of, or -1 if the
+  /// segment has all the channels.
+  int32 Channel() const { return channel_; }
+
+  /// The number of lines of the segments file read so far.
+  int32 NumLines() const { return num_lines_; }
+
+  ~SequentialWaveSegmentReader();
+
+ private:
+  // Reads the segment on this line of the segments file into the members
+  // below; returns false, with a warning, if it's invalid.
+  bool ReadSegment(const std::string &line);
+
+  WaveSegmentOptions opts_;
+  // We read from wav_reader_ if there is no segments file, else from
+  // segments_input_ and range_reader_.
+  SequentialTableReader<WaveHolder> *wav_reader_;
+  Input segments_input_;
+  RandomAccessWaveRangeReader *range_reader_;
+
+  bool done_;
+  int32 num_lines_;
+  std::string key_;
+  std::string recording_;
+  int32 start_samp_;
+  int32 channel_;
+  WaveData wave_;  // Not used if wav_reader_ != NULL.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SequentialWaveSegmentReader);
+};
+
+
 }  // namespace kaldi
 
 #endif  // KALDI_FEAT_WAVE_READER_H_
@@ -29,7 +29,10 @@ int main(int argc, char *argv[]) {
     using namespace kaldi;
     const char *usage =
         "Create Mel-filter bank (FBANK) feature files.\n"
-        "Usage:  compute-fbank-feats [options...] <wav-rspecifier> <feats-wspecifier>\n";
+        "Usage:  compute-fbank-feats [options...] <wav-rspecifier> <feats-wspecifier>\n"
+        "With --segments, features are computed for each segment of the\n"
+        "recordings in <wav-rspecifier> (indexed by recording id), as for\n"
+        "extract-segments <wav-rspecifier> <segments> ark:- | compute-fbank-feats ...\n";
 
     // construct all the global objects
     ParseOptions po(usage);
@@ -38,6 +41,8 @@ int main(int argc, char *argv[]) {
     BaseFloat vtln_warp = 1.0;
     std::string vtln_map_rspecifier;
     std::string utt2spk_rspecifier;
+    std::string segments_rxfilename;
+    WaveSegmentOptions segment_opts;
     int32 channel = -1;
     BaseFloat min_duration = 0.0;
     // Define defaults for gobal options
@@ -53,6 +58,13 @@ int main(int argc, char *argv[]) {
     po.Register("utt2spk", &utt2spk_rspecifier, "Utterance to speaker-id map (if doing VTLN and you have warps per speaker)");
     po.Register("channel", &channel, "Channel to extract (-1 -> expect mono, 0 -> left, 1 -> right)");
     po.Register("min-duration", &min_duration, "Minimum duration of segments to process (in seconds).");
+    po.Register("segments", &segments_rxfilename, "Segments file (see "
+                "extract-segments); if given, features are computed for each "
+                "segment, and <wav-rspecifier> is indexed by recording id.  The "
+                "segments are read from the recordings without reading the "
+                "whole recording if it's a file, and frames shared by "
+                "overlapping segments are computed once.");
+    segment_opts.Register(&po);
 
     // OPTION PARSING ..........................................................
     //
@@ -71,7 +83,10 @@ int main(int argc, char *argv[]) {
 
     Fbank fbank(fbank_opts);
 
-    SequentialTableReader<WaveHolder> reader(wav_rspecifier);
+    // This just reads the recordings if there is no segments file.
+    SequentialWaveSegmentReader reader(segments_rxfilename, wav_rspecifier,
+                                       segment_opts);
+    SegmentFeatureComputer<Fbank> computer(fbank_opts.frame_opts, &fbank);
     BaseFloatMatrixWriter kaldi_writer;  // typedef to TableWriter<something>.
     TableWriter<HtkMatrixHolder> htk_writer;
 
@@ -107,7 +122,9 @@ int main(int argc, char *argv[]) {
       {  // This block works out the channel (0=left, 1=right...)
         KALDI_ASSERT(num_chan > 0);  // should have been caught in
         // reading code if no channels.
-        if (channel == -1) {
+        // A channel in the segments file overrides --channel; the segment
+        // then has just that channel.
+        if (channel == -1 || reader.Channel() != -1) {
           this_chan = 0;
           if (num_chan != 1)
             KALDI_WARN << "Channel not specified but you have data with "
@@ -141,7 +158,10 @@ int main(int argc, char *argv[]) {
       SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
       Matrix<BaseFloat> features;
       try {
-        fbank.Compute(waveform, vtln_warp_local, &features, NULL);
+        computer.Compute(reader.Recording(),
+                         (reader.Channel() != -1 ? reader.Channel() : this_chan),
+                         reader.StartSample(), waveform, vtln_warp_local,
+                         &features);
       } catch (...) {
         KALDI_WARN << "Failed to compute features for utterance "
                    << utt;
@@ -177,6 +197,10 @@ int main(int argc, char *argv[]) {
     }
     KALDI_LOG << " Done " << num_success << " out of " << num_utts
               << " utterances.";
+    if (segments_rxfilename != "")
+      KALDI_LOG << "Computed " << computer.NumFramesComputed() << " frames "
+                << "and reused " << computer.NumFramesReused() << " frames "
+                << "of overlapping segments.";
     return (num_success != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
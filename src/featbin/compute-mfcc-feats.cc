@@ -28,7 +28,10 @@ int main(int argc, char *argv[]) {
     using namespace kaldi;
     const char *usage =
         "Create MFCC feature files.\n"
-        "Usage:  compute-mfcc-feats [options...] <wav-rspecifier> <feats-wspecifier>\n";
+        "Usage:  compute-mfcc-feats [options...] <wav-rspecifier> <feats-wspecifier>\n"
+        "With --segments, features are computed for each segment of the\n"
+        "recordings in <wav-rspecifier> (indexed by recording id), as for\n"
+        "extract-segments <wav-rspecifier> <segments> ark:- | compute-mfcc-feats ...\n";
 
     // construct all the global objects
     ParseOptions po(usage);
@@ -37,6 +40,8 @@ int main(int argc, char *argv[]) {
     BaseFloat vtln_warp = 1.0;
     std::string vtln_map_rspecifier;
     std::string utt2spk_rspecifier;
+    std::string segments_rxfilename;
+    WaveSegmentOptions segment_opts;
     int32 channel = -1;
     BaseFloat min_duration = 0.0;
     // Define defaults for gobal options
@@ -60,6 +65,13 @@ int main(int argc, char *argv[]) {
                 "0 -> left, 1 -> right)");
     po.Register("min-duration", &min_duration, "Minimum duration of segments "
                 "to process (in seconds).");
+    po.Register("segments", &segments_rxfilename, "Segments file (see "
+                "extract-segments); if given, features are computed for each "
+                "segment, and <wav-rspecifier> is indexed by recording id.  The "
+                "segments are read from the recordings without reading the "
+                "whole recording if it's a file, and frames shared by "
+                "overlapping segments are computed once.");
+    segment_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -74,7 +86,10 @@ int main(int argc, char *argv[]) {
 
     Mfcc mfcc(mfcc_opts);
 
-    SequentialTableReader<WaveHolder> reader(wav_rspecifier);
+    // This just reads the recordings if there is no segments file.
+    SequentialWaveSegmentReader reader(segments_rxfilename, wav_rspecifier,
+                                       segment_opts);
+    SegmentFeatureComputer<Mfcc> computer(mfcc_opts.frame_opts, &mfcc);
     BaseFloatMatrixWriter kaldi_writer;  // typedef to TableWriter<something>.
     TableWriter<HtkMatrixHolder> htk_writer;
 
@@ -110,7 +125,9 @@ int main(int argc, char *argv[]) {
       {  // This block works out the channel (0=left, 1=right...)
         KALDI_ASSERT(num_chan > 0);  // should have been caught in
         // reading code if no channels.
-        if (channel == -1) {
+        // A channel in the segments file overrides --channel; the segment
+        // then has just that channel.
+        if (channel == -1 || reader.Channel() != -1) {
           this_chan = 0;
           if (num_chan != 1)
             KALDI_WARN << "Channel not specified but you have data with "
@@ -144,7 +161,10 @@ int main(int argc, char *argv[]) {
       SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
       Matrix<BaseFloat> features;
       try {
-        mfcc.Compute(waveform, vtln_warp_local, &features, NULL);
+        computer.Compute(reader.Recording(),
+                         (reader.Channel() != -1 ? reader.Channel() : this_chan),
+                         reader.StartSample(), waveform, vtln_warp_local,
+                         &features);
       } catch (...) {
         KALDI_WARN << "Failed to compute features for utterance "
                    << utt;
@@ -180,6 +200,10 @@ int main(int argc, char *argv[]) {
     }
     KALDI_LOG << " Done " << num_success << " out of " << num_utts
               << " utterances.";
+    if (segments_rxfilename != "")
+      KALDI_LOG << "Computed " << computer.NumFramesComputed() << " frames "
+                << "and reused " << computer.NumFramesReused() << " frames "
+                << "of overlapping segments.";
     return (num_success != 0 ? 0 : 1);
   } catch(const std::exception &e) {
     std::cerr << e.what();
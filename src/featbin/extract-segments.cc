@@ -48,18 +48,15 @@ int main(int argc, char *argv[]) {
         "where <channel> will normally be 0 (left) or 1 (right)\n"
         "e.g. call-861225-A-0050-0065 call-861225 5.0 6.5 1\n"
         "And <end-time> of -1 means the segment runs till the end of the WAV file\n"
+        "Recordings that are files in an scp are not read in full: only the\n"
+        "segments are read.\n"
         "See also: extract-rows, which does the same thing but to feature files,\n"
         " wav-copy, wav-to-duration\n";
 
     ParseOptions po(usage);
-    BaseFloat min_segment_length = 0.1, // Minimum segment length in seconds.
-        max_overshoot = 0.5;  // max time by which last segment can overshoot
-    po.Register("min-segment-length", &min_segment_length,
-                "Minimum segment length in seconds (reject shorter segments)");
-    po.Register("max-overshoot", &max_overshoot,
-                "End segments overshooting audio by less than this (in seconds) "
-                "are truncated, else rejected.");
-    
+    WaveSegmentOptions opts;
+    opts.Register(&po);
+
     po.Read(argc, argv);
     if (po.NumArgs() != 3) {
       po.PrintUsage();
@@ -70,130 +67,27 @@ int main(int argc, char *argv[]) {
     std::string segments_rxfilename = po.GetArg(2);
     std::string wav_wspecifier = po.GetArg(3);
 
-    RandomAccessTableReader<WaveHolder> reader(wav_rspecifier);
+    // This reads each segment from its recording, checking the segments and
+    // skipping invalid ones with a warning.
+    SequentialWaveSegmentReader reader(segments_rxfilename, wav_rspecifier,
+                                       opts);
     TableWriter<WaveHolder> writer(wav_wspecifier);
-    Input ki(segments_rxfilename);  // no binary argment: never binary.
-
-    int32 num_lines = 0, num_success = 0;
-
-    std::string line;
-    /* read each line from segments file */
-    while (std::getline(ki.Stream(), line)) {
-      num_lines++;
-      std::vector<std::string> split_line;
-      // Split the line by space or tab and check the number of fields in each
-      // line. There must be 4 fields--segment name , reacording wav file name,
-      // start time, end time; 5th field (channel info) is optional.
-      SplitStringToVector(line, " \t\r", true, &split_line);
-      if (split_line.size() != 4 && split_line.size() != 5) {
-        KALDI_WARN << "Invalid line in segments file: " << line;
-        continue;
-      }
-      std::string segment = split_line[0],
-          recording = split_line[1],
-          start_str = split_line[2],
-          end_str = split_line[3];
 
-      // Convert the start time and endtime to real from string. Segment is
-      // ignored if start or end time cannot be converted to real.
-      double start, end;
-      if (!ConvertStringToReal(start_str, &start)) {
-        KALDI_WARN << "Invalid line in segments file [bad start]: " << line;
-        continue;
-      }
-      if (!ConvertStringToReal(end_str, &end)) {
-        KALDI_WARN << "Invalid line in segments file [bad end]: " << line;
-        continue;
-      }
-      // start time must not be negative; start time must not be greater than
-      // end time, except if end time is -1
-      if (start < 0 || (end != -1.0 && end <= 0) || ((start >= end) && (end > 0))) {
-        KALDI_WARN << "Invalid line in segments file [empty or invalid segment]: "
-                   << line;
-        continue;
-      }
-      int32 channel = -1;  // means channel info is unspecified.
-      // if each line has 5 elements then 5th element must be channel identifier
-      if (split_line.size() == 5) {
-        if (!ConvertStringToInteger(split_line[4], &channel) || channel < 0) {
-          KALDI_WARN << "Invalid line in segments file [bad channel]: " << line;
-          continue;
-        }
-      }
-      /* check whether a segment start time and end time exists in recording 
-       * if fails , skips the segment.
-       */ 
-     if (!reader.HasKey(recording)) {
-        KALDI_WARN << "Could not find recording " << recording
-                   << ", skipping segment " << segment;
-        continue;
-      }
-      
-      const WaveData &wave = reader.Value(recording);
-      const Matrix<BaseFloat> &wave_data = wave.Data();
-      BaseFloat samp_freq = wave.SampFreq();  // read sampling fequency
-      int32 num_samp = wave_data.NumCols(),  // number of samples in recording
-        num_chan = wave_data.NumRows();  // number of channels in recording
-
-      // Convert starting time of the segment to corresponding sample number.
-      // If end time is -1 then use the whole file starting from start time.
-      int32 start_samp = start * samp_freq,
-          end_samp = (end != -1)? (end * samp_freq) : num_samp;
-      KALDI_ASSERT(start_samp >= 0 && end_samp > 0 && "Invalid start or end.");
-
-      // start sample must be less than total number of samples,
-      // otherwise skip the segment
-      if (start_samp < 0 || start_samp >= num_samp) {
-        KALDI_WARN << "Start sample out of range " << start_samp << " [length:] "
-                   << num_samp << ", skipping segment " << segment;
-        continue;
-      }
-      /* end sample must be less than total number samples 
-       * otherwise skip the segment
-       */
-      if (end_samp > num_samp) {
-        if ((end_samp >=
-             num_samp + static_cast<int32>(max_overshoot * samp_freq))) {
-          KALDI_WARN << "End sample too far out of range " << end_samp
-                     << " [length:] " << num_samp << ", skipping segment "
-                     << segment;
-          continue;
-        }
-        end_samp = num_samp;  // for small differences, just truncate.
-      }
-      // Skip if segment size is less than minimum segment length (default 0.1s)
-      if (end_samp <=
-          start_samp + static_cast<int32>(min_segment_length * samp_freq)) {
-        KALDI_WARN << "Segment " << segment << " too short, skipping it.";
-        continue;
-      }
+    int32 num_success = 0;
+    for (; !reader.Done(); reader.Next()) {
+      std::string segment = reader.Key();
+      const WaveData &segment_wave = reader.Value();
       /* check whether the wav file has more than one channel
        * if yes, specify the channel info in segments file
-       * otherwise skips the segment
-       */
-      if (channel == -1) {
-        if (num_chan == 1) channel = 0;
-        else {
-          KALDI_ERR << "If your data has multiple channels, you must specify the"
-              " channel in the segments file.  Processing segment " << segment;
-        }
-      } else {
-        if (channel >= num_chan) {
-          KALDI_WARN << "Invalid channel " << channel << " >= " << num_chan
-                     << ", processing segment " << segment;
-          continue;
-        }
-      }
-      /*
-       * This function  return a portion of a wav data from the orignial wav data matrix 
        */
-      SubMatrix<BaseFloat> segment_matrix(wave_data, channel, 1, start_samp, end_samp-start_samp);
-      WaveData segment_wave(samp_freq, segment_matrix);
+      if (segment_wave.Data().NumRows() != 1)
+        KALDI_ERR << "If your data has multiple channels, you must specify the"
+            " channel in the segments file.  Processing segment " << segment;
       writer.Write(segment, segment_wave); // write segment in wave format.
       num_success++;
     }
     KALDI_LOG << "Successfully processed " << num_success << " lines out of "
-              << num_lines << " in the segments file. ";
+              << reader.NumLines() << " in the segments file. ";
     /* prints number of segments processed */
     return 0;
   } catch(const std::exception &e) {
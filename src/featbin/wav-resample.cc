@@ -0,0 +1,128 @@
+// featbin/wav-resample.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "feat/resample.h"
+#include "feat/wave-reader.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    const char *usage =
+        "Resample archives of wave files to a new sampling frequency, e.g. to\n"
+        "convert a 44.1kHz or 48kHz corpus to 16kHz.  The sampling frequencies\n"
+        "must be integers.\n"
+        "\n"
+        "Usage:  wav-resample [options...] <wav-rspecifier> <wav-wspecifier>\n"
+        "e.g. wav-resample --new-sample-frequency=16000 scp:wav.scp ark:-\n"
+        "See also: wav-copy\n";
+
+    ParseOptions po(usage);
+
+    int32 new_samp_freq = 16000;
+    BaseFloat filter_cutoff = -1.0;
+    int32 num_zeros = 10;
+    po.Register("new-sample-frequency", &new_samp_freq, "Sampling frequency "
+                "of the output, in Hz.");
+    po.Register("filter-cutoff", &filter_cutoff, "Cutoff frequency of the "
+                "low-pass filter, in Hz; must be at most half of both sampling "
+                "frequencies.  If <= 0, 0.99 times half the lower of the two "
+                "sampling frequencies.");
+    po.Register("num-zeros", &num_zeros, "Controls the sharpness of the "
+                "filter (number of zeros of the windowed sinc function on each "
+                "side); more is sharper but slower.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    if (new_samp_freq <= 0 || num_zeros <= 0)
+      KALDI_ERR << "Invalid options --new-sample-frequency=" << new_samp_freq
+                << " --num-zeros=" << num_zeros;
+
+    std::string wav_rspecifier = po.GetArg(1),
+        wav_wspecifier = po.GetArg(2);
+
+    int32 num_done = 0, num_err = 0;
+
+    SequentialTableReader<WaveHolder> wav_reader(wav_rspecifier);
+    TableWriter<WaveHolder> wav_writer(wav_wspecifier);
+
+    // We keep the resampler between files, as setting up its filters is
+    // relatively expensive; it's only recreated if the input sampling frequency
+    // changes.
+    LinearResample *resampler = NULL;
+    int32 resampler_samp_freq = 0;
+
+    for (; !wav_reader.Done(); wav_reader.Next()) {
+      std::string key = wav_reader.Key();
+      const WaveData &wave = wav_reader.Value();
+      int32 samp_freq = static_cast<int32>(wave.SampFreq());
+      if (samp_freq <= 0 || samp_freq != wave.SampFreq()) {
+        KALDI_WARN << "Sampling frequency " << wave.SampFreq()
+                   << " is not a positive integer, for utterance " << key;
+        num_err++;
+        continue;
+      }
+      if (samp_freq == new_samp_freq) {
+        wav_writer.Write(key, wave);
+        num_done++;
+        continue;
+      }
+      if (resampler == NULL || resampler_samp_freq != samp_freq) {
+        delete resampler;
+        BaseFloat cutoff = filter_cutoff;
+        if (cutoff <= 0.0)
+          cutoff = 0.99 * 0.5 * std::min(samp_freq, new_samp_freq);
+        resampler = new LinearResample(samp_freq, new_samp_freq, cutoff,
+                                       num_zeros);
+        resampler_samp_freq = samp_freq;
+      }
+
+      const Matrix<BaseFloat> &data = wave.Data();
+      Matrix<BaseFloat> new_data;
+      Vector<BaseFloat> channel_out;
+      for (int32 c = 0; c < data.NumRows(); c++) {
+        resampler->Resample(data.Row(c), true, &channel_out);
+        if (c == 0)
+          new_data.Resize(data.NumRows(), channel_out.Dim());
+        new_data.CopyRowFromVec(channel_out, c);
+      }
+      if (new_data.NumCols() == 0) {
+        KALDI_WARN << "Empty output for utterance " << key;
+        num_err++;
+        continue;
+      }
+      WaveData new_wave(new_samp_freq, new_data);
+      wav_writer.Write(key, new_wave);
+      num_done++;
+    }
+    delete resampler;
+    KALDI_LOG << "Resampled " << num_done << " wave files to "
+              << new_samp_freq << " Hz; " << num_err << " had errors.";
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -41,8 +41,8 @@ namespace kaldi {
 
    You should appreciate that this interface is designed to allow random
    access to features, as long as they are ready.  That is, the user
-   can call GetFrame for any frame less than NumFramesReady(), and when
-   implementing a child class you must not make assumptions about the
+   can call GetFrame (or GetFrames) for any frame less than NumFramesReady(),
+   and when implementing a child class you must not make assumptions about the
    order in which the user makes these calls.
 */
    
@@ -74,6 +74,22 @@ class OnlineFeatureInterface {
   /// the class.
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) = 0;
 
+  /// Gets the feature vectors for frames "frame" through
+  /// frame + num_frames - 1 into the rows of "feats", which must have
+  /// num_frames rows and Dim() columns.  The same requirements apply as for
+  /// GetFrame(): frame + num_frames must not exceed NumFramesReady().  The
+  /// default implementation just calls GetFrame() for each frame; classes
+  /// that can compute a range of frames more efficiently than one at a time
+  /// should override it.
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats) {
+    KALDI_ASSERT(feats->NumRows() == num_frames);
+    for (int32 i = 0; i < num_frames; i++) {
+      SubVector<BaseFloat> feat(*feats, i);
+      GetFrame(frame + i, &feat);
+    }
+  }
+
   /// Virtual destructor.  Note: constructors that take another member of
   /// type OnlineFeatureInterface are not expected to take ownership of
   /// that pointer; the caller needs to keep track of that manually.
@@ -0,0 +1,221 @@
+// kws/kws-inverted-index-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "fstext/epsilon-property.h"
+#include "kws/kws-functions.h"
+#include "kws/kws-search.h"
+#include "kws/kws-inverted-index.h"
+
+namespace kaldi {
+
+using namespace fst;
+
+// Returns a random word lattice with words 0 (silence) ... num_words, in which
+// all paths to a state have the same length, as in real lattices.
+static CompactLattice *RandWordLattice(int32 num_words) {
+  CompactLattice *clat = new CompactLattice;
+  int32 num_states = RandInt(2, 8);
+  std::vector<int32> times(num_states, 0);
+  for (int32 s = 0; s < num_states; s++) {
+    clat->AddState();
+    if (s > 0) times[s] = times[s - 1] + RandInt(1, 5);
+  }
+  clat->SetStart(0);
+  for (int32 s = 0; s + 1 < num_states; s++) {
+    int32 num_arcs = RandInt(1, 3);
+    for (int32 i = 0; i < num_arcs; i++) {
+      // The first arc goes to the next state, so every state is on a path.
+      int32 nextstate = (i == 0 ? s + 1 : RandInt(s + 1, num_states - 1)),
+          word = RandInt(0, num_words);
+      std::vector<int32> alignment(times[nextstate] - times[s], 1);
+      LatticeWeight weight(RandUniform(), RandUniform());
+      clat->AddArc(s, CompactLatticeArc(word, word,
+                                        CompactLatticeWeight(weight, alignment),
+                                        nextstate));
+    }
+  }
+  clat->SetFinal(num_states - 1, CompactLatticeWeight::One());
+  return clat;
+}
+
+// Creates the index of "clat" for utterance "uid", as lattice-to-kws-index
+// does.
+static void MakeKwsIndex(const CompactLattice &clat_in, int32 uid,
+                         KwsLexicographicFst *index) {
+  CompactLattice clat(clat_in);
+  std::vector<int32> state_times;
+  CompactLatticeStateTimes(clat, &state_times);
+  bool ok = ClusterLattice(&clat, state_times);
+  KALDI_ASSERT(ok);
+  EnsureEpsilonProperty(&clat);
+  TopSort(&clat);
+  CompactLatticeStateTimes(clat, &state_times);
+  KwsProductFst factor_transducer;
+  ok = CreateFactorTransducer(clat, state_times, uid, &factor_transducer);
+  KALDI_ASSERT(ok);
+  RemoveLongSilences(50, state_times, &factor_transducer);
+  DoFactorMerging(&factor_transducer, index);
+  DoFactorDisambiguation(index);
+  OptimizeFactorTransducer(index, -1, true);
+}
+
+// Searches "index" for the one-word keyword "word", as kws-search does, and
+// appends the results to "results".
+static void SearchKwsIndex(const KwsLexicographicFst &index, int32 word,
+                           std::vector<KwsSearchResult> *results) {
+  VectorFst<StdArc> keyword;
+  keyword.AddState();
+  keyword.AddState();
+  keyword.SetStart(0);
+  keyword.SetFinal(1, TropicalWeight::One());
+  keyword.AddArc(0, StdArc(word, word, TropicalWeight::One(), 1));
+  KwsSearchOptions opts;
+  KwsLexicographicFst keyword_fst;
+  PrepareKeywordForSearch(opts, keyword, &keyword_fst);
+  KwsLexicographicFst index_copy(index);
+  KwsIndexSearcher searcher(&index_copy);
+  int32 num_bad = searcher.Search(opts, keyword_fst, results);
+  KALDI_ASSERT(num_bad == 0);
+}
+
+// The span of an occurrence: (utterance, start time, end time).
+typedef std::pair<int32, std::pair<int32, int32> > KwsSpan;
+
+// Checks that "results" and "ref_results" have the same occurrences with the
+// same scores (but not necessarily in the same order, in case of ties).
+static void AssertSameResults(const std::vector<KwsSearchResult> &results,
+                              const std::vector<KwsSearchResult> &ref_results) {
+  KALDI_ASSERT(results.size() == ref_results.size());
+  std::multimap<KwsSpan, double> spans, ref_spans;
+  for (size_t i = 0; i < results.size(); i++) {
+    if (i > 0)  // Best first.
+      KALDI_ASSERT(results[i - 1].score <= results[i].score);
+    const KwsSearchResult &r = results[i], &ref = ref_results[i];
+    spans.insert(std::make_pair(
+        KwsSpan(r.uid, std::make_pair(r.tbeg, r.tend)), r.score));
+    ref_spans.insert(std::make_pair(
+        KwsSpan(ref.uid, std::make_pair(ref.tbeg, ref.tend)), ref.score));
+  }
+  std::multimap<KwsSpan, double>::const_iterator iter = spans.begin(),
+      ref_iter = ref_spans.begin();
+  for (; iter != spans.end(); ++iter, ++ref_iter) {
+    KALDI_ASSERT(iter->first == ref_iter->first);
+    KALDI_ASSERT(fabs(iter->second - ref_iter->second) < 1.0e-04);
+  }
+}
+
+// Works out the results for the keyword "words" (of one or two words) from the
+// results of searching the plain indexes for each word, in the way that
+// KwsInvertedIndex::Search() is documented to.
+static void ReferenceSearch(
+    const KwsSearchOptions &opts,
+    const KwsInvertedSearchOptions &inverted_opts,
+    const std::vector<std::vector<KwsSearchResult> > &word_results,
+    const std::vector<int32> &words, double cost,
+    std::vector<KwsSearchResult> *results) {
+  KALDI_ASSERT(words.size() == 1 || words.size() == 2);
+  results->clear();
+  if (words.size() == 1) {
+    *results = word_results[words[0]];
+  } else {
+    // The best score for each span.
+    std::map<KwsSpan, double> best;
+    const std::vector<KwsSearchResult> &first = word_results[words[0]],
+        &second = word_results[words[1]];
+    for (size_t i = 0; i < first.size(); i++) {
+      for (size_t j = 0; j < second.size(); j++) {
+        const KwsSearchResult &a = first[i], &b = second[j];
+        if (a.uid != b.uid || b.tbeg < a.tend ||
+            b.tbeg > a.tend + inverted_opts.max_gap)
+          continue;
+        KwsSpan span(a.uid, std::make_pair(a.tbeg, b.tend));
+        double score = std::max(a.score, b.score);
+        if (best.count(span) == 0 || score < best[span])
+          best[span] = score;
+      }
+    }
+    for (std::map<KwsSpan, double>::const_iterator iter = best.begin();
+         iter != best.end(); ++iter)
+      results->push_back(KwsSearchResult(iter->first.first,
+                                         iter->first.second.first,
+                                         iter->first.second.second,
+                                         iter->second));
+  }
+  for (size_t i = 0; i < results->size(); i++)
+    (*results)[i].score += cost;
+  MergeKwsSearchResults(opts.n_best, results);
+}
+
+void UnitTestKwsInvertedIndex() {
+  int32 num_words = RandInt(1, 4), num_utts = RandInt(1, 4);
+
+  // The inverted index is made by adding up the ones for the utterances, as
+  // kws-search does; "word_results" are the results of searching the plain
+  // indexes for each word.
+  KwsInvertedIndex inverted_index;
+  std::vector<std::vector<KwsSearchResult> > word_results(num_words + 1);
+  for (int32 uid = 1; uid <= num_utts; uid++) {
+    CompactLattice *clat = RandWordLattice(num_words);
+    KwsLexicographicFst index;
+    MakeKwsIndex(*clat, uid, &index);
+    delete clat;
+    KwsInvertedIndex utt_inverted_index;
+    utt_inverted_index.AddIndex(index);
+    inverted_index.Add(utt_inverted_index);
+    for (int32 w = 1; w <= num_words; w++)
+      SearchKwsIndex(index, w, &(word_results[w]));
+  }
+
+  // Check that it survives writing and reading.
+  bool binary = (Rand() % 2 == 0);
+  WriteKaldiObject(inverted_index, "tmpf", binary);
+  KwsInvertedIndex inverted_index2;
+  ReadKaldiObject("tmpf", &inverted_index2);
+  unlink("tmpf");
+  KALDI_ASSERT(inverted_index2.NumWords() == inverted_index.NumWords());
+
+  KwsSearchOptions opts;
+  KwsInvertedSearchOptions inverted_opts;
+  inverted_opts.max_gap = RandInt(0, 5);
+  for (int32 n = 0; n < 10; n++) {
+    opts.n_best = (Rand() % 2 == 0 ? -1 : RandInt(1, 3));
+    std::vector<int32> words(RandInt(1, 2));
+    for (size_t i = 0; i < words.size(); i++)
+      words[i] = RandInt(1, num_words);
+    double cost = 0.5 * RandInt(0, 2);
+    std::vector<KwsSearchResult> results, ref_results;
+    inverted_index2.Search(opts, inverted_opts, words, cost, &results);
+    ReferenceSearch(opts, inverted_opts, word_results, words, cost,
+                    &ref_results);
+    AssertSameResults(results, ref_results);
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    UnitTestKwsInvertedIndex();
+  std::cout << "Test OK\n";
+}
@@ -0,0 +1,194 @@
+// kws/kws-inverted-index.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include <set>
+
+#include "kws/kws-inverted-index.h"
+
+namespace kaldi {
+
+// Orders occurrences by utterance and time, as in the lists of the inverted
+// index.
+static bool CompareByTime(const KwsSearchResult &a, const KwsSearchResult &b) {
+  if (a.uid != b.uid) return a.uid < b.uid;
+  if (a.tbeg != b.tbeg) return a.tbeg < b.tbeg;
+  if (a.tend != b.tend) return a.tend < b.tend;
+  return a.score < b.score;
+}
+
+static bool SameTime(const KwsSearchResult &a, const KwsSearchResult &b) {
+  return a.uid == b.uid && a.tbeg == b.tbeg && a.tend == b.tend;
+}
+
+void KwsInvertedIndex::AddIndex(const KwsLexicographicFst &index) {
+  using namespace fst;
+  typedef KwsLexicographicArc Arc;
+  typedef Arc::Weight Weight;
+
+  // The words are the input labels of the arcs that do not enter final
+  // states (those have the disambiguation symbols).
+  std::set<int32> words;
+  for (StateIterator<KwsLexicographicFst> siter(index); !siter.Done();
+       siter.Next()) {
+    for (ArcIterator<KwsLexicographicFst> aiter(index, siter.Value());
+         !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0 && index.Final(arc.nextstate) == Weight::Zero())
+        words.insert(arc.ilabel);
+    }
+  }
+  if (words.empty()) return;
+
+  KwsLexicographicFst index_copy(index);
+  KwsIndexSearcher searcher(&index_copy);
+  KwsSearchOptions opts;  // Default options: we want all the results.
+  for (std::set<int32>::const_iterator iter = words.begin();
+       iter != words.end(); ++iter) {
+    KwsLexicographicFst keyword;
+    keyword.AddState();
+    keyword.AddState();
+    keyword.SetStart(0);
+    keyword.SetFinal(1, Weight::One());
+    keyword.AddArc(0, Arc(*iter, *iter, Weight::One(), 1));
+
+    std::vector<KwsSearchResult> &list = lists_[*iter];
+    size_t old_size = list.size();
+    if (searcher.Search(opts, keyword, &list) > 0)
+      KALDI_WARN << "The index does not have the expected structure for "
+                 << "word " << *iter;
+    std::sort(list.begin() + old_size, list.end(), CompareByTime);
+    std::inplace_merge(list.begin(), list.begin() + old_size, list.end(),
+                       CompareByTime);
+    if (list.empty()) lists_.erase(*iter);
+  }
+}
+
+void KwsInvertedIndex::Add(const KwsInvertedIndex &other) {
+  for (MapType::const_iterator iter = other.lists_.begin();
+       iter != other.lists_.end(); ++iter) {
+    std::vector<KwsSearchResult> &list = lists_[iter->first];
+    size_t old_size = list.size();
+    list.insert(list.end(), iter->second.begin(), iter->second.end());
+    std::inplace_merge(list.begin(), list.begin() + old_size, list.end(),
+                       CompareByTime);
+  }
+}
+
+void KwsInvertedIndex::SearchFrom(
+    const KwsInvertedSearchOptions &inverted_opts,
+    const std::vector<int32> &words, size_t pos,
+    int32 uid, int32 tbeg, int32 tend, double score,
+    std::vector<KwsSearchResult> *results) const {
+  MapType::const_iterator iter = lists_.find(words[pos]);
+  if (iter == lists_.end()) return;
+  const std::vector<KwsSearchResult> &list = iter->second;
+  // The first occurrence in utterance "uid" that starts at or after "tend".
+  KwsSearchResult first(uid, tend, std::numeric_limits<int32>::min(),
+                        -std::numeric_limits<double>::infinity());
+  std::vector<KwsSearchResult>::const_iterator
+      occ = std::lower_bound(list.begin(), list.end(), first, CompareByTime);
+  for (; occ != list.end() && occ->uid == uid &&
+           occ->tbeg <= tend + inverted_opts.max_gap; ++occ) {
+    double this_score = std::max(score, occ->score);
+    if (pos + 1 == words.size())
+      results->push_back(KwsSearchResult(uid, tbeg, occ->tend, this_score));
+    else
+      SearchFrom(inverted_opts, words, pos + 1, uid, tbeg, occ->tend,
+                 this_score, results);
+  }
+}
+
+void KwsInvertedIndex::Search(const KwsSearchOptions &opts,
+                              const KwsInvertedSearchOptions &inverted_opts,
+                              const std::vector<int32> &words, double cost,
+                              std::vector<KwsSearchResult> *results) const {
+  KALDI_ASSERT(!words.empty());
+  MapType::const_iterator iter = lists_.find(words[0]);
+  if (iter == lists_.end()) return;
+  const std::vector<KwsSearchResult> &list = iter->second;
+
+  std::vector<KwsSearchResult> found;
+  if (words.size() == 1) {
+    found = list;
+  } else {
+    for (size_t i = 0; i < list.size(); i++)
+      SearchFrom(inverted_opts, words, 1, list[i].uid, list[i].tbeg,
+                 list[i].tend, list[i].score, &found);
+    // The same span may be reached via different occurrences of the words in
+    // the middle; keep the best score for each.
+    std::sort(found.begin(), found.end(), CompareByTime);
+    found.erase(std::unique(found.begin(), found.end(), SameTime),
+                found.end());
+  }
+  for (size_t i = 0; i < found.size(); i++)
+    found[i].score += cost;
+  MergeKwsSearchResults(opts.n_best, &found);
+  results->insert(results->end(), found.begin(), found.end());
+}
+
+void KwsInvertedIndex::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<KwsInvertedIndex>");
+  int32 num_words = lists_.size();
+  WriteBasicType(os, binary, num_words);
+  for (MapType::const_iterator iter = lists_.begin(); iter != lists_.end();
+       ++iter) {
+    const std::vector<KwsSearchResult> &list = iter->second;
+    int32 size = list.size();
+    WriteBasicType(os, binary, iter->first);
+    WriteBasicType(os, binary, size);
+    for (int32 i = 0; i < size; i++) {
+      WriteBasicType(os, binary, list[i].uid);
+      WriteBasicType(os, binary, list[i].tbeg);
+      WriteBasicType(os, binary, list[i].tend);
+      WriteBasicType(os, binary, list[i].score);
+    }
+    if (!binary) os << '\n';
+  }
+  WriteToken(os, binary, "</KwsInvertedIndex>");
+}
+
+void KwsInvertedIndex::Read(std::istream &is, bool binary) {
+  lists_.clear();
+  ExpectToken(is, binary, "<KwsInvertedIndex>");
+  int32 num_words;
+  ReadBasicType(is, binary, &num_words);
+  KALDI_ASSERT(num_words >= 0);
+  for (int32 w = 0; w < num_words; w++) {
+    int32 word, size;
+    ReadBasicType(is, binary, &word);
+    ReadBasicType(is, binary, &size);
+    KALDI_ASSERT(size >= 0);
+    std::vector<KwsSearchResult> &list = lists_[word];
+    list.reserve(size);
+    for (int32 i = 0; i < size; i++) {
+      int32 uid, tbeg, tend;
+      double score;
+      ReadBasicType(is, binary, &uid);
+      ReadBasicType(is, binary, &tbeg);
+      ReadBasicType(is, binary, &tend);
+      ReadBasicType(is, binary, &score);
+      list.push_back(KwsSearchResult(uid, tbeg, tend, score));
+    }
+  }
+  ExpectToken(is, binary, "</KwsInvertedIndex>");
+}
+
+}  // namespace kaldi
@@ -0,0 +1,118 @@
+// kws/kws-inverted-index.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_KWS_KWS_INVERTED_INDEX_H_
+#define KALDI_KWS_KWS_INVERTED_INDEX_H_
+
+#include <map>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "kws/kaldi-kws.h"
+#include "kws/kws-search.h"
+
+namespace kaldi {
+
+struct KwsInvertedSearchOptions {
+  int32 max_words;
+  int32 max_gap;
+  int32 max_utts_per_shard;
+
+  KwsInvertedSearchOptions(): max_words(1), max_gap(50),
+                              max_utts_per_shard(1000) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("inverted-max-words", &max_words, "Keywords that are a "
+                   "single sequence of at most this many words are looked up "
+                   "in the inverted index (if given); others are searched for "
+                   "by composition with the index.  Only single-word lookups "
+                   "are exact; for longer keywords, the score is the worst "
+                   "of the scores of its words.");
+    opts->Register("inverted-max-gap", &max_gap, "Maximum number of frames "
+                   "between successive words of a keyword, when it is looked "
+                   "up in the inverted index (cf. lattice-to-kws-index "
+                   "--max-silence-frames).");
+    opts->Register("inverted-max-utts-per-shard", &max_utts_per_shard,
+                   "The inverted indexes are combined and searched this many "
+                   "utterances at a time, so that only this many are in memory "
+                   "at once (if <= 0, all of them are combined).");
+  }
+};
+
+/// This class is an auxiliary index, used to answer queries that consist of
+/// a few words without composition with the factor-transducer index: for each
+/// word, it stores the list of its occurrences, i.e. the results kws-search
+/// would output for that word as a keyword, sorted by utterance id and time.
+/// It is created by lattice-to-kws-index, one per utterance.  At search time
+/// the ones for a range of utterances are combined with Add(); since a keyword
+/// never spans utterances, the results for the ranges can simply be merged.
+class KwsInvertedIndex {
+ public:
+  KwsInvertedIndex() { }
+
+  /// Adds the occurrences of all the words in "index" (normally the index of
+  /// one utterance, as created by lattice-to-kws-index).  They are found by
+  /// searching the index for each word, so they are the same as the results of
+  /// that search.
+  void AddIndex(const KwsLexicographicFst &index);
+
+  /// Adds the occurrences in "other".
+  void Add(const KwsInvertedIndex &other);
+
+  /// Looks up the word sequence "words" (of length at least one), and appends
+  /// the occurrences to "results" (up to opts.n_best of them, the best ones,
+  /// if it is not -1).  A sequence occurs where each word starts at most
+  /// inverted_opts.max_gap frames after the end of the previous one, in the
+  /// same utterance; its score is the worst score of its words (for more than
+  /// one word, this is a lower bound on the cost of the sequence in the index,
+  /// so it is not exact).  "cost" is added to every score (it is the cost of
+  /// the keyword FST).
+  void Search(const KwsSearchOptions &opts,
+              const KwsInvertedSearchOptions &inverted_opts,
+              const std::vector<int32> &words, double cost,
+              std::vector<KwsSearchResult> *results) const;
+
+  int32 NumWords() const { return lists_.size(); }
+
+  void Clear() { lists_.clear(); }
+
+  void Write(std::ostream &os, bool binary) const;
+
+  void Read(std::istream &is, bool binary);
+
+ private:
+  // Appends to "results" the occurrences of words[pos], words[pos+1], ...
+  // that follow an occurrence of words[pos-1] ending at time "tend" in
+  // utterance "uid".  "tbeg" is the start time of the sequence, and "score"
+  // its score so far.
+  void SearchFrom(const KwsInvertedSearchOptions &inverted_opts,
+                  const std::vector<int32> &words, size_t pos,
+                  int32 uid, int32 tbeg, int32 tend, double score,
+                  std::vector<KwsSearchResult> *results) const;
+
+  // Maps each word to its occurrences, sorted by (uid, tbeg, tend, score).
+  typedef std::map<int32, std::vector<KwsSearchResult> > MapType;
+  MapType lists_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_KWS_KWS_INVERTED_INDEX_H_
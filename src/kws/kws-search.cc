@@ -0,0 +1,207 @@
+// kws/kws-search.cc
+
+// Copyright 2012-2013  Johns Hopkins University (Authors: Guoguo Chen, Daniel Povey)
+//                2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+
+#include "kws/kws-search.h"
+
+namespace kaldi {
+
+typedef KwsLexicographicArc Arc;
+typedef Arc::Weight Weight;
+typedef Arc::StateId StateId;
+
+static inline uint64 EncodeLabel(StateId ilabel, StateId olabel) {
+  return (((int64)olabel)<<32)+((int64)ilabel);
+}
+
+static inline StateId DecodeLabelUid(uint64 osymbol) {
+  // We only need the utterance id
+  return ((StateId)(osymbol>>32));
+}
+
+class VectorFstToKwsLexicographicFstMapper {
+ public:
+  typedef fst::StdArc FromArc;
+  typedef FromArc::Weight FromWeight;
+  typedef KwsLexicographicArc ToArc;
+  typedef KwsLexicographicWeight ToWeight;
+
+  VectorFstToKwsLexicographicFstMapper() {}
+
+  ToArc operator()(const FromArc &arc) const {
+    return ToArc(arc.ilabel,
+                 arc.olabel,
+                 (arc.weight == FromWeight::Zero() ?
+                  ToWeight::Zero() :
+                  ToWeight(arc.weight.Value(),
+                           StdLStdWeight::One())),
+                 arc.nextstate);
+  }
+
+  fst::MapFinalAction FinalAction() const { return fst::MAP_NO_SUPERFINAL; }
+
+  fst::MapSymbolsAction InputSymbolsAction() const { return fst::MAP_COPY_SYMBOLS; }
+
+  fst::MapSymbolsAction OutputSymbolsAction() const { return fst::MAP_COPY_SYMBOLS;}
+
+  uint64 Properties(uint64 props) const { return props; }
+};
+
+void PrepareKeywordForSearch(const KwsSearchOptions &opts,
+                             const fst::VectorFst<fst::StdArc> &keyword_in,
+                             KwsLexicographicFst *keyword_fst) {
+  using namespace fst;
+  VectorFst<StdArc> keyword(keyword_in);
+  // Process the case where we have confusion for keywords
+  if (opts.keyword_beam != -1) {
+    Prune(&keyword, opts.keyword_beam);
+  }
+  if (opts.keyword_nbest != -1) {
+    VectorFst<StdArc> tmp;
+    ShortestPath(keyword, &tmp, opts.keyword_nbest, true, true);
+    keyword = tmp;
+  }
+  Map(keyword, keyword_fst, VectorFstToKwsLexicographicFstMapper());
+}
+
+KwsIndexSearcher::KwsIndexSearcher(KwsLexicographicFst *index) {
+  using namespace fst;
+  // Take over the implementation of "index" without copying it;
+  // DeleteStates() gives "index" a new, empty implementation since the old
+  // one is shared.
+  index_ = *index;
+  index->DeleteStates();
+
+  // First we have to remove the disambiguation symbols. But rather than
+  // removing them totally, we actually move them from input side to output
+  // side, making the output symbol a "combined" symbol of the disambiguation
+  // symbols and the utterance id's.
+  // Note that in Dogan and Murat's original paper, they simply remove the
+  // disambiguation symbol on the input symbol side, which will not allow us
+  // to do epsilon removal after composition with the keyword FST. They have
+  // to traverse the resulting FST.
+  int32 label_count = 1;
+  unordered_map<uint64, uint32> label_encoder;
+  for (StateIterator<KwsLexicographicFst> siter(index_); !siter.Done();
+       siter.Next()) {
+    StateId state_id = siter.Value();
+    for (MutableArcIterator<KwsLexicographicFst>
+             aiter(&index_, state_id); !aiter.Done(); aiter.Next()) {
+      Arc arc = aiter.Value();
+      // Skip the non-final arcs
+      if (index_.Final(arc.nextstate) == Weight::Zero())
+        continue;
+      // Encode the input and output label of the final arc, and this is the
+      // new output label for this arc; set the input label to <epsilon>
+      uint64 osymbol = EncodeLabel(arc.ilabel, arc.olabel);
+      arc.ilabel = 0;
+      unordered_map<uint64, uint32>::iterator iter =
+          label_encoder.find(osymbol);
+      if (iter == label_encoder.end()) {
+        arc.olabel = label_count;
+        label_encoder[osymbol] = label_count;
+        label_decoder_[label_count] = osymbol;
+        label_count++;
+      } else {
+        arc.olabel = iter->second;
+      }
+      aiter.SetValue(arc);
+    }
+  }
+  ArcSort(&index_, fst::ILabelCompare<KwsLexicographicArc>());
+}
+
+int32 KwsIndexSearcher::Search(const KwsSearchOptions &opts,
+                               const KwsLexicographicFst &keyword_fst,
+                               std::vector<KwsSearchResult> *results) const {
+  using namespace fst;
+  KwsLexicographicFst result_fst;
+  Compose(keyword_fst, index_, &result_fst);
+  Project(&result_fst, PROJECT_OUTPUT);
+  Minimize(&result_fst);
+  ShortestPath(result_fst, &result_fst, opts.n_best);
+  RmEpsilon(&result_fst);
+
+  // No result found
+  if (result_fst.Start() == kNoStateId)
+    return 0;
+
+  // Got something here
+  int32 num_bad = 0;
+  for (ArcIterator<KwsLexicographicFst>
+           aiter(result_fst, result_fst.Start()); !aiter.Done(); aiter.Next()) {
+    const Arc &arc = aiter.Value();
+
+    // We're expecting a two-state FST
+    if (result_fst.Final(arc.nextstate) != Weight::One()) {
+      num_bad++;
+      continue;
+    }
+
+    unordered_map<uint32, uint64>::const_iterator iter =
+        label_decoder_.find(arc.olabel);
+    KALDI_ASSERT(iter != label_decoder_.end());
+    int32 uid = static_cast<int32>(DecodeLabelUid(iter->second)),
+        tbeg = arc.weight.Value2().Value1().Value(),
+        tend = arc.weight.Value2().Value2().Value();
+    double score = arc.weight.Value1().Value();
+
+    if (score < 0) {
+      if (score < opts.negative_tolerance) {
+        KALDI_WARN << "Score out of expected range: " << score;
+      }
+      score = 0.0;
+    }
+    results->push_back(KwsSearchResult(uid, tbeg, tend, score));
+  }
+  return num_bad;
+}
+
+bool GetKwsIndexUttRange(const KwsLexicographicFst &index,
+                         int32 *min_uid, int32 *max_uid) {
+  using namespace fst;
+  *min_uid = std::numeric_limits<int32>::max();
+  *max_uid = std::numeric_limits<int32>::min();
+  bool ans = false;
+  for (StateIterator<KwsLexicographicFst> siter(index); !siter.Done();
+       siter.Next()) {
+    for (ArcIterator<KwsLexicographicFst> aiter(index, siter.Value());
+         !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (index.Final(arc.nextstate) == Weight::Zero())
+        continue;
+      *min_uid = std::min<int32>(*min_uid, arc.olabel);
+      *max_uid = std::max<int32>(*max_uid, arc.olabel);
+      ans = true;
+    }
+  }
+  return ans;
+}
+
+void MergeKwsSearchResults(int32 n_best,
+                           std::vector<KwsSearchResult> *results) {
+  std::sort(results->begin(), results->end());
+  if (n_best != -1 && static_cast<int32>(results->size()) > n_best)
+    results->erase(results->begin() + n_best, results->end());
+}
+
+}  // namespace kaldi
@@ -0,0 +1,133 @@
+// kws/kws-search.h
+
+// Copyright 2012-2013  Johns Hopkins University (Authors: Guoguo Chen, Daniel Povey)
+//                2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_KWS_KWS_SEARCH_H_
+#define KALDI_KWS_KWS_SEARCH_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "util/stl-utils.h"
+#include "kws/kaldi-kws.h"
+
+namespace kaldi {
+
+struct KwsSearchOptions {
+  int32 n_best;
+  int32 keyword_nbest;
+  double keyword_beam;
+  double negative_tolerance;
+
+  KwsSearchOptions(): n_best(-1), keyword_nbest(-1), keyword_beam(-1),
+                      negative_tolerance(-0.1) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("nbest", &n_best, "Return the best n hypotheses.");
+    opts->Register("keyword-nbest", &keyword_nbest,
+                   "Pick the best n keywords if the FST contains multiple "
+                   "keywords.");
+    opts->Register("negative-tolerance", &negative_tolerance,
+                   "The program will print a warning if we get negative score "
+                   "smaller than this tolerance.");
+    opts->Register("keyword-beam", &keyword_beam,
+                   "Prune the FST with the given beam if the FST contains "
+                   "multiple keywords.");
+  }
+
+  void Check() const {
+    if (n_best < 0 && n_best != -1)
+      KALDI_ERR << "Bad number for nbest";
+    if (keyword_nbest < 0 && keyword_nbest != -1)
+      KALDI_ERR << "Bad number for keyword-nbest";
+    if (keyword_beam < 0 && keyword_beam != -1)
+      KALDI_ERR << "Bad number for keyword-beam";
+  }
+};
+
+/// One search result: the keyword occurs in utterance "uid" between frames
+/// "tbeg" and "tend", with negated log-probability "score".
+struct KwsSearchResult {
+  int32 uid;
+  int32 tbeg;
+  int32 tend;
+  double score;
+
+  KwsSearchResult(int32 uid, int32 tbeg, int32 tend, double score):
+      uid(uid), tbeg(tbeg), tend(tend), score(score) { }
+
+  /// Orders from best to worst score (then by utterance and time), as
+  /// used when merging the results of several index shards.
+  bool operator < (const KwsSearchResult &other) const {
+    if (score != other.score) return score < other.score;
+    if (uid != other.uid) return uid < other.uid;
+    if (tbeg != other.tbeg) return tbeg < other.tbeg;
+    return tend < other.tend;
+  }
+};
+
+/// Applies the --keyword-beam and --keyword-nbest options to a keyword FST
+/// and converts it to the semiring of the index.
+void PrepareKeywordForSearch(const KwsSearchOptions &opts,
+                             const fst::VectorFst<fst::StdArc> &keyword,
+                             KwsLexicographicFst *keyword_fst);
+
+/// This class holds an index, as output by kws-index-union (or one shard of a
+/// sharded index), prepared for searching.  It is not thread-safe (because
+/// composition copies the FST, and OpenFst's reference counting is not
+/// thread-safe), so threads should each have their own.
+class KwsIndexSearcher {
+ public:
+  /// Takes over the index from "index" (which is left empty), and prepares
+  /// it for search.
+  explicit KwsIndexSearcher(KwsLexicographicFst *index);
+
+  /// Searches for "keyword_fst", as output by PrepareKeywordForSearch(), and
+  /// appends the results (up to opts.n_best of them, if it is not -1) to
+  /// "results".  Returns the number of results that had to be skipped because
+  /// the search FST did not have the expected structure.
+  int32 Search(const KwsSearchOptions &opts,
+               const KwsLexicographicFst &keyword_fst,
+               std::vector<KwsSearchResult> *results) const;
+
+ private:
+  KwsLexicographicFst index_;
+  // Maps the combined labels we put on the final arcs of the index to the
+  // original (disambiguation symbol, utterance id) pairs.
+  unordered_map<uint32, uint64> label_decoder_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(KwsIndexSearcher);
+};
+
+/// Outputs the lowest and highest utterance ids in an index, i.e. of the
+/// output labels on the arcs that enter final states.  Returns false if
+/// there are no such arcs.
+bool GetKwsIndexUttRange(const KwsLexicographicFst &index,
+                         int32 *min_uid, int32 *max_uid);
+
+/// Keeps the best "n_best" of the results for one keyword (all of them if
+/// n_best == -1), in order from best to worst; this is used to merge the
+/// results of searching several shards of an index.
+void MergeKwsSearchResults(int32 n_best,
+                           std::vector<KwsSearchResult> *results);
+
+}  // namespace kaldi
+
+#endif  // KALDI_KWS_KWS_SEARCH_H_
@@ -23,6 +23,83 @@
 #include "fstext/fstext-utils.h"
 #include "kws/kaldi-kws.h"
 #include "kws/kws-functions.h"
+#include "kws/kws-search.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+// Does the encoded epsilon removal, determinization and minimization.
+void OptimizeKwsIndex(int32 max_states, KwsLexicographicFst *index) {
+  using namespace fst;
+  KwsLexicographicFst ifst = *index;
+  EncodeMapper<KwsLexicographicArc> encoder(kEncodeLabels, ENCODE);
+  Encode(&ifst, &encoder);
+  try {
+    DeterminizeStar(ifst, index, kDelta, NULL, max_states);
+  } catch(const std::exception &e) {
+    KALDI_WARN << e.what()
+               << " (should affect speed of search but not results)";
+    *index = ifst;
+  }
+  Minimize(index);
+  Decode(index, encoder);
+}
+
+typedef TableWriter< fst::VectorFstTplHolder<KwsLexicographicArc> >
+    KwsIndexWriter;
+
+// Optimizes one union of indexes (unless skip_opt).  If "index_writer" is
+// non-NULL, the destructor writes the result as one shard of a sharded index,
+// with the range of utterance ids in it, "<first-id>-<last-id>", as the key;
+// otherwise it appends it to "output", for the next level of the tree in which
+// the indexes are combined.
+class KwsIndexOptimizeTask {
+ public:
+  // Initializer takes ownership of "index".
+  KwsIndexOptimizeTask(bool skip_opt, int32 max_states,
+                       KwsLexicographicFst *index,
+                       KwsIndexWriter *index_writer,
+                       std::vector<KwsLexicographicFst*> *output):
+      skip_opt_(skip_opt), max_states_(max_states), index_(index),
+      index_writer_(index_writer), output_(output), has_utts_(false) { }
+
+  void operator () () {
+    if (skip_opt_ == false)
+      OptimizeKwsIndex(max_states_, index_);
+    if (index_writer_ != NULL) {
+      int32 min_uid, max_uid;
+      has_utts_ = GetKwsIndexUttRange(*index_, &min_uid, &max_uid);
+      std::ostringstream os;
+      os << min_uid << '-' << max_uid;
+      key_ = os.str();
+    }
+  }
+
+  ~KwsIndexOptimizeTask() {
+    if (skip_opt_ == true)
+      KALDI_LOG << "Skipping index optimization...";
+    if (index_writer_ == NULL) {
+      output_->push_back(index_);
+      return;
+    }
+    if (has_utts_)
+      index_writer_->Write(key_, *index_);
+    else
+      KALDI_WARN << "Index shard contains no utterances; not writing it.";
+    delete index_;
+  }
+
+ private:
+  bool skip_opt_;
+  int32 max_states_;
+  KwsLexicographicFst *index_;
+  KwsIndexWriter *index_writer_;
+  std::vector<KwsLexicographicFst*> *output_;
+  bool has_utts_;
+  std::string key_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -35,6 +112,14 @@ int main(int argc, char *argv[]) {
         "Take a union of the indexed lattices. The input index is in the T*T*T semiring and\n"
         "the output index is also in the T*T*T semiring. At the end of this program, encoded\n"
         "epsilon removal, determinization and minimization will be applied.\n"
+        "If --max-utts-per-shard is set, the output is a sharded index: each\n"
+        "index written covers the next (at most) that many input indexes, which\n"
+        "should be ordered by utterance id, and its key is the range of utterance\n"
+        "ids it covers, e.g. \"1-2000\" (otherwise the key is \"global\").\n"
+        "kws-search accepts either kind of index.\n"
+        "With --num-threads > 1, the shards, or (for an unsharded index) the\n"
+        "unions of --fan-in indexes at each level of a tree that combines them,\n"
+        "are optimized in parallel.\n"
         "\n"
         "Usage: kws-index-union [options]  index-rspecifier index-wspecifier\n"
         " e.g.: kws-index-union ark:input.idx ark:global.idx\n";
@@ -44,9 +129,19 @@ int main(int argc, char *argv[]) {
     bool strict = true;
     bool skip_opt = false;
     int32 max_states = -1;
+    int32 max_utts_per_shard = -1;
+    int32 fan_in = 16;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     po.Register("strict", &strict, "Will allow 0 lattice if it is set to false.");
     po.Register("skip-optimization", &skip_opt, "Skip optimization if it's set to true.");
     po.Register("max-states", &max_states, "Maximum states for DeterminizeStar.");
+    po.Register("max-utts-per-shard", &max_utts_per_shard, "If > 0, write a "
+                "sharded index in which each shard is the union of this many "
+                "input indexes (normally, one per utterance).");
+    po.Register("fan-in", &fan_in, "With --num-threads > 1, the number of "
+                "indexes whose union is optimized at each node of the tree in "
+                "which the indexes are combined.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -61,40 +156,78 @@ int main(int argc, char *argv[]) {
     SequentialTableReader< VectorFstTplHolder<KwsLexicographicArc> > index_reader(index_rspecifier);
     TableWriter< VectorFstTplHolder<KwsLexicographicArc> > index_writer(index_wspecifier);
 
-    int32 n_done = 0;
-    KwsLexicographicFst global_index;
-    for (; !index_reader.Done(); index_reader.Next()) {
-      std::string key = index_reader.Key();
-      KwsLexicographicFst index = index_reader.Value();
-      index_reader.FreeCurrent();
-
-      Union(&global_index, index);
-
-      n_done++;
+    bool sharded = (max_utts_per_shard > 0);
+    // The indexes are combined in a tree: each node is the optimized union of
+    // (at most) "fan_in" nodes of the level below, and the nodes of one level
+    // are optimized in parallel.  This is only worthwhile with more than one
+    // thread; otherwise we optimize the union of all the indexes once.
+    bool use_tree = (!sharded && !skip_opt &&
+                     sequencer_config.num_threads > 1);
+    if (use_tree && fan_in < 2)
+      KALDI_ERR << "--fan-in must be at least 2, got " << fan_in;
+    int32 group_size = (sharded ? max_utts_per_shard :
+                        (use_tree ? fan_in : -1));
+
+    int32 n_done = 0, n_shards = 0, n_in_group = 0;
+    std::vector<KwsLexicographicFst*> level;
+    {
+      TaskSequencer<KwsIndexOptimizeTask> sequencer(sequencer_config);
+      KwsLexicographicFst *group_index = new KwsLexicographicFst();
+      for (; !index_reader.Done(); index_reader.Next()) {
+        const KwsLexicographicFst &index = index_reader.Value();
+        Union(group_index, index);
+        index_reader.FreeCurrent();
+
+        n_done++;
+        n_in_group++;
+        if (n_in_group == group_size) {
+          sequencer.Run(new KwsIndexOptimizeTask(
+              skip_opt, max_states, group_index,
+              (sharded ? &index_writer : NULL), &level));
+          group_index = new KwsLexicographicFst();
+          n_in_group = 0;
+          n_shards++;
+        }
+      }
+      if (n_in_group > 0 || (!sharded && n_done == 0)) {
+        sequencer.Run(new KwsIndexOptimizeTask(
+            skip_opt, max_states, group_index,
+            (sharded ? &index_writer : NULL), &level));
+        n_shards++;
+      } else {
+        delete group_index;
+      }
     }
 
-    if (skip_opt == false) {
-      // Do the encoded epsilon removal, determinization and minimization
-      KwsLexicographicFst ifst = global_index;
-      EncodeMapper<KwsLexicographicArc> encoder(kEncodeLabels, ENCODE);
-      Encode(&ifst, &encoder);
-      try {
-        DeterminizeStar(ifst, &global_index, kDelta, NULL, max_states);
-      } catch(const std::exception &e) {
-        KALDI_WARN << e.what()
-                   << " (should affect speed of search but not results)";
-        global_index = ifst;
+    // Combine the levels of the tree until only the root is left.
+    while (level.size() > 1) {
+      KALDI_VLOG(1) << "Combining " << level.size() << " indexes...";
+      std::vector<KwsLexicographicFst*> next_level;
+      TaskSequencer<KwsIndexOptimizeTask> sequencer(sequencer_config);
+      for (size_t i = 0; i < level.size(); i += fan_in) {
+        KwsLexicographicFst *group_index = level[i];
+        for (size_t j = i + 1; j < level.size() && j < i + fan_in; j++) {
+          Union(group_index, *(level[j]));
+          delete level[j];
+        }
+        sequencer.Run(new KwsIndexOptimizeTask(skip_opt, max_states,
+                                               group_index, NULL,
+                                               &next_level));
       }
-      Minimize(&global_index);
-      Decode(&global_index, encoder);
-    } else {
-      KALDI_LOG << "Skipping index optimization...";
+      sequencer.Wait();
+      level.swap(next_level);
     }
 
     // Write the result
-    index_writer.Write("global", global_index);
+    if (!sharded) {
+      KALDI_ASSERT(level.size() == 1);
+      index_writer.Write("global", *(level[0]));
+      delete level[0];
+    }
 
     KALDI_LOG << "Done " << n_done << " indices";
+    if (sharded)
+      KALDI_LOG << "Wrote " << n_shards << " index shards";
     if (strict == true)
       return (n_done != 0 ? 0 : 1);
     else
@@ -1,6 +1,6 @@
 // kwsbin/kws-search.cc
 
-// Copyright 2012-2013  Johns Hopkins University (Authors: Guoguo Chen, Daniel Povey)
+// Copyright 2012-2015  Johns Hopkins University (Authors: Guoguo Chen, Daniel Povey)
 
 // See ../../COPYING for clarification regarding multiple authors
 //
@@ -21,70 +21,119 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "fstext/kaldi-fst-io.h"
+#include "fstext/fstext-utils.h"
 #include "kws/kaldi-kws.h"
+#include "kws/kws-search.h"
+#include "kws/kws-inverted-index.h"
+#include "thread/kaldi-task-sequence.h"
 
 namespace kaldi {
 
-typedef KwsLexicographicArc Arc;
-typedef Arc::Weight Weight;
-typedef Arc::StateId StateId;
-
-uint64 EncodeLabel(StateId ilabel,
-                   StateId olabel) {
-  return (((int64)olabel)<<32)+((int64)ilabel);
-
-}
-
-StateId DecodeLabelUid(uint64 osymbol) {
-  // We only need the utterance id
-  return ((StateId)(osymbol>>32));
-}
-
-class VectorFstToKwsLexicographicFstMapper {
+// Searches for all the keywords in one shard of the index.
+class KwsSearchShardTask {
  public:
-  typedef fst::StdArc FromArc;
-  typedef FromArc::Weight FromWeight;
-  typedef KwsLexicographicArc ToArc;
-  typedef KwsLexicographicWeight ToWeight;
-
-  VectorFstToKwsLexicographicFstMapper() {}
-
-  ToArc operator()(const FromArc &arc) const {
-    return ToArc(arc.ilabel, 
-                 arc.olabel,
-                 (arc.weight == FromWeight::Zero() ?
-                  ToWeight::Zero() :
-                  ToWeight(arc.weight.Value(),
-                           StdLStdWeight::One())),
-                 arc.nextstate);
+  // Initializer takes ownership of "index".
+  KwsSearchShardTask(const KwsSearchOptions &opts,
+                     const std::vector<std::string> &keyword_keys,
+                     const std::vector<KwsLexicographicFst*> &keywords,
+                     const std::string &shard_key,
+                     KwsLexicographicFst *index,
+                     std::vector<std::vector<KwsSearchResult> > *all_results,
+                     std::vector<bool> *found,
+                     int32 *num_fail):
+      opts_(opts), keyword_keys_(keyword_keys), keywords_(keywords),
+      shard_key_(shard_key), index_(index), all_results_(all_results),
+      found_(found), num_fail_(num_fail) { }
+
+  void operator () () {
+    KwsIndexSearcher searcher(index_);
+    delete index_;  // It is empty now; the searcher took over its contents.
+    index_ = NULL;
+    size_t num_keywords = keywords_.size();
+    results_.resize(num_keywords);
+    num_bad_.resize(num_keywords);
+    for (size_t k = 0; k < num_keywords; k++) {
+      if (keywords_[k] == NULL)
+        continue;  // Looked up in the inverted index.
+      // We make a deep copy of the keyword (constructing from the Fst base
+      // class), because composition copies it, and OpenFst's reference
+      // counting is not thread-safe.
+      KwsLexicographicFst keyword(
+          static_cast<const fst::Fst<KwsLexicographicArc>&>(*(keywords_[k])));
+      num_bad_[k] = searcher.Search(opts_, keyword, &(results_[k]));
+    }
   }
 
-  fst::MapFinalAction FinalAction() const { return fst::MAP_NO_SUPERFINAL; }
-
-  fst::MapSymbolsAction InputSymbolsAction() const { return fst::MAP_COPY_SYMBOLS; }
-
-  fst::MapSymbolsAction OutputSymbolsAction() const { return fst::MAP_COPY_SYMBOLS;}
+  ~KwsSearchShardTask() {
+    for (size_t k = 0; k < results_.size(); k++) {
+      if (num_bad_[k] > 0) {
+        KALDI_WARN << "The resulting FST does not have the expected structure "
+                   << "for key " << keyword_keys_[k] << " in index "
+                   << shard_key_;
+        (*num_fail_) += num_bad_[k];
+      }
+      if (!results_[k].empty() || num_bad_[k] > 0)
+        (*found_)[k] = true;
+      std::vector<KwsSearchResult> &results = (*all_results_)[k];
+      results.insert(results.end(), results_[k].begin(), results_[k].end());
+      // Keep only the n-best so far, so memory use does not grow with the
+      // number of shards.
+      MergeKwsSearchResults(opts_.n_best, &results);
+    }
+  }
 
-  uint64 Properties(uint64 props) const { return props; }
+ private:
+  const KwsSearchOptions &opts_;
+  const std::vector<std::string> &keyword_keys_;
+  const std::vector<KwsLexicographicFst*> &keywords_;  // NULL if not searched.
+  std::string shard_key_;
+  KwsLexicographicFst *index_;  // Owned here until operator () is called.
+  std::vector<std::vector<KwsSearchResult> > results_;  // Indexed by keyword.
+  std::vector<int32> num_bad_;  // Indexed by keyword.
+  std::vector<std::vector<KwsSearchResult> > *all_results_;
+  std::vector<bool> *found_;
+  int32 *num_fail_;
 };
 
+// Looks up the keywords that have a word sequence in "words" (those that are
+// empty are not looked up) in one shard of the inverted index, and merges the
+// results into "all_results", keeping the n-best.
+static void SearchInvertedIndexShard(
+    const KwsSearchOptions &opts,
+    const KwsInvertedSearchOptions &inverted_opts,
+    const KwsInvertedIndex &inverted_index,
+    const std::vector<std::vector<int32> > &words,
+    const std::vector<double> &costs,
+    std::vector<std::vector<KwsSearchResult> > *all_results,
+    std::vector<bool> *found) {
+  for (size_t k = 0; k < words.size(); k++) {
+    if (words[k].empty()) continue;
+    std::vector<KwsSearchResult> &results = (*all_results)[k];
+    inverted_index.Search(opts, inverted_opts, words[k], costs[k], &results);
+    if (!results.empty()) (*found)[k] = true;
+    MergeKwsSearchResults(opts.n_best, &results);
+  }
 }
 
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
     using namespace fst;
     typedef kaldi::int32 int32;
-    typedef kaldi::uint32 uint32;
-    typedef kaldi::uint64 uint64;
-    typedef KwsLexicographicArc Arc;
-    typedef Arc::Weight Weight;
-    typedef Arc::StateId StateId;
 
     const char *usage =
         "Search the keywords over the index. This program can be executed parallely, either\n"
         "on the index side or the keywords side; we use a script to combine the final search\n"
-        "results. Note that the index archive has a only key \"global\".\n"
+        "results.  The index archive may have a single key \"global\", as written by\n"
+        "kws-index-union, or it may be sharded (see kws-index-union --max-utts-per-shard),\n"
+        "in which case the shards are read one at a time, searched in parallel (see\n"
+        "--num-threads), and the results for each keyword merged, keeping the n-best.\n"
+        "Note: every index in the archive is searched.\n"
+        "With --inverted-index (as written by lattice-to-kws-index for the same\n"
+        "utterances), keywords of up to --inverted-max-words words are looked up in\n"
+        "it instead; it is read --inverted-max-utts-per-shard utterances at a time.\n"
         "The output file is in the format:\n"
         "kw utterance_id beg_frame end_frame negated_log_probs\n"
         " e.g.: KW1 1 23 67 0.6074219\n"
@@ -94,37 +143,25 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
 
-    int32 n_best = -1;
-    int32 keyword_nbest = -1;
+    KwsSearchOptions search_opts;
+    KwsInvertedSearchOptions inverted_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     bool strict = true;
-    double negative_tolerance = -0.1;
-    double keyword_beam = -1;
-    
-    po.Register("nbest", &n_best, "Return the best n hypotheses.");
-    po.Register("keyword-nbest", &keyword_nbest,
-                "Pick the best n keywords if the FST contains multiple keywords.");
+    std::string inverted_index_rspecifier;
+
+    search_opts.Register(&po);
+    inverted_opts.Register(&po);
+    sequencer_config.Register(&po);
+    po.Register("inverted-index", &inverted_index_rspecifier, "Rspecifier of "
+                "inverted indexes, as written by lattice-to-kws-index, for the "
+                "utterances in the index; if given, short keywords are looked "
+                "up in them (see --inverted-max-words).");
     po.Register("strict", &strict, "Affects the return status of the program.");
-    po.Register("negative-tolerance", &negative_tolerance, 
-                "The program will print a warning if we get negative score smaller "
-                "than this tolerance.");
-    po.Register("keyword-beam", &keyword_beam,
-                "Prune the FST with the given beam if the FST contains multiple keywords.");
-
-    if (n_best < 0 && n_best != -1) {
-      KALDI_ERR << "Bad number for nbest";
-      exit (1);
-    }
-    if (keyword_nbest < 0 && keyword_nbest != -1) {
-      KALDI_ERR << "Bad number for keyword-nbest";
-      exit (1);
-    }
-    if (keyword_beam < 0 && keyword_beam != -1) {
-      KALDI_ERR << "Bad number for keyword-beam";
-      exit (1);
-    }
 
     po.Read(argc, argv);
 
+    search_opts.Check();
+
     if (po.NumArgs() < 3 || po.NumArgs() > 4) {
       po.PrintUsage();
       exit(1);
@@ -134,117 +171,119 @@ int main(int argc, char *argv[]) {
         keyword_rspecifier = po.GetOptArg(2),
         result_wspecifier = po.GetOptArg(3);
 
-    RandomAccessTableReader< VectorFstTplHolder<KwsLexicographicArc> > index_reader(index_rspecifier);
-    SequentialTableReader<VectorFstHolder> keyword_reader(keyword_rspecifier);
-    TableWriter< BasicVectorHolder<double> > result_writer(result_wspecifier);
-
-    // Index has key "global"
-    KwsLexicographicFst index = index_reader.Value("global");
-    
-    // First we have to remove the disambiguation symbols. But rather than
-    // removing them totally, we actually move them from input side to output
-    // side, making the output symbol a "combined" symbol of the disambiguation
-    // symbols and the utterance id's.
-    // Note that in Dogan and Murat's original paper, they simply remove the
-    // disambiguation symbol on the input symbol side, which will not allow us
-    // to do epsilon removal after composition with the keyword FST. They have
-    // to traverse the resulting FST.
-    int32 label_count = 1;
-    unordered_map<uint64, uint32> label_encoder;
-    unordered_map<uint32, uint64> label_decoder;
-    for (StateIterator<KwsLexicographicFst> siter(index); !siter.Done(); siter.Next()) {
-      StateId state_id = siter.Value();
-      for (MutableArcIterator<KwsLexicographicFst> 
-           aiter(&index, state_id); !aiter.Done(); aiter.Next()) {
-        Arc arc = aiter.Value();
-        // Skip the non-final arcs
-        if (index.Final(arc.nextstate) == Weight::Zero())
-          continue;
-        // Encode the input and output label of the final arc, and this is the
-        // new output label for this arc; set the input label to <epsilon>
-        uint64 osymbol = EncodeLabel(arc.ilabel, arc.olabel);
-        arc.ilabel = 0;
-        if (label_encoder.find(osymbol) == label_encoder.end()) {
-          arc.olabel = label_count;
-          label_encoder[osymbol] = label_count;
-          label_decoder[label_count] = osymbol;
-          label_count++;
-        } else { 
-          arc.olabel = label_encoder[osymbol];
-        }
-        aiter.SetValue(arc);
+    // The keywords are read first, as they are searched for in each shard of
+    // the index.
+    std::vector<std::string> keyword_keys;
+    std::vector<KwsLexicographicFst*> keywords;
+    {
+      SequentialTableReader<VectorFstHolder> keyword_reader(keyword_rspecifier);
+      for (; !keyword_reader.Done(); keyword_reader.Next()) {
+        keyword_keys.push_back(keyword_reader.Key());
+        keywords.push_back(new KwsLexicographicFst());
+        PrepareKeywordForSearch(search_opts, keyword_reader.Value(),
+                                keywords.back());
       }
     }
-    ArcSort(&index, fst::ILabelCompare<KwsLexicographicArc>());
-    
-    int32 n_done = 0;
-    int32 n_fail = 0;
-    for (; !keyword_reader.Done(); keyword_reader.Next()) {
-      std::string key = keyword_reader.Key();
-      VectorFst<StdArc> keyword = keyword_reader.Value();
-      keyword_reader.FreeCurrent();
 
-      // Process the case where we have confusion for keywords
-      if (keyword_beam != -1) {
-        Prune(&keyword, keyword_beam);
-      }
-      if (keyword_nbest != -1) {
-        VectorFst<StdArc> tmp;
-        ShortestPath(keyword, &tmp, keyword_nbest, true, true);
-        keyword = tmp;
+    std::vector<std::vector<KwsSearchResult> > all_results(keywords.size());
+    std::vector<bool> found(keywords.size(), false);
+
+    // Keywords that are a short sequence of words are looked up in the
+    // inverted index, if we have one, and are not searched for in the index.
+    // Like the index, the inverted index is read in shards (of
+    // --inverted-max-utts-per-shard utterances), so that only one shard is in
+    // memory at a time.
+    int32 num_inverted = 0;
+    if (inverted_index_rspecifier != "") {
+      std::vector<std::vector<int32> > inverted_words(keywords.size());
+      std::vector<double> inverted_costs(keywords.size(), 0.0);
+      for (size_t k = 0; k < keywords.size(); k++) {
+        std::vector<int32> isymbols, osymbols;
+        KwsLexicographicWeight weight;
+        if (!GetLinearSymbolSequence(*(keywords[k]), &isymbols, &osymbols,
+                                     &weight) ||
+            isymbols != osymbols || isymbols.empty() ||
+            static_cast<int32>(isymbols.size()) > inverted_opts.max_words ||
+            weight == KwsLexicographicWeight::Zero())
+          continue;
+        inverted_words[k] = isymbols;
+        inverted_costs[k] = weight.Value1().Value();
+        delete keywords[k];
+        keywords[k] = NULL;
+        num_inverted++;
       }
 
-      KwsLexicographicFst keyword_fst;
-      KwsLexicographicFst result_fst;
-      Map(keyword, &keyword_fst, VectorFstToKwsLexicographicFstMapper());
-      Compose(keyword_fst, index, &result_fst);
-      Project(&result_fst, PROJECT_OUTPUT);
-      Minimize(&result_fst);
-      ShortestPath(result_fst, &result_fst, n_best);
-      RmEpsilon(&result_fst);
-
-      // No result found
-      if (result_fst.Start() == kNoStateId)
-        continue;
-
-      // Got something here
-      double score;
-      int32 tbeg, tend, uid;
-      for (ArcIterator<KwsLexicographicFst> 
-           aiter(result_fst, result_fst.Start()); !aiter.Done(); aiter.Next()) {
-        const Arc &arc = aiter.Value();
-
-        // We're expecting a two-state FST
-        if (result_fst.Final(arc.nextstate) != Weight::One()) {
-          KALDI_WARN << "The resulting FST does not have the expected structure for key " << key;
-          n_fail++;
-          continue;
+      SequentialTableReader<KaldiObjectHolder<KwsInvertedIndex> >
+          inverted_index_reader(inverted_index_rspecifier);
+      KwsInvertedIndex inverted_index;
+      int32 num_utts = 0, num_inverted_shards = 0;
+      while (true) {
+        bool done = inverted_index_reader.Done();
+        if (!done) {
+          inverted_index.Add(inverted_index_reader.Value());
+          num_utts++;
+          inverted_index_reader.Next();
+        }
+        if (num_utts > 0 &&
+            (done || num_utts == inverted_opts.max_utts_per_shard)) {
+          SearchInvertedIndexShard(search_opts, inverted_opts, inverted_index,
+                                   inverted_words, inverted_costs,
+                                   &all_results, &found);
+          inverted_index.Clear();
+          num_utts = 0;
+          num_inverted_shards++;
         }
+        if (done) break;
+      }
+      KALDI_VLOG(1) << "Searched " << num_inverted_shards
+                    << " shards of the inverted index.";
+    }
 
-        uint64 osymbol = label_decoder[arc.olabel];
-        uid = (int32)DecodeLabelUid(osymbol);
-        tbeg = arc.weight.Value2().Value1().Value();
-        tend = arc.weight.Value2().Value2().Value();
-        score = arc.weight.Value1().Value();
+    SequentialTableReader< VectorFstTplHolder<KwsLexicographicArc> >
+        index_reader(index_rspecifier);
+    TableWriter< BasicVectorHolder<double> > result_writer(result_wspecifier);
 
-        if (score < 0) {
-          if (score < negative_tolerance) {
-            KALDI_WARN << "Score out of expected range: " << score;
-          }
-          score = 0.0;
-        }
-        vector<double> result;
-        result.push_back(uid);
-        result.push_back(tbeg);
-        result.push_back(tend);
-        result.push_back(score);
-        result_writer.Write(key, result);
+    int32 num_shards = 0, n_fail = 0;
+    {
+      TaskSequencer<KwsSearchShardTask> sequencer(sequencer_config);
+      for (; !index_reader.Done(); index_reader.Next()) {
+        // Will give ownership to "task" below.  We make a deep copy
+        // (constructing from the Fst base class), because OpenFst's reference
+        // counting is not thread-safe.
+        const Fst<KwsLexicographicArc> &value = index_reader.Value();
+        KwsLexicographicFst *index = new KwsLexicographicFst(value);
+        index_reader.FreeCurrent();
+        sequencer.Run(new KwsSearchShardTask(search_opts, keyword_keys,
+                                             keywords, index_reader.Key(),
+                                             index, &all_results, &found,
+                                             &n_fail));
+        num_shards++;
       }
+      sequencer.Wait();
+    }
+    if (num_shards == 0)
+      KALDI_WARN << "No index was read from " << index_rspecifier;
 
-      n_done++;
+    int32 n_done = 0;
+    for (size_t k = 0; k < keywords.size(); k++) {
+      for (size_t i = 0; i < all_results[k].size(); i++) {
+        const KwsSearchResult &r = all_results[k][i];
+        std::vector<double> result;
+        result.push_back(r.uid);
+        result.push_back(r.tbeg);
+        result.push_back(r.tend);
+        result.push_back(r.score);
+        result_writer.Write(keyword_keys[k], result);
+      }
+      if (found[k]) n_done++;
+      delete keywords[k];  // may be NULL.
     }
 
-    KALDI_LOG << "Done " << n_done << " keywords";
+    KALDI_LOG << "Done " << n_done << " keywords, searching " << num_shards
+              << " index shards";
+    if (inverted_index_rspecifier != "")
+      KALDI_LOG << "Looked up " << num_inverted << " of " << keywords.size()
+                << " keywords in the inverted index.";
     if (strict == true)
       return (n_done != 0 ? 0 : 1);
     else
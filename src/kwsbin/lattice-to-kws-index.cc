@@ -1,7 +1,7 @@
 // kwsbin/lattice-to-kws-index.cc
 
-// Copyright 2012  Johns Hopkins University (Author: Guoguo Chen)
-//                 Lucas Ondel
+// Copyright 2012-2015  Johns Hopkins University (Author: Guoguo Chen)
+//                      Lucas Ondel
 
 // See ../../COPYING for clarification regarding multiple authors
 //
@@ -26,7 +26,162 @@
 #include "lat/lattice-functions.h"
 #include "kws/kaldi-kws.h"
 #include "kws/kws-functions.h"
+#include "kws/kws-inverted-index.h"
 #include "fstext/epsilon-property.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+// Creates the index of one lattice; the steps are those of Dogan and Murat's
+// paper (see the comments below).
+class LatticeToKwsIndexTask {
+ public:
+  // Initializer takes ownership of "clat".
+  LatticeToKwsIndexTask(int32 max_silence_frames, int32 max_states,
+                        bool allow_partial, const std::string &key,
+                        int32 utterance_id, CompactLattice *clat,
+                        TableWriter< fst::VectorFstTplHolder<KwsLexicographicArc> >
+                        *index_writer,
+                        TableWriter<KaldiObjectHolder<KwsInvertedIndex> >
+                        *inverted_index_writer,
+                        int32 *num_done, int32 *num_fail):
+      max_silence_frames_(max_silence_frames), max_states_(max_states),
+      allow_partial_(allow_partial), key_(key), utterance_id_(utterance_id),
+      clat_(clat), index_writer_(index_writer),
+      inverted_index_writer_(inverted_index_writer), num_done_(num_done),
+      num_fail_(num_fail), num_errors_(0), done_(false) { }
+
+  void operator () () {
+    CompactLattice &clat = *clat_;
+    // Topologically sort the lattice, if not already sorted.
+    uint64 props = clat.Properties(fst::kFstProperties, false);
+    if (!(props & fst::kTopSorted)) {
+      if (fst::TopSort(&clat) == false) {
+        KALDI_WARN << "Cycles detected in lattice " << key_;
+        num_errors_ = 1;
+        return;
+      }
+    }
+
+    // Get the alignments
+    vector<int32> state_times;
+    CompactLatticeStateTimes(clat, &state_times);
+
+    // Cluster the arcs in the CompactLattice, write the cluster_id on the
+    // output label side.
+    // ClusterLattice() corresponds to the second part of the preprocessing in
+    // Dogan and Murat's paper -- clustering. Note that we do the first part
+    // of preprocessing (the weight pushing step) later when generating the
+    // factor transducer.
+    KALDI_VLOG(1) << "Arc clustering...";
+    bool success = false;
+    success = ClusterLattice(&clat, state_times);
+    if (!success) {
+      KALDI_WARN << "State id's and alignments do not match for lattice "
+                 << key_;
+      num_errors_ = 1;
+      return;
+    }
+
+    // The next part is something new, not in the Dogan and Can paper.  It is
+    // necessary because we have epsilon arcs, due to silences, in our
+    // lattices.  We modify the factor transducer, while maintaining
+    // equivalence, to ensure that states don't have both epsilon *and*
+    // non-epsilon arcs entering them.  (and the same, with "entering"
+    // replaced with "leaving").  Later we will find out which states have
+    // non-epsilon arcs leaving/entering them and use it to be more selective
+    // in adding arcs to connect them with the initial/final states.  The goal
+    // here is to disallow silences at the beginning or ending of a keyword
+    // occurrence.
+    if (true) {
+      EnsureEpsilonProperty(&clat);
+      fst::TopSort(&clat);
+      // We have to recompute the state times because they will have changed.
+      CompactLatticeStateTimes(clat, &state_times);
+    }
+
+    // Generate factor transducer
+    // CreateFactorTransducer() corresponds to the "Factor Generation" part of
+    // Dogan and Murat's paper. But we also move the weight pushing step to
+    // this function as we have to compute the alphas and betas anyway.
+    KALDI_VLOG(1) << "Generating factor transducer...";
+    KwsProductFst factor_transducer;
+    success = CreateFactorTransducer(clat, state_times, utterance_id_,
+                                     &factor_transducer);
+    if (!success) {
+      KALDI_WARN << "Cannot generate factor transducer for lattice " << key_;
+      num_errors_++;
+    }
+    delete clat_;
+    clat_ = NULL;
+
+    MaybeDoSanityCheck(factor_transducer);
+
+    // Remove long silence arc
+    // We add the filtering step in our implementation. This is because gap
+    // between two successive words in a query term should be less than 0.5s
+    KALDI_VLOG(1) << "Removing long silence...";
+    RemoveLongSilences(max_silence_frames_, state_times, &factor_transducer);
+
+    MaybeDoSanityCheck(factor_transducer);
+
+    // Do factor merging, and return a transducer in T*T*T semiring. This step
+    // corresponds to the "Factor Merging" part in Dogan and Murat's paper.
+    KALDI_VLOG(1) << "Merging factors...";
+    DoFactorMerging(&factor_transducer, &index_transducer_);
+
+    MaybeDoSanityCheck(index_transducer_);
+
+    // Do factor disambiguation. It corresponds to the "Factor Disambiguation"
+    // step in Dogan and Murat's paper.
+    KALDI_VLOG(1) << "Doing factor disambiguation...";
+    DoFactorDisambiguation(&index_transducer_);
+
+    MaybeDoSanityCheck(index_transducer_);
+
+    // Optimize the above factor transducer. It corresponds to the
+    // "Optimization" step in the paper.
+    KALDI_VLOG(1) << "Optimizing factor transducer...";
+    OptimizeFactorTransducer(&index_transducer_, max_states_, allow_partial_);
+
+    MaybeDoSanityCheck(index_transducer_);
+
+    // The inverted index, used by kws-search to look up short keywords
+    // without composition.
+    if (inverted_index_writer_ != NULL)
+      inverted_index_.AddIndex(index_transducer_);
+    done_ = true;
+  }
+
+  ~LatticeToKwsIndexTask() {
+    delete clat_;
+    (*num_fail_) += num_errors_;
+    if (done_) {
+      index_writer_->Write(key_, index_transducer_);
+      if (inverted_index_writer_ != NULL)
+        inverted_index_writer_->Write(key_, inverted_index_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  int32 max_silence_frames_;
+  int32 max_states_;
+  bool allow_partial_;
+  std::string key_;
+  int32 utterance_id_;
+  CompactLattice *clat_;  // Owned here.
+  KwsLexicographicFst index_transducer_;
+  KwsInvertedIndex inverted_index_;
+  TableWriter< fst::VectorFstTplHolder<KwsLexicographicArc> > *index_writer_;
+  TableWriter<KaldiObjectHolder<KwsInvertedIndex> > *inverted_index_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+  int32 num_errors_;
+  bool done_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -38,9 +193,14 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Create an inverted index of the given lattices. The output index is in the T*T*T\n"
         "semiring. For details for the semiring, please refer to Dogan Can and Muran Saraclar's"
-        "lattice indexing paper."
+        "lattice indexing paper.\n"
+        "Lattices are indexed in parallel if --num-threads > 1.\n"
+        "\n"
+        "If inverted-index-wspecifier is given, it also writes, for each lattice, an\n"
+        "inverted index (the occurrences of each word) which kws-search can use to look\n"
+        "up short keywords (see kws-search --inverted-index).\n"
         "\n"
-        "Usage: lattice-to-kws-index [options]  utter-symtab-rspecifier lattice-rspecifier index-wspecifier\n"
+        "Usage: lattice-to-kws-index [options]  utter-symtab-rspecifier lattice-rspecifier index-wspecifier [inverted-index-wspecifier]\n"
         " e.g.: lattice-to-kws-index ark:utter.symtab ark:1.lats ark:global.idx\n";
 
     ParseOptions po(usage);
@@ -49,6 +209,7 @@ int main(int argc, char *argv[]) {
     bool strict = true;
     bool allow_partial = true;
     BaseFloat max_states_scale = 4;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     po.Register("max-silence-frames", &max_silence_frames, "Maximum #frames for"
                 " silence arc.");
     po.Register("strict", &strict, "Setting --strict=false will cause successful "
@@ -59,6 +220,7 @@ int main(int argc, char *argv[]) {
                 "limit on the number of states.");
     po.Register("allow-partial", &allow_partial, "Allow partial output if fails"
                 " to determinize, otherwise skip determinization if it fails.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -69,7 +231,8 @@ int main(int argc, char *argv[]) {
 
     std::string usymtab_rspecifier = po.GetOptArg(1),
         lats_rspecifier = po.GetArg(2),
-        index_wspecifier = po.GetOptArg(3);
+        index_wspecifier = po.GetOptArg(3),
+        inverted_index_wspecifier = po.GetOptArg(4);
 
     // We use RandomAccessInt32Reader to read the utterance symtab table.
     RandomAccessInt32Reader usymtab_reader(usymtab_rspecifier);
@@ -78,126 +241,53 @@ int main(int argc, char *argv[]) {
     // structure for the rest of the work
     SequentialCompactLatticeReader clat_reader(lats_rspecifier);
     TableWriter< fst::VectorFstTplHolder<KwsLexicographicArc> > index_writer(index_wspecifier);
+    TableWriter<KaldiObjectHolder<KwsInvertedIndex> > inverted_index_writer;
+    if (inverted_index_wspecifier != "" &&
+        !inverted_index_writer.Open(inverted_index_wspecifier))
+      KALDI_ERR << "Could not open inverted index for writing: "
+                << inverted_index_wspecifier;
 
     int32 n_done = 0;
     int32 n_fail = 0;
+    // Failures counted in this thread; n_fail is updated by the tasks.
+    int32 n_no_uid = 0;
 
     int32 max_states = -1;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice clat = clat_reader.Value();
-      clat_reader.FreeCurrent();
-      KALDI_LOG << "Processing lattice " << key;
+    {
+      TaskSequencer<LatticeToKwsIndexTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        KALDI_LOG << "Processing lattice " << key;
 
-      if (max_states_scale > 0) {
-        max_states = static_cast<int32>(
-            max_states_scale * static_cast<BaseFloat>(clat.NumStates()));
-      }
-
-      // Check if we have the corresponding utterance id.
-      if (!usymtab_reader.HasKey(key)) {
-        KALDI_WARN << "Cannot find utterance id for " << key;
-        n_fail++;
-        continue;
-      }
-
-      // Topologically sort the lattice, if not already sorted.
-      uint64 props = clat.Properties(fst::kFstProperties, false);
-      if (!(props & fst::kTopSorted)) {
-        if (fst::TopSort(&clat) == false) {
-          KALDI_WARN << "Cycles detected in lattice " << key;
-          n_fail++;
+        // Check if we have the corresponding utterance id.
+        if (!usymtab_reader.HasKey(key)) {
+          KALDI_WARN << "Cannot find utterance id for " << key;
+          n_no_uid++;
           continue;
         }
-      } 
-
-      // Get the alignments
-      vector<int32> state_times;
-      CompactLatticeStateTimes(clat, &state_times);
 
-      // Cluster the arcs in the CompactLattice, write the cluster_id on the
-      // output label side.
-      // ClusterLattice() corresponds to the second part of the preprocessing in
-      // Dogan and Murat's paper -- clustering. Note that we do the first part
-      // of preprocessing (the weight pushing step) later when generating the
-      // factor transducer.
-      KALDI_VLOG(1) << "Arc clustering...";
-      bool success = false;
-      success = ClusterLattice(&clat, state_times);
-      if (!success) {
-        KALDI_WARN << "State id's and alignments do not match for lattice " << key;
-        n_fail++;
-        continue;
-      }
+        if (max_states_scale > 0) {
+          max_states = static_cast<int32>(
+              max_states_scale *
+              static_cast<BaseFloat>(clat_reader.Value().NumStates()));
+        }
 
-      // The next part is something new, not in the Dogan and Can paper.  It is
-      // necessary because we have epsilon arcs, due to silences, in our
-      // lattices.  We modify the factor transducer, while maintaining
-      // equivalence, to ensure that states don't have both epsilon *and*
-      // non-epsilon arcs entering them.  (and the same, with "entering"
-      // replaced with "leaving").  Later we will find out which states have
-      // non-epsilon arcs leaving/entering them and use it to be more selective
-      // in adding arcs to connect them with the initial/final states.  The goal
-      // here is to disallow silences at the beginning or ending of a keyword
-      // occurrence.
-      if (true) {
-        EnsureEpsilonProperty(&clat);
-        fst::TopSort(&clat);
-        // We have to recompute the state times because they will have changed.
-        CompactLatticeStateTimes(clat, &state_times);        
+        // We make a deep copy of the lattice (constructing from the Fst base
+        // class), because OpenFst's reference counting is not thread-safe.
+        CompactLattice *clat = new CompactLattice(
+            static_cast<const fst::Fst<CompactLatticeArc>&>(
+                clat_reader.Value()));
+        clat_reader.FreeCurrent();
+        sequencer.Run(new LatticeToKwsIndexTask(
+            max_silence_frames, max_states, allow_partial, key,
+            usymtab_reader.Value(key), clat, &index_writer,
+            (inverted_index_writer.IsOpen() ? &inverted_index_writer : NULL),
+            &n_done, &n_fail));
       }
-      
-      // Generate factor transducer
-      // CreateFactorTransducer() corresponds to the "Factor Generation" part of
-      // Dogan and Murat's paper. But we also move the weight pushing step to
-      // this function as we have to compute the alphas and betas anyway.
-      KALDI_VLOG(1) << "Generating factor transducer...";
-      KwsProductFst factor_transducer;
-      int32 utterance_id = usymtab_reader.Value(key);
-      success = CreateFactorTransducer(clat, state_times, utterance_id, &factor_transducer);
-      if (!success) {
-        KALDI_WARN << "Cannot generate factor transducer for lattice " << key;
-        n_fail++; 
-      }
-
-      MaybeDoSanityCheck(factor_transducer);
-
-      // Remove long silence arc
-      // We add the filtering step in our implementation. This is because gap
-      // between two successive words in a query term should be less than 0.5s
-      KALDI_VLOG(1) << "Removing long silence...";
-      RemoveLongSilences(max_silence_frames, state_times, &factor_transducer);
-
-      MaybeDoSanityCheck(factor_transducer);
-
-      // Do factor merging, and return a transducer in T*T*T semiring. This step
-      // corresponds to the "Factor Merging" part in Dogan and Murat's paper.
-      KALDI_VLOG(1) << "Merging factors...";
-      KwsLexicographicFst index_transducer;
-      DoFactorMerging(&factor_transducer, &index_transducer);
-
-      MaybeDoSanityCheck(index_transducer);
-      
-      // Do factor disambiguation. It corresponds to the "Factor Disambiguation"
-      // step in Dogan and Murat's paper.
-      KALDI_VLOG(1) << "Doing factor disambiguation...";
-      DoFactorDisambiguation(&index_transducer);
-
-      MaybeDoSanityCheck(index_transducer);
-
-      // Optimize the above factor transducer. It corresponds to the
-      // "Optimization" step in the paper.
-      KALDI_VLOG(1) << "Optimizing factor transducer...";
-      OptimizeFactorTransducer(&index_transducer, max_states, allow_partial);
-
-      MaybeDoSanityCheck(index_transducer);      
-      
-      // Write result
-      index_writer.Write(key, index_transducer);  
-
-      n_done++;
+      sequencer.Wait();
     }
+    n_fail += n_no_uid;
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     if (strict == true)
@@ -0,0 +1,113 @@
+// lat/compose-lattice-pruned-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lat/compose-lattice-pruned.h"
+#include "fstext/rand-fst.h"
+
+namespace kaldi {
+
+using namespace fst;
+
+static CompactLattice *RandCompactLattice() {
+  RandFstOptions opts;
+  opts.acyclic = true;
+  Lattice *fst = fst::RandPairFst<LatticeArc>(opts);
+  CompactLattice *cfst = new CompactLattice;
+  ConvertLattice(*fst, cfst);
+  delete fst;
+  TopSort(cfst);
+  return cfst;
+}
+
+// Makes a deterministic acceptor with two states, which accepts (with random
+// weights) most of the words that appear in "clat"; odd words take it to state
+// 1 and even words to state 0.
+static StdVectorFst *RandGrammar(const CompactLattice &clat) {
+  std::set<int32> words;
+  for (StateIterator<CompactLattice> siter(clat); !siter.Done(); siter.Next())
+    for (ArcIterator<CompactLattice> aiter(clat, siter.Value()); !aiter.Done();
+         aiter.Next())
+      if (aiter.Value().olabel != 0) words.insert(aiter.Value().olabel);
+  StdVectorFst *grammar = new StdVectorFst();
+  grammar->AddState();
+  grammar->AddState();
+  grammar->SetStart(0);
+  for (int32 s = 0; s < 2; s++) {
+    grammar->SetFinal(s, TropicalWeight(RandUniform()));
+    for (std::set<int32>::iterator iter = words.begin(); iter != words.end();
+         ++iter) {
+      if (Rand() % 10 == 0) continue;
+      grammar->AddArc(s, StdArc(*iter, *iter, TropicalWeight(RandUniform()),
+                                *iter % 2));
+    }
+  }
+  ArcSort(grammar, ILabelCompare<StdArc>());
+  return grammar;
+}
+
+void TestComposeCompactLatticePruned() {
+  CompactLattice *clat = RandCompactLattice();
+  StdVectorFst *grammar = RandGrammar(*clat);
+
+  CompactLattice composed_clat;
+  {
+    BackoffDeterministicOnDemandFst<StdArc> det_fst(*grammar);
+    ComposeCompactLatticeDeterministic(*clat, &det_fst, &composed_clat);
+  }
+
+  // With a very large beam, the result should be equivalent.
+  ComposeLatticePrunedOptions opts;
+  opts.beam = 1.0e+10;
+  opts.max_arcs = 0;
+  CompactLattice pruned_clat;
+  {
+    BackoffDeterministicOnDemandFst<StdArc> det_fst(*grammar);
+    ComposeCompactLatticePruned(opts, *clat, &det_fst, &pruned_clat);
+  }
+  KALDI_ASSERT(RandEquivalent(composed_clat, pruned_clat, 5, 0.01, Rand(),
+                              100));
+
+  // With a small beam and a small limit on the number of arcs, the output
+  // should be a subset of the full composition, and it should still have a
+  // complete path if the full composition does.
+  opts.beam = RandUniform();
+  opts.max_arcs = 1 + Rand() % 20;
+  {
+    BackoffDeterministicOnDemandFst<StdArc> det_fst(*grammar);
+    ComposeCompactLatticePruned(opts, *clat, &det_fst, &pruned_clat);
+  }
+  KALDI_ASSERT(NumArcs(pruned_clat) <= NumArcs(composed_clat));
+  // (Both outputs are connected, so they have a start state only if they
+  // have a complete path.)
+  KALDI_ASSERT((pruned_clat.Start() == kNoStateId) ==
+               (composed_clat.Start() == kNoStateId));
+
+  delete clat;
+  delete grammar;
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 20; i++)
+    kaldi::TestComposeCompactLatticePruned();
+  std::cout << "Test OK\n";
+}
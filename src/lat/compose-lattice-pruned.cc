@@ -0,0 +1,386 @@
+// lat/compose-lattice-pruned.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <set>
+
+#include "lat/compose-lattice-pruned.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+
+// Returns the cost we use for pruning, of a CompactLattice weight.
+static inline double PruningCost(const CompactLatticeWeight &w,
+                                 BaseFloat acoustic_scale) {
+  return w.Weight().Value1() + acoustic_scale * w.Weight().Value2();
+}
+
+// This class does the work of ComposeCompactLatticePruned().  Besides the
+// pruning described in the header, it makes sure that the output has a complete
+// path whenever the full composition has one, however tight the pruning is.  To
+// do this, some states are "forced", which means that they are expanded
+// whatever their cost.  The start state is forced.  When a forced state is
+// expanded, the one of its successors with the best estimated cost is forced
+// too (and the arc to it is added).  If a forced state turns out to be a dead
+// end (it is not final, and none of its successors can be forced), we go back
+// and force the next best successor of the state(s) that forced it.  This
+// stops as soon as any expanded state is final, because all states are
+// reachable from the start state through the arcs we have added.
+class PrunedCompactLatticeComposer {
+ public:
+  PrunedCompactLatticeComposer(
+      const ComposeLatticePrunedOptions &opts,
+      const CompactLattice &clat,
+      fst::DeterministicOnDemandFst<fst::StdArc> *det_fst,
+      CompactLattice *composed_clat):
+      opts_(opts), clat_(clat), det_fst_(det_fst),
+      composed_clat_(composed_clat), num_arcs_(0), path_complete_(false) { }
+
+  void Compose();
+
+ private:
+  typedef fst::StdArc::StateId StateId;
+  typedef CompactLatticeArc::Weight Weight2;
+  typedef std::pair<StateId, StateId> StatePair;
+  typedef unordered_map<StatePair, StateId, PairHasher<StateId> > MapType;
+
+  enum StateStatus { kPending, kExpanded, kSkipped };
+
+  // An arc we could add from a composed state.
+  struct Successor {
+    double forward_cost;  // forward cost of the destination via this arc.
+    double estimated_cost;
+    StatePair pair;  // the destination, as a pair of states.
+    CompactLatticeArc arc;  // the arc; arc.nextstate is not set.
+  };
+  // Used to sort successors from worst to best.
+  struct SuccessorWorseThan {
+    bool operator () (const Successor &a, const Successor &b) const {
+      return a.estimated_cost > b.estimated_cost;
+    }
+  };
+
+  // Works out the best-path costs from each state of clat_ to the end,
+  // ignoring det_fst_.
+  void ComputeBackwardCosts();
+
+  // Returns the composed state for this pair, creating it (as a pending state)
+  // if it did not exist; if it exists and is still pending, updates its costs
+  // if these are better.
+  StateId FindOrAddState(const StatePair &pair, double forward_cost,
+                         double estimated_cost);
+
+  // Makes a state that was created or skipped wait for expansion.
+  void MakePending(StateId state);
+
+  // Outputs the arcs we could add from "state" (those that det_fst_ accepts).
+  void GetSuccessors(StateId state, std::vector<Successor> *successors);
+
+  // Adds the arc for "successor" from "state", unless "check_duplicate" is
+  // true and it is already there; returns the destination state.
+  StateId AddArc(StateId state, const Successor &successor,
+                 bool check_duplicate);
+
+  // Sets the final-prob of "state", and adds the arcs whose estimated cost is
+  // no more than "cutoff".
+  void ExpandState(StateId state, double cutoff);
+
+  // Sets candidates_[state], for a forced state, from its successors.
+  void SetCandidates(StateId state, const std::vector<Successor> &successors);
+
+  // Forces the best remaining candidate successor of "state", going back to
+  // the states that forced "state" if it has none left.
+  void ForceSuccessors(StateId state);
+
+  const ComposeLatticePrunedOptions &opts_;
+  const CompactLattice &clat_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *det_fst_;
+  CompactLattice *composed_clat_;
+
+  std::vector<double> backward_cost_;  // indexed by state of clat_.
+
+  // The following are indexed by composed state.
+  std::vector<StatePair> pairs_;
+  std::vector<double> forward_cost_;
+  // The forward cost plus the backward cost of the clat_ state; while the
+  // state is pending it is also an element of pending_costs_.
+  std::vector<double> estimated_cost_;
+  std::vector<StateStatus> status_;
+  std::vector<bool> forced_;
+  std::vector<bool> dead_end_;  // true for forced states that are dead ends.
+
+  std::multiset<double> pending_costs_;
+  MapType state_map_;
+  // The queue of states to be expanded, as (clat state, composed state), so
+  // that we take them in topological order; because the clat states of all
+  // predecessors of a state are earlier, its forward cost is final by the time
+  // we expand it.
+  std::priority_queue<StatePair, std::vector<StatePair>,
+                      std::greater<StatePair> > queue_;
+
+  // For forced states: the states that forced them, and the successors we may
+  // still force, best last.
+  unordered_map<StateId, std::vector<StateId> > forced_by_;
+  unordered_map<StateId, std::vector<Successor> > candidates_;
+
+  int32 num_arcs_;
+  bool path_complete_;  // true once some expanded state is final.
+};
+
+void PrunedCompactLatticeComposer::ComputeBackwardCosts() {
+  int32 num_states1 = clat_.NumStates();
+  backward_cost_.resize(num_states1);
+  for (StateId s1 = num_states1 - 1; s1 >= 0; s1--) {
+    double cost = PruningCost(clat_.Final(s1), opts_.acoustic_scale);
+    for (fst::ArcIterator<CompactLattice> aiter(clat_, s1); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      double arc_cost = PruningCost(arc.weight, opts_.acoustic_scale) +
+          backward_cost_[arc.nextstate];
+      if (arc_cost < cost) cost = arc_cost;
+    }
+    backward_cost_[s1] = cost;
+  }
+}
+
+PrunedCompactLatticeComposer::StateId
+PrunedCompactLatticeComposer::FindOrAddState(const StatePair &pair,
+                                             double forward_cost,
+                                             double estimated_cost) {
+  MapType::iterator iter = state_map_.find(pair);
+  if (iter == state_map_.end()) {
+    StateId state = composed_clat_->AddState();
+    state_map_[pair] = state;
+    pairs_.push_back(pair);
+    forward_cost_.push_back(forward_cost);
+    estimated_cost_.push_back(estimated_cost);
+    status_.push_back(kPending);
+    forced_.push_back(false);
+    dead_end_.push_back(false);
+    MakePending(state);
+    return state;
+  }
+  StateId state = iter->second;
+  // A state that was already expanded or skipped keeps its costs; they are
+  // only used for pruning.
+  if (status_[state] == kPending && forward_cost < forward_cost_[state]) {
+    pending_costs_.erase(pending_costs_.find(estimated_cost_[state]));
+    forward_cost_[state] = forward_cost;
+    estimated_cost_[state] = estimated_cost;
+    pending_costs_.insert(estimated_cost);
+  }
+  return state;
+}
+
+void PrunedCompactLatticeComposer::MakePending(StateId state) {
+  status_[state] = kPending;
+  pending_costs_.insert(estimated_cost_[state]);
+  queue_.push(StatePair(pairs_[state].first, state));
+}
+
+void PrunedCompactLatticeComposer::GetSuccessors(
+    StateId state, std::vector<Successor> *successors) {
+  successors->clear();
+  StateId s1 = pairs_[state].first, s2 = pairs_[state].second;
+  for (fst::ArcIterator<CompactLattice> aiter(clat_, s1);
+       !aiter.Done(); aiter.Next()) {
+    const CompactLatticeArc &arc1 = aiter.Value();
+    Successor successor;
+    successor.arc = arc1;
+    StateId next_state2;
+    if (arc1.olabel == 0) {
+      // If the symbol on <arc1> is <epsilon>, we transit to the next state
+      // for <clat>, but keep <det_fst> at the current state.
+      next_state2 = s2;
+    } else {
+      fst::StdArc arc2;
+      if (!det_fst_->GetArc(s2, arc1.olabel, &arc2))
+        continue;
+      next_state2 = arc2.nextstate;
+      successor.arc.weight = Weight2(
+          LatticeWeight(arc1.weight.Weight().Value1() + arc2.weight.Value(),
+                        arc1.weight.Weight().Value2()),
+          arc1.weight.String());
+    }
+    successor.forward_cost = forward_cost_[state] +
+        PruningCost(successor.arc.weight, opts_.acoustic_scale);
+    successor.estimated_cost = successor.forward_cost +
+        backward_cost_[arc1.nextstate];
+    successor.pair = StatePair(arc1.nextstate, next_state2);
+    successors->push_back(successor);
+  }
+}
+
+PrunedCompactLatticeComposer::StateId PrunedCompactLatticeComposer::AddArc(
+    StateId state, const Successor &successor, bool check_duplicate) {
+  StateId next_state = FindOrAddState(successor.pair, successor.forward_cost,
+                                      successor.estimated_cost);
+  CompactLatticeArc arc(successor.arc);
+  arc.nextstate = next_state;
+  if (check_duplicate) {
+    for (fst::ArcIterator<CompactLattice> aiter(*composed_clat_, state);
+         !aiter.Done(); aiter.Next()) {
+      const CompactLatticeArc &other = aiter.Value();
+      if (other.nextstate == arc.nextstate && other.ilabel == arc.ilabel &&
+          other.olabel == arc.olabel && other.weight == arc.weight)
+        return next_state;
+    }
+  }
+  composed_clat_->AddArc(state, arc);
+  num_arcs_++;
+  return next_state;
+}
+
+void PrunedCompactLatticeComposer::ExpandState(StateId state, double cutoff) {
+  StateId s1 = pairs_[state].first, s2 = pairs_[state].second;
+  status_[state] = kExpanded;
+  // We compute the product of the final weights manually since this is more
+  // efficient.
+  const Weight2 &final1 = clat_.Final(s1);
+  if (final1 != Weight2::Zero()) {
+    Weight2 final_weight(LatticeWeight(final1.Weight().Value1() +
+                                       det_fst_->Final(s2).Value(),
+                                       final1.Weight().Value2()),
+                         final1.String());
+    if (final_weight != Weight2::Zero()) {
+      composed_clat_->SetFinal(state, final_weight);
+      path_complete_ = true;
+    }
+  }
+  std::vector<Successor> successors;
+  GetSuccessors(state, &successors);
+  for (size_t i = 0; i < successors.size(); i++)
+    if (successors[i].estimated_cost <= cutoff)
+      AddArc(state, successors[i], false);
+  if (forced_[state] && !path_complete_) {
+    SetCandidates(state, successors);
+    ForceSuccessors(state);
+  }
+}
+
+void PrunedCompactLatticeComposer::SetCandidates(
+    StateId state, const std::vector<Successor> &successors) {
+  std::vector<Successor> &candidates = candidates_[state];
+  const double infinity = std::numeric_limits<double>::infinity();
+  // Successors whose clat state has no path to the end cannot help.
+  for (size_t i = 0; i < successors.size(); i++)
+    if (successors[i].estimated_cost != infinity)
+      candidates.push_back(successors[i]);
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   SuccessorWorseThan());
+}
+
+void PrunedCompactLatticeComposer::ForceSuccessors(StateId state) {
+  // The forced states that need a (new) forced successor.
+  std::vector<StateId> to_force(1, state);
+  while (!to_force.empty() && !path_complete_) {
+    StateId s = to_force.back();
+    to_force.pop_back();
+    std::vector<Successor> &candidates = candidates_[s];
+    bool forced_one = false;
+    while (!candidates.empty() && !forced_one) {
+      Successor successor = candidates.back();
+      candidates.pop_back();
+      StateId next_state = AddArc(s, successor, true);
+      if (forced_[next_state]) {
+        if (dead_end_[next_state])
+          continue;
+        // It is being dealt with already; we will come back to "s" if it
+        // turns out to be a dead end.
+        forced_by_[next_state].push_back(s);
+        forced_one = true;
+        continue;
+      }
+      forced_[next_state] = true;
+      forced_by_[next_state].push_back(s);
+      forced_one = true;
+      if (status_[next_state] == kSkipped) {
+        MakePending(next_state);
+      } else if (status_[next_state] == kExpanded) {
+        // It was expanded before it was forced (and it is not final, or the
+        // path would be complete), so work out its candidates now.
+        std::vector<Successor> successors;
+        GetSuccessors(next_state, &successors);
+        SetCandidates(next_state, successors);
+        to_force.push_back(next_state);
+      }
+      // Otherwise it is pending, and will be expanded because it is forced.
+    }
+    if (!forced_one) {
+      dead_end_[s] = true;
+      candidates_.erase(s);
+      std::vector<StateId> &forced_by = forced_by_[s];
+      to_force.insert(to_force.end(), forced_by.begin(), forced_by.end());
+    }
+  }
+}
+
+void PrunedCompactLatticeComposer::Compose() {
+  KALDI_ASSERT(opts_.beam >= 0.0);
+  composed_clat_->DeleteStates();
+  if (clat_.Start() == fst::kNoStateId) return;
+  if (clat_.Properties(fst::kTopSorted, true) == 0)
+    KALDI_ERR << "Input lattice must be topologically sorted.";
+
+  const double infinity = std::numeric_limits<double>::infinity();
+  ComputeBackwardCosts();
+
+  StatePair start_pair(clat_.Start(), det_fst_->Start());
+  StateId start_state = FindOrAddState(start_pair, 0.0,
+                                       backward_cost_[start_pair.first]);
+  composed_clat_->SetStart(start_state);
+  // If "clat" has no complete path, neither does the full composition.
+  if (backward_cost_[start_pair.first] != infinity)
+    forced_[start_state] = true;
+
+  while (!queue_.empty()) {
+    StateId state = queue_.top().second;
+    queue_.pop();
+    double this_estimated_cost = estimated_cost_[state];
+    pending_costs_.erase(pending_costs_.find(this_estimated_cost));
+    double best_cost = this_estimated_cost;
+    if (!pending_costs_.empty() && *pending_costs_.begin() < best_cost)
+      best_cost = *pending_costs_.begin();
+    bool too_many_arcs = (opts_.max_arcs > 0 && num_arcs_ >= opts_.max_arcs);
+    double cutoff = best_cost + (too_many_arcs ? 0.0 : opts_.beam);
+    bool force = forced_[state] && !path_complete_;
+    if (!force &&
+        (this_estimated_cost > cutoff || this_estimated_cost == infinity)) {
+      status_[state] = kSkipped;  // Don't expand this state.
+      continue;
+    }
+    ExpandState(state, cutoff);
+  }
+  fst::Connect(composed_clat_);
+}
+
+void ComposeCompactLatticePruned(
+    const ComposeLatticePrunedOptions &opts,
+    const CompactLattice &clat,
+    fst::DeterministicOnDemandFst<fst::StdArc> *det_fst,
+    CompactLattice *composed_clat) {
+  KALDI_ASSERT(composed_clat != NULL);
+  PrunedCompactLatticeComposer composer(opts, clat, det_fst, composed_clat);
+  composer.Compose();
+}
+
+}  // namespace kaldi
@@ -0,0 +1,75 @@
+// lat/compose-lattice-pruned.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_LAT_COMPOSE_LATTICE_PRUNED_H_
+#define KALDI_LAT_COMPOSE_LATTICE_PRUNED_H_
+
+#include "base/kaldi-common.h"
+#include "fstext/fstext-lib.h"
+#include "itf/options-itf.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+struct ComposeLatticePrunedOptions {
+  BaseFloat beam;
+  BaseFloat acoustic_scale;
+  int32 max_arcs;
+
+  ComposeLatticePrunedOptions(): beam(8.0), acoustic_scale(0.1),
+                                 max_arcs(100000) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("beam", &beam, "Pruning beam used in composition: states "
+                   "whose estimated best-path cost is more than this much "
+                   "worse than the best are not expanded.");
+    opts->Register("acoustic-scale", &acoustic_scale, "Scale on acoustic "
+                   "costs, used only for pruning.");
+    opts->Register("max-arcs", &max_arcs, "Once the composed lattice has this "
+                   "many arcs, the beam is reduced to zero, so that only the "
+                   "states with the best estimated cost are expanded (this "
+                   "bounds the work per lattice).  If <= 0, no limit.");
+  }
+};
+
+/// This function does the same thing as ComposeCompactLatticeDeterministic()
+/// in lattice-functions.h, but with pruning, so that it does not expand all the
+/// paths of a dense lattice.  "clat" must be topologically sorted.  The states
+/// of the composed lattice are processed in the topological order of the
+/// states of "clat"; the estimated cost of the best path through a composed
+/// state is its forward cost (including the weights of "det_fst") plus the
+/// backward cost of its "clat" state (in which the weights of "det_fst" are
+/// not included), and a state is expanded, and an arc added, only if its
+/// estimated cost is within opts.beam of the best estimate among the states
+/// still waiting to be expanded (or within zero, once the output has
+/// opts.max_arcs arcs).  Costs are graph cost plus opts.acoustic_scale times
+/// acoustic cost.  However tight the pruning, the output has at least one
+/// complete path if the full composition has one: the best successor of the
+/// start state, and recursively of each state reached that way, is always
+/// expanded, and if that leads to a dead end we go back and try the next best.
+void ComposeCompactLatticePruned(
+    const ComposeLatticePrunedOptions &opts,
+    const CompactLattice &clat,
+    fst::DeterministicOnDemandFst<fst::StdArc> *det_fst,
+    CompactLattice *composed_clat);
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_COMPOSE_LATTICE_PRUNED_H_
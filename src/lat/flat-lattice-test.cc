@@ -0,0 +1,118 @@
+// lat/flat-lattice-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lat/flat-lattice.h"
+
+namespace kaldi {
+
+// Generates a random topologically sorted lattice in which all the final
+// states are on the last frame, as forward-backward requires: there are
+// "width" states on each frame after the start state, which has arcs to all
+// of them; state i on frame t always has an arc to state i on frame t+1, and
+// there are some other random arcs between consecutive frames.
+static void RandLattice(Lattice *lat) {
+  int32 num_frames = 1 + Rand() % 10, width = 1 + Rand() % 4;
+  lat->DeleteStates();
+  for (int32 s = 0; s < 1 + num_frames * width; s++)
+    lat->AddState();
+  lat->SetStart(0);
+  for (int32 t = 0; t < num_frames; t++) {
+    int32 this_width = (t == 0 ? 1 : width),
+        this_begin = (t == 0 ? 0 : 1 + (t - 1) * width),
+        next_begin = 1 + t * width;
+    for (int32 i = 0; i < this_width; i++) {
+      for (int32 j = 0; j < width; j++) {
+        if (t > 0 && j != i && Rand() % 2 == 0) continue;
+        LatticeWeight weight(RandUniform() * 5.0, RandUniform() * 5.0);
+        int32 ilabel = 1 + Rand() % 20, olabel = Rand() % 3;
+        lat->AddArc(this_begin + i,
+                    LatticeArc(ilabel, olabel, weight, next_begin + j));
+      }
+    }
+  }
+  for (int32 i = 0; i < width; i++)
+    lat->SetFinal(1 + (num_frames - 1) * width + i,
+                  LatticeWeight(RandUniform(), 0.0));
+}
+
+void TestFlatLatticeForwardBackward() {
+  for (int32 i = 0; i < 10; i++) {
+    Lattice lat;
+    RandLattice(&lat);
+    FlatLattice flat_lat(lat);
+    std::vector<int32> state_times;
+    int32 num_frames = LatticeStateTimes(lat, &state_times);
+    KALDI_ASSERT(flat_lat.NumFrames() == num_frames &&
+                 flat_lat.StateTimes() == state_times);
+
+    Posterior post;
+    double acoustic_like_sum;
+    BaseFloat tot_like = LatticeForwardBackward(flat_lat, &post,
+                                                &acoustic_like_sum);
+    // The posteriors on each frame sum to one.
+    KALDI_ASSERT(static_cast<int32>(post.size()) == num_frames);
+    for (int32 t = 0; t < num_frames; t++) {
+      double sum = 0.0;
+      for (size_t j = 0; j < post[t].size(); j++)
+        sum += post[t][j].second;
+      AssertEqual(sum, 1.0, 0.001);
+    }
+    // Compare the total likelihood with the one computed on the CompactLattice.
+    CompactLattice clat;
+    ConvertLattice(lat, &clat);
+    fst::TopSort(&clat);
+    std::vector<double> clat_beta;
+    KALDI_ASSERT(ComputeCompactLatticeBetas(clat, &clat_beta));
+    AssertEqual(tot_like, clat_beta[0], 0.001);
+    std::vector<double> alpha, beta;
+    AssertEqual(ComputeLatticeAlphas(flat_lat, &alpha), clat_beta[0], 0.001);
+    AssertEqual(ComputeLatticeBetas(flat_lat, &beta), clat_beta[0], 0.001);
+  }
+}
+
+void TestFlatLatticePrune() {
+  for (int32 i = 0; i < 10; i++) {
+    Lattice lat;
+    RandLattice(&lat);
+    BaseFloat beam = RandUniform() * 10.0 + 0.1;
+    FlatLattice flat_lat(lat);
+    KALDI_ASSERT(flat_lat.Prune(beam));
+
+    // PruneLattice() followed by Connect() should remove the same arcs.
+    PruneLattice(beam, &lat);
+    fst::Connect(&lat);
+    FlatLattice flat_lat2(lat);
+    KALDI_ASSERT(flat_lat.NumStates() == flat_lat2.NumStates() &&
+                 flat_lat.NumArcs() == flat_lat2.NumArcs() &&
+                 flat_lat.NumFrames() == flat_lat2.NumFrames());
+    std::vector<double> alpha, alpha2;
+    AssertEqual(ComputeLatticeAlphas(flat_lat, &alpha),
+                ComputeLatticeAlphas(flat_lat2, &alpha2), 0.001);
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  kaldi::TestFlatLatticeForwardBackward();
+  kaldi::TestFlatLatticePrune();
+  std::cout << "Test OK.\n";
+}
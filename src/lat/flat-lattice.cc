@@ -0,0 +1,385 @@
+// lat/flat-lattice.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+
+#include "lat/flat-lattice.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+
+void FlatLattice::Init(const Lattice &lat) {
+  // Make sure the lattice is topologically sorted.
+  if (lat.Properties(fst::kTopSorted, true) == 0)
+    KALDI_ERR << "Input lattice must be topologically sorted.";
+  KALDI_ASSERT(lat.Start() == 0);
+
+  int32 num_states = lat.NumStates(), num_arcs = 0;
+  for (int32 s = 0; s < num_states; s++)
+    num_arcs += lat.NumArcs(s);
+
+  arc_begin_.resize(num_states + 1);
+  arc_nextstate_.resize(num_arcs);
+  arc_ilabel_.resize(num_arcs);
+  arc_olabel_.resize(num_arcs);
+  arc_like_.resize(num_arcs);
+  arc_acoustic_cost_.resize(num_arcs);
+  final_.resize(num_states);
+  state_times_.clear();
+  state_times_.resize(num_states, -1);
+  state_times_[0] = 0;
+
+  int32 a = 0;
+  for (int32 s = 0; s < num_states; s++) {
+    arc_begin_[s] = a;
+    final_[s] = lat.Final(s);
+    int32 cur_time = state_times_[s];
+    for (fst::ArcIterator<Lattice> aiter(lat, s); !aiter.Done();
+         aiter.Next(), a++) {
+      const LatticeArc &arc = aiter.Value();
+      arc_nextstate_[a] = arc.nextstate;
+      arc_ilabel_[a] = arc.ilabel;
+      arc_olabel_[a] = arc.olabel;
+      arc_like_[a] = -ConvertToCost(arc.weight);
+      arc_acoustic_cost_[a] = arc.weight.Value2();
+      // Work out the times as in LatticeStateTimes().
+      int32 next_time = (arc.ilabel != 0 ? cur_time + 1 : cur_time);
+      if (state_times_[arc.nextstate] == -1)
+        state_times_[arc.nextstate] = next_time;
+      else
+        KALDI_ASSERT(state_times_[arc.nextstate] == next_time);
+    }
+  }
+  arc_begin_[num_states] = a;
+  num_frames_ = *std::max_element(state_times_.begin(), state_times_.end());
+}
+
+bool FlatLattice::Prune(BaseFloat beam) {
+  KALDI_ASSERT(beam > 0.0);
+  int32 num_states = NumStates();
+  if (num_states == 0) return false;
+  const double inf = std::numeric_limits<double>::infinity();
+  std::vector<double> forward_cost(num_states, inf),
+      backward_cost(num_states, inf);
+  forward_cost[0] = 0.0;
+  double best_final_cost = inf;
+  for (int32 s = 0; s < num_states; s++) {
+    double this_forward_cost = forward_cost[s];
+    for (int32 a = arc_begin_[s]; a < arc_begin_[s + 1]; a++) {
+      int32 nextstate = arc_nextstate_[a];
+      double next_forward_cost = this_forward_cost - arc_like_[a];
+      if (forward_cost[nextstate] > next_forward_cost)
+        forward_cost[nextstate] = next_forward_cost;
+    }
+    double this_final_cost = this_forward_cost + ConvertToCost(final_[s]);
+    if (this_final_cost < best_final_cost)
+      best_final_cost = this_final_cost;
+  }
+  if (best_final_cost == inf) {
+    *this = FlatLattice();
+    return false;
+  }
+  double cutoff = best_final_cost + beam;
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    double this_backward_cost = ConvertToCost(final_[s]);
+    for (int32 a = arc_begin_[s]; a < arc_begin_[s + 1]; a++) {
+      double arc_backward_cost = backward_cost[arc_nextstate_[a]] -
+          arc_like_[a];
+      if (arc_backward_cost < this_backward_cost)
+        this_backward_cost = arc_backward_cost;
+    }
+    backward_cost[s] = this_backward_cost;
+  }
+
+  // A state survives if the best path through it is within the beam; this is
+  // true of both ends of any arc that survives.  Because we keep the original
+  // order of the states, the new numbering is still topologically sorted and
+  // the start state is still zero.
+  std::vector<int32> new_state(num_states, -1);
+  int32 new_num_states = 0;
+  for (int32 s = 0; s < num_states; s++)
+    if (forward_cost[s] + backward_cost[s] <= cutoff)
+      new_state[s] = new_num_states++;
+  KALDI_ASSERT(new_state[0] == 0);
+
+  int32 a_out = 0;
+  num_frames_ = 0;
+  for (int32 s = 0; s < num_states; s++) {
+    int32 s_out = new_state[s];
+    if (s_out == -1) continue;
+    int32 begin = arc_begin_[s], end = arc_begin_[s + 1];
+    arc_begin_[s_out] = a_out;  // s_out <= s, so we have already read it.
+    for (int32 a = begin; a < end; a++) {
+      int32 nextstate = arc_nextstate_[a];
+      if (forward_cost[s] - arc_like_[a] + backward_cost[nextstate] > cutoff)
+        continue;
+      // a_out <= a, so we overwrite only arcs we have already read.
+      arc_nextstate_[a_out] = new_state[nextstate];
+      arc_ilabel_[a_out] = arc_ilabel_[a];
+      arc_olabel_[a_out] = arc_olabel_[a];
+      arc_like_[a_out] = arc_like_[a];
+      arc_acoustic_cost_[a_out] = arc_acoustic_cost_[a];
+      a_out++;
+    }
+    if (forward_cost[s] + ConvertToCost(final_[s]) > cutoff)
+      final_[s_out] = LatticeWeight::Zero();
+    else
+      final_[s_out] = final_[s];
+    state_times_[s_out] = state_times_[s];
+    num_frames_ = std::max(num_frames_, state_times_[s]);
+  }
+  arc_begin_[new_num_states] = a_out;
+  arc_begin_.resize(new_num_states + 1);
+  arc_nextstate_.resize(a_out);
+  arc_ilabel_.resize(a_out);
+  arc_olabel_.resize(a_out);
+  arc_like_.resize(a_out);
+  arc_acoustic_cost_.resize(a_out);
+  final_.resize(new_num_states);
+  state_times_.resize(new_num_states);
+  return true;
+}
+
+
+double ComputeLatticeAlphas(const FlatLattice &lat,
+                            std::vector<double> *alpha) {
+  int32 num_states = lat.NumStates(), max_time = lat.NumFrames();
+  alpha->clear();
+  alpha->resize(num_states, kLogZeroDouble);
+  double tot_forward_prob = kLogZeroDouble;
+  if (num_states == 0) return tot_forward_prob;
+  (*alpha)[0] = 0.0;
+  for (int32 s = 0; s < num_states; s++) {
+    double this_alpha = (*alpha)[s];
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      int32 nextstate = lat.NextState(a);
+      (*alpha)[nextstate] = LogAdd((*alpha)[nextstate],
+                                   this_alpha + lat.ArcLike(a));
+    }
+    const LatticeWeight &f = lat.Final(s);
+    if (f != LatticeWeight::Zero()) {
+      double final_like = this_alpha - (f.Value1() + f.Value2());
+      tot_forward_prob = LogAdd(tot_forward_prob, final_like);
+      KALDI_ASSERT(lat.StateTime(s) == max_time &&
+                   "Lattice is inconsistent (final-prob not at max_time)");
+    }
+  }
+  return tot_forward_prob;
+}
+
+double ComputeLatticeBetas(const FlatLattice &lat,
+                           std::vector<double> *beta) {
+  int32 num_states = lat.NumStates();
+  beta->resize(num_states);
+  if (num_states == 0) return kLogZeroDouble;
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    const LatticeWeight &f = lat.Final(s);
+    double this_beta = -(f.Value1() + f.Value2());
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      double arc_beta = (*beta)[lat.NextState(a)] + lat.ArcLike(a);
+      this_beta = LogAdd(this_beta, arc_beta);
+    }
+    (*beta)[s] = this_beta;
+  }
+  return (*beta)[0];
+}
+
+
+BaseFloat LatticeForwardBackward(const FlatLattice &lat, Posterior *post,
+                                 double *acoustic_like_sum) {
+  if (acoustic_like_sum) *acoustic_like_sum = 0.0;
+
+  int32 num_states = lat.NumStates(), max_time = lat.NumFrames();
+  std::vector<double> alpha;
+  double tot_forward_prob = ComputeLatticeAlphas(lat, &alpha);
+  std::vector<double> &beta(alpha); // we re-use the same memory for
+  // this, but it's semantically distinct so we name it differently.
+
+  post->clear();
+  post->resize(max_time);
+
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    const LatticeWeight &f = lat.Final(s);
+    double this_alpha = alpha[s],
+        this_beta = -(f.Value1() + f.Value2());
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      double arc_beta = beta[lat.NextState(a)] + lat.ArcLike(a);
+      this_beta = LogAdd(this_beta, arc_beta);
+      int32 transition_id = lat.ILabel(a);
+
+      // The following "if" is an optimization to avoid un-needed exp().
+      if (transition_id != 0 || acoustic_like_sum != NULL) {
+        double posterior = Exp(this_alpha + arc_beta - tot_forward_prob);
+
+        if (transition_id != 0) // Arc has a transition-id on it [not epsilon]
+          (*post)[lat.StateTime(s)].push_back(
+              std::make_pair(transition_id,
+                             static_cast<BaseFloat>(posterior)));
+        if (acoustic_like_sum != NULL)
+          *acoustic_like_sum -= posterior * lat.ArcAcousticCost(a);
+      }
+    }
+    if (acoustic_like_sum != NULL && f != LatticeWeight::Zero()) {
+      double final_logprob = - ConvertToCost(f),
+          posterior = Exp(this_alpha + final_logprob - tot_forward_prob);
+      *acoustic_like_sum -= posterior * f.Value2();
+    }
+    beta[s] = this_beta;
+  }
+  double tot_backward_prob = (num_states == 0 ? kLogZeroDouble : beta[0]);
+  if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-8)) {
+    KALDI_WARN << "Total forward probability over lattice = " << tot_forward_prob
+              << ", while total backward probability = " << tot_backward_prob;
+  }
+  // Now combine any posteriors with the same transition-id.
+  for (int32 t = 0; t < max_time; t++)
+    MergePairVectorSumming(&((*post)[t]));
+  return tot_backward_prob;
+}
+
+
+BaseFloat LatticeForwardBackwardMpeVariants(
+    const TransitionModel &trans,
+    const std::vector<int32> &silence_phones,
+    const FlatLattice &lat,
+    const std::vector<int32> &num_ali,
+    std::string criterion,
+    bool one_silence_class,
+    Posterior *post) {
+  KALDI_ASSERT(criterion == "mpfe" || criterion == "smbr");
+  bool is_mpfe = (criterion == "mpfe");
+
+  int32 num_states = lat.NumStates(), num_arcs = lat.NumArcs(),
+      max_time = lat.NumFrames();
+  KALDI_ASSERT(max_time == static_cast<int32>(num_ali.size()));
+  std::vector<double> alpha, beta,
+      alpha_smbr(num_states, 0), //forward variable for sMBR
+      beta_smbr(num_states, 0); //backward variable for sMBR
+
+  double tot_forward_score = 0;
+
+  post->clear();
+  post->resize(max_time);
+
+  // First Pass Forward,
+  double tot_forward_prob = ComputeLatticeAlphas(lat, &alpha);
+  // First Pass Backward,
+  double tot_backward_prob = ComputeLatticeBetas(lat, &beta);
+  // First Pass Forward-Backward Check
+  // may loose the condition somehow here 1e-6 (was 1e-8)
+  if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-6)) {
+    KALDI_ERR << "Total forward probability over lattice = " << tot_forward_prob
+              << ", while total backward probability = " << tot_backward_prob;
+  }
+
+  // The frame accuracy of each arc, which is needed in both passes below.
+  std::vector<double> arc_acc(num_arcs, 0.0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 cur_time = lat.StateTime(s);
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      int32 transition_id = lat.ILabel(a);
+      if (transition_id == 0) continue;
+      int32 phone = trans.TransitionIdToPhone(transition_id),
+          ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
+      bool phone_is_sil = std::binary_search(silence_phones.begin(),
+                                             silence_phones.end(),
+                                             phone),
+          ref_phone_is_sil = std::binary_search(silence_phones.begin(),
+                                                silence_phones.end(),
+                                                ref_phone),
+          both_sil = phone_is_sil && ref_phone_is_sil;
+      double frame_acc;
+      if (!is_mpfe) { // smbr.
+        int32 pdf = trans.TransitionIdToPdf(transition_id),
+            ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
+        if (!one_silence_class)  // old behavior
+          frame_acc = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
+        else
+          frame_acc = (pdf == ref_pdf || both_sil) ? 1.0 : 0.0;
+      } else {
+        if (!one_silence_class)  // old behavior
+          frame_acc = (phone == ref_phone && !phone_is_sil) ? 1.0 : 0.0;
+        else
+          frame_acc = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
+      }
+      arc_acc[a] = frame_acc;
+    }
+  }
+
+  if (num_states > 0)
+    alpha_smbr[0] = 0.0;
+  // Second Pass Forward, calculate forward for MPFE/SMBR
+  for (int32 s = 0; s < num_states; s++) {
+    double this_alpha = alpha[s];
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      int32 nextstate = lat.NextState(a);
+      double arc_scale = Exp(this_alpha + lat.ArcLike(a) - alpha[nextstate]);
+      alpha_smbr[nextstate] += arc_scale * (alpha_smbr[s] + arc_acc[a]);
+    }
+    const LatticeWeight &f = lat.Final(s);
+    if (f != LatticeWeight::Zero()) {
+      double final_like = this_alpha - (f.Value1() + f.Value2());
+      double arc_scale = Exp(final_like - tot_forward_prob);
+      tot_forward_score += arc_scale * alpha_smbr[s];
+    }
+  }
+  // Second Pass Backward, collect Mpe style posteriors
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      int32 nextstate = lat.NextState(a);
+      double arc_like = lat.ArcLike(a),
+          arc_beta = beta[nextstate] + arc_like,
+          frame_acc = arc_acc[a];
+      double arc_scale = Exp(beta[nextstate] + arc_like - beta[s]);
+      // check arc_scale NAN,
+      // this is to prevent partial paths in Lattices
+      // i.e., paths don't survive to the final state
+      if (KALDI_ISNAN(arc_scale)) arc_scale = 0;
+      beta_smbr[s] += arc_scale * (beta_smbr[nextstate] + frame_acc);
+
+      int32 transition_id = lat.ILabel(a);
+      if (transition_id != 0) { // Arc has a transition-id on it [not epsilon]
+        double posterior = Exp(alpha[s] + arc_beta - tot_forward_prob);
+        double acc_diff = alpha_smbr[s] + frame_acc + beta_smbr[nextstate]
+                               - tot_forward_score;
+        double posterior_smbr = posterior * acc_diff;
+        (*post)[lat.StateTime(s)].push_back(
+            std::make_pair(transition_id,
+                           static_cast<BaseFloat>(posterior_smbr)));
+      }
+    }
+  }
+
+  //Second Pass Forward Backward check
+  double tot_backward_score = (num_states == 0 ? 0.0 : beta_smbr[0]);
+  // may loose the condition somehow here 1e-5/1e-4
+  if (!ApproxEqual(tot_forward_score, tot_backward_score, 1e-4)) {
+    KALDI_ERR << "Total forward score over lattice = " << tot_forward_score
+              << ", while total backward score = " << tot_backward_score;
+  }
+
+  // Output the computed posteriors
+  for (int32 t = 0; t < max_time; t++)
+    MergePairVectorSumming(&((*post)[t]));
+  return tot_forward_score;
+}
+
+
+}  // namespace kaldi
@@ -0,0 +1,141 @@
+// lat/flat-lattice.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_LAT_FLAT_LATTICE_H_
+#define KALDI_LAT_FLAT_LATTICE_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "hmm/posterior.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/**
+   FlatLattice is a read-only copy of a topologically sorted Lattice, stored in
+   compressed-sparse-row form: the arcs leaving state s are arcs
+   ArcBegin(s) ... ArcEnd(s) - 1, and the destination state, input label
+   (transition-id), likelihood and acoustic cost of the arcs are held in
+   separate flat arrays.  The time (frame index) of each state is computed when
+   the lattice is converted.
+
+   The forward-backward style algorithms below make several passes over the
+   arcs; on a FlatLattice each pass is a linear scan of a few arrays, rather
+   than an iteration over the per-state arc vectors of a VectorFst.  The
+   functions in lattice-functions.h that take a Lattice (e.g.
+   LatticeForwardBackward()) convert it and call the versions declared here,
+   so the results are the same; programs that do more than one thing with the
+   same lattice can convert it once and call these directly.
+*/
+class FlatLattice {
+ public:
+  FlatLattice(): arc_begin_(1, 0), num_frames_(0) { }
+
+  /// Calls Init(lat).
+  explicit FlatLattice(const Lattice &lat) { Init(lat); }
+
+  /// Copies the lattice, which must be topologically sorted and start at state
+  /// zero (it is an error otherwise), and works out the state times as in
+  /// LatticeStateTimes().
+  void Init(const Lattice &lat);
+
+  int32 NumStates() const { return arc_begin_.size() - 1; }
+
+  int32 NumArcs() const { return arc_nextstate_.size(); }
+
+  /// The number of frames, which is the maximum over the state times (this is
+  /// what LatticeStateTimes() returns).
+  int32 NumFrames() const { return num_frames_; }
+
+  int32 ArcBegin(int32 s) const { return arc_begin_[s]; }
+  int32 ArcEnd(int32 s) const { return arc_begin_[s + 1]; }
+
+  int32 NextState(int32 a) const { return arc_nextstate_[a]; }
+  /// The transition-id on arc a, or zero for epsilon.
+  int32 ILabel(int32 a) const { return arc_ilabel_[a]; }
+  /// The word label on arc a.
+  int32 OLabel(int32 a) const { return arc_olabel_[a]; }
+  /// The log-likelihood of arc a, i.e. minus the sum of the graph and acoustic
+  /// costs (as -ConvertToCost(arc.weight)).
+  double ArcLike(int32 a) const { return arc_like_[a]; }
+  /// The acoustic cost (weight.Value2()) of arc a.
+  BaseFloat ArcAcousticCost(int32 a) const { return arc_acoustic_cost_[a]; }
+
+  const LatticeWeight &Final(int32 s) const { return final_[s]; }
+  bool IsFinal(int32 s) const { return final_[s] != LatticeWeight::Zero(); }
+
+  int32 StateTime(int32 s) const { return state_times_[s]; }
+  const std::vector<int32> &StateTimes() const { return state_times_; }
+
+  /// Removes the arcs and final-probs that are not within "beam" of the best
+  /// path (like PruneLattice()), and then the states that are no longer on any
+  /// successful path.  The state numbering stays in topological order.
+  /// Returns false if the lattice had no successful path (in which case it is
+  /// left empty).
+  bool Prune(BaseFloat beam);
+
+ private:
+  std::vector<int32> arc_begin_;  // size NumStates() + 1.
+  std::vector<int32> arc_nextstate_;
+  std::vector<int32> arc_ilabel_;
+  std::vector<int32> arc_olabel_;
+  std::vector<double> arc_like_;
+  std::vector<BaseFloat> arc_acoustic_cost_;
+  std::vector<LatticeWeight> final_;
+  std::vector<int32> state_times_;
+  int32 num_frames_;
+};
+
+
+/// Computes the forward log-probabilities of the states (the final-probs are
+/// not included; compare LatticeForwardBackward()).  Returns the total
+/// log-probability of the lattice.
+double ComputeLatticeAlphas(const FlatLattice &lat,
+                            std::vector<double> *alpha);
+
+/// Computes the backward log-probabilities of the states (these include the
+/// final-probs).  Returns (*beta)[0], which is the total log-probability of
+/// the lattice.
+double ComputeLatticeBetas(const FlatLattice &lat,
+                           std::vector<double> *beta);
+
+/// As LatticeForwardBackward() in lattice-functions.h, but on a FlatLattice.
+BaseFloat LatticeForwardBackward(const FlatLattice &lat,
+                                 Posterior *arc_post,
+                                 double *acoustic_like_sum = NULL);
+
+/// As LatticeForwardBackwardMpeVariants() in lattice-functions.h, but on a
+/// FlatLattice.  The frame accuracy of each arc is computed once and shared
+/// between the forward and backward passes.
+BaseFloat LatticeForwardBackwardMpeVariants(
+    const TransitionModel &trans,
+    const std::vector<int32> &silence_phones,
+    const FlatLattice &lat,
+    const std::vector<int32> &num_ali,
+    std::string criterion,
+    bool one_silence_class,
+    Posterior *post);
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_FLAT_LATTICE_H_
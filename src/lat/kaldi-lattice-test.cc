@@ -95,6 +95,42 @@ void TestCompactLatticeTableCross(bool binary) {
   }
 }
 
+// Write in the packed format, read as CompactLattice and as Lattice.
+void TestCompactLatticeTablePacked(bool quantize) {
+  CompactLatticeWriter writer(quantize ? "ark,packed-quantized:tmpf" :
+                              "ark,packed:tmpf");
+  int N = 10;
+  std::vector<CompactLattice*> lat_vec(N);
+  for (int i = 0; i < N; i++) {
+    char buf[2];
+    buf[0] = '0' + i;
+    buf[1] = '\0';
+    std::string key = "key" + std::string(buf);
+    CompactLattice *fst = RandCompactLattice();
+    lat_vec[i] = fst;
+    writer.Write(key, *fst);
+  }
+  writer.Close();
+
+  // The quantized costs are multiples of 0.01, so each is within 0.005 of the
+  // original; otherwise the lattices should be identical.
+  float delta = (quantize ? 0.02 : 0.0);
+  RandomAccessCompactLatticeReader reader("ark:tmpf");
+  RandomAccessLatticeReader lat_reader("ark:tmpf");
+  for (int i = 0; i < N; i++) {
+    char buf[2];
+    buf[0] = '0' + i;
+    buf[1] = '\0';
+    std::string key = "key" + std::string(buf);
+    const CompactLattice &fst = reader.Value(key);
+    KALDI_ASSERT(fst::Equal(fst, *(lat_vec[i]), delta));
+    CompactLattice fst2;
+    ConvertLattice(lat_reader.Value(key), &fst2);
+    KALDI_ASSERT(fst::Equal(fst2, *(lat_vec[i]), delta));
+    delete lat_vec[i];
+  }
+}
+
 // Lattice, binary.
 void TestLatticeTable(bool binary) {
   LatticeWriter writer(binary ? "ark:tmpf" : "ark,t:tmpf");
@@ -167,6 +203,10 @@ int main() {
     TestLatticeTable(binary);
     TestLatticeTableCross(binary);
   }
+  for (int i = 0; i < 2; i++) {
+    bool quantize = (i%2 == 0);
+    TestCompactLatticeTablePacked(quantize);
+  }
   std::cout << "Test OK\n";
   
   unlink("tmpf");
@@ -19,6 +19,9 @@
 // limitations under the License.
 
 
+#include <cmath>
+#include <cstring>
+
 #include "lat/kaldi-lattice.h"
 #include "fst/script/print-impl.h"
 
@@ -311,6 +314,8 @@ bool ReadCompactLattice(std::istream &is, bool binary,
                         CompactLattice **clat) {
   KALDI_ASSERT(*clat == NULL);
   if (binary) {
+    if (is.peek() == '<')  // the packed format starts with "<PackedLat>".
+      return ReadPackedCompactLattice(is, clat);
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading compact lattice: error reading FST header.";
@@ -369,6 +374,285 @@ bool ReadCompactLattice(std::istream &is, bool binary,
 }
 
 
+// The "packed" lattice format.  After the token "<PackedLat>" and the size in
+// bytes of the rest of the data, there is a sequence of unsigned
+// variable-length integers (7 bits per byte, least significant first, with
+// the top bit set on all but the last byte); signed values are zig-zag coded
+// first.  The data is: flags (1 if the weights are quantized), then if
+// quantized the quantum as a raw float; the number of states and the start
+// state; then for each state, (num-arcs * 2 + is-final), the final weight if
+// final, and the arcs.  An arc is (nextstate - state), (ilabel * 2 +
+// [olabel != ilabel]), the olabel if different, and the weight.  A weight is
+// the two costs, then the string as the number of runs followed by
+// (label - previous run's label, run length - 1) for each run.  Unquantized
+// costs are raw floats; quantized costs are the rounded value of cost/quantum,
+// plus one, or zero followed by a raw float if that would not be finite.
+
+static const float kPackedLatticeQuantum = 0.01;
+
+// Limits on what we accept when reading, so that corrupted data cannot make us
+// allocate huge amounts of memory: the longest string in a weight (an arc
+// normally covers a handful of frames, and a whole utterance of this many
+// frames would be about 46 hours long), and the amount of data we read from
+// the stream at a time.
+static const uint64 kPackedLatticeMaxStringLength = 1 << 24;
+static const int64 kPackedLatticeReadChunk = 1 << 20;
+
+static inline uint64 ZigZagEncode(int64 i) {
+  return (static_cast<uint64>(i) << 1) ^ static_cast<uint64>(i >> 63);
+}
+
+static inline int64 ZigZagDecode(uint64 i) {
+  return static_cast<int64>(i >> 1) ^ -static_cast<int64>(i & 1);
+}
+
+static inline void PackUint(uint64 i, std::string *buf) {
+  while (i >= 128) {
+    buf->push_back(static_cast<char>((i & 127) | 128));
+    i >>= 7;
+  }
+  buf->push_back(static_cast<char>(i));
+}
+
+static inline void PackFloat(float f, std::string *buf) {
+  char bytes[sizeof(f)];
+  memcpy(bytes, &f, sizeof(f));
+  buf->append(bytes, sizeof(f));
+}
+
+static inline void PackCost(float cost, float quantum, std::string *buf) {
+  if (quantum != 0.0) {
+    double q = std::floor(cost / quantum + 0.5);
+    if (q > -1.0e15 && q < 1.0e15) {  // false for infinity and NaN.
+      PackUint(ZigZagEncode(static_cast<int64>(q)) + 1, buf);
+      return;
+    }
+    PackUint(0, buf);
+  }
+  PackFloat(cost, buf);
+}
+
+static void PackWeight(const CompactLatticeWeight &w, float quantum,
+                       std::string *buf) {
+  PackCost(w.Weight().Value1(), quantum, buf);
+  PackCost(w.Weight().Value2(), quantum, buf);
+  const std::vector<int32> &str = w.String();
+  size_t num_runs = 0;
+  for (size_t i = 0; i < str.size(); i++)
+    if (i == 0 || str[i] != str[i-1]) num_runs++;
+  PackUint(num_runs, buf);
+  int32 prev_label = 0;
+  for (size_t i = 0; i < str.size(); ) {
+    size_t j = i + 1;
+    while (j < str.size() && str[j] == str[i]) j++;
+    PackUint(ZigZagEncode(static_cast<int64>(str[i]) - prev_label), buf);
+    PackUint(j - i - 1, buf);
+    prev_label = str[i];
+    i = j;
+  }
+}
+
+bool WritePackedCompactLattice(std::ostream &os, bool quantize,
+                               const CompactLattice &clat) {
+  typedef CompactLatticeArc::StateId StateId;
+  float quantum = (quantize ? kPackedLatticeQuantum : 0.0);
+  std::string buf;
+  PackUint(quantize ? 1 : 0, &buf);
+  if (quantize) PackFloat(quantum, &buf);
+  StateId num_states = clat.NumStates();
+  PackUint(num_states, &buf);
+  if (num_states > 0)
+    PackUint(ZigZagEncode(clat.Start()), &buf);
+  for (StateId s = 0; s < num_states; s++) {
+    bool is_final = (clat.Final(s) != CompactLatticeWeight::Zero());
+    PackUint((static_cast<uint64>(clat.NumArcs(s)) << 1) + (is_final ? 1 : 0),
+             &buf);
+    if (is_final) PackWeight(clat.Final(s), quantum, &buf);
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      PackUint(ZigZagEncode(static_cast<int64>(arc.nextstate) - s), &buf);
+      bool same_labels = (arc.olabel == arc.ilabel);
+      PackUint((static_cast<uint64>(arc.ilabel) << 1) + (same_labels ? 0 : 1),
+               &buf);
+      if (!same_labels) PackUint(arc.olabel, &buf);
+      PackWeight(arc.weight, quantum, &buf);
+    }
+  }
+  try {
+    WriteToken(os, true, "<PackedLat>");
+    WriteBasicType(os, true, static_cast<int64>(buf.size()));
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error writing packed lattice: " << e.what();
+    return false;
+  }
+  os.write(buf.data(), buf.size());
+  return os.good();
+}
+
+/// PackedLatticeDecoder reads the values written by the Pack* functions above
+/// from a buffer; instead of checking every value, the caller checks Ok()
+/// (which becomes false if we read past the end) at the end.
+class PackedLatticeDecoder {
+ public:
+  PackedLatticeDecoder(const char *begin, const char *end, float quantum):
+      cur_(begin), end_(end), quantum_(quantum), ok_(true) { }
+
+  void SetQuantum(float quantum) { quantum_ = quantum; }
+
+  uint64 ReadUint() {
+    uint64 ans = 0;
+    for (int32 shift = 0; shift < 64 && cur_ != end_; shift += 7) {
+      unsigned char c = static_cast<unsigned char>(*(cur_++));
+      ans |= static_cast<uint64>(c & 127) << shift;
+      if ((c & 128) == 0) return ans;
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  int64 ReadInt() { return ZigZagDecode(ReadUint()); }
+
+  float ReadFloat() {
+    float f;
+    if (static_cast<size_t>(end_ - cur_) < sizeof(f)) {
+      ok_ = false;
+      return 0.0;
+    }
+    memcpy(&f, cur_, sizeof(f));
+    cur_ += sizeof(f);
+    return f;
+  }
+
+  float ReadCost() {
+    if (quantum_ != 0.0) {
+      uint64 i = ReadUint();
+      if (i != 0) return ZigZagDecode(i - 1) * static_cast<double>(quantum_);
+    }
+    return ReadFloat();
+  }
+
+  void ReadWeight(CompactLatticeWeight *w) {
+    float cost1 = ReadCost(), cost2 = ReadCost();
+    uint64 num_runs = ReadUint();
+    std::vector<int32> str;
+    int32 label = 0;
+    for (uint64 r = 0; r < num_runs && ok_; r++) {
+      label += ReadInt();
+      uint64 run_length = ReadUint() + 1;
+      if (run_length > kPackedLatticeMaxStringLength - str.size()) {
+        ok_ = false;  // the data must be corrupted.
+        break;
+      }
+      str.insert(str.end(), run_length, label);
+    }
+    *w = CompactLatticeWeight(LatticeWeight(cost1, cost2), str);
+  }
+
+  bool Ok() const { return ok_; }
+  bool Done() const { return cur_ == end_; }
+  void SetError() { ok_ = false; }
+
+ private:
+  const char *cur_;
+  const char *end_;
+  float quantum_;
+  bool ok_;
+};
+
+bool ReadPackedCompactLattice(std::istream &is, CompactLattice **clat) {
+  typedef CompactLatticeArc::StateId StateId;
+  KALDI_ASSERT(*clat == NULL);
+  std::string buf;
+  try {
+    ExpectToken(is, true, "<PackedLat>");
+    int64 size;
+    ReadBasicType(is, true, &size);
+    if (size < 0) {
+      KALDI_WARN << "Reading packed lattice: invalid size " << size;
+      return false;
+    }
+    // We read in chunks rather than allocating "size" bytes up front, so that
+    // a corrupted size makes us fail at the end of the stream instead of
+    // trying to allocate it.
+    while (static_cast<int64>(buf.size()) < size) {
+      size_t offset = buf.size(),
+          chunk = std::min(size - static_cast<int64>(offset),
+                           kPackedLatticeReadChunk);
+      buf.resize(offset + chunk);
+      is.read(&(buf[offset]), chunk);
+      if (is.fail()) {
+        KALDI_WARN << "Reading packed lattice: stream failure.";
+        return false;
+      }
+    }
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error reading packed lattice: " << e.what();
+    return false;
+  }
+
+  PackedLatticeDecoder decoder(buf.data(), buf.data() + buf.size(), 0.0);
+  uint64 flags = decoder.ReadUint();
+  if (flags & 1) decoder.SetQuantum(decoder.ReadFloat());
+  uint64 num_states = decoder.ReadUint();
+  // Each state takes at least one byte, which limits the damage if the data is
+  // corrupted.
+  if (!decoder.Ok() || num_states > buf.size()) {
+    KALDI_WARN << "Reading packed lattice: invalid data.";
+    return false;
+  }
+  CompactLattice *ans = new CompactLattice();
+  for (uint64 s = 0; s < num_states; s++)
+    ans->AddState();
+  if (num_states > 0) {
+    int64 start = decoder.ReadInt();
+    if (start < -1 || start >= static_cast<int64>(num_states))
+      decoder.SetError();
+    else
+      ans->SetStart(start);
+  }
+  for (StateId s = 0; s < static_cast<StateId>(num_states) && decoder.Ok();
+       s++) {
+    uint64 i = decoder.ReadUint(), num_arcs = i >> 1;
+    if (i & 1) {
+      CompactLatticeWeight final_weight;
+      decoder.ReadWeight(&final_weight);
+      ans->SetFinal(s, final_weight);
+    }
+    for (uint64 a = 0; a < num_arcs && decoder.Ok(); a++) {
+      CompactLatticeArc arc;
+      int64 nextstate = s + decoder.ReadInt();
+      uint64 labels = decoder.ReadUint();
+      arc.ilabel = labels >> 1;
+      arc.olabel = ((labels & 1) != 0 ? decoder.ReadUint() : arc.ilabel);
+      decoder.ReadWeight(&arc.weight);
+      if (nextstate < 0 || nextstate >= static_cast<int64>(num_states)) {
+        decoder.SetError();
+        break;
+      }
+      arc.nextstate = nextstate;
+      ans->AddArc(s, arc);
+    }
+  }
+  if (!decoder.Ok() || !decoder.Done()) {
+    KALDI_WARN << "Reading packed lattice: invalid data.";
+    delete ans;
+    return false;
+  }
+  *clat = ans;
+  return true;
+}
+
+template<>
+bool WriteTableObject<CompactLatticeHolder>(std::ostream &os,
+                                            const WspecifierOptions &opts,
+                                            const CompactLattice &t) {
+  if (opts.packed && opts.binary)
+    return WritePackedCompactLattice(os, opts.packed_quantize, t);
+  else
+    return CompactLatticeHolder::Write(os, opts.binary, t);
+}
+
 bool CompactLatticeHolder::Read(std::istream &is) {
   Clear(); // in case anything currently stored.
   int c = is.peek();
@@ -380,8 +664,10 @@ bool CompactLatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadCompactLattice(is, false, &t_);
-  } else if (c != 214) { // 214 is first char of FST magic number,
-    // on little-endian machines which is all we support (\326 octal)
+  } else if (c != 214 && c != '<') {
+    // 214 is first char of FST magic number,
+    // on little-endian machines which is all we support (\326 octal).
+    // '<' starts the packed format.
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
                << " [non-space but no magic number detected], file pos is "
                << is.tellg();
@@ -430,6 +716,12 @@ bool ReadLattice(std::istream &is, bool binary,
                  Lattice **lat) {
   KALDI_ASSERT(*lat == NULL);
   if (binary) {
+    if (is.peek() == '<') {  // the packed format starts with "<PackedLat>".
+      CompactLattice *clat = NULL;
+      if (!ReadPackedCompactLattice(is, &clat)) return false;
+      *lat = ConvertToLattice(clat);
+      return true;
+    }
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading lattice: error reading FST header.";
@@ -502,8 +794,10 @@ bool LatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadLattice(is, false, &t_);
-  } else if (c != 214) { // 214 is first char of FST magic number,
-    // on little-endian machines which is all we support (\326 octal)
+  } else if (c != 214 && c != '<') {
+    // 214 is first char of FST magic number,
+    // on little-endian machines which is all we support (\326 octal).
+    // '<' starts the packed format.
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
                << " [non-space but no magic number detected], file pos is "
                << is.tellg();
@@ -65,6 +65,21 @@ bool ReadCompactLattice(std::istream &is, bool binary,
 bool ReadLattice(std::istream &is, bool binary,
                  Lattice **lat);
 
+// WritePackedCompactLattice writes a lattice in the "packed" binary format,
+// which is what the "packed" and "packed-quantized" wspecifier options select
+// for CompactLatticeWriter.  Compared with the OpenFst binary format it uses
+// variable-length integers for labels and for state ids (coded as the
+// difference from the source state), run-length codes the transition-id
+// strings, and (if quantize == true) stores the weights as multiples of 0.01
+// rather than as floats.  It starts with the token "<PackedLat>", and
+// ReadCompactLattice() and ReadLattice() (binary mode), and thus also the
+// lattice Holders, detect it automatically.
+bool WritePackedCompactLattice(std::ostream &os, bool quantize,
+                               const CompactLattice &clat);
+// Reads the format written by WritePackedCompactLattice(); requires that *clat
+// be NULL when called.
+bool ReadPackedCompactLattice(std::istream &is, CompactLattice **clat);
+
 
 class CompactLatticeHolder {
  public:
@@ -126,6 +141,13 @@ class LatticeHolder {
   T *t_;
 };
 
+// Writes in the packed format if the wspecifier has the "packed" or
+// "packed-quantized" option (and is not in text mode).
+template<>
+bool WriteTableObject<CompactLatticeHolder>(std::ostream &os,
+                                            const WspecifierOptions &opts,
+                                            const CompactLattice &t);
+
 typedef TableWriter<LatticeHolder> LatticeWriter;
 typedef SequentialTableReader<LatticeHolder> SequentialLatticeReader;
 typedef RandomAccessTableReader<LatticeHolder> RandomAccessLatticeReader;
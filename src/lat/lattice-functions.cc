@@ -24,6 +24,7 @@
 
 
 #include "lat/lattice-functions.h"
+#include "lat/flat-lattice.h"
 #include "hmm/transition-model.h"
 #include "util/stl-utils.h"
 #include "base/kaldi-math.h"
@@ -274,83 +275,9 @@ BaseFloat LatticeForwardBackward(const Lattice &lat, Posterior *post,
   // Note, Posterior is defined as follows:  Indexed [frame], then a list
   // of (transition-id, posterior-probability) pairs.
   // typedef std::vector<std::vector<std::pair<int32, BaseFloat> > > Posterior;
-  using namespace fst;
-  typedef Lattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
-
-  if (acoustic_like_sum) *acoustic_like_sum = 0.0;
-
-  // Make sure the lattice is topologically sorted.
-  if (lat.Properties(fst::kTopSorted, true) == 0)
-    KALDI_ERR << "Input lattice must be topologically sorted.";
-  KALDI_ASSERT(lat.Start() == 0);
-
-  int32 num_states = lat.NumStates();
-  vector<int32> state_times;
-  int32 max_time = LatticeStateTimes(lat, &state_times);
-  std::vector<double> alpha(num_states, kLogZeroDouble);
-  std::vector<double> &beta(alpha); // we re-use the same memory for
-  // this, but it's semantically distinct so we name it differently.
-  double tot_forward_prob = kLogZeroDouble;
-
-  post->clear();
-  post->resize(max_time);
-
-  alpha[0] = 0.0;
-  // Propagate alphas forward.
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      alpha[arc.nextstate] = LogAdd(alpha[arc.nextstate], this_alpha + arc_like);
-    }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
-      tot_forward_prob = LogAdd(tot_forward_prob, final_like);
-      KALDI_ASSERT(state_times[s] == max_time &&
-                   "Lattice is inconsistent (final-prob not at max_time)");
-    }
-  }
-  for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = lat.Final(s);
-    double this_beta = -(f.Value1() + f.Value2());
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
-      this_beta = LogAdd(this_beta, arc_beta);
-      int32 transition_id = arc.ilabel;
-
-      // The following "if" is an optimization to avoid un-needed exp().
-      if (transition_id != 0 || acoustic_like_sum != NULL) {
-        double posterior = Exp(alpha[s] + arc_beta - tot_forward_prob);
-
-        if (transition_id != 0) // Arc has a transition-id on it [not epsilon]
-          (*post)[state_times[s]].push_back(std::make_pair(transition_id,
-                                                           static_cast<kaldi::BaseFloat>(posterior)));
-        if (acoustic_like_sum != NULL)
-          *acoustic_like_sum -= posterior * arc.weight.Value2();
-      }
-    }
-    if (acoustic_like_sum != NULL && f != Weight::Zero()) {
-      double final_logprob = - ConvertToCost(f),
-          posterior = Exp(alpha[s] + final_logprob - tot_forward_prob);
-      *acoustic_like_sum -= posterior * f.Value2();
-    }
-    beta[s] = this_beta;
-  }
-  double tot_backward_prob = beta[0];
-  if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-8)) {
-    KALDI_WARN << "Total forward probability over lattice = " << tot_forward_prob
-              << ", while total backward probability = " << tot_backward_prob;
-  }
-  // Now combine any posteriors with the same transition-id.
-  for (int32 t = 0; t < max_time; t++)
-    MergePairVectorSumming(&((*post)[t]));
-  return tot_backward_prob;
+  // The work is done on a flat copy of the lattice; see flat-lattice.h.
+  FlatLattice flat_lat(lat);
+  return LatticeForwardBackward(flat_lat, post, acoustic_like_sum);
 }
 
 
@@ -745,177 +672,11 @@ BaseFloat LatticeForwardBackwardMpeVariants(
     std::string criterion,
     bool one_silence_class,
     Posterior *post) {
-  using namespace fst;
-  typedef Lattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
-
-  KALDI_ASSERT(criterion == "mpfe" || criterion == "smbr");
-  bool is_mpfe = (criterion == "mpfe");
-
-  if (lat.Properties(fst::kTopSorted, true) == 0)
-    KALDI_ERR << "Input lattice must be topologically sorted.";
-  KALDI_ASSERT(lat.Start() == 0);
-
-  int32 num_states = lat.NumStates();
-  vector<int32> state_times;
-  int32 max_time = LatticeStateTimes(lat, &state_times);
-  KALDI_ASSERT(max_time == static_cast<int32>(num_ali.size()));
-  std::vector<double> alpha(num_states, kLogZeroDouble),
-      alpha_smbr(num_states, 0), //forward variable for sMBR
-      beta(num_states, kLogZeroDouble),
-      beta_smbr(num_states, 0); //backward variable for sMBR
-
-  double tot_forward_prob = kLogZeroDouble;
-  double tot_forward_score = 0;
-
-  post->clear();
-  post->resize(max_time);
-
-  alpha[0] = 0.0;
-  // First Pass Forward,
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      alpha[arc.nextstate] = LogAdd(alpha[arc.nextstate], this_alpha + arc_like);
-    }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
-      tot_forward_prob = LogAdd(tot_forward_prob, final_like);
-      KALDI_ASSERT(state_times[s] == max_time &&
-                   "Lattice is inconsistent (final-prob not at max_time)");
-    }
-  }
-  // First Pass Backward,
-  for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = lat.Final(s);
-    double this_beta = -(f.Value1() + f.Value2());
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
-      this_beta = LogAdd(this_beta, arc_beta);
-    }
-    beta[s] = this_beta;
-  }
-  // First Pass Forward-Backward Check
-  double tot_backward_prob = beta[0];
-  // may loose the condition somehow here 1e-6 (was 1e-8)
-  if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-6)) {
-    KALDI_ERR << "Total forward probability over lattice = " << tot_forward_prob
-              << ", while total backward probability = " << tot_backward_prob;
-  }
-
-  alpha_smbr[0] = 0.0;
-  // Second Pass Forward, calculate forward for MPFE/SMBR
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      double frame_acc = 0.0;
-      if (arc.ilabel != 0) {
-        int32 cur_time = state_times[s];
-        int32 phone = trans.TransitionIdToPhone(arc.ilabel),
-            ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
-        bool phone_is_sil = std::binary_search(silence_phones.begin(),
-                                               silence_phones.end(),
-                                               phone),
-            ref_phone_is_sil = std::binary_search(silence_phones.begin(),
-                                                  silence_phones.end(),
-                                                  ref_phone),
-            both_sil = phone_is_sil && ref_phone_is_sil;
-        if (!is_mpfe) { // smbr.
-          int32 pdf = trans.TransitionIdToPdf(arc.ilabel),
-              ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
-          if (!one_silence_class)  // old behavior
-            frame_acc = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (pdf == ref_pdf || both_sil) ? 1.0 : 0.0;
-        } else {
-          if (!one_silence_class)  // old behavior
-            frame_acc = (phone == ref_phone && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
-        }
-      }
-      double arc_scale = Exp(alpha[s] + arc_like - alpha[arc.nextstate]);
-      alpha_smbr[arc.nextstate] += arc_scale * (alpha_smbr[s] + frame_acc);
-    }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
-      double arc_scale = Exp(final_like - tot_forward_prob);
-      tot_forward_score += arc_scale * alpha_smbr[s];
-      KALDI_ASSERT(state_times[s] == max_time &&
-                   "Lattice is inconsistent (final-prob not at max_time)");
-    }
-  }
-  // Second Pass Backward, collect Mpe style posteriors
-  for (StateId s = num_states-1; s >= 0; s--) {
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
-      double frame_acc = 0.0;
-      int32 transition_id = arc.ilabel;
-      if (arc.ilabel != 0) {
-        int32 cur_time = state_times[s];
-        int32 phone = trans.TransitionIdToPhone(arc.ilabel),
-            ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
-        bool phone_is_sil = std::binary_search(silence_phones.begin(),
-                                               silence_phones.end(), phone),
-            ref_phone_is_sil = std::binary_search(silence_phones.begin(),
-                                                  silence_phones.end(),
-                                                  ref_phone),
-            both_sil = phone_is_sil && ref_phone_is_sil;
-        if (!is_mpfe) { // smbr.
-          int32 pdf = trans.TransitionIdToPdf(arc.ilabel),
-              ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
-          if (!one_silence_class)  // old behavior
-            frame_acc = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (pdf == ref_pdf || both_sil) ? 1.0 : 0.0;
-        } else {
-          if (!one_silence_class)  // old behavior
-            frame_acc = (phone == ref_phone && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
-        }
-      }
-      double arc_scale = Exp(beta[arc.nextstate] + arc_like - beta[s]);
-      // check arc_scale NAN,
-      // this is to prevent partial paths in Lattices
-      // i.e., paths don't survive to the final state
-      if (KALDI_ISNAN(arc_scale)) arc_scale = 0;
-      beta_smbr[s] += arc_scale * (beta_smbr[arc.nextstate] + frame_acc);
-
-      if (transition_id != 0) { // Arc has a transition-id on it [not epsilon]
-        double posterior = Exp(alpha[s] + arc_beta - tot_forward_prob);
-        double acc_diff = alpha_smbr[s] + frame_acc + beta_smbr[arc.nextstate]
-                               - tot_forward_score;
-        double posterior_smbr = posterior * acc_diff;
-        (*post)[state_times[s]].push_back(std::make_pair(transition_id,
-                                                         static_cast<BaseFloat>(posterior_smbr)));
-      }
-    }
-  }
-
-  //Second Pass Forward Backward check
-  double tot_backward_score = beta_smbr[0];  // Initial state id == 0
-  // may loose the condition somehow here 1e-5/1e-4
-  if (!ApproxEqual(tot_forward_score, tot_backward_score, 1e-4)) {
-    KALDI_ERR << "Total forward score over lattice = " << tot_forward_score
-              << ", while total backward score = " << tot_backward_score;
-  }
-
-  // Output the computed posteriors
-  for (int32 t = 0; t < max_time; t++)
-    MergePairVectorSumming(&((*post)[t]));
-  return tot_forward_score;
+  // The work is done on a flat copy of the lattice; see flat-lattice.h.
+  FlatLattice flat_lat(lat);
+  return LatticeForwardBackwardMpeVariants(trans, silence_phones, flat_lat,
+                                           num_ali, criterion,
+                                           one_silence_class, post);
 }
 
 bool CompactLatticeToWordAlignment(const CompactLattice &clat,
@@ -0,0 +1,245 @@
+// lat/sausages-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "matrix/kaldi-matrix.h"
+#include "lat/sausages.h"
+#include "lat/lattice-functions.h"
+#include "fstext/rand-fst.h"
+
+namespace kaldi {
+
+using namespace fst;
+
+// Returns a random acyclic word lattice (input label == output label) with at
+// least one complete path.
+static CompactLattice *RandWordLattice() {
+  RandFstOptions opts;
+  opts.acyclic = true;
+  opts.allow_empty = false;
+  while (true) {
+    Lattice *lat = RandPairFst<LatticeArc>(opts);
+    Project(lat, PROJECT_OUTPUT);
+    CompactLattice *clat = new CompactLattice;
+    ConvertLattice(*lat, clat);
+    delete lat;
+    Connect(clat);
+    if (clat->Start() != kNoStateId)
+      return clat;
+    delete clat;
+  }
+}
+
+struct ReferenceArc {
+  int32 word;
+  int32 start_node;
+  BaseFloat loglike;
+};
+
+static inline double ReferenceL(int32 a, int32 b) {
+  return (a == b ? 0.0 : 1.0);
+}
+
+// A straightforward implementation of Figures 4 and 5 of the paper (see
+// sausages.h), as MinimumBayesRisk used to do it: the arcs entering each node
+// are a vector of vectors, alpha-dash and beta-dash are matrices allocated
+// here, and the stats for each bin are a map.  Computes the sausage stats
+// "gamma" (indexed from zero) for the hypothesis "words", which should not
+// contain epsilons, and returns the expected edit distance.
+static double ReferenceSausageStats(
+    const CompactLattice &clat_in, const std::vector<int32> &words,
+    std::vector<std::map<int32, double> > *gamma) {
+  // Prepare the lattice in the same way as MinimumBayesRisk does, so that the
+  // states are numbered the same.
+  CompactLattice clat(clat_in);
+  CreateSuperFinal(&clat);
+  if (!(clat.Properties(kFstProperties, false) & kTopSorted)) {
+    bool acyclic = TopSort(&clat);
+    KALDI_ASSERT(acyclic);
+  }
+  int32 N = clat.NumStates();
+  std::vector<std::vector<ReferenceArc> > pre(N + 1);  // index 1...N
+  for (int32 n = 1; n <= N; n++) {
+    for (ArcIterator<CompactLattice> aiter(clat, n - 1); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &carc = aiter.Value();
+      ReferenceArc arc;
+      arc.word = carc.ilabel;
+      arc.start_node = n;
+      arc.loglike = -(carc.weight.Weight().Value1() +
+                      carc.weight.Weight().Value2());
+      pre[carc.nextstate + 1].push_back(arc);
+    }
+  }
+  std::vector<int32> R(1, 0);  // indexed 1...Q, as in the paper.
+  for (size_t i = 0; i < words.size(); i++) {
+    KALDI_ASSERT(words[i] != 0);
+    R.push_back(0);
+    R.push_back(words[i]);
+  }
+  R.push_back(0);
+  int32 Q = static_cast<int32>(R.size()) - 1;
+  // The same constant as MinimumBayesRisk::delta(), with the same rounding.
+  double delta = static_cast<BaseFloat>(1.0e-05);
+
+  Vector<double> alpha(N + 1);
+  Matrix<double> alpha_dash(N + 1, Q + 1), beta_dash(N + 1, Q + 1);
+  Vector<double> alpha_dash_arc(Q + 1), beta_dash_arc(Q + 1);
+  std::vector<int32> b_arc(Q + 1);
+
+  // Figure 4.
+  alpha(1) = 0.0;
+  for (int32 q = 1; q <= Q; q++)
+    alpha_dash(1, q) = alpha_dash(1, q - 1) + ReferenceL(0, R[q]);
+  for (int32 n = 2; n <= N; n++) {
+    double alpha_n = kLogZeroDouble;
+    for (size_t i = 0; i < pre[n].size(); i++)
+      alpha_n = LogAdd(alpha_n,
+                       alpha(pre[n][i].start_node) + pre[n][i].loglike);
+    alpha(n) = alpha_n;
+    for (size_t i = 0; i < pre[n].size(); i++) {
+      const ReferenceArc &arc = pre[n][i];
+      int32 s_a = arc.start_node, w_a = arc.word;
+      for (int32 q = 0; q <= Q; q++) {
+        if (q == 0) {
+          alpha_dash_arc(q) = alpha_dash(s_a, q) + ReferenceL(w_a, 0) + delta;
+        } else {
+          double a1 = alpha_dash(s_a, q - 1) + ReferenceL(w_a, R[q]),
+              a2 = alpha_dash(s_a, q) + ReferenceL(w_a, 0) + delta,
+              a3 = alpha_dash_arc(q - 1) + ReferenceL(0, R[q]);
+          alpha_dash_arc(q) = std::min(a1, std::min(a2, a3));
+        }
+        alpha_dash(n, q) += Exp(alpha(s_a) + arc.loglike - alpha(n)) *
+            alpha_dash_arc(q);
+      }
+    }
+  }
+
+  // Figure 5.
+  gamma->clear();
+  gamma->resize(Q);
+  beta_dash(N, Q) = 1.0;
+  for (int32 n = N; n >= 2; n--) {
+    for (size_t i = 0; i < pre[n].size(); i++) {
+      const ReferenceArc &arc = pre[n][i];
+      int32 s_a = arc.start_node, w_a = arc.word;
+      alpha_dash_arc(0) = alpha_dash(s_a, 0) + ReferenceL(w_a, 0) + delta;
+      for (int32 q = 1; q <= Q; q++) {
+        double a1 = alpha_dash(s_a, q - 1) + ReferenceL(w_a, R[q]),
+            a2 = alpha_dash(s_a, q) + ReferenceL(w_a, 0) + delta,
+            a3 = alpha_dash_arc(q - 1) + ReferenceL(0, R[q]);
+        if (a1 <= a2) {
+          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc(q) = a1; }
+          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+        } else {
+          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc(q) = a2; }
+          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+        }
+      }
+      beta_dash_arc.SetZero();
+      for (int32 q = Q; q >= 1; q--) {
+        beta_dash_arc(q) += Exp(alpha(s_a) + arc.loglike - alpha(n)) *
+            beta_dash(n, q);
+        if (b_arc[q] == 1) {
+          beta_dash(s_a, q - 1) += beta_dash_arc(q);
+          (*gamma)[q - 1][w_a] += beta_dash_arc(q);
+        } else if (b_arc[q] == 2) {
+          beta_dash(s_a, q) += beta_dash_arc(q);
+        } else {
+          beta_dash_arc(q - 1) += beta_dash_arc(q);
+          (*gamma)[q - 1][0] += beta_dash_arc(q);
+        }
+      }
+      beta_dash_arc(0) += Exp(alpha(s_a) + arc.loglike - alpha(n)) *
+          beta_dash(n, 0);
+      beta_dash(s_a, 0) += beta_dash_arc(0);
+    }
+  }
+  beta_dash_arc.SetZero();
+  for (int32 q = Q; q >= 1; q--) {
+    beta_dash_arc(q) += beta_dash(1, q);
+    beta_dash_arc(q - 1) += beta_dash_arc(q);
+    (*gamma)[q - 1][0] += beta_dash_arc(q);
+  }
+  return alpha_dash(N, Q);
+}
+
+// Checks the stats from MinimumBayesRisk for the hypothesis "words" against
+// the reference implementation.
+static void CheckSausageStats(const CompactLattice &clat,
+                              const std::vector<int32> &words) {
+  MinimumBayesRiskOptions opts;
+  opts.decode_mbr = false;  // so the stats are for "words".
+  MinimumBayesRisk mbr(clat, words, opts);
+  KALDI_ASSERT(mbr.GetOneBest() == words);
+
+  std::vector<std::map<int32, double> > ref_gamma;
+  double ref_risk = ReferenceSausageStats(clat, words, &ref_gamma);
+  KALDI_ASSERT(ApproxEqual(mbr.GetBayesRisk(), ref_risk, 1.0e-04));
+
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > > &gamma =
+      mbr.GetSausageStats();
+  KALDI_ASSERT(gamma.size() == ref_gamma.size());
+  for (size_t q = 0; q < gamma.size(); q++) {
+    // Everything in the reference must be in gamma[q] (unless it is
+    // negligible), and vice versa.
+    std::map<int32, double> this_gamma;
+    for (size_t j = 0; j < gamma[q].size(); j++) {
+      KALDI_ASSERT(this_gamma.count(gamma[q][j].first) == 0);
+      this_gamma[gamma[q][j].first] = gamma[q][j].second;
+      if (j > 0)  // sorted from largest to smallest posterior.
+        KALDI_ASSERT(gamma[q][j].second <= gamma[q][j - 1].second);
+    }
+    for (std::map<int32, double>::const_iterator iter = ref_gamma[q].begin();
+         iter != ref_gamma[q].end(); ++iter) {
+      double value = (this_gamma.count(iter->first) != 0 ?
+                      this_gamma[iter->first] : 0.0);
+      KALDI_ASSERT(fabs(value - iter->second) < 1.0e-04);
+    }
+    for (std::map<int32, double>::const_iterator iter = this_gamma.begin();
+         iter != this_gamma.end(); ++iter) {
+      double ref_value = (ref_gamma[q].count(iter->first) != 0 ?
+                          ref_gamma[q][iter->first] : 0.0);
+      KALDI_ASSERT(fabs(iter->second - ref_value) < 1.0e-04);
+    }
+  }
+}
+
+void TestMinimumBayesRiskStats() {
+  CompactLattice *clat = RandWordLattice();
+
+  // The stats for the MAP hypothesis.
+  MinimumBayesRisk map_decoder(*clat, false);
+  CheckSausageStats(*clat, map_decoder.GetOneBest());
+
+  // The stats for a random hypothesis, which need not be in the lattice.
+  std::vector<int32> words(RandInt(0, 4));
+  for (size_t i = 0; i < words.size(); i++)
+    words[i] = RandInt(1, 6);
+  CheckSausageStats(*clat, words);
+
+  delete clat;
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 100; i++)
+    kaldi::TestMinimumBayesRiskStats();
+  std::cout << "Test OK\n";
+}
@@ -20,12 +20,13 @@
 
 #include "lat/sausages.h"
 #include "lat/lattice-functions.h"
+#include "base/timer.h"
 
 namespace kaldi {
 
 // this is Figure 6 in the paper.
 void MinimumBayesRisk::MbrDecode() {
-  
+  Timer timer;
   for (size_t counter = 0; ; counter++) {
     NormalizeEps(&R_);
     AccStats(); // writes to gamma_
@@ -64,6 +65,12 @@ void MinimumBayesRisk::MbrDecode() {
       KALDI_WARN << "Iterating too many times in MbrDecode; stopping.";
       break;
     }
+    if (max_time_ > 0.0 && timer.Elapsed() > max_time_) {
+      KALDI_VLOG(1) << "Stopping MbrDecode after " << (counter + 1)
+                    << " iterations because --max-time=" << max_time_
+                    << " was exceeded.";
+      break;
+    }
   }
   RemoveEps(&R_);
 }
@@ -90,156 +97,177 @@ void MinimumBayesRisk::NormalizeEps(std::vector<int32> *vec) {
   (*vec)[0] = 0;
 }
 
-double MinimumBayesRisk::EditDistance(int32 N, int32 Q,
-                                      Vector<double> &alpha,
-                                      Matrix<double> &alpha_dash,
-                                      Vector<double> &alpha_dash_arc) {
-  alpha(1) = 0.0; // = log(1).  Line 5.
-  alpha_dash(1, 0) = 0.0; // Line 5.
+double MinimumBayesRisk::EditDistance(int32 N, int32 Q) {
+  // alpha_dash(n, q) is alpha_dash[n * stride + q].
+  const int32 stride = Q + 1;
+  double *alpha = &(alpha_[0]), *alpha_dash = &(alpha_dash_[0]),
+      *alpha_dash_arc = &(alpha_dash_arc_[0]);
+  std::fill(alpha_dash_.begin(), alpha_dash_.end(), 0.0);
+  alpha[1] = 0.0; // = log(1).  Line 5.
+  alpha_dash[stride] = 0.0; // Line 5.
   for (int32 q = 1; q <= Q; q++) 
-    alpha_dash(1, q) = alpha_dash(1, q-1) + l(0, r(q)); // Line 7.
+    alpha_dash[stride + q] = alpha_dash[stride + q - 1] + l(0, r(q)); // Line 7.
   for (int32 n = 2; n <= N; n++) {
+    int32 arcs_begin = pre_begin_[n], arcs_end = pre_begin_[n+1];
     double alpha_n = kLogZeroDouble;
-    for (size_t i = 0; i < pre_[n].size(); i++) {
-      const Arc &arc = arcs_[pre_[n][i]];
-      alpha_n = LogAdd(alpha_n, alpha(arc.start_node) + arc.loglike);
+    for (int32 i = arcs_begin; i < arcs_end; i++) {
+      const Arc &arc = arcs_[i];
+      alpha_n = LogAdd(alpha_n, alpha[arc.start_node] + arc.loglike);
     }
-    alpha(n) = alpha_n; // Line 10.
+    alpha[n] = alpha_n; // Line 10.
     // Line 11 omitted: matrix was initialized to zero.
-    for (size_t i = 0; i < pre_[n].size(); i++) {
-      const Arc &arc = arcs_[pre_[n][i]];
+    double *alpha_dash_n = alpha_dash + n * stride;
+    for (int32 i = arcs_begin; i < arcs_end; i++) {
+      const Arc &arc = arcs_[i];
       int32 s_a = arc.start_node, w_a = arc.word;
-      BaseFloat p_a = arc.loglike;
-      for (int32 q = 0; q <= Q; q++) {
-        if (q == 0) {
-          alpha_dash_arc(q) = // line 15.
-              alpha_dash(s_a, q) + l(w_a, 0) + delta();
-        } else {  // a1,a2,a3 are the 3 parts of min expression of line 17.
-          int32 r_q = r(q);
-          double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-              a2 = alpha_dash(s_a, q) + l(w_a, 0) + delta(),
-              a3 = alpha_dash_arc(q-1) + l(0, r_q);
-          alpha_dash_arc(q) = std::min(a1, std::min(a2, a3));
-        }
+      const double *alpha_dash_s_a = alpha_dash + s_a * stride;
+      // The posterior of the arc given its end state, used in line 19.
+      double arc_post = Exp(alpha[s_a] + arc.loglike - alpha_n);
+      alpha_dash_arc[0] = // line 15.
+          alpha_dash_s_a[0] + l(w_a, 0) + delta();
+      alpha_dash_n[0] += arc_post * alpha_dash_arc[0]; // line 19.
+      for (int32 q = 1; q <= Q; q++) {
+        // a1,a2,a3 are the 3 parts of min expression of line 17.
+        int32 r_q = r(q);
+        double a1 = alpha_dash_s_a[q-1] + l(w_a, r_q),
+            a2 = alpha_dash_s_a[q] + l(w_a, 0) + delta(),
+            a3 = alpha_dash_arc[q-1] + l(0, r_q);
+        alpha_dash_arc[q] = std::min(a1, std::min(a2, a3));
         // line 19:
-        alpha_dash(n, q) += Exp(alpha(s_a) + p_a - alpha(n)) * alpha_dash_arc(q);
+        alpha_dash_n[q] += arc_post * alpha_dash_arc[q];
       }
     }
   }
-  return alpha_dash(N, Q); // line 23.
+  return alpha_dash[N * stride + Q]; // line 23.
 }
 
 // Figure 5 in the paper.
 void MinimumBayesRisk::AccStats() {
-  using std::map;
-  
-  int32 N = static_cast<int32>(pre_.size()) - 1,
+  int32 N = static_cast<int32>(pre_begin_.size()) - 2,
       Q = static_cast<int32>(R_.size());
+  const int32 stride = Q + 1;
 
-  Vector<double> alpha(N+1); // index (1...N)
-  Matrix<double> alpha_dash(N+1, Q+1); // index (1...N, 0...Q)
-  Vector<double> alpha_dash_arc(Q+1); // index 0...Q
-  Matrix<double> beta_dash(N+1, Q+1); // index (1...N, 0...Q)
-  Vector<double> beta_dash_arc(Q+1); // index 0...Q
-  vector<char> b_arc(Q+1); // integer in {1,2,3}; index 1...Q
-  vector<map<int32, double> > gamma(Q+1); // temp. form of gamma.
-  // index 1...Q [word] -> occ.
-
+  // The temporaries are class members so that we don't reallocate them on each
+  // iteration; std::vector::resize() does not free memory when shrinking.
+  alpha_.resize(N+1); // index (1...N)
+  alpha_dash_.resize((N+1) * stride); // index (1...N, 0...Q)
+  alpha_dash_arc_.resize(Q+1); // index 0...Q
+  beta_dash_.resize((N+1) * stride); // index (1...N, 0...Q)
+  beta_dash_arc_.resize(Q+1); // index 0...Q
+  b_arc_.resize(Q+1); // integer in {1,2,3}; index 1...Q
+  gamma_tmp_.resize(Q+1); // temp. form of gamma; index 1...Q
   // The tau arrays below are the sums over words of the tau_b
   // and tau_e timing quantities mentioned in Appendix C of
   // the paper... we are using these to get averaged times for
   // the sausage bins, not specifically for the 1-best output.
-  Vector<double> tau_b(Q+1), tau_e(Q+1);
+  tau_b_.resize(Q+1);
+  tau_e_.resize(Q+1);
+  std::fill(beta_dash_.begin(), beta_dash_.end(), 0.0);
+  std::fill(tau_b_.begin(), tau_b_.end(), 0.0);
+  std::fill(tau_e_.begin(), tau_e_.end(), 0.0);
+  for (int32 q = 1; q <= Q; q++)
+    gamma_tmp_[q].clear();
 
-  double Ltmp = EditDistance(N, Q, alpha, alpha_dash, alpha_dash_arc); 
+  double Ltmp = EditDistance(N, Q); 
   if (L_ != 0 && Ltmp > L_) { // L_ != 0 is to rule out 1st iter.
     KALDI_WARN << "Edit distance increased: " << Ltmp << " > "
                << L_;
   }
   L_ = Ltmp;
   KALDI_VLOG(2) << "L = " << L_;
+
+  const double *alpha = &(alpha_[0]), *alpha_dash = &(alpha_dash_[0]);
+  double *alpha_dash_arc = &(alpha_dash_arc_[0]),
+      *beta_dash = &(beta_dash_[0]), *beta_dash_arc = &(beta_dash_arc_[0]),
+      *tau_b = &(tau_b_[0]), *tau_e = &(tau_e_[0]);
+  char *b_arc = &(b_arc_[0]);
+  std::vector<std::pair<int32, double> > *gamma = &(gamma_tmp_[0]);
+
   // omit line 10: zero when initialized.
-  beta_dash(N, Q) = 1.0; // Line 11.
+  beta_dash[N * stride + Q] = 1.0; // Line 11.
   for (int32 n = N; n >= 2; n--) {
-    for (size_t i = 0; i < pre_[n].size(); i++) {
-      const Arc &arc = arcs_[pre_[n][i]];
+    const double *beta_dash_n = beta_dash + n * stride;
+    for (int32 i = pre_begin_[n]; i < pre_begin_[n+1]; i++) {
+      const Arc &arc = arcs_[i];
       int32 s_a = arc.start_node, w_a = arc.word;
-      BaseFloat p_a = arc.loglike;
-      alpha_dash_arc(0) = alpha_dash(s_a, 0) + l(w_a, 0) + delta(); // line 14.
+      const double *alpha_dash_s_a = alpha_dash + s_a * stride;
+      double *beta_dash_s_a = beta_dash + s_a * stride;
+      alpha_dash_arc[0] = alpha_dash_s_a[0] + l(w_a, 0) + delta(); // line 14.
       for (int32 q = 1; q <= Q; q++) { // this loop == lines 15-18.
         int32 r_q = r(q);
-        double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-            a2 = alpha_dash(s_a, q) + l(w_a, 0) + delta(),
-            a3 = alpha_dash_arc(q-1) + l(0, r_q);
+        double a1 = alpha_dash_s_a[q-1] + l(w_a, r_q),
+            a2 = alpha_dash_s_a[q] + l(w_a, 0) + delta(),
+            a3 = alpha_dash_arc[q-1] + l(0, r_q);
         if (a1 <= a2) {
-          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc(q) = a1; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc[q] = a1; }
+          else { b_arc[q] = 3; alpha_dash_arc[q] = a3; }
         } else {
-          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc(q) = a2; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc[q] = a2; }
+          else { b_arc[q] = 3; alpha_dash_arc[q] = a3; }
         }
       }
-      beta_dash_arc.SetZero(); // line 19.
+      std::fill(beta_dash_arc, beta_dash_arc + Q + 1, 0.0); // line 19.
+      double arc_post = Exp(alpha[s_a] + arc.loglike - alpha[n]);
       for (int32 q = Q; q >= 1; q--) {
         // line 21:
-        beta_dash_arc(q) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, q);
+        beta_dash_arc[q] += arc_post * beta_dash_n[q];
         switch (static_cast<int>(b_arc[q])) { // lines 22 and 23:
           case 1:
-            beta_dash(s_a, q-1) += beta_dash_arc(q);
+            beta_dash_s_a[q-1] += beta_dash_arc[q];
             // next: gamma(q, w(a)) += beta_dash_arc(q)
-            AddToMap(w_a, beta_dash_arc(q), &(gamma[q]));
+            AddToGamma(w_a, beta_dash_arc[q], &(gamma[q]));
             // next: accumulating times, see decl for tau_b,tau_e
-            tau_b(q) += state_times_[s_a] * beta_dash_arc(q);
-            tau_e(q) += state_times_[n] * beta_dash_arc(q);
+            tau_b[q] += state_times_[s_a] * beta_dash_arc[q];
+            tau_e[q] += state_times_[n] * beta_dash_arc[q];
             break;
           case 2:
-            beta_dash(s_a, q) += beta_dash_arc(q);
+            beta_dash_s_a[q] += beta_dash_arc[q];
             break;
           case 3:
-            beta_dash_arc(q-1) += beta_dash_arc(q);
+            beta_dash_arc[q-1] += beta_dash_arc[q];
             // next: gamma(q, epsilon) += beta_dash_arc(q)
-            AddToMap(0, beta_dash_arc(q), &(gamma[q]));
+            AddToGamma(0, beta_dash_arc[q], &(gamma[q]));
             // next: accumulating times, see decl for tau_b,tau_e
             // WARNING: there was an error in Appendix C.  If we followed
             // the instructions there the next line would say state_times_[sa], but
             // it would be wrong.  I will try to publish an erratum.
-            tau_b(q) += state_times_[n] * beta_dash_arc(q);
-            tau_e(q) += state_times_[n] * beta_dash_arc(q);
+            tau_b[q] += state_times_[n] * beta_dash_arc[q];
+            tau_e[q] += state_times_[n] * beta_dash_arc[q];
             break;
           default:
             KALDI_ERR << "Invalid b_arc value"; // error in code.
         }
       }
-      beta_dash_arc(0) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, 0);
-      beta_dash(s_a, 0) += beta_dash_arc(0); // line 26.
+      beta_dash_arc[0] += arc_post * beta_dash_n[0];
+      beta_dash_s_a[0] += beta_dash_arc[0]; // line 26.
     }
   }
-  beta_dash_arc.SetZero(); // line 29.
+  std::fill(beta_dash_arc, beta_dash_arc + Q + 1, 0.0); // line 29.
   for (int32 q = Q; q >= 1; q--) {
-    beta_dash_arc(q) += beta_dash(1, q);
-    beta_dash_arc(q-1) += beta_dash_arc(q);
-    AddToMap(0, beta_dash_arc(q), &(gamma[q]));
+    beta_dash_arc[q] += beta_dash[stride + q];
+    beta_dash_arc[q-1] += beta_dash_arc[q];
+    AddToGamma(0, beta_dash_arc[q], &(gamma[q]));
     // the statements below are actually redundant because
     // state_times_[1] is zero.
-    tau_b(q) += state_times_[1] * beta_dash_arc(q);
-    tau_e(q) += state_times_[1] * beta_dash_arc(q);
+    tau_b[q] += state_times_[1] * beta_dash_arc[q];
+    tau_e[q] += state_times_[1] * beta_dash_arc[q];
   }
   for (int32 q = 1; q <= Q; q++) { // a check (line 35)
     double sum = 0.0;
-    for (map<int32, double>::iterator iter = gamma[q].begin();
-         iter != gamma[q].end(); ++iter) sum += iter->second;
+    for (size_t j = 0; j < gamma[q].size(); j++)
+      sum += gamma[q][j].second;
     if (fabs(sum - 1.0) > 0.1)
       KALDI_WARN << "sum of gamma[" << q << ",s] is " << sum;
   }
   // The next part is where we take gamma, and convert
   // to the class member gamma_, which is using a different
   // data structure and indexed from zero, not one.
-  gamma_.clear();
   gamma_.resize(Q);
   for (int32 q = 1; q <= Q; q++) {
-    for (map<int32, double>::iterator iter = gamma[q].begin();
-         iter != gamma[q].end(); ++iter)
-      gamma_[q-1].push_back(std::make_pair(iter->first, static_cast<BaseFloat>(iter->second)));
+    gamma_[q-1].clear();
+    for (size_t j = 0; j < gamma[q].size(); j++)
+      gamma_[q-1].push_back(std::make_pair(gamma[q][j].first,
+                                           static_cast<BaseFloat>(gamma[q][j].second)));
     // sort gamma_[q-1] from largest to smallest posterior.
     GammaCompare comp;
     std::sort(gamma_[q-1].begin(), gamma_[q-1].end(), comp);
@@ -247,11 +275,10 @@ void MinimumBayesRisk::AccStats() {
   // We do the same conversion for the state times tau_b and tau_e:
   // they get turned into the times_ data member, which has zero-based
   // indexing.
-  times_.clear();
   times_.resize(Q);
   for (int32 q = 1; q <= Q; q++) {
-    times_[q-1].first = tau_b(q);
-    times_[q-1].second = tau_e(q);
+    times_[q-1].first = tau_b[q];
+    times_[q-1].second = tau_e[q];
     if (times_[q-1].first > times_[q-1].second) // this is quite bad.
       KALDI_WARN << "Times out of order";
     if (q > 1 && times_[q-2].second > times_[q-1].first) {
@@ -285,12 +312,13 @@ void MinimumBayesRisk::PrepareLatticeAndInitStats(CompactLattice *clat) {
     state_times_[i] = state_times_[i-1];
   
   // Now we convert the information in "clat" into a special internal
-  // format (pre_, post_ and arcs_) which allows us to access the
+  // format (pre_begin_ and arcs_) which allows us to access the
   // arcs preceding any given state.
   // Note: in our internal format the states will be numbered from 1,
   // which involves adding 1 to the OpenFst states.
   int32 N = clat->NumStates();
-  pre_.resize(N+1);
+  std::vector<int32> num_pre(N+2, 0); // number of arcs entering each node.
+  std::vector<Arc> arcs; // arcs in the order of their start nodes.
 
   // Careful: "Arc" is a class-member struct, not an OpenFst type of arc as one
   // would normally assume.
@@ -308,57 +336,82 @@ void MinimumBayesRisk::PrepareLatticeAndInitStats(CompactLattice *clat) {
       // loglike: sum graph/LM and acoustic cost, and negate to
       // convert to loglikes.  We assume acoustic scaling is already done.
 
-      pre_[arc.end_node].push_back(arcs_.size()); // record index of this arc.
-      arcs_.push_back(arc);
+      num_pre[arc.end_node]++;
+      arcs.push_back(arc);
     }
   }
+  // Sort the arcs on end node (stably, so the arcs entering each node stay in
+  // the order of their start nodes) with a counting sort.
+  pre_begin_.resize(N+2);
+  pre_begin_[0] = 0;
+  for (int32 n = 1; n <= N+1; n++)
+    pre_begin_[n] = pre_begin_[n-1] + num_pre[n-1];
+  std::vector<int32> next_pos(pre_begin_.begin(), pre_begin_.end() - 1);
+  arcs_.resize(arcs.size());
+  for (size_t i = 0; i < arcs.size(); i++)
+    arcs_[next_pos[arcs[i].end_node]++] = arcs[i];
 }
 
-MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in, bool do_mbr):
-    do_mbr_(do_mbr) {
-  CompactLattice clat(clat_in); // copy.
-
-  PrepareLatticeAndInitStats(&clat);
-
-  // We don't need to look at clat.Start() or clat.Final(state):
-  // we know clat.Start() == 0 since it's topologically sorted,
-  // and clat.Final(state) is Zero() except for One() at the last-
+void MinimumBayesRisk::InitOneBest(CompactLattice *clat) {
+  // We don't need to look at clat->Start() or clat->Final(state):
+  // we know clat->Start() == 0 since it's topologically sorted,
+  // and clat->Final(state) is Zero() except for One() at the last-
   // numbered state, thanks to CreateSuperFinal and the topological
   // sorting.
+  RemoveAlignmentsFromCompactLattice(clat); // will be more efficient
+  // in best-path if we do this.
+  Lattice lat;
+  ConvertLattice(*clat, &lat); // convert from CompactLattice to Lattice.
+  fst::VectorFst<fst::StdArc> fst;
+  ConvertLattice(lat, &fst); // convert from lattice to normal FST.
+  fst::VectorFst<fst::StdArc> fst_shortest_path;
+  fst::ShortestPath(fst, &fst_shortest_path); // take shortest path of FST.
+  std::vector<int32> alignment, words;
+  fst::TropicalWeight weight;
+  GetLinearSymbolSequence(fst_shortest_path, &alignment, &words, &weight);
+  KALDI_ASSERT(alignment.empty()); // we removed the alignment.
+  R_ = words;
+  L_ = 0.0; // Set current edit-distance to 0 [just so we know
+  // when we're on the 1st iter.]
+}
+
+void MinimumBayesRisk::Init(const CompactLattice &clat_in,
+                            const std::vector<int32> *words) {
+  CompactLattice clat(clat_in); // copy.
 
-  { // Now set R_ to one best in the FST.
-    RemoveAlignmentsFromCompactLattice(&clat); // will be more efficient
-    // in best-path if we do this.
-    Lattice lat;
-    ConvertLattice(clat, &lat); // convert from CompactLattice to Lattice.
-    fst::VectorFst<fst::StdArc> fst;
-    ConvertLattice(lat, &fst); // convert from lattice to normal FST.
-    fst::VectorFst<fst::StdArc> fst_shortest_path;
-    fst::ShortestPath(fst, &fst_shortest_path); // take shortest path of FST.
-    std::vector<int32> alignment, words;
-    fst::TropicalWeight weight;
-    GetLinearSymbolSequence(fst_shortest_path, &alignment, &words, &weight);
-    KALDI_ASSERT(alignment.empty()); // we removed the alignment.
-    R_ = words;
-    L_ = 0.0; // Set current edit-distance to 0 [just so we know
-    // when we're on the 1st iter.]
+  PrepareLatticeAndInitStats(&clat);
+  if (words == NULL) {
+    InitOneBest(&clat); // Now set R_ to one best in the FST.
+  } else {
+    R_ = *words;
+    L_ = 0.0;
   }
-  
   MbrDecode();
-  
+}
+
+MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in, bool do_mbr):
+    do_mbr_(do_mbr), max_time_(0.0) {
+  Init(clat_in, NULL);
 }
 
 MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
                                    const std::vector<int32> &words,
-                                   bool do_mbr): do_mbr_(do_mbr) {
-  CompactLattice clat(clat_in); // copy.
-
-  PrepareLatticeAndInitStats(&clat);
+                                   bool do_mbr):
+    do_mbr_(do_mbr), max_time_(0.0) {
+  Init(clat_in, &words);
+}
 
-  R_ = words;
-  L_ = 0.0;
+MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
+                                   const MinimumBayesRiskOptions &opts):
+    do_mbr_(opts.decode_mbr), max_time_(opts.max_time) {
+  Init(clat_in, NULL);
+}
 
-  MbrDecode();
+MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
+                                   const std::vector<int32> &words,
+                                   const MinimumBayesRiskOptions &opts):
+    do_mbr_(opts.decode_mbr), max_time_(opts.max_time) {
+  Init(clat_in, &words);
 }
 
 }  // namespace kaldi
@@ -32,6 +32,27 @@
 
 namespace kaldi {
 
+struct MinimumBayesRiskOptions {
+  /// Boolean configuration parameter: if true, we actually update the
+  /// hypothesis to do MBR decoding (if false, our output is the MAP decoded
+  /// output, but we output the stats too, e.g. for confidences).
+  bool decode_mbr;
+  /// If > 0, the maximum time in seconds to spend iterating on one lattice;
+  /// we stop (keeping the current hypothesis) after the first iteration that
+  /// ends later than this.
+  BaseFloat max_time;
+
+  MinimumBayesRiskOptions(): decode_mbr(true), max_time(0.0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("decode-mbr", &decode_mbr, "If true, do Minimum Bayes Risk "
+                   "decoding (else, Maximum a Posteriori)");
+    opts->Register("max-time", &max_time, "If > 0, maximum time in seconds to "
+                   "spend on the MBR iterations for one lattice; useful for "
+                   "latency-sensitive applications.");
+  }
+};
+
 /// The implementation of the Minimum Bayes Risk decoding method described in
 ///  "Minimum Bayes Risk decoding and system combination based on a recursion for
 ///  edit distance", Haihua Xu, Daniel Povey, Lidia Mangu and Jie Zhu, Computer
@@ -70,6 +91,14 @@ class MinimumBayesRisk {
   MinimumBayesRisk(const CompactLattice &clat,
                    const std::vector<int32> &words, bool do_mbr = false);
 
+  /// As the constructors above, but with options.
+  MinimumBayesRisk(const CompactLattice &clat,
+                   const MinimumBayesRiskOptions &opts);
+
+  MinimumBayesRisk(const CompactLattice &clat,
+                   const std::vector<int32> &words,
+                   const MinimumBayesRiskOptions &opts);
+
   const std::vector<int32> &GetOneBest() const { // gets one-best (with no epsilons)
     return R_;
   }
@@ -101,8 +130,16 @@ class MinimumBayesRisk {
   }  
 
  private:
+  /// Does the whole computation for the constructors; if "words" is NULL we
+  /// start from the best path through the lattice, else from *words.
+  void Init(const CompactLattice &clat, const std::vector<int32> *words);
+
   void PrepareLatticeAndInitStats(CompactLattice *clat);
 
+  /// Sets R_ to the best path through "clat", which should have been
+  /// prepared by PrepareLatticeAndInitStats().
+  void InitOneBest(CompactLattice *clat);
+
   /// Minimum-Bayes-Risk Decode. Top-level algorithm.  Figure 6 of the paper.
   void MbrDecode(); 
 
@@ -113,11 +150,9 @@ class MinimumBayesRisk {
   inline int32 r(int32 q) { return R_[q-1]; }
   
   
-  /// Figure 4 of the paper; called from AccStats (Fig. 5)
-  double EditDistance(int32 N, int32 Q,
-                      Vector<double> &alpha,
-                      Matrix<double> &alpha_dash,
-                      Vector<double> &alpha_dash_arc);
+  /// Figure 4 of the paper; called from AccStats (Fig. 5).  Outputs to
+  /// alpha_ and alpha_dash_.
+  double EditDistance(int32 N, int32 Q);
 
   /// Figure 5 of the paper.  Outputs to gamma_ and L_.
   void AccStats(); 
@@ -132,13 +167,20 @@ class MinimumBayesRisk {
   static inline BaseFloat delta() { return 1.0e-05; } // A constant
   // used in the algorithm.
 
-  /// Function used to increment map.
-  static inline void AddToMap(int32 i, double d, std::map<int32, double> *gamma) {
+  /// Function used to increment the stats for one bin, which are a list of
+  /// (word, posterior) pairs; there are only ever a few words in a bin, so we
+  /// don't bother with a map.
+  static inline void AddToGamma(int32 i, double d,
+                                std::vector<std::pair<int32, double> > *gamma) {
     if (d == 0) return;
-    std::pair<const int32, double> pr(i, d);
-    std::pair<std::map<int32, double>::iterator, bool> ret = gamma->insert(pr);
-    if (!ret.second) // not inserted, so add to contents.
-      ret.first->second += d;
+    for (std::vector<std::pair<int32, double> >::iterator iter = gamma->begin();
+         iter != gamma->end(); ++iter) {
+      if (iter->first == i) {
+        iter->second += d;
+        return;
+      }
+    }
+    gamma->push_back(std::make_pair(i, d));
   }
     
   struct Arc {
@@ -152,18 +194,23 @@ class MinimumBayesRisk {
   /// to do MBR decoding (if false, our output is the MAP decoded output, but we
   /// output the stats too).
   bool do_mbr_;
+
+  /// If > 0, the maximum time in seconds to spend in MbrDecode().
+  BaseFloat max_time_;
   
   /// Arcs in the topologically sorted acceptor form of the word-level lattice,
   /// with one final-state.  Contains (word-symbol, log-likelihood on arc ==
-  /// negated cost).  Indexed from zero.
+  /// negated cost).  Indexed from zero, and sorted on end_node so that the
+  /// arcs entering each node are contiguous.
   std::vector<Arc> arcs_;
 
-  /// For each node in the lattice, a list of arcs entering that node. Indexed
-  /// from 1 (first node == 1).
-  std::vector<std::vector<int32> > pre_;
+  /// For each node n in the lattice, the arcs entering that node are
+  /// arcs_[pre_begin_[n]] ... arcs_[pre_begin_[n+1] - 1].  Indexed from 1
+  /// (first node == 1), with an extra element at the end.
+  std::vector<int32> pre_begin_;
 
   std::vector<int32> state_times_; // time of each state in the word lattice,
-  // indexed from 1 (same index as into pre_)
+  // indexed from 1 (same index as into pre_begin_)
   
   std::vector<int32> R_; // current 1-best word sequence, normalized to have
   // epsilons between each word and at the beginning and end.  R in paper...
@@ -192,6 +239,21 @@ class MinimumBayesRisk {
   // vector of confidences for the 1-best output (which could be
   // the MAP output if do_mbr_ == false, or the MBR output otherwise).
   // Indexed by the same index as one_best_times_.
+
+  // The following are temporaries used in EditDistance() and AccStats(),
+  // which are class members so that they are not reallocated on each
+  // iteration.  alpha_dash_ and beta_dash_ are matrices indexed (1...N,
+  // 0...Q), stored as rows of dimension Q+1; the others are indexed as in the
+  // comments in AccStats().
+  std::vector<double> alpha_;
+  std::vector<double> alpha_dash_;
+  std::vector<double> alpha_dash_arc_;
+  std::vector<double> beta_dash_;
+  std::vector<double> beta_dash_arc_;
+  std::vector<char> b_arc_;
+  std::vector<double> tau_b_;
+  std::vector<double> tau_e_;
+  std::vector<std::vector<std::pair<int32, double> > > gamma_tmp_;
   
   struct GammaCompare{
     // should be like operator <.  But we want reverse order
@@ -18,6 +18,9 @@
 // limitations under the License.
 
 
+#include <limits>
+#include <map>
+
 #include "lat/phone-align-lattice.h"
 #include "lat/word-align-lattice-lexicon.h"
 #include "lat/lattice-functions.h"
@@ -36,8 +39,6 @@ class LatticeLexiconWordAligner {
  public:
   typedef CompactLatticeArc::StateId StateId;
   typedef CompactLatticeArc::Label Label;
-  typedef WordAlignLatticeLexiconInfo::ViabilityMap ViabilityMap;
-  typedef WordAlignLatticeLexiconInfo::LexiconMap LexiconMap;
   typedef WordAlignLatticeLexiconInfo::NumPhonesMap NumPhonesMap;
 
   /*
@@ -79,7 +80,9 @@ class LatticeLexiconWordAligner {
     /// successfully call TakeTransition.  It's a kind of co-accessibility test
     /// that avoids us creating an exponentially large number of states that
     /// would contribute nothing to the final output.
-    bool ViableIfAdvanced(const ViabilityMap &viability_map) const;
+    bool ViableIfAdvanced(const WordAlignLexiconTrie &trie) const;
+
+    const std::vector<int32> &Phones() const { return phones_; }
     
     int32 NumPhones() const { return phones_.size(); }
     int32 NumWords() const { return words_.size(); }
@@ -95,11 +98,12 @@ class LatticeLexiconWordAligner {
                               ComputationState *next_state,
                               CompactLatticeArc *arc_out) const;
     
-    /// Take a transition, if possible; consume "num_phones" phones and (if
-    /// word_id != 0) the word "word_id" which must be the first word in words_.
-    /// Returns true if we could take the transition.
-    bool TakeTransition(const LexiconMap &lexicon_map,
-                        int32 word_id,
+    /// Take a transition, consuming "num_phones" phones and (if word_id != 0)
+    /// the word "word_id" which must be the first word in words_, and
+    /// outputting the word "new_word_id"; the calling code must have checked
+    /// that the lexicon has the corresponding entry.
+    void TakeTransition(int32 word_id,
+                        int32 new_word_id,
                         int32 num_phones,
                         ComputationState *next_state,
                         CompactLatticeArc *arc_out) const;
@@ -224,6 +228,13 @@ class LatticeLexiconWordAligner {
   
   // Process any non-epsilon transitions out of this state in the output lattice.
   void ProcessWordTransitions(const Tuple &tuple, StateId output_state);
+
+  // Takes the transitions out of this state that consume the word "word_id"
+  // (which may be zero, for epsilon transitions) and between min_num_phones
+  // and max_num_phones phones, for which there are lexicon entries.
+  void ProcessTransitionsForWord(const Tuple &tuple, StateId output_state,
+                                 int32 word_id, int32 min_num_phones,
+                                 int32 max_num_phones);
   
   // Take any transitions that correspond to advancing along arcs arc in the
   // original FST.
@@ -381,7 +392,6 @@ void LatticeLexiconWordAligner::AppendVectors(
 void LatticeLexiconWordAligner::ProcessEpsilonTransitions(
     const Tuple &tuple, StateId output_state) {
   const ComputationState &comp_state = tuple.comp_state;
-  StateId input_state = tuple.input_state;
   StateId zero_word = 0;
   NumPhonesMap::const_iterator iter =
       lexicon_info_.num_phones_map_.find(zero_word);
@@ -421,28 +431,44 @@ void LatticeLexiconWordAligner::ProcessEpsilonTransitions(
   
   if (min_num_phones == 0)
     KALDI_ERR << "Lexicon error: epsilon transition that produces no output:";
-    
-  for (int32 num_phones = min_num_phones;
-       num_phones <= max_num_phones;
-       num_phones++) {
+
+  ProcessTransitionsForWord(tuple, output_state, zero_word,
+                            min_num_phones, max_num_phones);
+}
+
+void LatticeLexiconWordAligner::ProcessTransitionsForWord(
+    const Tuple &tuple, StateId output_state, int32 word_id,
+    int32 min_num_phones, int32 max_num_phones) {
+  const ComputationState &comp_state = tuple.comp_state;
+  const std::vector<int32> &phones = comp_state.Phones();
+  const WordAlignLexiconTrie &trie = lexicon_info_.trie_;
+  // We extend the phone sequence one phone at a time, following the trie, so
+  // we stop as soon as no lexicon entry starts with the sequence.
+  int32 node = trie.Root();
+  for (int32 num_phones = 0; num_phones <= max_num_phones; num_phones++) {
+    if (num_phones > 0) {
+      node = trie.Child(node, phones[num_phones - 1]);
+      if (node == -1) break;
+    }
+    int32 new_word_id;
+    if (num_phones < min_num_phones ||
+        !trie.Lookup(node, word_id, &new_word_id))
+      continue;
+    if (new_word_id == 0) new_word_id = kTemporaryEpsilon; // we'll revert
+    // this at the end, as for lexicon_map_.
     Tuple next_tuple;
-    next_tuple.input_state = input_state; // We're not taking a transition in the
-    // input FST so this stays the same.
+    next_tuple.input_state = tuple.input_state; // We're not taking a
+    // transition in the input FST so this stays the same.
     CompactLatticeArc arc;
-    if (comp_state.TakeTransition(lexicon_info_.lexicon_map_,
-                                  zero_word,
-                                  num_phones,
-                                  &next_tuple.comp_state,
-                                  &arc)) {
-      ProcessTransition(output_state, next_tuple, &arc);
-    }
+    comp_state.TakeTransition(word_id, new_word_id, num_phones,
+                              &next_tuple.comp_state, &arc);
+    ProcessTransition(output_state, next_tuple, &arc);
   }
 }
 
 void LatticeLexiconWordAligner::ProcessWordTransitions(
     const Tuple &tuple, StateId output_state) {
   const ComputationState &comp_state = tuple.comp_state;
-  StateId input_state = tuple.input_state;
   if (comp_state.NumWords() > 0) {
     int32 min_num_phones, max_num_phones;
     int32 word_id = comp_state.PendingWord();
@@ -468,30 +494,15 @@ void LatticeLexiconWordAligner::ProcessWordTransitions(
     } else {
       return; // Nothing to do, since neither the word nor the phones are fresh.
     }
-
-      
-    for (int32 num_phones = min_num_phones;
-         num_phones <= max_num_phones;
-         num_phones++) {
-      Tuple next_tuple;
-      next_tuple.input_state = input_state; // We're not taking a transition in the
-      // input FST so this stays the same.
-      CompactLatticeArc arc;
-      if (comp_state.TakeTransition(lexicon_info_.lexicon_map_,
-                                    word_id,
-                                    num_phones,
-                                    &next_tuple.comp_state,
-                                    &arc)) {
-        ProcessTransition(output_state, next_tuple, &arc);
-      }
-    }
+    ProcessTransitionsForWord(tuple, output_state, word_id,
+                              min_num_phones, max_num_phones);
   }
 }
 
 
 void LatticeLexiconWordAligner::PossiblyAdvanceArc(
     const Tuple &tuple, StateId output_state) {
-  if (tuple.comp_state.ViableIfAdvanced(lexicon_info_.viability_map_)) {
+  if (tuple.comp_state.ViableIfAdvanced(lexicon_info_.trie_)) {
     for(fst::ArcIterator<CompactLattice> aiter(lat_in_, tuple.input_state);
         !aiter.Done(); aiter.Next()) {
       const CompactLatticeArc &arc_in = aiter.Value();
@@ -606,7 +617,7 @@ void LatticeLexiconWordAligner::ComputationState::Advance(
 
 
 bool LatticeLexiconWordAligner::ComputationState::ViableIfAdvanced(
-    const ViabilityMap &viability_map) const {
+    const WordAlignLexiconTrie &trie) const {
   /* This will ideally to return true if and only if we can ever take
      any kind of transition out of this state after "advancing" it by adding
      words and/or phones.  It's OK to return true in some cases where the
@@ -621,16 +632,12 @@ bool LatticeLexiconWordAligner::ComputationState::ViableIfAdvanced(
     // than this phone sequence can have either zero (<eps>/epsilon) or the
     // first element of words_, as an entry in the lexicon with that phone
     // sequence.
-    ViabilityMap::const_iterator iter = viability_map.find(phones_);
-    if (iter == viability_map.end()) return false;
-    else {
-      const std::vector<int32> &this_set = iter->second; // sorted vector.
-      // Return true if either 0 or words_[0] is in the set.  If 0 is
-      // in the set, it will be the 1st element of the vector, because it's
-      // the lowest element.
-      return (this_set.front() == 0 ||
-              std::binary_search(this_set.begin(), this_set.end(), words_[0]));
+    int32 node = trie.Root();
+    for (size_t i = 0; i < phones_.size(); i++) {
+      node = trie.Child(node, phones_[i]);
+      if (node == -1) return false;
     }
+    return trie.IsViable(node, words_[0]);
   }
 }
 
@@ -672,48 +679,33 @@ void LatticeLexiconWordAligner::ComputationState::TakeForcedTransition(
 }
 
 
-bool LatticeLexiconWordAligner::ComputationState::TakeTransition(
-    const LexiconMap &lexicon_map, int32 word_id, int32 num_phones,
+void LatticeLexiconWordAligner::ComputationState::TakeTransition(
+    int32 word_id, int32 new_word_id, int32 num_phones,
     ComputationState *next_state, CompactLatticeArc *arc_out) const {
   KALDI_ASSERT(word_id == 0 || (!words_.empty() && word_id == words_[0]));
   KALDI_ASSERT(num_phones <= static_cast<int32>(phones_.size()));
-      
-  std::vector<int32> lexicon_key;
-  lexicon_key.reserve(1 + num_phones);
-  lexicon_key.push_back(word_id); // put 1st word in lexicon_key.
-  lexicon_key.insert(lexicon_key.end(),
-                     phones_.begin(), phones_.begin() + num_phones);
-  LexiconMap::const_iterator iter = lexicon_map.find(lexicon_key);
-  if (iter == lexicon_map.end()) { // no such entry
-    return false;
-  } else { // Entry exists.  We'll create an arc.
-    next_state->phones_.assign(phones_.begin() + num_phones, phones_.end());
-    next_state->words_.assign(words_.begin() + (word_id == 0 ? 0 : 1),
-                              words_.end());
-    next_state->transition_ids_.assign(transition_ids_.begin() + num_phones,
-                                       transition_ids_.end());
-    next_state->word_fresh_ =
-        (word_id != 0 && !next_state->words_.empty()) ? kFresh : kNotFresh;
-    next_state->phone_fresh_ =
-        (next_state->phones_.empty() || num_phones == 0) ? kNotFresh : kAllFresh;
-    next_state->weight_ = LatticeWeight::One();
-
-    // Set arc_out:
-    Label word_id = iter->second; // word_id will typically be
-    // the same as words_[0], i.e. the
-    // word we consumed.
-        
-    std::vector<int32> appended_transition_ids;
-    AppendVectors(transition_ids_.begin(),
-                  transition_ids_.begin() + num_phones,
-                  &appended_transition_ids);
-    arc_out->ilabel = word_id;
-    arc_out->olabel = word_id;
-    arc_out->weight = CompactLatticeWeight(weight_,
-                                           appended_transition_ids);
-    // arc_out->nextstate will be set in the calling code.
-    return true;
-  }
+  next_state->phones_.assign(phones_.begin() + num_phones, phones_.end());
+  next_state->words_.assign(words_.begin() + (word_id == 0 ? 0 : 1),
+                            words_.end());
+  next_state->transition_ids_.assign(transition_ids_.begin() + num_phones,
+                                     transition_ids_.end());
+  next_state->word_fresh_ =
+      (word_id != 0 && !next_state->words_.empty()) ? kFresh : kNotFresh;
+  next_state->phone_fresh_ =
+      (next_state->phones_.empty() || num_phones == 0) ? kNotFresh : kAllFresh;
+  next_state->weight_ = LatticeWeight::One();
+
+  // Set arc_out.  new_word_id will typically be the same as words_[0],
+  // i.e. the word we consumed.
+  std::vector<int32> appended_transition_ids;
+  AppendVectors(transition_ids_.begin(),
+                transition_ids_.begin() + num_phones,
+                &appended_transition_ids);
+  arc_out->ilabel = new_word_id;
+  arc_out->olabel = new_word_id;
+  arc_out->weight = CompactLatticeWeight(weight_,
+                                         appended_transition_ids);
+  // arc_out->nextstate will be set in the calling code.
 }
 
 
@@ -751,30 +743,85 @@ static bool IsPlausibleWord(const WordAlignLatticeLexiconInfo &lexicon_info,
   }
 }
 
-void WordAlignLatticeLexiconInfo::UpdateViabilityMap(
-    const std::vector<int32> &lexicon_entry) {
-  int32 word = lexicon_entry[0];  // note: word may be zero.
-  int32 num_phones = static_cast<int32>(lexicon_entry.size()) - 2;
-  std::vector<int32> phones;
-  phones.reserve(num_phones - 1);
-  // for each nonempty sequence of phones that is a strict prefix of the phones
-  // in the lexicon entry (i.e. lexicon_entry [2 ... ]), add the word to the set
-  // in viability_map_[phones].
-  for (int32 n = 0; n < num_phones - 1; n++) {
-    phones.push_back(lexicon_entry[n + 2]); // first phone is at position 2.
-    // n+1 is the length of the sequence of phones
-    viability_map_[phones].push_back(word);
+WordAlignLexiconTrie::WordAlignLexiconTrie(
+    const std::vector<std::vector<int32> > &lexicon) {
+  // First build the trie with a map for the children of each node, then
+  // convert it to the flat representation.
+  std::vector<std::map<int32, int32> > children(1);
+  std::vector<std::vector<std::pair<int32, int32> > > entries(1);
+  std::vector<std::vector<int32> > viable(1);
+  for (size_t i = 0; i < lexicon.size(); i++) {
+    const std::vector<int32> &lexicon_entry = lexicon[i];
+    KALDI_ASSERT(lexicon_entry.size() >= 2);
+    int32 word = lexicon_entry[0], new_word = lexicon_entry[1],
+        num_phones = static_cast<int32>(lexicon_entry.size()) - 2;
+    KALDI_ASSERT(word >= 0 && "Error: negative labels in lexicon.");
+    int32 node = 0;
+    for (int32 n = 0; n < num_phones; n++) {
+      // "node" is a strict prefix of the phones of this entry; we don't
+      // record the word for the root, as the empty sequence is always viable.
+      if (n > 0) viable[node].push_back(word);
+      int32 phone = lexicon_entry[n + 2];
+      std::map<int32, int32>::iterator iter = children[node].find(phone);
+      if (iter != children[node].end()) {
+        node = iter->second;
+      } else {
+        int32 child = children.size();
+        children[node][phone] = child;
+        children.resize(child + 1);
+        entries.resize(child + 1);
+        viable.resize(child + 1);
+        node = child;
+      }
+    }
+    entries[node].push_back(std::make_pair(word, new_word));
   }
-}
 
-void WordAlignLatticeLexiconInfo::FinalizeViabilityMap() {
-  for (ViabilityMap::iterator iter = viability_map_.begin();
-       iter != viability_map_.end();
-       ++iter) {
-    std::vector<int32> &words = iter->second;
-    SortAndUniq(&words);
-    KALDI_ASSERT(words[0] >= 0 && "Error: negative labels in lexicon.");
+  int32 num_nodes = children.size();
+  child_begin_.reserve(num_nodes + 1);
+  entry_begin_.reserve(num_nodes + 1);
+  viable_begin_.reserve(num_nodes + 1);
+  for (int32 node = 0; node < num_nodes; node++) {
+    child_begin_.push_back(child_phones_.size());
+    for (std::map<int32, int32>::const_iterator iter = children[node].begin();
+         iter != children[node].end(); ++iter) {
+      child_phones_.push_back(iter->first);
+      child_nodes_.push_back(iter->second);
+    }
+    entry_begin_.push_back(entries_.size());
+    SortAndUniq(&(entries[node]));
+    entries_.insert(entries_.end(), entries[node].begin(),
+                    entries[node].end());
+    viable_begin_.push_back(viable_words_.size());
+    SortAndUniq(&(viable[node]));
+    viable_words_.insert(viable_words_.end(), viable[node].begin(),
+                         viable[node].end());
   }
+  child_begin_.push_back(child_phones_.size());
+  entry_begin_.push_back(entries_.size());
+  viable_begin_.push_back(viable_words_.size());
+}
+
+bool WordAlignLexiconTrie::Lookup(int32 node, int32 word,
+                                  int32 *new_word) const {
+  std::vector<std::pair<int32, int32> >::const_iterator
+      begin = entries_.begin() + entry_begin_[node],
+      end = entries_.begin() + entry_begin_[node + 1],
+      iter = std::lower_bound(
+          begin, end, std::make_pair(word, std::numeric_limits<int32>::min()));
+  if (iter == end || iter->first != word) return false;
+  *new_word = iter->second;
+  return true;
+}
+
+bool WordAlignLexiconTrie::IsViable(int32 node, int32 word) const {
+  std::vector<int32>::const_iterator
+      begin = viable_words_.begin() + viable_begin_[node],
+      end = viable_words_.begin() + viable_begin_[node + 1];
+  if (begin == end) return false;
+  // Return true if either 0 or "word" is in the set.  If 0 is in the set, it
+  // will be the 1st element, because it's the lowest element.
+  return (*begin == 0 || std::binary_search(begin, end, word));
 }
 
 /// Update the map from a vector (orig-word-symbol phone1 phone2 ... ) to the
@@ -871,15 +918,13 @@ void WordAlignLatticeLexiconInfo::UpdateEquivalenceMap(
 
 
 WordAlignLatticeLexiconInfo::WordAlignLatticeLexiconInfo(
-    const std::vector<std::vector<int32> > &lexicon) {
+    const std::vector<std::vector<int32> > &lexicon): trie_(lexicon) {
   for (size_t i = 0; i < lexicon.size(); i++) {
     const std::vector<int32> &lexicon_entry = lexicon[i];
     KALDI_ASSERT(lexicon_entry.size() >= 2);
-    UpdateViabilityMap(lexicon_entry);
     UpdateLexiconMap(lexicon_entry);
     UpdateNumPhonesMap(lexicon_entry);
   }
-  FinalizeViabilityMap();
   UpdateEquivalenceMap(lexicon);
 }
 
@@ -19,6 +19,7 @@
 
 #ifndef KALDI_LAT_WORD_ALIGN_LATTICE_LEXICON_H_
 #define KALDI_LAT_WORD_ALIGN_LATTICE_LEXICON_H_
+#include <algorithm>
 #include <fst/fstlib.h>
 #include <fst/fst-decl.h>
 
@@ -51,6 +52,59 @@ bool ReadLexiconForWordAlign (std::istream &is,
 
 
 
+/// A trie over the phone sequences of the word-alignment lexicon, in flat
+/// arrays, so that extending a phone sequence by one phone is a binary search.
+/// Node zero is the root (the empty sequence).  It is not modified after
+/// construction, so it may be shared between threads.
+class WordAlignLexiconTrie {
+ public:
+  /// "lexicon" is as read by ReadLexiconForWordAlign(); each entry is
+  /// (old-word new-word phone1 phone2 ...).
+  explicit WordAlignLexiconTrie(
+      const std::vector<std::vector<int32> > &lexicon);
+
+  int32 Root() const { return 0; }
+
+  /// Returns the node for the phone sequence of "node" followed by "phone", or
+  /// -1 if no lexicon entry starts with that sequence.
+  int32 Child(int32 node, int32 phone) const {
+    std::vector<int32>::const_iterator
+        begin = child_phones_.begin() + child_begin_[node],
+        end = child_phones_.begin() + child_begin_[node + 1],
+        iter = std::lower_bound(begin, end, phone);
+    if (iter == end || *iter != phone) return -1;
+    return child_nodes_[iter - child_phones_.begin()];
+  }
+
+  /// If there is a lexicon entry with old-word "word" and the phone sequence
+  /// of "node", outputs its new-word to "new_word" and returns true; else
+  /// returns false.
+  bool Lookup(int32 node, int32 word, int32 *new_word) const;
+
+  /// Returns true if there is a lexicon entry with old-word zero or "word",
+  /// whose phone sequence starts with that of "node" and is longer.
+  bool IsViable(int32 node, int32 word) const;
+
+  int32 NumNodes() const { return static_cast<int32>(child_begin_.size()) - 1; }
+
+ private:
+  // The children of node n are at positions child_begin_[n] through
+  // child_begin_[n+1] - 1 of child_phones_ and child_nodes_, sorted on phone.
+  std::vector<int32> child_begin_;
+  std::vector<int32> child_phones_;
+  std::vector<int32> child_nodes_;
+  // The lexicon entries ending at node n are the (old-word, new-word) pairs at
+  // positions entry_begin_[n] through entry_begin_[n+1] - 1, sorted.
+  std::vector<int32> entry_begin_;
+  std::vector<std::pair<int32, int32> > entries_;
+  // The old-words (including zero) of lexicon entries that strictly extend
+  // the sequence of node n are at positions viable_begin_[n] through
+  // viable_begin_[n+1] - 1 of viable_words_, sorted and unique.
+  std::vector<int32> viable_begin_;
+  std::vector<int32> viable_words_;
+};
+
+
 /// This class extracts some information from the lexicon and stores it
 /// in a suitable form for the word-alignment code to use.
 class WordAlignLatticeLexiconInfo {
@@ -68,24 +122,10 @@ class WordAlignLatticeLexiconInfo {
  protected:
   friend class LatticeLexiconWordAligner;
 
-  void UpdateViabilityMap(const std::vector<int32> &lexicon_entry);
   void UpdateLexiconMap(const std::vector<int32> &lexicon_entry);
   void UpdateNumPhonesMap(const std::vector<int32> &lexicon_entry);
   void UpdateEquivalenceMap(const std::vector<std::vector<int32> > &lexicon);
 
-  void FinalizeViabilityMap(); // sorts the vectors.
-  
-  /// The type ViabilityMap maps from sequences of phones (excluding the empty
-  /// sequence), to the sets of all word-labels [on the input lattice] that
-  /// could correspond to phone sequences that start with s [but are longer than
-  /// s].  The sets of word-labels are represented as sorted vectors of int32
-  /// Note: the zero word-label is included here.  This is used in a kind
-  /// of co-accessibility test, to see whether it is worth extending this state
-  /// by traversing arcs in the input lattice.
-  typedef unordered_map<std::vector<int32>,
-                        std::vector<int32>,
-                        VectorHasher<int32> > ViabilityMap;
-
   /// This is a map from a vector (orig-word-symbol phone1 phone2 ... ) to
   /// the new word-symbol.  [todo: make sure the new word-symbol is always nonzero.]
   typedef unordered_map<std::vector<int32>, int32,
@@ -101,10 +141,12 @@ class WordAlignLatticeLexiconInfo {
   typedef unordered_map<int32, int32> EquivalenceMap;
 
   // The following three variables represent various types of information
-  // gathered from the lexicon.
+  // gathered from the lexicon.  The alignment itself looks up phone sequences
+  // in trie_; lexicon_map_ is used to check the lexicon for duplicates, and
+  // in testing code.
   LexiconMap lexicon_map_;
   NumPhonesMap num_phones_map_;
-  ViabilityMap viability_map_;
+  WordAlignLexiconTrie trie_;
 
   // As lexicon_map but in reverse sense w.r.t. words [we only
   // do this for asymmetric entries.]  Used only in testing code.
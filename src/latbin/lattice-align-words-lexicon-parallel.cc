@@ -0,0 +1,195 @@
+// latbin/lattice-align-words-lexicon-parallel.cc
+
+// Copyright 2012  Johns Hopkins University (Author: Daniel Povey)
+//           2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/word-align-lattice-lexicon.h"
+#include "lat/lattice-functions.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+class WordAlignLatticeLexiconTask {
+ public:
+  // Initializer takes ownership of "clat".
+  WordAlignLatticeLexiconTask(const TransitionModel &tmodel,
+                              const WordAlignLatticeLexiconInfo &lexicon_info,
+                              const WordAlignLatticeLexiconOpts &opts,
+                              bool output_if_error,
+                              bool output_if_empty,
+                              std::string key,
+                              CompactLattice *clat,
+                              CompactLatticeWriter *clat_writer,
+                              int32 *num_done,
+                              int32 *num_err):
+      tmodel_(tmodel), lexicon_info_(lexicon_info), opts_(opts),
+      output_if_error_(output_if_error), output_if_empty_(output_if_empty),
+      key_(key), clat_(clat), clat_writer_(clat_writer), num_done_(num_done),
+      num_err_(num_err), ok_(false) { }
+
+  void operator () () {
+    ok_ = WordAlignLatticeLexicon(*clat_, tmodel_, lexicon_info_, opts_,
+                                  &aligned_clat_);
+    if (ok_ && aligned_clat_.Start() != fst::kNoStateId)
+      TopSortCompactLatticeIfNeeded(&aligned_clat_);
+  }
+
+  ~WordAlignLatticeLexiconTask() {
+    // The output is written here, in the same order as the input, and with the
+    // same logic as in lattice-align-words-lexicon.
+    if (!ok_) {
+      (*num_err_)++;
+      if (output_if_empty_ && aligned_clat_.NumStates() == 0 &&
+          clat_->NumStates() != 0) {
+        KALDI_WARN << "Algorithm produced no output (due to --max-expand?), "
+                   << "so passing input through as output, for key " << key_;
+        clat_writer_->Write(key_, *clat_);
+      } else if (!output_if_error_) {
+        KALDI_WARN << "Lattice for " << key_ << " did not align correctly";
+      } else if (aligned_clat_.Start() != fst::kNoStateId) {
+        KALDI_WARN << "Outputting partial lattice for " << key_;
+        clat_writer_->Write(key_, aligned_clat_);
+      } else {
+        KALDI_WARN << "Empty aligned lattice for " << key_
+                   << ", producing no output.";
+      }
+    } else if (aligned_clat_.Start() == fst::kNoStateId) {
+      (*num_err_)++;
+      KALDI_WARN << "Lattice was empty for key " << key_;
+    } else {
+      (*num_done_)++;
+      KALDI_VLOG(2) << "Aligned lattice for " << key_;
+      clat_writer_->Write(key_, aligned_clat_);
+    }
+    delete clat_;
+  }
+
+ private:
+  const TransitionModel &tmodel_;
+  const WordAlignLatticeLexiconInfo &lexicon_info_;
+  const WordAlignLatticeLexiconOpts &opts_;
+  bool output_if_error_;
+  bool output_if_empty_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  CompactLattice aligned_clat_;  // The output of our process.  Will be
+                                 // written to clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+  bool ok_;
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using kaldi::int32;
+
+    const char *usage =
+        "Convert lattices so that the arcs in the CompactLattice format correspond with\n"
+        "words (i.e. aligned with word boundaries).  This is a version of\n"
+        "lattice-align-words-lexicon that accepts the --num-threads option; the\n"
+        "threads share the model and the lexicon, which are read-only.  See\n"
+        "lattice-align-words-lexicon for the format of the lexicon.\n"
+        "Usage: lattice-align-words-lexicon-parallel [options] <lexicon-file> <model> <lattice-rspecifier> <lattice-wspecifier>\n"
+        " e.g.: lattice-align-words-lexicon-parallel --num-threads=8 --partial-word-label=4324 \\\n"
+        "   --max-expand 10.0 data/lang/phones/align_lexicon.int final.mdl ark:1.lats ark:aligned.lats\n";
+
+    ParseOptions po(usage);
+    bool output_if_error = true;
+    bool output_if_empty = false;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
+    po.Register("output-error-lats", &output_if_error, "Output lattices that aligned "
+                "with errors (e.g. due to force-out");
+    po.Register("output-if-empty", &output_if_empty, "If true: if algorithm gives "
+                "error and produces empty output, pass the input through.");
+
+    WordAlignLatticeLexiconOpts opts;
+    opts.Register(&po);
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 4) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string
+        align_lexicon_rxfilename = po.GetArg(1),
+        model_rxfilename = po.GetArg(2),
+        lats_rspecifier = po.GetArg(3),
+        lats_wspecifier = po.GetArg(4);
+
+    std::vector<std::vector<int32> > lexicon;
+    {
+      bool binary_in;
+      Input ki(align_lexicon_rxfilename, &binary_in);
+      KALDI_ASSERT(!binary_in && "Not expecting binary file for lexicon");
+      if (!ReadLexiconForWordAlign(ki.Stream(), &lexicon)) {
+        KALDI_ERR << "Error reading alignment lexicon from "
+                  << align_lexicon_rxfilename;
+      }
+    }
+
+    TransitionModel tmodel;
+    ReadKaldiObject(model_rxfilename, &tmodel);
+
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+    CompactLatticeWriter clat_writer(lats_wspecifier);
+
+    WordAlignLatticeLexiconInfo lexicon_info(lexicon);
+    { std::vector<std::vector<int32> > temp; lexicon.swap(temp); }
+    // No longer needed.
+
+    int32 num_done = 0, num_err = 0;
+
+    {
+      TaskSequencer<WordAlignLatticeLexiconTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        // Will give ownership to "task" below.  We make a deep copy
+        // (constructing from the Fst base class), because OpenFst's reference
+        // counting is not thread-safe.
+        const fst::Fst<CompactLatticeArc> &value = clat_reader.Value();
+        CompactLattice *clat = new CompactLattice(value);
+        clat_reader.FreeCurrent();
+        sequencer.Run(new WordAlignLatticeLexiconTask(
+            tmodel, lexicon_info, opts, output_if_error, output_if_empty,
+            key, clat, &clat_writer, &num_done, &num_err));
+      }
+      sequencer.Wait();
+    }
+    KALDI_LOG << "Successfully aligned " << num_done << " lattices; "
+              << num_err << " had errors.";
+    return (num_done > num_err ? 0 : 1); // We changed the error condition slightly here,
+    // if there are errors in the word-boundary phones we can get situations
+    // where most lattices give an error.
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
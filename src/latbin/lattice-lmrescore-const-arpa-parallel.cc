@@ -0,0 +1,187 @@
+// latbin/lattice-lmrescore-const-arpa-parallel.cc
+
+// Copyright 2014  Guoguo Chen
+//           2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "fstext/fstext-lib.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lm/const-arpa-lm.h"
+#include "thread/kaldi-task-sequence.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+class RescoreLatticeTask {
+ public:
+  // Initializer takes ownership of "clat".  "cache" may be NULL.
+  RescoreLatticeTask(const ConstArpaLm &const_arpa,
+                     ConstArpaLmCache *cache,
+                     BaseFloat lm_scale,
+                     std::string key,
+                     CompactLattice *clat,
+                     CompactLatticeWriter *clat_writer,
+                     int32 *num_done,
+                     int32 *num_fail):
+      const_arpa_(const_arpa), cache_(cache), lm_scale_(lm_scale), key_(key),
+      clat_(clat), clat_writer_(clat_writer), num_done_(num_done),
+      num_fail_(num_fail) { }
+
+  void operator () () {
+    // Before composing with the LM FST, we scale the lattice weights by the
+    // inverse of "lm_scale".  We'll later scale by "lm_scale".  We do it this
+    // way so we can determinize and it will give the right effect (taking the
+    // "best path" through the LM) regardless of the sign of lm_scale.
+    fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale_), clat_);
+    ArcSort(clat_, fst::OLabelCompare<CompactLatticeArc>());
+
+    // Wraps the ConstArpaLm format language model into FST.  Each lattice has
+    // its own wrapper, but they share the cache.
+    ConstArpaLmDeterministicFst const_arpa_fst(const_arpa_, cache_);
+
+    // Composes lattice with language model.
+    CompactLattice composed_clat;
+    ComposeCompactLatticeDeterministic(*clat_, &const_arpa_fst,
+                                       &composed_clat);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+
+    // Determinizes the composed lattice.
+    Lattice composed_lat;
+    ConvertLattice(composed_clat, &composed_lat);
+    Invert(&composed_lat);
+    DeterminizeLattice(composed_lat, &determinized_clat_);
+    fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &determinized_clat_);
+  }
+
+  ~RescoreLatticeTask() {
+    if (determinized_clat_.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*num_fail_)++;
+    } else {
+      clat_writer_->Write(key_, determinized_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ConstArpaLm &const_arpa_;
+  ConstArpaLmCache *cache_;
+  BaseFloat lm_scale_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  CompactLattice determinized_clat_;  // The output of our process.  Will be
+                                      // written to clat_writer_ in the
+                                      // destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Rescores lattice with the ConstArpaLm format language model.  This is\n"
+        "a version of lattice-lmrescore-const-arpa that accepts the\n"
+        "--num-threads option; the threads share the language model, and a\n"
+        "cache of language model lookups (see --lm-cache-size).\n"
+        "\n"
+        "Usage: lattice-lmrescore-const-arpa-parallel [options] \\\n"
+        "                   lattice-rspecifier const-arpa-in lattice-wspecifier\n"
+        " e.g.: lattice-lmrescore-const-arpa-parallel --num-threads=8 \\\n"
+        "                   --lm-scale=-1.0 ark:in.lats const_arpa ark:out.lats\n";
+
+    ParseOptions po(usage);
+    BaseFloat lm_scale = 1.0;
+    int32 lm_cache_size = 1000000;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
+    po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
+                "costs; frequently 1.0 or -1.0");
+    po.Register("lm-cache-size", &lm_cache_size, "Maximum number of language "
+                "model lookups (history plus word) to cache, shared between "
+                "threads; if zero, no cache is used.");
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string lats_rspecifier = po.GetArg(1),
+        lm_rxfilename = po.GetArg(2),
+        lats_wspecifier = po.GetArg(3);
+
+    // Reads the language model in ConstArpaLm format.
+    ConstArpaLm const_arpa;
+    ReadKaldiObject(lm_rxfilename, &const_arpa);
+
+    ConstArpaLmCache *cache = NULL;
+    if (lm_cache_size > 0)
+      cache = new ConstArpaLmCache(lm_cache_size);
+
+    // Reads and writes as compact lattice.
+    SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
+    CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
+
+    int32 n_done = 0, n_fail = 0;
+    {
+      TaskSequencer<RescoreLatticeTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+        if (lm_scale != 0.0) {
+          // Will give ownership to "task" below.  We make a deep copy
+          // (constructing from the Fst base class), because OpenFst's
+          // reference counting is not thread-safe.
+          const fst::Fst<CompactLatticeArc> &value =
+              compact_lattice_reader.Value();
+          CompactLattice *clat = new CompactLattice(value);
+          compact_lattice_reader.FreeCurrent();
+          sequencer.Run(new RescoreLatticeTask(const_arpa, cache, lm_scale,
+                                               key, clat,
+                                               &compact_lattice_writer,
+                                               &n_done, &n_fail));
+        } else {
+          // Zero scale so nothing to do (and no tasks are run).
+          compact_lattice_writer.Write(key, compact_lattice_reader.Value());
+          n_done++;
+        }
+      }
+      sequencer.Wait();
+    }
+    delete cache;
+
+    KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
+    return (n_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
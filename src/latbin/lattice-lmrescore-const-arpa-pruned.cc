@@ -0,0 +1,134 @@
+// latbin/lattice-lmrescore-const-arpa-pruned.cc
+
+// Copyright 2014  Guoguo Chen
+//           2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "fstext/fstext-lib.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lat/compose-lattice-pruned.h"
+#include "lm/const-arpa-lm.h"
+#include "util/common-utils.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Rescores lattice with the ConstArpaLm format language model, like\n"
+        "lattice-lmrescore-const-arpa, but the composition with the language\n"
+        "model is pruned (using the forward and backward costs of the input\n"
+        "lattice), so that it does not expand all the paths of dense lattices.\n"
+        "The --lm-scale must be positive; to remove the old LM scores first,\n"
+        "use lattice-lmrescore-const-arpa with --lm-scale=-1.0 (or\n"
+        "lattice-lmrescore).\n"
+        "\n"
+        "Usage: lattice-lmrescore-const-arpa-pruned [options] \\\n"
+        "              lattice-rspecifier const-arpa-in lattice-wspecifier\n"
+        " e.g.: lattice-lmrescore-const-arpa-pruned --beam=8.0 \\\n"
+        "              ark:in.lats const_arpa ark:out.lats\n";
+
+    ParseOptions po(usage);
+    BaseFloat lm_scale = 1.0;
+    ComposeLatticePrunedOptions compose_opts;
+
+    po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
+                "costs; must be positive.");
+    compose_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (lm_scale <= 0.0)
+      KALDI_ERR << "--lm-scale must be positive, got " << lm_scale;
+
+    std::string lats_rspecifier = po.GetArg(1),
+        lm_rxfilename = po.GetArg(2),
+        lats_wspecifier = po.GetArg(3);
+
+    // Reads the language model in ConstArpaLm format.
+    ConstArpaLm const_arpa;
+    ReadKaldiObject(lm_rxfilename, &const_arpa);
+
+    // Reads and writes as compact lattice.
+    SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
+    CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
+
+    int32 n_done = 0, n_fail = 0;
+    int64 tot_arcs_in = 0, tot_arcs_out = 0;
+    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+      std::string key = compact_lattice_reader.Key();
+      CompactLattice clat = compact_lattice_reader.Value();
+      compact_lattice_reader.FreeCurrent();
+
+      if (clat.Properties(fst::kTopSorted, true) == 0 && !TopSort(&clat)) {
+        KALDI_WARN << "Cycles detected in lattice for utterance " << key;
+        n_fail++;
+        continue;
+      }
+      // As in lattice-lmrescore-const-arpa, we scale the graph costs by
+      // 1/lm_scale before composition and by lm_scale afterwards, so that
+      // determinization gives the right effect.
+      fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale), &clat);
+
+      // Wraps the ConstArpaLm format language model into FST. We re-create it
+      // for each lattice to prevent memory usage increasing with time.
+      ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
+
+      // Composes lattice with language model.
+      CompactLattice composed_clat;
+      ComposeCompactLatticePruned(compose_opts, clat,
+                                  &const_arpa_fst, &composed_clat);
+      tot_arcs_in += NumArcs(clat);
+      tot_arcs_out += NumArcs(composed_clat);
+
+      // Determinizes the composed lattice.
+      Lattice composed_lat;
+      ConvertLattice(composed_clat, &composed_lat);
+      Invert(&composed_lat);
+      CompactLattice determinized_clat;
+      DeterminizeLattice(composed_lat, &determinized_clat);
+      fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
+      if (determinized_clat.Start() == fst::kNoStateId) {
+        KALDI_WARN << "Empty lattice for utterance " << key
+                   << " (incompatible LM?)";
+        n_fail++;
+      } else {
+        compact_lattice_writer.Write(key, determinized_clat);
+        n_done++;
+      }
+    }
+
+    KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
+    KALDI_LOG << "Average number of arcs before composition was "
+              << (tot_arcs_in / std::max<double>(1.0, n_done + n_fail))
+              << ", after (pruned) composition "
+              << (tot_arcs_out / std::max<double>(1.0, n_done + n_fail));
+    return (n_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,211 @@
+// latbin/lattice-mbr-decode-parallel.cc
+
+// Copyright 2012  Johns Hopkins University (Author: Daniel Povey)
+//           2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "lat/sausages.h"
+#include "hmm/posterior.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+// The writers and the totals that the tasks output to; the tasks only access
+// them in their destructors, which TaskSequencer runs sequentially.
+struct MbrDecodeOutput {
+  Int32VectorWriter *trans_writer;
+  BaseFloatWriter *bayes_risk_writer;
+  PosteriorWriter *sausage_stats_writer;
+  BaseFloatPairVectorWriter *times_writer;
+  const fst::SymbolTable *word_syms;  // for debug output; may be NULL.
+  bool one_best_times;
+  int32 num_done;
+  int32 num_words;
+  double tot_bayes_risk;
+};
+
+class MbrDecodeTask {
+ public:
+  // Initializer takes ownership of "clat".
+  MbrDecodeTask(const MinimumBayesRiskOptions &opts,
+                BaseFloat lm_scale,
+                BaseFloat acoustic_scale,
+                std::string key,
+                CompactLattice *clat,
+                MbrDecodeOutput *output):
+      opts_(opts), lm_scale_(lm_scale), acoustic_scale_(acoustic_scale),
+      key_(key), clat_(clat), output_(output), mbr_(NULL) { }
+
+  void operator () () {
+    fst::ScaleLattice(fst::LatticeScale(lm_scale_, acoustic_scale_), clat_);
+    mbr_ = new MinimumBayesRisk(*clat_, opts_);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+  }
+
+  ~MbrDecodeTask() {
+    MbrDecodeOutput &out = *output_;
+    if (out.trans_writer->IsOpen())
+      out.trans_writer->Write(key_, mbr_->GetOneBest());
+    if (out.bayes_risk_writer->IsOpen())
+      out.bayes_risk_writer->Write(key_, mbr_->GetBayesRisk());
+    if (out.sausage_stats_writer->IsOpen())
+      out.sausage_stats_writer->Write(key_, mbr_->GetSausageStats());
+    if (out.times_writer->IsOpen())
+      out.times_writer->Write(key_, out.one_best_times ?
+                              mbr_->GetOneBestTimes() :
+                              mbr_->GetSausageTimes());
+    if (out.word_syms != NULL) {
+      const std::vector<int32> &words = mbr_->GetOneBest();
+      std::cerr << key_ << ' ';
+      for (size_t i = 0; i < words.size(); i++) {
+        // We don't throw here, as we are in a destructor.
+        std::string s = out.word_syms->Find(words[i]);
+        if (s == "")
+          KALDI_WARN << "Word-id " << words[i] << " not in symbol table.";
+        else
+          std::cerr << s << ' ';
+      }
+      std::cerr << '\n';
+    }
+    out.num_done++;
+    out.num_words += mbr_->GetOneBest().size();
+    out.tot_bayes_risk += mbr_->GetBayesRisk();
+    delete mbr_;
+  }
+
+ private:
+  const MinimumBayesRiskOptions &opts_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  MbrDecodeOutput *output_;
+  MinimumBayesRisk *mbr_;  // The output of our process.  Owned locally.
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Do Minimum Bayes Risk decoding (decoding that aims to minimize the \n"
+        "expected word error rate).  This is a version of lattice-mbr-decode\n"
+        "that accepts the --num-threads option; see lattice-mbr-decode for a\n"
+        "description of the outputs.  The --max-time option limits the time\n"
+        "spent iterating on each lattice.\n"
+        "\n"
+        "Usage: lattice-mbr-decode-parallel [options]  lattice-rspecifier "
+        "transcriptions-wspecifier [ bayes-risk-wspecifier "
+        "[ sausage-stats-wspecifier [ times-wspecifier] ] ] \n"
+        " e.g.: lattice-mbr-decode-parallel --num-threads=8 --acoustic-scale=0.1 "
+        "ark:1.lats ark:1.tra ark:/dev/null ark:1.sau\n";
+
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 1.0;
+    BaseFloat lm_scale = 1.0;
+    bool one_best_times = false;
+    MinimumBayesRiskOptions mbr_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
+    std::string word_syms_filename;
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for "
+                "acoustic likelihoods");
+    po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
+                "probabilities");
+    po.Register("word-symbol-table", &word_syms_filename, "Symbol table for "
+                "words [for debug output]");
+    po.Register("one-best-times", &one_best_times, "If true, output times "
+                "corresponding to one-best, not whole sausage.");
+    mbr_opts.Register(&po);
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 2 || po.NumArgs() > 5) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string lats_rspecifier = po.GetArg(1),
+        trans_wspecifier = po.GetArg(2),
+        bayes_risk_wspecifier = po.GetOptArg(3),
+        sausage_stats_wspecifier = po.GetOptArg(4),
+        times_wspecifier = po.GetOptArg(5);
+
+    // Read as compact lattice.
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+
+    Int32VectorWriter trans_writer(trans_wspecifier);
+    BaseFloatWriter bayes_risk_writer(bayes_risk_wspecifier);
+    // Note: type Posterior = vector<vector<pair<int32,BaseFloat> > >
+    // happens to be the same as needed for the sausage stats.
+    PosteriorWriter sausage_stats_writer(sausage_stats_wspecifier);
+    BaseFloatPairVectorWriter times_writer(times_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    MbrDecodeOutput output;
+    output.trans_writer = &trans_writer;
+    output.bayes_risk_writer = &bayes_risk_writer;
+    output.sausage_stats_writer = &sausage_stats_writer;
+    output.times_writer = &times_writer;
+    output.word_syms = word_syms;
+    output.one_best_times = one_best_times;
+    output.num_done = 0;
+    output.num_words = 0;
+    output.tot_bayes_risk = 0.0;
+
+    {
+      TaskSequencer<MbrDecodeTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        // Will give ownership to "task" below.  We make a deep copy
+        // (constructing from the Fst base class), because OpenFst's reference
+        // counting is not thread-safe.
+        const fst::Fst<CompactLatticeArc> &value = clat_reader.Value();
+        CompactLattice *clat = new CompactLattice(value);
+        clat_reader.FreeCurrent();
+        sequencer.Run(new MbrDecodeTask(mbr_opts, lm_scale, acoustic_scale,
+                                        key, clat, &output));
+      }
+      sequencer.Wait();
+    }
+
+    KALDI_LOG << "Done " << output.num_done << " lattices.";
+    KALDI_LOG << "Average Bayes Risk per sentence is "
+              << (output.tot_bayes_risk / output.num_done) << " and per word, "
+              << (output.tot_bayes_risk / output.num_words);
+
+    delete word_syms;
+    return (output.num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,176 @@
+// lm/const-arpa-lm-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <set>
+
+#include "lm/const-arpa-lm.h"
+
+namespace kaldi {
+
+// Symbols used in the random language models.
+static const int32 kBos = 1, kEos = 2, kUnk = 3;
+
+// Writes a random trigram language model in Arpa format, with integer words
+// 1 ... num_words, and converts it to ConstArpaLm format in "lm".
+static void RandomConstArpaLm(int32 num_words, ConstArpaLm *lm) {
+  typedef std::set<std::vector<int32> > NgramSet;
+  int32 order = 3;
+  std::vector<NgramSet> ngrams(order);
+  for (int32 w = 1; w <= num_words; w++)
+    ngrams[0].insert(std::vector<int32>(1, w));
+  for (int32 n = 1; n < order; n++) {
+    std::vector<std::vector<int32> > histories(ngrams[n - 1].begin(),
+                                               ngrams[n - 1].end());
+    int32 num_ngrams = RandInt(num_words, 3 * num_words);
+    for (int32 i = 0; i < num_ngrams; i++) {
+      std::vector<int32> ngram = histories[RandInt(0, histories.size() - 1)];
+      if (ngram.back() == kEos) continue;
+      ngram.push_back(RandInt(kEos, num_words));  // <s> only comes first.
+      ngrams[n].insert(ngram);
+    }
+  }
+  // Only n-grams that are histories of higher-order n-grams get backoff
+  // weights, as in a real language model.
+  NgramSet histories;
+  for (int32 n = 1; n < order; n++)
+    for (NgramSet::iterator iter = ngrams[n].begin();
+         iter != ngrams[n].end(); ++iter)
+      histories.insert(std::vector<int32>(iter->begin(), iter->end() - 1));
+
+  std::string arpa_filename = "const-arpa-lm-test.arpa",
+      lm_filename = "const-arpa-lm-test.carpa";
+  {
+    Output ko(arpa_filename, false);
+    std::ostream &os = ko.Stream();
+    os << "\\data\\\n";
+    for (int32 n = 0; n < order; n++)
+      os << "ngram " << (n + 1) << "=" << ngrams[n].size() << "\n";
+    for (int32 n = 0; n < order; n++) {
+      // No empty line after the "\data\" section; the reader warns about it.
+      os << (n == 0 ? "" : "\n") << "\\" << (n + 1) << "-grams:\n";
+      for (NgramSet::iterator iter = ngrams[n].begin();
+           iter != ngrams[n].end(); ++iter) {
+        os << -RandUniform() * 4.0;
+        for (size_t i = 0; i < iter->size(); i++)
+          os << (i == 0 ? '\t' : ' ') << (*iter)[i];
+        if (histories.count(*iter) != 0)
+          os << '\t' << -RandUniform();
+        os << "\n";
+      }
+    }
+    os << "\n\\end\\\n";
+  }
+  BuildConstArpaLm(false, kBos, kEos, kUnk, arpa_filename, lm_filename);
+  ReadKaldiObject(lm_filename, lm);
+  unlink(arpa_filename.c_str());
+  unlink(lm_filename.c_str());
+}
+
+// Works out the log-probability and following history state in the same way
+// as ConstArpaLmDeterministicFst does, but without any cache.
+static float LookupDirectly(const ConstArpaLm &lm,
+                            const std::vector<int32> &hist, int32 word,
+                            std::vector<int32> *next_hist) {
+  float logprob = lm.GetNgramLogprob(word, hist);
+  *next_hist = hist;
+  next_hist->push_back(word);
+  while (static_cast<int32>(next_hist->size()) >= lm.NgramOrder())
+    next_hist->erase(next_hist->begin());
+  while (!lm.HistoryStateExists(*next_hist))
+    next_hist->erase(next_hist->begin());
+  return logprob;
+}
+
+// Checks that whatever a small cache returns agrees with direct lookups in
+// the language model, while entries are continually replaced.
+void UnitTestConstArpaLmCache() {
+  int32 num_words = RandInt(5, 20);
+  ConstArpaLm lm;
+  RandomConstArpaLm(num_words, &lm);
+  ConstArpaLmCache cache(RandInt(1, 10), RandInt(1, 3));
+
+  int32 num_found = 0, num_lookups = 1000;
+  std::vector<int32> hist(1, kBos);
+  for (int32 i = 0; i < num_lookups; i++) {
+    int32 word = RandInt(kEos + 1, num_words);
+    std::vector<int32> ref_next_hist, next_hist;
+    float ref_logprob = LookupDirectly(lm, hist, word, &ref_next_hist),
+        logprob;
+    if (cache.Lookup(hist, word, &logprob, &next_hist)) {
+      KALDI_ASSERT(logprob == ref_logprob && next_hist == ref_next_hist);
+      num_found++;
+    } else {
+      cache.Insert(hist, word, ref_logprob, ref_next_hist);
+      KALDI_ASSERT(cache.Lookup(hist, word, &logprob, &next_hist));
+      KALDI_ASSERT(logprob == ref_logprob && next_hist == ref_next_hist);
+    }
+    hist = (RandInt(0, 9) == 0 ? std::vector<int32>(1, kBos) : ref_next_hist);
+  }
+  KALDI_LOG << "Found " << num_found << " of " << num_lookups
+            << " lookups in the cache.";
+}
+
+// Checks that ConstArpaLmDeterministicFst gives the same scores and states
+// with and without a (small, shared) cache, and that the scores agree with
+// ConstArpaLm::GetNgramLogprob() given the full history.
+void UnitTestConstArpaLmDeterministicFst() {
+  typedef fst::StdArc::StateId StateId;
+  int32 num_words = RandInt(5, 20);
+  ConstArpaLm lm;
+  RandomConstArpaLm(num_words, &lm);
+  ConstArpaLmCache cache(RandInt(1, 20));
+
+  for (int32 utt = 0; utt < 20; utt++) {
+    // A new pair of FSTs for each utterance, as in lattice rescoring.
+    ConstArpaLmDeterministicFst fst(lm), cached_fst(lm, &cache);
+    StateId s = fst.Start(), cached_s = cached_fst.Start();
+    KALDI_ASSERT(s == cached_s);
+    std::vector<int32> words(1, kBos);
+    int32 length = RandInt(0, 10);
+    for (int32 i = 0; i < length; i++) {
+      int32 word = RandInt(kEos + 1, num_words);
+      fst::StdArc arc, cached_arc;
+      KALDI_ASSERT(fst.GetArc(s, word, &arc));
+      KALDI_ASSERT(cached_fst.GetArc(cached_s, word, &cached_arc));
+      KALDI_ASSERT(arc.weight == cached_arc.weight &&
+                   arc.nextstate == cached_arc.nextstate);
+      // The history in the FST state may be shorter than the full history,
+      // but that should not change the score.
+      int32 start = std::max<int32>(
+          0, static_cast<int32>(words.size()) - (lm.NgramOrder() - 1));
+      std::vector<int32> hist(words.begin() + start, words.end());
+      AssertEqual(-arc.weight.Value(), lm.GetNgramLogprob(word, hist));
+      words.push_back(word);
+      s = arc.nextstate;
+      cached_s = cached_arc.nextstate;
+    }
+    KALDI_ASSERT(fst.Final(s) == cached_fst.Final(cached_s));
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++) {
+    UnitTestConstArpaLmCache();
+    UnitTestConstArpaLmDeterministicFst();
+  }
+  KALDI_LOG << "Tests succeeded.";
+}
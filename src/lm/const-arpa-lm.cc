@@ -1026,8 +1026,63 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
   os << std::endl << "\\end\\" << std::endl;
 }
 
+ConstArpaLmCache::ConstArpaLmCache(size_t capacity, int32 num_locks) {
+  KALDI_ASSERT(num_locks > 0);
+  entries_.resize(std::max<size_t>(capacity, 1));
+  mutexes_.resize(num_locks);
+  for (int32 i = 0; i < num_locks; i++)
+    mutexes_[i] = new Mutex();
+}
+
+ConstArpaLmCache::~ConstArpaLmCache() {
+  DeletePointers(&mutexes_);
+}
+
+size_t ConstArpaLmCache::GetIndex(const std::vector<int32> &hist,
+                                  int32 word) const {
+  // The same as VectorHasher applied to "hist" followed by "word", without
+  // having to build that vector.
+  const size_t kPrime = 7853;
+  size_t ans = 0;
+  std::vector<int32>::const_iterator iter = hist.begin(), end = hist.end();
+  for (; iter != end; ++iter)
+    ans = ans * kPrime + *iter;
+  ans = ans * kPrime + word;
+  return ans % entries_.size();
+}
+
+bool ConstArpaLmCache::Lookup(const std::vector<int32> &hist, int32 word,
+                              float *logprob, std::vector<int32> *next_hist) {
+  size_t index = GetIndex(hist, word);
+  const Entry &entry = entries_[index];
+  Mutex *mutex = mutexes_[index % mutexes_.size()];
+  mutex->Lock();
+  bool found = (entry.word == word && entry.hist == hist);
+  if (found) {
+    *logprob = entry.logprob;
+    *next_hist = entry.next_hist;
+  }
+  mutex->Unlock();
+  return found;
+}
+
+void ConstArpaLmCache::Insert(const std::vector<int32> &hist, int32 word,
+                              float logprob,
+                              const std::vector<int32> &next_hist) {
+  KALDI_ASSERT(word >= 0);
+  size_t index = GetIndex(hist, word);
+  Entry &entry = entries_[index];
+  Mutex *mutex = mutexes_[index % mutexes_.size()];
+  mutex->Lock();
+  entry.hist = hist;
+  entry.word = word;
+  entry.logprob = logprob;
+  entry.next_hist = next_hist;
+  mutex->Unlock();
+}
+
 ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
-    const ConstArpaLm& lm) : lm_(lm) {
+    const ConstArpaLm& lm, ConstArpaLmCache *cache) : lm_(lm), cache_(cache) {
   // Creates a history state for <s>.
   std::vector<Label> bos_state(1, lm_.BosSymbol());
   state_to_wseq_.push_back(bos_state);
@@ -1047,25 +1102,32 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
                                          Label ilabel, fst::StdArc *oarc) {
   // At this point, we should have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  std::vector<Label> wseq = state_to_wseq_[s];
-
-  float logprob = lm_.GetNgramLogprob(ilabel, wseq);
+  std::vector<Label> wseq;
+  float logprob;
+  if (cache_ == NULL ||
+      !cache_->Lookup(state_to_wseq_[s], ilabel, &logprob, &wseq)) {
+    wseq = state_to_wseq_[s];
+    logprob = lm_.GetNgramLogprob(ilabel, wseq);
+    if (logprob != std::numeric_limits<float>::min()) {
+      // Locates the next state in ConstArpaLm. Note that OOV and backoff have
+      // been taken care of in ConstArpaLm.
+      wseq.push_back(ilabel);
+      while (wseq.size() >= lm_.NgramOrder()) {
+        // History state has at most lm_.NgramOrder() -1 words in the state.
+        wseq.erase(wseq.begin(), wseq.begin() + 1);
+      }
+      while (!lm_.HistoryStateExists(wseq)) {
+        KALDI_ASSERT(wseq.size() > 0);
+        wseq.erase(wseq.begin(), wseq.begin() + 1);
+      }
+    }
+    if (cache_ != NULL)
+      cache_->Insert(state_to_wseq_[s], ilabel, logprob, wseq);
+  }
   if (logprob == std::numeric_limits<float>::min()) {
     return false;
   }
 
-  // Locates the next state in ConstArpaLm. Note that OOV and backoff have been
-  // taken care of in ConstArpaLm.
-  wseq.push_back(ilabel);
-  while (wseq.size() >= lm_.NgramOrder()) {
-    // History state has at most lm_.NgramOrder() -1 words in the state.
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
-  }
-  while (!lm_.HistoryStateExists(wseq)) {
-    KALDI_ASSERT(wseq.size() > 0);
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
-  }
-
   std::pair<const std::vector<Label>, StateId> wseq_state_pair(
       wseq, static_cast<Label>(state_to_wseq_.size()));
 
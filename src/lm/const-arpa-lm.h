@@ -22,6 +22,7 @@
 
 #include "base/kaldi-common.h"
 #include "fstext/deterministic-fst.h"
+#include "thread/kaldi-mutex.h"
 #include "util/common-utils.h"
 
 namespace kaldi {
@@ -195,6 +196,53 @@ class ConstArpaLm {
   int32* lm_states_;
 };
 
+/**
+ This class is a cache of the results of looking up a word given a history in a
+ ConstArpaLm: the log-probability, and the history state that follows.  It is
+ intended to be shared between the ConstArpaLmDeterministicFst objects that are
+ created for different utterances, possibly in different threads, so that the
+ lookups for common histories are done only once; it is thread-safe.  It has a
+ fixed number of entries, and each (history, word) pair can only be stored in
+ the one entry given by its hash value, so inserting a pair replaces whatever
+ was stored there before; this keeps a lookup down to one hash, one lock and
+ one comparison.  The entries are protected by a fixed number of locks.
+ */
+class ConstArpaLmCache {
+ public:
+  // "capacity" is the number of entries; they are shared between "num_locks"
+  // locks.
+  explicit ConstArpaLmCache(size_t capacity, int32 num_locks = 64);
+
+  ~ConstArpaLmCache();
+
+  // If the result of looking up "word" given "hist" is in the cache, outputs
+  // the log-probability and following history state, and returns true.
+  bool Lookup(const std::vector<int32> &hist, int32 word, float *logprob,
+              std::vector<int32> *next_hist);
+
+  // Adds an entry to the cache, replacing the one (if any) that was stored in
+  // the same place.
+  void Insert(const std::vector<int32> &hist, int32 word, float logprob,
+              const std::vector<int32> &next_hist);
+
+ private:
+  struct Entry {
+    std::vector<int32> hist;
+    int32 word;  // -1 if the entry is unused.
+    float logprob;
+    std::vector<int32> next_hist;
+    Entry(): word(-1), logprob(0.0) { }
+  };
+
+  // Returns the index into entries_ for this history and word.
+  size_t GetIndex(const std::vector<int32> &hist, int32 word) const;
+
+  std::vector<Entry> entries_;
+  std::vector<Mutex*> mutexes_;  // entries_[i] is protected by
+                                 // mutexes_[i % mutexes_.size()].
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ConstArpaLmCache);
+};
+
 /**
  This class wraps a ConstArpaLm format language model with the interface defined
  in DeterministicOnDemandFst.
@@ -206,7 +254,11 @@ class ConstArpaLmDeterministicFst :
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  ConstArpaLmDeterministicFst(const ConstArpaLm& lm);
+  // If "cache" is not NULL, it is used (and updated) when working out the
+  // arcs; it is not owned here, and it may be shared with other objects of
+  // this class that wrap the same language model.
+  ConstArpaLmDeterministicFst(const ConstArpaLm& lm,
+                              ConstArpaLmCache *cache = NULL);
 
   // We cannot use "const" because the pure virtual function in the interface is
   // not const.
@@ -225,6 +277,7 @@ class ConstArpaLmDeterministicFst :
   MapType wseq_to_state_;
   std::vector<std::vector<Label> > state_to_wseq_;
   const ConstArpaLm& lm_;
+  ConstArpaLmCache *cache_;
 };
 
 // Reads in an Arpa format language model and converts it into ConstArpaLm
@@ -202,6 +202,64 @@ void UnitTestSparseMatrixTraceMatSmat() {
   }
 }
 
+// GeneralMatrix only supports BaseFloat, so this is not templated.
+void UnitTestAppendGeneralMatrixRows() {
+  for (int32 i = 0; i < 10; i++) {
+    int32 num_mats = 1 + Rand() % 5, num_cols = 10 + Rand() % 20;
+    bool sparse = (i % 2 == 0);
+    std::vector<GeneralMatrix> mats(num_mats);
+    std::vector<Matrix<BaseFloat> > full_mats(num_mats);
+    int32 tot_rows = 0;
+    for (int32 j = 0; j < num_mats; j++) {
+      int32 num_rows = 1 + Rand() % 10;
+      full_mats[j].Resize(num_rows, num_cols);
+      if (sparse) {
+        SparseMatrix<BaseFloat> smat(num_rows, num_cols);
+        smat.SetRandn(0.8);
+        smat.CopyToMat(&(full_mats[j]));
+        mats[j] = smat;
+      } else {
+        full_mats[j].SetRandn();
+        mats[j] = full_mats[j];
+        if (j % 2 == 1) {
+          mats[j].Compress();
+          mats[j].CopyToMat(&(full_mats[j]));
+        }
+      }
+      tot_rows += num_rows;
+    }
+    Matrix<BaseFloat> ref(tot_rows, num_cols);
+    int32 row_offset = 0;
+    for (int32 j = 0; j < num_mats; j++) {
+      int32 num_rows = full_mats[j].NumRows();
+      ref.RowRange(row_offset, num_rows).CopyFromMat(full_mats[j]);
+      row_offset += num_rows;
+    }
+
+    std::vector<const GeneralMatrix*> const_ptrs(num_mats);
+    std::vector<GeneralMatrix*> ptrs(num_mats);
+    for (int32 j = 0; j < num_mats; j++)
+      const_ptrs[j] = ptrs[j] = &(mats[j]);
+
+    GeneralMatrix appended1, appended2;
+    // Call twice on the same output, to test the reuse of its memory.
+    AppendGeneralMatrixRows(const_ptrs, &appended1);
+    AppendGeneralMatrixRows(const_ptrs, &appended1);
+    AppendGeneralMatrixRows(ptrs, &appended2);
+    KALDI_ASSERT((appended1.Type() == kSparseMatrix) == sparse &&
+                 (appended2.Type() == kSparseMatrix) == sparse);
+    Matrix<BaseFloat> mat1(appended1.NumRows(), appended1.NumCols()),
+        mat2(appended2.NumRows(), appended2.NumCols());
+    appended1.CopyToMat(&mat1);
+    appended2.CopyToMat(&mat2);
+    AssertEqual(mat1, ref);
+    AssertEqual(mat2, ref);
+    // the destructive version clears the inputs.
+    for (int32 j = 0; j < num_mats; j++)
+      KALDI_ASSERT(mats[j].NumRows() == 0);
+  }
+}
+
 template <typename Real>
 void SparseMatrixUnitTest() {
   // SparseVector
@@ -223,6 +281,7 @@ int main() {
   kaldi::SetVerboseLevel(5);
   kaldi::SparseMatrixUnitTest<float>();
   kaldi::SparseMatrixUnitTest<double>();
+  kaldi::UnitTestAppendGeneralMatrixRows();
   KALDI_LOG << "Tests succeeded.";
   return 0;
 }
@@ -64,6 +64,14 @@ void SparseVector<Real>::CopyToVec(VectorBase<OtherReal> *vec) const {
     other_data[iter->first] = iter->second;
 }
 
+template
+void SparseVector<float>::CopyToVec(VectorBase<float> *vec) const;
+template
+void SparseVector<float>::CopyToVec(VectorBase<double> *vec) const;
+template
+void SparseVector<double>::CopyToVec(VectorBase<float> *vec) const;
+template
+void SparseVector<double>::CopyToVec(VectorBase<double> *vec) const;
 
 template <typename Real>
 template <typename OtherReal>
@@ -813,53 +821,117 @@ void GeneralMatrix::Read(std::istream &is, bool binary) {
 }
 
 
-void AppendGeneralMatrixRows(const std::vector<const GeneralMatrix *> &src,
-                             GeneralMatrix *mat) {
-  mat->Clear();
-  int32 size = src.size();
-  if (size == 0)
-    return;
+// This is called from the two versions of AppendGeneralMatrixRows(); it works
+// out whether all the inputs are sparse (or empty), and the total number of
+// rows and the number of columns of the output.
+template <class GeneralMatrixPtr>
+static bool GetAppendedGeneralMatrixSize(const std::vector<GeneralMatrixPtr> &src,
+                                         int32 *tot_rows_out,
+                                         int32 *num_cols_out) {
+  int32 size = src.size(), tot_rows = 0, num_cols = -1;
   bool all_sparse = true;
   for (int32 i = 0; i < size; i++) {
-    if (src[i]->Type() != kSparseMatrix && src[i]->NumRows() != 0) {
-      all_sparse = false;
-      break;
+    const GeneralMatrix &src_mat = *(src[i]);
+    int32 src_rows = src_mat.NumRows(), src_cols = src_mat.NumCols();
+    if (src_rows != 0) {
+      if (src_mat.Type() != kSparseMatrix)
+        all_sparse = false;
+      tot_rows += src_rows;
+      if (num_cols == -1) num_cols = src_cols;
+      else if (num_cols != src_cols)
+        KALDI_ERR << "Appending rows of matrices with inconsistent num-cols: "
+                  << num_cols << " vs. " << src_cols;
     }
   }
-  if (all_sparse) {
-    std::vector<SparseMatrix<BaseFloat> > sparse_mats(size);
-    for (int32 i = 0; i < size; i++)
-      sparse_mats[i] = src[i]->GetSparseMatrix();
-    SparseMatrix<BaseFloat> appended_mat;
-    appended_mat.AppendSparseMatrixRows(&sparse_mats);
-    mat->SwapSparseMatrix(&appended_mat);
-  } else {
-    int32 tot_rows = 0, num_cols = -1;
+  *tot_rows_out = tot_rows;
+  *num_cols_out = (num_cols == -1 ? 0 : num_cols);
+  return all_sparse;
+}
+
+// This is called from the two versions of AppendGeneralMatrixRows() for the
+// case where not all inputs are sparse.  It copies (decompressing where
+// necessary) each input directly into its row-range of the output, reusing
+// the memory of "mat" if it was already a full matrix of the right size.
+template <class GeneralMatrixPtr>
+static void AppendGeneralMatrixRowsFull(const std::vector<GeneralMatrixPtr> &src,
+                                        int32 tot_rows, int32 num_cols,
+                                        GeneralMatrix *mat) {
+  Matrix<BaseFloat> appended_mat;
+  if (mat->Type() == kFullMatrix)
+    mat->SwapFullMatrix(&appended_mat);
+  mat->Clear();
+  // The following will not reallocate if the size is unchanged.
+  appended_mat.Resize(tot_rows, num_cols, kUndefined);
+  int32 size = src.size(), row_offset = 0;
+  for (int32 i = 0; i < size; i++) {
+    const GeneralMatrix &src_mat = *(src[i]);
+    int32 src_rows = src_mat.NumRows();
+    if (src_rows != 0) {
+      SubMatrix<BaseFloat> dest_submat(appended_mat, row_offset, src_rows,
+                                       0, num_cols);
+      src_mat.CopyToMat(&dest_submat);
+      row_offset += src_rows;
+    }
+  }
+  KALDI_ASSERT(row_offset == tot_rows);
+  mat->SwapFullMatrix(&appended_mat);
+}
+
+void AppendGeneralMatrixRows(const std::vector<const GeneralMatrix *> &src,
+                             GeneralMatrix *mat) {
+  if (src.empty()) {
+    mat->Clear();
+    return;
+  }
+  int32 tot_rows, num_cols;
+  if (GetAppendedGeneralMatrixSize(src, &tot_rows, &num_cols)) {
+    // All sparse: copy the rows directly into a pre-sized SparseMatrix.
+    mat->Clear();
+    SparseMatrix<BaseFloat> appended_mat(tot_rows, num_cols);
+    SparseVector<BaseFloat> *dest_row = appended_mat.Data();
+    int32 size = src.size();
     for (int32 i = 0; i < size; i++) {
-      const GeneralMatrix &src_mat = *(src[i]);
-      int32 src_rows = src_mat.NumRows(), src_cols = src_mat.NumCols();
-      if (src_rows != 0) {
-        tot_rows += src_rows;
-        if (num_cols == -1) num_cols = src_cols;
-        else if (num_cols != src_cols)
-          KALDI_ERR << "Appending rows of matrices with inconsistent num-cols: "
-                    << num_cols << " vs. " << src_cols;
-      }
+      if (src[i]->NumRows() == 0)
+        continue;
+      const SparseMatrix<BaseFloat> &src_mat = src[i]->GetSparseMatrix();
+      int32 src_rows = src_mat.NumRows();
+      for (int32 r = 0; r < src_rows; r++, dest_row++)
+        *dest_row = src_mat.Row(r);
     }
-    Matrix<BaseFloat> appended_mat(tot_rows, num_cols, kUndefined);
-    int32 row_offset = 0;
+    mat->SwapSparseMatrix(&appended_mat);
+  } else {
+    AppendGeneralMatrixRowsFull(src, tot_rows, num_cols, mat);
+  }
+}
+
+void AppendGeneralMatrixRows(const std::vector<GeneralMatrix *> &src,
+                             GeneralMatrix *mat) {
+  if (src.empty()) {
+    mat->Clear();
+    return;
+  }
+  int32 tot_rows, num_cols;
+  if (GetAppendedGeneralMatrixSize(src, &tot_rows, &num_cols)) {
+    // All sparse: move the rows of the inputs into the output.
+    mat->Clear();
+    SparseMatrix<BaseFloat> appended_mat(tot_rows, num_cols), src_mat;
+    SparseVector<BaseFloat> *dest_row = appended_mat.Data();
+    int32 size = src.size();
     for (int32 i = 0; i < size; i++) {
-      const GeneralMatrix &src_mat = *(src[i]);
+      if (src[i]->NumRows() == 0)
+        continue;
+      src[i]->SwapSparseMatrix(&src_mat);
       int32 src_rows = src_mat.NumRows();
-      if (src_rows != 0) {
-        SubMatrix<BaseFloat> dest_submat(appended_mat, row_offset, src_rows,
-                                         0, num_cols);
-        src_mat.CopyToMat(&dest_submat);
-        row_offset += src_rows;
-      }
+      SparseVector<BaseFloat> *src_row = src_mat.Data();
+      for (int32 r = 0; r < src_rows; r++, dest_row++, src_row++)
+        dest_row->Swap(src_row);
+      src_mat.Resize(0, 0);
     }
-    KALDI_ASSERT(row_offset == tot_rows);
-    mat->SwapFullMatrix(&appended_mat);
+    mat->SwapSparseMatrix(&appended_mat);
+  } else {
+    AppendGeneralMatrixRowsFull(src, tot_rows, num_cols, mat);
+    for (size_t i = 0; i < src.size(); i++)
+      src[i]->Clear();
   }
 }
 
@@ -325,10 +325,30 @@ class GeneralMatrix {
 /// Appends all the matrix rows of a list of GeneralMatrixes, to get a single
 /// GeneralMatrix.  Preserves sparsity if all inputs were sparse (or empty).
 /// Does not preserve compression, if inputs were compressed; you have to
-/// re-compress manually, if that's what you need.
+/// re-compress manually, if that's what you need.  Compressed inputs are
+/// uncompressed directly into the output.  If "mat" is already a full
+/// (uncompressed) matrix of exactly the output size, its memory is reused,
+/// which saves an allocation when this is called repeatedly with the same
+/// output (e.g. for minibatches).  Note: this reuse never happens if you
+/// compress "mat" after each call, since it is then no longer a full matrix
+/// the next time round.
 void AppendGeneralMatrixRows(const std::vector<const GeneralMatrix *> &src,
                              GeneralMatrix *mat);
 
+/// This version of AppendGeneralMatrixRows() is destructive of the inputs;
+/// the output is the same as for the const version.  On successful return,
+/// every element of "src" is empty (NumRows() == 0), whatever its type was;
+/// no input is left in any other state.  Rows are only moved rather than
+/// copied when all the inputs are sparse (or empty); in that case each
+/// SparseVector row is swapped into the output without copying its
+/// elements.  Otherwise the inputs are copied (decompressing where needed)
+/// exactly as in the const version, and cleared afterwards.  If the inputs
+/// have inconsistent numbers of columns this function dies before modifying
+/// anything.  The pointers in "src" must be distinct and must not point to
+/// "mat".
+void AppendGeneralMatrixRows(const std::vector<GeneralMatrix *> &src,
+                             GeneralMatrix *mat);
+
 
 /// Outputs a SparseMatrix<Real> containing only the rows r of "in" such that
 /// keep_rows[r] == true.  keep_rows.size() must equal in.NumRows(), and rows
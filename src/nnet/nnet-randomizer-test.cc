@@ -213,9 +213,47 @@ void UnitTestStdVectorRandomizer() {
 }
 
 
+void UnitTestMatrixRandomizerScratch() {
+  Matrix<BaseFloat> m(1111,10);
+  InitRand(&m);
+  CuMatrix<BaseFloat> m2(m);
+  // config
+  NnetDataRandomizerOptions c;
+  c.randomizer_size = 1000;
+  c.minibatch_size = 100;
+  c.randomizer_scratch_dir = ".";
+  // randomizer, in-memory randomizer as reference
+  MatrixRandomizer r(c);
+  NnetDataRandomizerOptions c_mem(c);
+  c_mem.randomizer_scratch_dir = "";
+  MatrixRandomizer r_mem(c_mem);
+  // shuffle twice, the 2nd time with the left-over from the 1st pass
+  for (int32 pass = 0; pass < 2; pass++) {
+    r.AddData(m2);
+    r_mem.AddData(m2);
+    KALDI_ASSERT(r.IsFull());
+    KALDI_ASSERT(r.NumFrames() == r_mem.NumFrames());
+    std::vector<int32> mask(r.NumFrames());
+    for(int32 i=0; i<mask.size(); i++) { mask[i]=i; }
+    std::random_shuffle(mask.begin(), mask.end());
+    r.Randomize(mask);
+    r_mem.Randomize(mask);
+    // make sure we get the same data as from the in-memory randomizer
+    int32 i=0;
+    for( ; !r.Done(); r.Next(), r_mem.Next(), i++) {
+      Matrix<BaseFloat> m3(r.Value()), m4(r_mem.Value());
+      AssertEqual(m3, m4);
+    }
+    KALDI_ASSERT(r_mem.Done());
+    KALDI_ASSERT(i == 11); // 11 minibatches (+11 frames left-over)
+  }
+}
+
+
 int main() {
   UnitTestRandomizerMask();
   UnitTestMatrixRandomizer();
+  UnitTestMatrixRandomizerScratch();
   UnitTestVectorRandomizer();
   UnitTestStdVectorRandomizer();
   
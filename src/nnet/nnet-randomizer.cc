@@ -21,6 +21,13 @@
 
 #include <algorithm>
 #include <vector>
+#include <cerrno>
+#include <cstring>
+
+#if !defined(_MSC_VER)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 namespace kaldi {
 namespace nnet1 {
@@ -42,7 +49,105 @@ const std::vector<int32>& RandomizerMask::Generate(int32 mask_size) {
 
 /* MatrixRandomizer:: */
 
+MatrixRandomizer::~MatrixRandomizer() {
+#if !defined(_MSC_VER)
+  if (scratch_data_ != NULL) {
+    munmap(scratch_data_, static_cast<size_t>(scratch_rows_) * scratch_cols_ * sizeof(BaseFloat));
+  }
+  if (scratch_fd_ >= 0) {
+    close(scratch_fd_);
+  }
+#endif
+}
+
+void MatrixRandomizer::ResizeScratch(int32 num_rows, int32 num_cols) {
+#if defined(_MSC_VER)
+  KALDI_ERR << "--randomizer-scratch-dir is not supported on Windows";
+#else
+  if (scratch_fd_ < 0) {
+    // create the scratch file, unlink it right away so it is removed
+    // even if the training crashes,
+    std::string name = conf_.randomizer_scratch_dir + "/nnet-randomizer.XXXXXX";
+    std::vector<char> name_buf(name.begin(), name.end());
+    name_buf.push_back('\0');
+    scratch_fd_ = mkstemp(&name_buf[0]);
+    if (scratch_fd_ < 0) {
+      KALDI_ERR << "Cannot create scratch file " << name << ", " << strerror(errno);
+    }
+    unlink(&name_buf[0]);
+    scratch_cols_ = num_cols;
+  }
+  KALDI_ASSERT(num_cols == scratch_cols_ && num_rows >= scratch_rows_);
+  if (scratch_data_ != NULL) {
+    munmap(scratch_data_, static_cast<size_t>(scratch_rows_) * scratch_cols_ * sizeof(BaseFloat));
+    scratch_data_ = NULL;
+  }
+  size_t num_bytes = static_cast<size_t>(num_rows) * num_cols * sizeof(BaseFloat);
+  if (ftruncate(scratch_fd_, num_bytes) != 0) {
+    KALDI_ERR << "Cannot resize scratch file to " << num_bytes << " bytes, " << strerror(errno);
+  }
+  void *p = mmap(NULL, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, scratch_fd_, 0);
+  if (p == MAP_FAILED) {
+    KALDI_ERR << "Cannot mmap scratch file of " << num_bytes << " bytes, " << strerror(errno);
+  }
+  scratch_data_ = static_cast<BaseFloat*>(p);
+  scratch_rows_ = num_rows;
+  KALDI_VLOG(1) << "Randomizer scratch file has " << num_rows << " rows, "
+                << num_bytes / (1024*1024) << " MB";
+#endif
+}
+
+void MatrixRandomizer::PrefetchScratch(int32 begin) {
+#if !defined(_MSC_VER)
+  int32 end = std::min(begin + conf_.minibatch_size, data_end_);
+  size_t page_size = sysconf(_SC_PAGESIZE),
+         row_bytes = scratch_cols_ * sizeof(BaseFloat);
+  for (int32 i = begin; i < end; i++) {
+    int32 r = (mask_.empty() ? i : mask_[i]);
+    // madvise needs page-aligned address,
+    size_t addr = reinterpret_cast<size_t>(ScratchRow(r)),
+           page_begin = addr & ~(page_size - 1);
+    madvise(reinterpret_cast<void*>(page_begin), addr + row_bytes - page_begin, MADV_WILLNEED);
+  }
+#endif
+}
+
 void MatrixRandomizer::AddData(const CuMatrixBase<BaseFloat>& m) {
+  if (UseScratch()) {
+    // pre-allocate before 1st use
+    if (scratch_rows_ == 0) {
+      ResizeScratch(conf_.randomizer_size, m.NumCols());
+    }
+    KALDI_ASSERT(m.NumCols() == scratch_cols_);
+    // optionally put previous left-over to front,
+    // (the left-over rows are in the order of the mask, so we gather them)
+    if (data_begin_ > 0) {
+      KALDI_ASSERT(data_begin_ <= data_end_); // sanity check
+      int32 leftover = data_end_ - data_begin_;
+      Matrix<BaseFloat> leftover_rows(leftover, scratch_cols_, kUndefined);
+      for (int32 i = 0; i < leftover; i++) {
+        int32 r = (mask_.empty() ? data_begin_ + i : mask_[data_begin_ + i]);
+        leftover_rows.Row(i).CopyFromVec(SubVector<BaseFloat>(ScratchRow(r), scratch_cols_));
+      }
+      for (int32 i = 0; i < leftover; i++) {
+        SubVector<BaseFloat>(ScratchRow(i), scratch_cols_).CopyFromVec(leftover_rows.Row(i));
+      }
+      data_begin_ = 0; data_end_ = leftover;
+      mask_.clear();
+    }
+    // extend the buffer if necessary
+    if (scratch_rows_ < data_end_ + m.NumRows()) {
+      ResizeScratch(data_end_ + m.NumRows() + 1000, scratch_cols_); // +1000 row extra
+    }
+    // copy the data
+    Matrix<BaseFloat> m_host(m.NumRows(), m.NumCols(), kUndefined);
+    m.CopyToMat(&m_host);
+    for (int32 i = 0; i < m_host.NumRows(); i++) {
+      SubVector<BaseFloat>(ScratchRow(data_end_ + i), scratch_cols_).CopyFromVec(m_host.Row(i));
+    }
+    data_end_ += m.NumRows();
+    return;
+  }
   // pre-allocate before 1st use
   if(data_.NumCols() == 0) {
     data_.Resize(conf_.randomizer_size,m.NumCols());
@@ -73,6 +178,12 @@ void MatrixRandomizer::Randomize(const std::vector<int32>& mask) {
   KALDI_ASSERT(data_begin_ == 0);
   KALDI_ASSERT(data_end_ > 0);
   KALDI_ASSERT(data_end_ == mask.size());
+  if (UseScratch()) {
+    // the rows stay in place, they get gathered by Value(),
+    mask_ = mask;
+    PrefetchScratch(0);
+    return;
+  }
   // Copy to auxiliary buffer for unshuffled data
   data_aux_ = data_;
   // Put the mask to GPU 
@@ -92,6 +203,19 @@ void MatrixRandomizer::Next() {
 
 const CuMatrixBase<BaseFloat>& MatrixRandomizer::Value() {
   KALDI_ASSERT(data_end_ - data_begin_ >= conf_.minibatch_size); // have data for minibatch
+  if (UseScratch()) {
+    // gather the rows of the mini-batch,
+    minibatch_host_.Resize(conf_.minibatch_size, scratch_cols_, kUndefined);
+    for (int32 i = 0; i < conf_.minibatch_size; i++) {
+      int32 r = (mask_.empty() ? data_begin_ + i : mask_[data_begin_ + i]);
+      minibatch_host_.Row(i).CopyFromVec(SubVector<BaseFloat>(ScratchRow(r), scratch_cols_));
+    }
+    // read-ahead the next mini-batch,
+    PrefetchScratch(data_begin_ + conf_.minibatch_size);
+    minibatch_.Resize(conf_.minibatch_size, scratch_cols_, kUndefined);
+    minibatch_.CopyFromMat(minibatch_host_);
+    return minibatch_;
+  }
   minibatch_.Resize(conf_.minibatch_size, data_.NumCols(),kUndefined);
   minibatch_.CopyFromMat(data_.RowRange(data_begin_,conf_.minibatch_size));
   return minibatch_;
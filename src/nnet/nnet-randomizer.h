@@ -21,6 +21,9 @@
 #ifndef KALDI_NNET_NNET_RANDOMIZER_H_
 #define KALDI_NNET_NNET_RANDOMIZER_H_
 
+#include <string>
+#include <vector>
+
 #include "base/kaldi-math.h"
 #include "itf/options-itf.h"
 #include "cudamatrix/cu-matrix.h"
@@ -34,6 +37,7 @@ struct NnetDataRandomizerOptions {
   int32 randomizer_size; // Maximum number of samples we want to have in memory at once.
   int32 randomizer_seed;
   int32 minibatch_size;  // Size of a single mini-batch.
+  std::string randomizer_scratch_dir; // If set, MatrixRandomizer keeps its buffer in a mmap'ed file in this directory.
 
   NnetDataRandomizerOptions()
    : randomizer_size(32768), randomizer_seed(777), minibatch_size(256) 
@@ -43,6 +47,7 @@ struct NnetDataRandomizerOptions {
     opts->Register("randomizer-size", &randomizer_size, "Capacity of randomizer, length of concatenated utterances which are used for frame-level shuffling (in frames, affects memory consumption, max 8000000).");
     opts->Register("randomizer-seed", &randomizer_seed, "Seed value for srand, sets fixed order of frame-level shuffling");
     opts->Register("minibatch-size", &minibatch_size, "Size of a minibatch.");
+    opts->Register("randomizer-scratch-dir", &randomizer_scratch_dir, "If set, the feature randomizer stores its buffer in a memory-mapped scratch file in this directory (file is deleted on exit), the resident memory stays bounded with large --randomizer-size, the minibatches are gathered from the file with prefetching. [ empty == buffer in (GPU) memory ]");
   }
 };
 ///
@@ -63,10 +68,18 @@ class RandomizerMask {
 
 
 /// Randomizes rows of a matrix according to a mask
+///
+/// With 'randomizer_scratch_dir' set, the buffer is not held in (GPU) memory,
+/// but in a memory-mapped scratch file (the OS pages it in/out as needed),
+/// the shuffling is done by gathering the rows of each mini-batch
+/// through the mask, while the rows of the next mini-batch are prefetched.
 class MatrixRandomizer {
  public:
-  MatrixRandomizer() : data_begin_(0), data_end_(0) { }
-  MatrixRandomizer(const NnetDataRandomizerOptions &conf) : data_begin_(0), data_end_(0) { Init(conf); }
+  MatrixRandomizer() : data_begin_(0), data_end_(0),
+    scratch_fd_(-1), scratch_data_(NULL), scratch_rows_(0), scratch_cols_(0) { }
+  MatrixRandomizer(const NnetDataRandomizerOptions &conf) : data_begin_(0), data_end_(0),
+    scratch_fd_(-1), scratch_data_(NULL), scratch_rows_(0), scratch_cols_(0) { Init(conf); }
+  ~MatrixRandomizer();
   /// Set the randomizer parameters (size)
   void Init(const NnetDataRandomizerOptions& conf) { conf_ = conf; }
 
@@ -97,6 +110,24 @@ class MatrixRandomizer {
   int32 data_end_;   
 
   NnetDataRandomizerOptions conf_;
+
+  // The disk-backed buffer (used with 'randomizer_scratch_dir'),
+  bool UseScratch() const { return !conf_.randomizer_scratch_dir.empty(); }
+  /// Opens the scratch file, or grows it to 'num_rows' (remaps the buffer),
+  void ResizeScratch(int32 num_rows, int32 num_cols);
+  /// Pointer to a row of the scratch buffer,
+  BaseFloat* ScratchRow(int32 r) { return scratch_data_ + static_cast<size_t>(r) * scratch_cols_; }
+  /// Asks the OS to read-ahead the rows of the mini-batch starting at 'begin',
+  void PrefetchScratch(int32 begin);
+
+  int32 scratch_fd_;
+  BaseFloat *scratch_data_; // mmap'ed scratch file,
+  int32 scratch_rows_;
+  int32 scratch_cols_;
+  std::vector<int32> mask_; // the row order for the mini-batches (scratch mode),
+  Matrix<BaseFloat> minibatch_host_; // mini-batch gathered from the scratch file,
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MatrixRandomizer);
 };
 
 
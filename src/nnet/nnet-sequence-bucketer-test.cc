@@ -0,0 +1,103 @@
+// nnet/nnet-sequence-bucketer-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet/nnet-sequence-bucketer.h"
+
+#include <algorithm>
+#include <set>
+
+using namespace kaldi;
+using namespace kaldi::nnet1;
+
+//////////////////////////////////////////////////
+
+// Feeds 'num_utt' utterances of random length through the bucketer,
+// checks that every utterance comes out exactly once with its own data,
+// returns the padding efficiency when grouping by 'num_streams',
+static BaseFloat RunBucketer(int32 bucket_buffer, int32 num_streams,
+                             int32 num_utt) {
+  SequenceBucketerOptions opts;
+  opts.bucket_buffer = bucket_buffer;
+  SequenceBucketer bucketer(opts, num_streams);
+  PaddingStats stats;
+
+  std::set<std::string> seen;
+  int32 u = 0;
+  std::vector<int32> group;
+  while (true) {
+    for ( ; !bucketer.IsFull() && u < num_utt; u++) {
+      int32 len = 1 + Rand() % 1000;
+      std::ostringstream key; key << "utt" << u;
+      Matrix<BaseFloat> feats(len, 2);
+      feats.Set(u);
+      Posterior targets(len);
+      Vector<BaseFloat> weights(len);
+      weights.Set(1.0);
+      bucketer.AcceptSequence(key.str(), &feats, &targets, &weights);
+      KALDI_ASSERT(feats.NumRows() == 0 && targets.empty() &&
+                   weights.Dim() == 0);
+    }
+    if (bucketer.Empty()) break;
+
+    std::string key;
+    Matrix<BaseFloat> feats;
+    Posterior targets;
+    Vector<BaseFloat> weights;
+    int32 len = bucketer.NextSequenceLength();
+    bucketer.GetSequence(&key, &feats, &targets, &weights);
+    KALDI_ASSERT(feats.NumRows() == len &&
+                 static_cast<int32>(targets.size()) == len &&
+                 weights.Dim() == len);
+    std::ostringstream expected_key; expected_key << "utt" << feats(0, 0);
+    KALDI_ASSERT(key == expected_key.str());
+    KALDI_ASSERT(seen.count(key) == 0);
+    seen.insert(key);
+
+    group.push_back(len);
+    if (static_cast<int32>(group.size()) == num_streams ||
+        (u == num_utt && bucketer.Empty())) {
+      int32 max_len = *std::max_element(group.begin(), group.end()), sum = 0;
+      for (size_t i = 0; i < group.size(); i++) sum += group[i];
+      stats.Add(sum, max_len * static_cast<int32>(group.size()));
+      group.clear();
+    }
+  }
+  KALDI_ASSERT(static_cast<int32>(seen.size()) == num_utt);
+  KALDI_LOG << "bucket_buffer " << bucket_buffer << ", " << stats.Report();
+  return stats.Efficiency();
+}
+
+void UnitTestSequenceBucketer() {
+  // no bucketing,
+  BaseFloat eff_none = RunBucketer(0, 20, 1000);
+  // bucketing over the whole data,
+  BaseFloat eff_all = RunBucketer(1000, 20, 1000);
+  // bucketing with a smaller buffer, (not a multiple of the group size)
+  BaseFloat eff_part = RunBucketer(250, 20, 1000);
+  KALDI_ASSERT(eff_all > eff_none);
+  KALDI_ASSERT(eff_part > eff_none);
+  KALDI_ASSERT(eff_all > 0.9);
+}
+
+
+int main() {
+  UnitTestSequenceBucketer();
+
+  std::cout << "Tests succeeded.\n";
+}
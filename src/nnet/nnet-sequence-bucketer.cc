@@ -0,0 +1,130 @@
+// nnet/nnet-sequence-bucketer.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet/nnet-sequence-bucketer.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace kaldi {
+namespace nnet1 {
+
+SequenceBucketer::SequenceBucketer(const SequenceBucketerOptions &opts,
+                                   int32 group_size)
+ : opts_(opts), group_size_(group_size) {
+  KALDI_ASSERT(opts.bucket_buffer >= 0);
+  KALDI_ASSERT(group_size > 0);
+  random_state_.seed = opts.bucket_seed;
+}
+
+SequenceBucketer::~SequenceBucketer() {
+  for (size_t i = 0; i < pending_.size(); i++) delete pending_[i];
+  for (size_t i = 0; i < ready_.size(); i++) delete ready_[i];
+}
+
+void SequenceBucketer::AcceptSequence(const std::string &key,
+                                      Matrix<BaseFloat> *feats,
+                                      Posterior *targets,
+                                      Vector<BaseFloat> *weights) {
+  Sequence *seq = new Sequence();
+  seq->key = key;
+  seq->feats.Swap(feats);
+  seq->targets.swap(*targets);
+  seq->weights.Swap(weights);
+  pending_.push_back(seq);
+}
+
+bool SequenceBucketer::IsFull() const {
+  if (opts_.bucket_buffer == 0) {
+    // no bucketing, we pass the utterances one by one,
+    return !Empty();
+  }
+  return (NumSequences() >= opts_.bucket_buffer);
+}
+
+namespace {
+// comparator for sorting by length,
+struct SequenceLengthIsLess {
+  template<class Seq>
+  bool operator() (const Seq *a, const Seq *b) const {
+    return a->feats.NumRows() < b->feats.NumRows();
+  }
+};
+}
+
+void SequenceBucketer::SortPending() {
+  if (opts_.bucket_buffer == 0) {
+    // no bucketing, keep the input order,
+    ready_.insert(ready_.end(), pending_.begin(), pending_.end());
+    pending_.clear();
+    return;
+  }
+  // sort by length, (stable, so the result does not depend on std::sort impl.)
+  std::stable_sort(pending_.begin(), pending_.end(), SequenceLengthIsLess());
+  // split to groups of similar length,
+  int32 num_groups = (pending_.size() + group_size_ - 1) / group_size_;
+  std::vector<int32> group_order(num_groups);
+  for (int32 g = 0; g < num_groups; g++) group_order[g] = g;
+  // shuffle the order of the groups (Fisher-Yates),
+  for (int32 g = num_groups - 1; g > 0; g--) {
+    std::swap(group_order[g], group_order[RandInt(0, g, &random_state_)]);
+  }
+  // enqueue the groups,
+  for (int32 i = 0; i < num_groups; i++) {
+    int32 begin = group_order[i] * group_size_,
+          end = std::min<int32>(begin + group_size_, pending_.size());
+    for (int32 j = begin; j < end; j++) {
+      ready_.push_back(pending_[j]);
+    }
+  }
+  pending_.clear();
+}
+
+int32 SequenceBucketer::NextSequenceLength() {
+  KALDI_ASSERT(!Empty());
+  if (ready_.empty()) SortPending();
+  return ready_.front()->feats.NumRows();
+}
+
+void SequenceBucketer::GetSequence(std::string *key,
+                                   Matrix<BaseFloat> *feats,
+                                   Posterior *targets,
+                                   Vector<BaseFloat> *weights) {
+  KALDI_ASSERT(!Empty());
+  if (ready_.empty()) SortPending();
+  Sequence *seq = ready_.front();
+  ready_.pop_front();
+  *key = seq->key;
+  feats->Swap(&seq->feats);
+  targets->swap(seq->targets);
+  weights->Swap(&seq->weights);
+  delete seq;
+}
+
+
+std::string PaddingStats::Report() const {
+  std::ostringstream oss;
+  oss << "Padding efficiency " << 100.0 * Efficiency() << "% ("
+      << num_valid_ << " useful frames out of " << num_total_
+      << " computed frames)";
+  return oss.str();
+}
+
+}  // namespace nnet1
+}  // namespace kaldi
@@ -0,0 +1,138 @@
+// nnet/nnet-sequence-bucketer.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET_NNET_SEQUENCE_BUCKETER_H_
+#define KALDI_NNET_NNET_SEQUENCE_BUCKETER_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-math.h"
+#include "itf/options-itf.h"
+#include "matrix/kaldi-matrix.h"
+#include "hmm/posterior.h"
+
+namespace kaldi {
+namespace nnet1 {
+
+/// Configuration of the length-bucketing of utterances in multi-stream
+/// (B)LSTM training.
+struct SequenceBucketerOptions {
+  int32 bucket_buffer;  ///< Number of utterances we read ahead, 0 = disabled.
+  int32 bucket_seed;
+
+  SequenceBucketerOptions()
+   : bucket_buffer(0), bucket_seed(777)
+  { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("bucket-buffer", &bucket_buffer, "Number of utterances which are read ahead and sorted by length, so the parallel streams get utterances of similar length (reduces padding). The groups of similar length are shuffled. [ 0 == disabled, utterances are used in the input order ]");
+    opts->Register("bucket-seed", &bucket_seed, "Seed for shuffling the groups of utterances with similar length");
+  }
+};
+
+
+/// Holds a buffer of utterances (features, targets, frame-weights),
+/// and hands them out so that consecutive utterances have similar length.
+///
+/// The buffered utterances are sorted by length and split into groups
+/// of 'group_size' utterances (typically the number of streams), the order
+/// of the groups is then shuffled. A new buffer is sorted when the previous
+/// one has been used up, so the reading and the training can be interleaved:
+/// @code
+///  while (true) {
+///    while (!bucketer.IsFull() && !reader.Done()) { ...; bucketer.AcceptSequence(...); reader.Next(); }
+///    if (bucketer.Empty()) break;
+///    bucketer.GetSequence(...);
+///  }
+/// @endcode
+/// With 'bucket_buffer == 0' the utterances go through in the input order.
+class SequenceBucketer {
+ public:
+  SequenceBucketer(const SequenceBucketerOptions &opts, int32 group_size);
+  ~SequenceBucketer();
+
+  /// Adds an utterance, the data are swapped in (the inputs are emptied).
+  void AcceptSequence(const std::string &key,
+                      Matrix<BaseFloat> *feats,
+                      Posterior *targets,
+                      Vector<BaseFloat> *weights);
+
+  /// Returns true when no more utterances should be added before GetSequence()
+  bool IsFull() const;
+  /// Returns true when there are no utterances stored,
+  bool Empty() const { return (pending_.empty() && ready_.empty()); }
+  /// Number of utterances stored,
+  int32 NumSequences() const { return pending_.size() + ready_.size(); }
+
+  /// Removes the next utterance, the data are swapped out,
+  void GetSequence(std::string *key,
+                   Matrix<BaseFloat> *feats,
+                   Posterior *targets,
+                   Vector<BaseFloat> *weights);
+
+  /// Length of the utterance which will be returned by next GetSequence(),
+  int32 NextSequenceLength();
+
+ private:
+  struct Sequence {
+    std::string key;
+    Matrix<BaseFloat> feats;
+    Posterior targets;
+    Vector<BaseFloat> weights;
+  };
+
+  /// Sorts 'pending_' by length, makes the groups, and moves them to 'ready_',
+  void SortPending();
+
+  SequenceBucketerOptions opts_;
+  int32 group_size_;
+  RandomState random_state_;
+
+  std::vector<Sequence*> pending_;  ///< accepted, not yet sorted,
+  std::deque<Sequence*> ready_;  ///< sorted and grouped, waiting for GetSequence(),
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SequenceBucketer);
+};
+
+
+/// Accumulates the number of useful and padded frames in (B)LSTM training,
+/// the padding efficiency is the ratio of useful frames to all the frames.
+class PaddingStats {
+ public:
+  PaddingStats() : num_valid_(0), num_total_(0) { }
+  void Add(int64 num_valid, int64 num_total) {
+    KALDI_ASSERT(num_valid <= num_total);
+    num_valid_ += num_valid;
+    num_total_ += num_total;
+  }
+  BaseFloat Efficiency() const {
+    return (num_total_ == 0 ? 1.0 : static_cast<BaseFloat>(num_valid_) / num_total_);
+  }
+  std::string Report() const;
+ private:
+  int64 num_valid_;
+  int64 num_total_;
+};
+
+}  // namespace nnet1
+}  // namespace kaldi
+
+#endif  // KALDI_NNET_NNET_SEQUENCE_BUCKETER_H_
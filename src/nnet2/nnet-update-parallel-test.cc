@@ -0,0 +1,176 @@
+// nnet2/nnet-update-parallel-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet2/nnet-update-parallel.h"
+#include "nnet2/nnet-update.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+namespace nnet2 {
+
+
+// Makes "num_egs" random single-frame examples for "nnet", each with a
+// different random weight, and writes them to the archive "tmpf".
+static void GenRandomExamples(const Nnet &nnet, int32 num_egs,
+                              std::vector<NnetExample> *egs) {
+  int32 num_rows = nnet.LeftContext() + 1 + nnet.RightContext();
+  NnetExampleWriter writer("ark:tmpf");
+  egs->resize(num_egs);
+  for (int32 i = 0; i < num_egs; i++) {
+    NnetExample &eg = (*egs)[i];
+    Matrix<BaseFloat> input(num_rows, nnet.InputDim());
+    input.SetRandn();
+    eg.input_frames = CompressedMatrix(input);
+    eg.left_context = nnet.LeftContext();
+    eg.labels.resize(1);
+    eg.SetLabelSingle(0, RandInt(0, nnet.OutputDim() - 1),
+                      0.5 + RandUniform());
+    std::ostringstream key;
+    key << i;
+    writer.Write(key.str(), eg);
+  }
+}
+
+// Trains "nnet" on "egs" with DoBackpropAsyncParallel(), reading them from
+// "tmpf"; outputs the total weight and returns the log-prob.
+static double TrainAsync(const NnetAsyncTrainerConfig &config,
+                         int32 num_threads,
+                         double *tot_weight,
+                         Nnet *nnet) {
+  g_num_threads = num_threads;
+  SequentialNnetExampleReader reader("ark:tmpf");
+  return DoBackpropAsyncParallel(config, &reader, tot_weight, nnet);
+}
+
+// Returns the parameters of "nnet" as a vector.
+static Vector<BaseFloat> GetParams(const Nnet &nnet) {
+  Vector<BaseFloat> params(nnet.GetParameterDim());
+  nnet.Vectorize(&params);
+  return params;
+}
+
+// Does single-threaded SGD on "egs" in order, as DoBackpropAsyncParallel()
+// should do with one thread (with or without syncing).
+static double TrainSequential(int32 minibatch_size,
+                              const std::vector<NnetExample> &egs,
+                              Nnet *nnet) {
+  double log_prob = 0.0;
+  for (size_t i = 0; i < egs.size(); i += minibatch_size) {
+    size_t end = std::min(egs.size(), i + minibatch_size);
+    std::vector<NnetExample> minibatch(egs.begin() + i, egs.begin() + end);
+    log_prob += DoBackprop(*nnet, minibatch, nnet);
+  }
+  return log_prob;
+}
+
+// With one thread, the result should be the same as plain SGD.
+void UnitTestDoBackpropAsyncParallelOneThread() {
+  Nnet *nnet = GenRandomNnet(RandInt(5, 20), RandInt(5, 20));
+  std::vector<NnetExample> egs;
+  GenRandomExamples(*nnet, RandInt(1, 100), &egs);
+
+  NnetAsyncTrainerConfig config;
+  config.minibatch_size = RandInt(1, 10);
+  config.sync_interval = RandInt(0, 3);
+  config.queue_size = RandInt(1, 3);
+
+  Nnet nnet_async(*nnet);
+  double tot_weight,
+      log_prob = TrainAsync(config, 1, &tot_weight, &nnet_async);
+  double ref_log_prob = TrainSequential(config.minibatch_size, egs, nnet);
+  KALDI_ASSERT(ApproxEqual(tot_weight, TotalNnetTrainingWeight(egs)));
+  KALDI_ASSERT(ApproxEqual(log_prob, ref_log_prob));
+  KALDI_ASSERT(GetParams(nnet_async).ApproxEqual(GetParams(*nnet), 1.0e-04));
+  delete nnet;
+}
+
+// With the learning rates set to zero the model does not change, so the total
+// weight and log-prob show whether each example was used exactly once (the
+// examples have different weights).
+void UnitTestDoBackpropAsyncParallelExamples() {
+  Nnet *nnet = GenRandomNnet(RandInt(5, 20), RandInt(5, 20));
+  nnet->SetLearningRates(0.0);
+  std::vector<NnetExample> egs;
+  GenRandomExamples(*nnet, RandInt(1, 200), &egs);
+
+  NnetAsyncTrainerConfig config;
+  config.minibatch_size = RandInt(1, 10);
+  config.sync_interval = RandInt(0, 3);
+  config.queue_size = RandInt(1, 3);
+
+  Nnet nnet_async(*nnet);
+  double tot_weight,
+      log_prob = TrainAsync(config, RandInt(2, 4), &tot_weight, &nnet_async);
+  KALDI_ASSERT(ApproxEqual(tot_weight, TotalNnetTrainingWeight(egs)));
+  KALDI_ASSERT(ApproxEqual(log_prob, ComputeNnetObjf(*nnet, egs)));
+  KALDI_ASSERT(GetParams(nnet_async).ApproxEqual(GetParams(*nnet), 1.0e-04));
+  delete nnet;
+}
+
+// With several threads and syncing, the shared model should get the sum of the
+// changes the threads made.  The learning rate is small, so (to first order)
+// the total change does not depend on the order of the minibatches or on which
+// thread saw them, and it should be close to the change from plain SGD.  If
+// the changes were averaged over threads, or a thread's change were lost or
+// added twice, the difference would be much larger.
+void UnitTestDoBackpropAsyncParallelSync() {
+  Nnet *nnet = GenRandomNnet(RandInt(5, 20), RandInt(5, 20));
+  nnet->SetLearningRates(1.0e-05);
+  std::vector<NnetExample> egs;
+  GenRandomExamples(*nnet, RandInt(50, 200), &egs);
+
+  NnetAsyncTrainerConfig config;
+  config.minibatch_size = RandInt(1, 10);
+  config.sync_interval = RandInt(1, 3);
+  config.queue_size = RandInt(1, 3);
+
+  Vector<BaseFloat> params_orig(GetParams(*nnet));
+  Nnet nnet_async(*nnet);
+  double tot_weight;
+  TrainAsync(config, RandInt(2, 4), &tot_weight, &nnet_async);
+  TrainSequential(config.minibatch_size, egs, nnet);
+  KALDI_ASSERT(ApproxEqual(tot_weight, TotalNnetTrainingWeight(egs)));
+
+  Vector<BaseFloat> change(GetParams(nnet_async)),
+      ref_change(GetParams(*nnet));
+  change.AddVec(-1.0, params_orig);
+  ref_change.AddVec(-1.0, params_orig);
+  KALDI_ASSERT(ref_change.Norm(2.0) > 0.0);
+  KALDI_LOG << "Change in parameters is " << change.Norm(2.0)
+            << ", versus " << ref_change.Norm(2.0) << " for plain SGD.";
+  KALDI_ASSERT(change.ApproxEqual(ref_change, 0.02));
+  delete nnet;
+}
+
+
+}  // namespace nnet2
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet2;
+  for (int32 i = 0; i < 5; i++) {
+    UnitTestDoBackpropAsyncParallelOneThread();
+    UnitTestDoBackpropAsyncParallelExamples();
+    UnitTestDoBackpropAsyncParallelSync();
+  }
+  unlink("tmpf");
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -21,7 +21,9 @@
 #include "nnet2/nnet-update.h"
 #include "thread/kaldi-thread.h"
 #include "thread/kaldi-mutex.h"
+#include "base/timer.h"
 #include <numeric>
+#include <deque>
 
 namespace kaldi {
 namespace nnet2 {
@@ -131,7 +133,7 @@ double DoBackpropSingleThreaded(const Nnet &nnet,
   while (!examples_reader->Done()) {
     std::vector<NnetExample> egs;
     egs.reserve(minibatch_size);
-    while (egs.size() < minibatch_size && examples_reader->Done()) {
+    while (egs.size() < minibatch_size && !examples_reader->Done()) {
       egs.push_back(examples_reader->Value());
       examples_reader->Next();
     }
@@ -199,6 +201,291 @@ double DoBackpropParallel(const Nnet &nnet,
 }
 
 
+/// This class is like ExamplesRepository, but with a separate queue for each
+/// training thread, so that the threads only contend with the reading thread
+/// (and not with each other) when getting examples.
+class PerThreadExamplesQueues {
+ public:
+  PerThreadExamplesQueues(int32 num_queues, int32 queue_size):
+      queues_(num_queues), free_slots_(num_queues * queue_size) {
+    KALDI_ASSERT(num_queues > 0 && queue_size > 0);
+    for (int32 i = 0; i < num_queues; i++)
+      queues_[i] = new Queue();
+  }
+
+  /// Puts the minibatch in the shortest queue; blocks if all the queues are
+  /// full.  Empties "examples".
+  void AcceptExamples(std::vector<NnetExample> *examples) {
+    KALDI_ASSERT(!examples->empty());
+    free_slots_.Wait();
+    // Because free_slots_ counts the free places in all queues, the shortest
+    // queue always has a free place.
+    int32 best_queue = 0;
+    size_t best_size = 0;
+    for (size_t i = 0; i < queues_.size(); i++) {
+      queues_[i]->mutex.Lock();
+      size_t size = queues_[i]->minibatches.size();
+      queues_[i]->mutex.Unlock();
+      if (i == 0 || size < best_size) {
+        best_queue = i;
+        best_size = size;
+      }
+    }
+    std::vector<NnetExample> *minibatch = new std::vector<NnetExample>();
+    minibatch->swap(*examples);
+    Queue *queue = queues_[best_queue];
+    queue->mutex.Lock();
+    queue->minibatches.push_back(minibatch);
+    queue->mutex.Unlock();
+    queue->ready.Signal();
+  }
+
+  /// Puts a NULL (end-of-data marker) into each queue.
+  void ExamplesDone() {
+    for (size_t i = 0; i < queues_.size(); i++) {
+      queues_[i]->mutex.Lock();
+      queues_[i]->minibatches.push_back(NULL);
+      queues_[i]->mutex.Unlock();
+      queues_[i]->ready.Signal();
+    }
+  }
+
+  /// Called by training thread "queue_index"; returns false when there are no
+  /// more examples.
+  bool ProvideExamples(int32 queue_index,
+                       std::vector<NnetExample> *examples) {
+    Queue *queue = queues_[queue_index];
+    queue->ready.Wait();
+    queue->mutex.Lock();
+    std::vector<NnetExample> *minibatch = queue->minibatches.front();
+    queue->minibatches.pop_front();
+    queue->mutex.Unlock();
+    if (minibatch == NULL)
+      return false;
+    examples->swap(*minibatch);
+    delete minibatch;
+    free_slots_.Signal();
+    return true;
+  }
+
+  ~PerThreadExamplesQueues() {
+    for (size_t i = 0; i < queues_.size(); i++) {
+      for (size_t j = 0; j < queues_[i]->minibatches.size(); j++)
+        delete queues_[i]->minibatches[j];
+      delete queues_[i];
+    }
+  }
+ private:
+  struct Queue {
+    Mutex mutex;  // guards "minibatches".
+    Semaphore ready;  // counts the elements of "minibatches".
+    std::deque<std::vector<NnetExample>*> minibatches;
+  };
+  std::vector<Queue*> queues_;
+  Semaphore free_slots_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PerThreadExamplesQueues);
+};
+
+
+/// The shared model and statistics of DoBackpropAsyncParallel; the threads
+/// access it under the mutex.
+struct NnetAsyncTrainerShared {
+  Nnet *nnet;
+  Mutex mutex;
+  int64 num_syncs;  // number of updates added to "nnet" by the threads.
+
+  // statistics, summed over threads.
+  double tot_weight;
+  double log_prob;
+  int64 num_minibatches;
+  double tot_staleness;
+  int64 max_staleness;
+  double wait_time;  // time the threads waited for examples.
+  double sync_time;  // time the threads waited for or held the lock.
+
+  NnetAsyncTrainerShared(Nnet *nnet_in):
+      nnet(nnet_in), num_syncs(0), tot_weight(0.0), log_prob(0.0),
+      num_minibatches(0), tot_staleness(0.0), max_staleness(0),
+      wait_time(0.0), sync_time(0.0) { }
+};
+
+
+class DoBackpropAsyncClass: public MultiThreadable {
+ public:
+  DoBackpropAsyncClass(const NnetAsyncTrainerConfig &config,
+                       PerThreadExamplesQueues *queues,
+                       NnetAsyncTrainerShared *shared):
+      config_(config), queues_(queues), shared_(shared),
+      local_nnet_(NULL), synced_nnet_(NULL), last_sync_(0),
+      tot_weight_(0.0), log_prob_(0.0), num_minibatches_(0),
+      tot_staleness_(0.0), max_staleness_(0),
+      wait_time_(0.0), sync_time_(0.0) { }
+
+  // The default copy constructor is OK as local_nnet_ and synced_nnet_ are
+  // NULL until operator () is called.
+
+  void operator () () {
+    if (config_.sync_interval > 0) {
+      shared_->mutex.Lock();
+      local_nnet_ = new Nnet(*(shared_->nnet));
+      synced_nnet_ = new Nnet(*(shared_->nnet));
+      last_sync_ = shared_->num_syncs;
+      shared_->mutex.Unlock();
+    }
+    Nnet *nnet = (local_nnet_ != NULL ? local_nnet_ : shared_->nnet);
+    std::vector<NnetExample> examples;
+    int32 minibatches_since_sync = 0;
+    while (true) {
+      Timer timer;
+      bool have_examples = queues_->ProvideExamples(thread_id_, &examples);
+      wait_time_ += timer.Elapsed();
+      if (!have_examples) break;
+      log_prob_ += DoBackprop(*nnet, examples, nnet);
+      tot_weight_ += TotalNnetTrainingWeight(examples);
+      num_minibatches_++;
+      examples.clear();
+      if (local_nnet_ != NULL &&
+          ++minibatches_since_sync == config_.sync_interval) {
+        Sync();
+        minibatches_since_sync = 0;
+      }
+    }
+    if (local_nnet_ != NULL) {
+      if (minibatches_since_sync > 0)
+        Sync();
+      delete local_nnet_;
+      delete synced_nnet_;
+      local_nnet_ = synced_nnet_ = NULL;
+    }
+    KALDI_VLOG(1) << "Thread " << thread_id_ << " processed "
+                  << num_minibatches_ << " minibatches (" << tot_weight_
+                  << " frames, weighted), log-prob per frame is "
+                  << (log_prob_ / tot_weight_) << "; waited " << wait_time_
+                  << " seconds for examples, " << sync_time_
+                  << " seconds syncing the model.";
+  }
+
+  ~DoBackpropAsyncClass() {
+    // Add our stats to the shared stats; the object that was passed to
+    // MultiThreader (which never ran) just adds zeros.
+    shared_->mutex.Lock();
+    shared_->tot_weight += tot_weight_;
+    shared_->log_prob += log_prob_;
+    shared_->num_minibatches += num_minibatches_;
+    shared_->tot_staleness += tot_staleness_;
+    shared_->max_staleness = std::max(shared_->max_staleness, max_staleness_);
+    shared_->wait_time += wait_time_;
+    shared_->sync_time += sync_time_;
+    shared_->mutex.Unlock();
+  }
+ private:
+  // Adds the change of the local model since the last sync to the shared
+  // model, and copies the shared model to the local model.
+  void Sync() {
+    Timer timer;
+    shared_->mutex.Lock();
+    // The staleness is the number of updates from other threads that were
+    // added since we last got the shared model.
+    int64 staleness = shared_->num_syncs - last_sync_;
+    tot_staleness_ += staleness;
+    max_staleness_ = std::max(max_staleness_, staleness);
+    Nnet *shared_nnet = shared_->nnet;
+    shared_nnet->AddNnet(1.0, *local_nnet_);
+    shared_nnet->AddNnet(-1.0, *synced_nnet_);
+    // Copy the parameters (and stats) without reallocating the components;
+    // this leaves things like the state of online preconditioning local to
+    // the thread.
+    local_nnet_->Scale(0.0);
+    local_nnet_->AddNnet(1.0, *shared_nnet);
+    synced_nnet_->Scale(0.0);
+    synced_nnet_->AddNnet(1.0, *shared_nnet);
+    last_sync_ = ++(shared_->num_syncs);
+    shared_->mutex.Unlock();
+    sync_time_ += timer.Elapsed();
+  }
+
+  const NnetAsyncTrainerConfig &config_;
+  PerThreadExamplesQueues *queues_;
+  NnetAsyncTrainerShared *shared_;
+  Nnet *local_nnet_;  // the model this thread trains (if sync_interval > 0).
+  Nnet *synced_nnet_;  // local_nnet_ as of the last sync.
+  int64 last_sync_;  // value of shared_->num_syncs at the last sync.
+
+  double tot_weight_;
+  double log_prob_;
+  int64 num_minibatches_;
+  double tot_staleness_;
+  int64 max_staleness_;
+  double wait_time_;
+  double sync_time_;
+};
+
+
+double DoBackpropAsyncParallel(const NnetAsyncTrainerConfig &config,
+                               SequentialNnetExampleReader *examples_reader,
+                               double *tot_weight,
+                               Nnet *nnet) {
+  KALDI_ASSERT(config.minibatch_size > 0 && config.sync_interval >= 0);
+#if HAVE_CUDA == 1
+  // Our GPU code won't work with multithreading.
+  if (CuDevice::Instantiate().Enabled())
+    return DoBackpropSingleThreaded(*nnet, config.minibatch_size,
+                                    examples_reader, tot_weight, nnet);
+#endif
+  int32 num_threads = g_num_threads;
+  KALDI_ASSERT(num_threads > 0);
+
+  Timer timer;
+  double read_wait_time = 0.0;  // time the reading thread was blocked.
+  PerThreadExamplesQueues queues(num_threads, config.queue_size);
+  NnetAsyncTrainerShared shared(nnet);
+  DoBackpropAsyncClass c(config, &queues, &shared);
+  {
+    // The initialization of the following class spawns the threads that
+    // process the examples.  They get re-joined in its destructor.
+    MultiThreader<DoBackpropAsyncClass> m(num_threads, c);
+
+    std::vector<NnetExample> examples;
+    examples.reserve(config.minibatch_size);
+    for (; !examples_reader->Done(); examples_reader->Next()) {
+      examples.push_back(examples_reader->Value());
+      if (examples.size() == config.minibatch_size) {
+        Timer wait_timer;
+        queues.AcceptExamples(&examples);
+        read_wait_time += wait_timer.Elapsed();
+        examples.reserve(config.minibatch_size);
+      }
+    }
+    if (!examples.empty()) // partial minibatch.
+      queues.AcceptExamples(&examples);
+    queues.ExamplesDone();
+  }
+  double elapsed = timer.Elapsed();
+  *tot_weight = shared.tot_weight;
+  double tot_log_prob = shared.log_prob;
+
+  KALDI_LOG << "Did backprop on " << *tot_weight << " examples with "
+            << num_threads << " threads, average log-prob per frame is "
+            << (tot_log_prob / *tot_weight);
+  KALDI_LOG << "Throughput was " << (*tot_weight / elapsed) << " frames/sec ("
+            << shared.num_minibatches << " minibatches in " << elapsed
+            << " seconds); training threads spent "
+            << (100.0 * shared.wait_time / (elapsed * num_threads))
+            << "% of the time waiting for examples and "
+            << (100.0 * shared.sync_time / (elapsed * num_threads))
+            << "% syncing the model; the reading thread was blocked "
+            << (100.0 * read_wait_time / elapsed) << "% of the time.";
+  if (config.sync_interval > 0 && shared.num_syncs > 0)
+    KALDI_LOG << "Model was synced " << shared.num_syncs << " times, "
+              << "average staleness was "
+              << (shared.tot_staleness / shared.num_syncs)
+              << " updates (max " << shared.max_staleness << ").";
+  KALDI_LOG << "[this line is to be parsed by a script:] log-prob-per-frame="
+            << (tot_log_prob / *tot_weight);
+  return tot_log_prob;
+}
+
+
 double DoBackpropSingleThreaded(const Nnet &nnet,
                                 int32 minibatch_size,
                                 const std::vector<NnetExample> &egs,
@@ -63,6 +63,49 @@ double DoBackpropParallel(const Nnet &nnet,
 
 
 
+struct NnetAsyncTrainerConfig {
+  int32 minibatch_size;
+  int32 sync_interval;
+  int32 queue_size;
+
+  NnetAsyncTrainerConfig(): minibatch_size(1024), sync_interval(0),
+                            queue_size(2) { }
+
+  void Register (OptionsItf *opts) {
+    opts->Register("minibatch-size", &minibatch_size,
+                   "Number of examples to use for each minibatch during "
+                   "training.");
+    opts->Register("sync-interval", &sync_interval,
+                   "If >0, each thread trains its own copy of the model and "
+                   "adds its parameter change to the shared model (and gets "
+                   "the shared model back) every this many minibatches.  If 0, "
+                   "all threads update the shared model directly (Hogwild).");
+    opts->Register("queue-size", &queue_size,
+                   "Number of minibatches that can be queued for each "
+                   "thread.");
+  }
+};
+
+
+/// This function does SGD training with multiple threads (the number of
+/// threads is g_num_threads), in the same way as the first version of
+/// DoBackpropParallel with nnet_to_update == &nnet, but each thread has its
+/// own queue of minibatches (the reading thread puts each minibatch into the
+/// shortest queue), so the threads do not contend for a single repository.
+/// If config.sync_interval > 0, each thread trains a private copy of the
+/// model and periodically adds its parameter change to "nnet", under a lock;
+/// this avoids the cache-line contention of Hogwild updates when the number
+/// of threads is large.  It prints throughput statistics (frames per second,
+/// time the threads spent waiting for data or for the lock) and the
+/// staleness of the updates, i.e. how many updates from other threads were
+/// added to the shared model since a thread last synced.
+/// Returns the total log-prob; outputs the total weight to "tot_weight".
+double DoBackpropAsyncParallel(const NnetAsyncTrainerConfig &config,
+                               SequentialNnetExampleReader *example_reader,
+                               double *tot_weight,
+                               Nnet *nnet);
+
+
 /// This is basically to clarify the fact that DoBackpropParallel will
 /// also work with nnet_to_update == NULL, and will compute the objf.
 /// Both versions of the function will support it, but this
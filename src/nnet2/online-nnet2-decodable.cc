@@ -102,16 +102,22 @@ void DecodableNnet2Online::ComputeForFrame(int32 frame) {
   KALDI_ASSERT(input_frame_end > input_frame_begin);
   Matrix<BaseFloat> features(input_frame_end - input_frame_begin,
                              feat_dim_);
-  for (int32 t = input_frame_begin; t < input_frame_end; t++) {
-    SubVector<BaseFloat> row(features, t - input_frame_begin);
-    int32 t_modified = t;
-    // The next two if-statements take care of "pad_input"
-    if (t_modified < 0)
-      t_modified = 0;
-    if (t_modified >= features_ready)
-      t_modified = features_ready - 1;
-    features_->GetFrame(t_modified, &row);
-  }
+  // Get the frames that exist with one call; rows outside that range are the
+  // padding for "pad_input", and are copies of the first or last frame.
+  int32 real_frame_begin = std::max<int32>(input_frame_begin, 0),
+      real_frame_end = std::min<int32>(input_frame_end, features_ready);
+  KALDI_ASSERT(real_frame_end > real_frame_begin);
+  SubMatrix<BaseFloat> real_features(features,
+                                     real_frame_begin - input_frame_begin,
+                                     real_frame_end - real_frame_begin,
+                                     0, feat_dim_);
+  features_->GetFrames(real_frame_begin, real_frame_end - real_frame_begin,
+                       &real_features);
+  for (int32 t = input_frame_begin; t < real_frame_begin; t++)
+    features.Row(t - input_frame_begin).CopyFromVec(real_features.Row(0));
+  for (int32 t = real_frame_end; t < input_frame_end; t++)
+    features.Row(t - input_frame_begin).CopyFromVec(
+        real_features.Row(real_features.NumRows() - 1));
   CuMatrix<BaseFloat> cu_features; 
   cu_features.Swap(&features);  // Copy to GPU, if we're using one.
   
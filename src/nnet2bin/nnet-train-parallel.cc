@@ -35,16 +35,20 @@ int main(int argc, char *argv[]) {
         "Train the neural network parameters with backprop and stochastic\n"
         "gradient descent using minibatches.  As nnet-train-simple, but\n"
         "uses multiple threads in a Hogwild type of update (for CPU, not GPU).\n"
+        "With --sync-interval > 0, each thread trains its own copy of the model\n"
+        "and adds its changes to the shared model every --sync-interval\n"
+        "minibatches (scales better with many threads).\n"
         "\n"
         "Usage:  nnet-train-parallel [options] <model-in> <training-examples-in> <model-out>\n"
         "\n"
         "e.g.:\n"
-        "nnet-train-parallel --num-threads=8 1.nnet ark:1.1.egs 2.nnet\n";
+        "nnet-train-parallel --num-threads=8 1.nnet ark:1.1.egs 2.nnet\n"
+        "nnet-train-parallel --num-threads=16 --sync-interval=4 1.nnet ark:1.1.egs 2.nnet\n";
     
     bool binary_write = true;
     bool zero_stats = true;
-    int32 minibatch_size = 1024;
     int32 srand_seed = 0;
+    NnetAsyncTrainerConfig train_config;
     
     ParseOptions po(usage);
     po.Register("binary", &binary_write, "Write output in binary mode");
@@ -55,8 +59,7 @@ int main(int argc, char *argv[]) {
     po.Register("num-threads", &g_num_threads, "Number of training threads to use "
                 "in the parallel update. [Note: if you use a parallel "
                 "implementation of BLAS, the actual number of threads may be larger.]");
-    po.Register("minibatch-size", &minibatch_size, "Number of examples to use for "
-                "each minibatch during training.");
+    train_config.Register(&po);
     
     po.Read(argc, argv);
     srand(srand_seed);
@@ -79,7 +82,7 @@ int main(int argc, char *argv[]) {
       am_nnet.Read(ki.Stream(), binary_read);
     }
 
-    KALDI_ASSERT(minibatch_size > 0);
+    KALDI_ASSERT(train_config.minibatch_size > 0);
 
     if (zero_stats) am_nnet.GetNnet().ZeroStats();
 
@@ -87,11 +90,10 @@ int main(int argc, char *argv[]) {
     SequentialNnetExampleReader example_reader(examples_rspecifier);
     
 
-    DoBackpropParallel(am_nnet.GetNnet(),
-                       minibatch_size,
-                       &example_reader,
-                       &num_examples,
-                       &(am_nnet.GetNnet()));
+    DoBackpropAsyncParallel(train_config,
+                            &example_reader,
+                            &num_examples,
+                            &(am_nnet.GetNnet()));
     
     {
       Output ko(nnet_wxfilename, binary_write);
@@ -0,0 +1,362 @@
+// nnet3/nnet-example-stream.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-example-stream.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+int32 GetSimpleNnetExamples(const MatrixBase<BaseFloat> &feats,
+                            const MatrixBase<BaseFloat> *ivector_feats,
+                            const Posterior &pdf_post,
+                            int32 num_pdfs,
+                            int32 left_context,
+                            int32 right_context,
+                            int32 frames_per_eg,
+                            std::vector<NnetExample> *egs,
+                            std::vector<int32> *start_frames) {
+  KALDI_ASSERT(feats.NumRows() == static_cast<int32>(pdf_post.size()));
+  KALDI_ASSERT(frames_per_eg > 0);
+  // reserve space so that resizing "egs" does not copy the examples.
+  egs->reserve(egs->size() +
+               (feats.NumRows() + frames_per_eg - 1) / frames_per_eg);
+
+  for (int32 t = 0; t < feats.NumRows(); t += frames_per_eg) {
+
+    // actual_frames_per_eg is the number of frames with nonzero
+    // posteriors.  At the end of the file we pad with zero posteriors
+    // so that all examples have the same structure (prevents the need
+    // for recompilations).
+    int32 actual_frames_per_eg = std::min(frames_per_eg,
+                                          feats.NumRows() - t);
+
+    int32 tot_frames = left_context + frames_per_eg + right_context;
+
+    Matrix<BaseFloat> input_frames(tot_frames, feats.NumCols(), kUndefined);
+
+    // Set up "input_frames".
+    for (int32 j = -left_context; j < frames_per_eg + right_context; j++) {
+      int32 t2 = j + t;
+      if (t2 < 0) t2 = 0;
+      if (t2 >= feats.NumRows()) t2 = feats.NumRows() - 1;
+      SubVector<BaseFloat> src(feats, t2),
+          dest(input_frames, j + left_context);
+      dest.CopyFromVec(src);
+    }
+
+    egs->resize(egs->size() + 1);
+    NnetExample &eg = egs->back();
+
+    // call the regular input "input".
+    eg.io.push_back(NnetIo("input", - left_context,
+                           input_frames));
+
+    // if applicable, add the iVector feature.
+    if (ivector_feats != NULL) {
+      // try to get closest frame to middle of window to get
+      // a representative iVector.
+      int32 closest_frame = t + (actual_frames_per_eg / 2);
+      KALDI_ASSERT(ivector_feats->NumRows() > 0);
+      if (closest_frame >= ivector_feats->NumRows())
+        closest_frame = ivector_feats->NumRows() - 1;
+      Matrix<BaseFloat> ivector(1, ivector_feats->NumCols());
+      ivector.Row(0).CopyFromVec(ivector_feats->Row(closest_frame));
+      eg.io.push_back(NnetIo("ivector", 0, ivector));
+    }
+
+    // add the labels.
+    Posterior labels(frames_per_eg);
+    for (int32 i = 0; i < actual_frames_per_eg; i++)
+      labels[i] = pdf_post[t + i];
+    // remaining posteriors for frames are empty.
+    eg.io.push_back(NnetIo("output", num_pdfs, 0, labels));
+
+    if (start_frames != NULL)
+      start_frames->push_back(t);
+  }
+  return feats.NumRows();
+}
+
+
+NnetExampleStream::NnetExampleStream(
+    const NnetExampleStreamOptions &config,
+    int32 num_pdfs,
+    const std::string &feature_rspecifier,
+    const std::string &pdf_post_rspecifier,
+    const std::string &ivector_rspecifier):
+    config_(config), num_pdfs_(num_pdfs),
+    use_ivectors_(!ivector_rspecifier.empty()),
+    feat_reader_(feature_rspecifier),
+    pdf_post_reader_(pdf_post_rspecifier),
+    ivector_reader_(ivector_rspecifier),
+    pending_output_frames_(0),
+    slots_free_(config.num_minibatches_queued),
+    finished_(false), stop_(false), thread_failed_(false),
+    num_done_(0), num_err_(0), num_egs_(0), num_frames_(0),
+    num_minibatches_(0) {
+  KALDI_ASSERT(num_pdfs > 0 && config.num_frames > 0 &&
+               config.minibatch_size > 0 && config.buffer_size >= 0 &&
+               config.num_minibatches_queued > 0);
+  shuffle_buffer_.resize(config.buffer_size, NULL);
+  pending_egs_.reserve(config.minibatch_size);
+
+  pthread_attr_t pthread_attr;
+  pthread_attr_init(&pthread_attr);
+  int32 ret;
+  // below, Run is the static class-member function.
+  if ((ret=pthread_create(&thread_, &pthread_attr,
+                          Run, static_cast<void*>(this)))) {
+    const char *c = strerror(ret);
+    if (c == NULL) { c = "[NULL]"; }
+    KALDI_ERR << "Error creating thread, errno was: " << c;
+  }
+}
+
+void* NnetExampleStream::Run(void *ptr_in) {
+  NnetExampleStream *ptr = reinterpret_cast<NnetExampleStream*>(ptr_in);
+  try {
+    ptr->ProduceMinibatches();
+  } catch (const std::exception &e) {
+    // An exception must not propagate out of the thread function (that would
+    // call std::terminate()); we record it, and GetNextMinibatch() reports it
+    // in the calling thread.  The NULL marks the end of the data.
+    ptr->error_message_ = e.what();
+    ptr->thread_failed_ = true;
+    ptr->QueueMinibatch(NULL);
+  }
+  return NULL;
+}
+
+bool NnetExampleStream::Stopped() {
+  queue_mutex_.Lock();
+  bool ans = stop_;
+  queue_mutex_.Unlock();
+  return ans;
+}
+
+void NnetExampleStream::ProduceMinibatches() {
+  std::vector<NnetExample> egs;
+  for (; !feat_reader_.Done(); feat_reader_.Next()) {
+    if (Stopped())
+      return;  // the destructor was called; nobody will read the rest.
+    std::string key = feat_reader_.Key();
+    const Matrix<BaseFloat> &feats = feat_reader_.Value();
+    if (!pdf_post_reader_.HasKey(key)) {
+      KALDI_WARN << "No pdf-level posterior for key " << key;
+      num_err_++;
+      continue;
+    }
+    const Posterior &pdf_post = pdf_post_reader_.Value(key);
+    if (pdf_post.size() != feats.NumRows()) {
+      KALDI_WARN << "Posterior has wrong size " << pdf_post.size()
+                 << " versus " << feats.NumRows();
+      num_err_++;
+      continue;
+    }
+    const Matrix<BaseFloat> *ivector_feats = NULL;
+    if (use_ivectors_) {
+      if (!ivector_reader_.HasKey(key)) {
+        KALDI_WARN << "No iVectors for utterance " << key;
+        num_err_++;
+        continue;
+      }
+      // this address will be valid until we call HasKey() or Value()
+      // again.
+      ivector_feats = &(ivector_reader_.Value(key));
+      if (abs(feats.NumRows() - ivector_feats->NumRows()) >
+          config_.length_tolerance || ivector_feats->NumRows() == 0) {
+        KALDI_WARN << "Length difference between feats " << feats.NumRows()
+                   << " and iVectors " << ivector_feats->NumRows()
+                   << "exceeds tolerance " << config_.length_tolerance;
+        num_err_++;
+        continue;
+      }
+    }
+    egs.clear();
+    num_frames_ += GetSimpleNnetExamples(feats, ivector_feats, pdf_post,
+                                         num_pdfs_, config_.left_context,
+                                         config_.right_context,
+                                         config_.num_frames, &egs);
+    for (size_t i = 0; i < egs.size(); i++)
+      AcceptExample(&(egs[i]));
+    num_done_++;
+  }
+  if (Stopped())
+    return;
+  // Flush the shuffling buffer.
+  for (size_t i = 0; i < shuffle_buffer_.size(); i++) {
+    if (shuffle_buffer_[i] != NULL) {
+      AddToMinibatch(shuffle_buffer_[i]);
+      delete shuffle_buffer_[i];
+      shuffle_buffer_[i] = NULL;
+    }
+  }
+  FlushMinibatch();
+  QueueMinibatch(NULL);  // signals the end of the data.
+}
+
+void NnetExampleStream::AcceptExample(NnetExample *eg) {
+  num_egs_++;
+  if (shuffle_buffer_.empty()) {  // no randomization.
+    AddToMinibatch(eg);
+    return;
+  }
+  int32 index = RandInt(0, static_cast<int32>(shuffle_buffer_.size()) - 1,
+                        &random_state_);
+  if (shuffle_buffer_[index] == NULL) {
+    shuffle_buffer_[index] = new NnetExample();
+    shuffle_buffer_[index]->Swap(eg);
+  } else {
+    // Output the example that was in this slot, and replace it with the new
+    // one.  Swapping avoids copying the feature matrices.
+    shuffle_buffer_[index]->Swap(eg);
+    AddToMinibatch(eg);
+  }
+}
+
+void NnetExampleStream::AddToMinibatch(NnetExample *eg) {
+  int32 num_output_frames = 0;
+  for (size_t i = 0; i < eg->io.size(); i++)
+    if (eg->io[i].name == "output")
+      num_output_frames = eg->io[i].indexes.size();
+  pending_egs_.resize(pending_egs_.size() + 1);
+  pending_egs_.back().Swap(eg);
+  pending_output_frames_ += num_output_frames;
+  bool minibatch_ready =
+      (config_.measure_output_frames ?
+       pending_output_frames_ >= config_.minibatch_size :
+       static_cast<int32>(pending_egs_.size()) >= config_.minibatch_size);
+  if (minibatch_ready)
+    FlushMinibatch();
+}
+
+void NnetExampleStream::FlushMinibatch() {
+  if (pending_egs_.empty())
+    return;
+  // Reuse a minibatch that the trainer has finished with, if there is one, so
+  // that MergeExamples() can reuse its memory.
+  NnetExample *merged_eg = NULL;
+  queue_mutex_.Lock();
+  if (stop_) {  // don't spend time merging examples nobody will read.
+    queue_mutex_.Unlock();
+    pending_egs_.clear();
+    pending_output_frames_ = 0;
+    return;
+  }
+  if (!free_minibatches_.empty()) {
+    merged_eg = free_minibatches_.back();
+    free_minibatches_.pop_back();
+  }
+  queue_mutex_.Unlock();
+  if (merged_eg == NULL)
+    merged_eg = new NnetExample();
+  // This version of MergeExamples() consumes pending_egs_.
+  MergeExamples(&pending_egs_, false, merged_eg);
+  pending_output_frames_ = 0;
+  num_minibatches_++;
+  QueueMinibatch(merged_eg);
+}
+
+void NnetExampleStream::QueueMinibatch(NnetExample *eg) {
+  // We check stop_ before waiting as well as after, because the destructor
+  // signals slots_free_ only once.
+  if (Stopped()) {
+    delete eg;
+    return;
+  }
+  slots_free_.Wait();
+  queue_mutex_.Lock();
+  if (stop_) {
+    queue_mutex_.Unlock();
+    delete eg;
+    return;
+  }
+  queue_.push_back(eg);
+  queue_mutex_.Unlock();
+  minibatches_ready_.Signal();
+}
+
+bool NnetExampleStream::GetNextMinibatch(NnetExample *eg) {
+  if (GetNextMinibatchInternal(eg))
+    return true;
+  // thread_failed_ was set before the end of the data was queued, so it is
+  // safe to read it here.
+  if (thread_failed_)
+    KALDI_ERR << "Error producing examples in the background thread: "
+              << error_message_;
+  return false;
+}
+
+bool NnetExampleStream::GetNextMinibatchInternal(NnetExample *eg) {
+  KALDI_ASSERT(!finished_);
+  minibatches_ready_.Wait();
+  queue_mutex_.Lock();
+  NnetExample *next_eg = queue_.front();
+  queue_.pop_front();
+  if (next_eg != NULL) {
+    // After the swap, next_eg contains the caller's previous minibatch (if
+    // any); we give it back to the background thread for reuse.
+    eg->Swap(next_eg);
+    if (free_minibatches_.size() <
+        static_cast<size_t>(config_.num_minibatches_queued))
+      free_minibatches_.push_back(next_eg);
+    else
+      delete next_eg;
+  }
+  queue_mutex_.Unlock();
+  slots_free_.Signal();
+  if (next_eg == NULL) {
+    finished_ = true;
+    return false;
+  }
+  return true;
+}
+
+bool NnetExampleStream::PrintStats() const {
+  KALDI_ASSERT(finished_);
+  KALDI_LOG << "Processed " << num_done_ << " feature files, generated "
+            << num_egs_ << " examples covering " << num_frames_
+            << " frames, merged into " << num_minibatches_ << " minibatches; "
+            << num_err_ << " files had errors.";
+  return (num_done_ != 0);
+}
+
+NnetExampleStream::~NnetExampleStream() {
+  // Tell the background thread to stop, and wake it up in case it is waiting
+  // for a free place in the queue.
+  queue_mutex_.Lock();
+  stop_ = true;
+  queue_mutex_.Unlock();
+  slots_free_.Signal();
+  if (pthread_join(thread_, NULL))
+    KALDI_ERR << "Error rejoining thread.";
+  // If we stopped early, or the background thread failed, there may still be
+  // examples in the shuffling buffer and minibatches in the queue.
+  for (size_t i = 0; i < shuffle_buffer_.size(); i++)
+    delete shuffle_buffer_[i];
+  for (size_t i = 0; i < queue_.size(); i++)
+    delete queue_[i];
+  for (size_t i = 0; i < free_minibatches_.size(); i++)
+    delete free_minibatches_[i];
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
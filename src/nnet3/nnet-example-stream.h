@@ -0,0 +1,220 @@
+// nnet3/nnet-example-stream.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_EXAMPLE_STREAM_H_
+#define KALDI_NNET3_NNET_EXAMPLE_STREAM_H_
+
+#include <deque>
+#include "nnet3/nnet-example.h"
+#include "nnet3/nnet-example-utils.h"
+#include "thread/kaldi-thread.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-semaphore.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+/** This function splits the features and labels of a single utterance into
+    examples, each with "frames_per_eg" labeled frames plus the requested
+    left and right context, and appends them to "egs".  This is the same
+    format that nnet3-get-egs writes; at the end of the utterance we pad with
+    empty posteriors so that all examples have the same structure.  If
+    "ivector_feats" is non-NULL, we add an input named "ivector" containing the
+    iVector closest to the middle of each chunk.  The first frame index of each
+    example is appended to "start_frames", if it is non-NULL.  Returns the
+    number of frames that had labels (i.e. feats.NumRows()).
+ */
+int32 GetSimpleNnetExamples(const MatrixBase<BaseFloat> &feats,
+                            const MatrixBase<BaseFloat> *ivector_feats,
+                            const Posterior &pdf_post,
+                            int32 num_pdfs,
+                            int32 left_context,
+                            int32 right_context,
+                            int32 frames_per_eg,
+                            std::vector<NnetExample> *egs,
+                            std::vector<int32> *start_frames = NULL);
+
+
+struct NnetExampleStreamOptions {
+  int32 left_context;
+  int32 right_context;
+  int32 num_frames;
+  int32 buffer_size;
+  int32 minibatch_size;
+  bool measure_output_frames;
+  int32 num_minibatches_queued;
+  int32 length_tolerance;
+
+  NnetExampleStreamOptions(): left_context(0), right_context(0),
+                              num_frames(1), buffer_size(10000),
+                              minibatch_size(512),
+                              measure_output_frames(true),
+                              num_minibatches_queued(4),
+                              length_tolerance(100) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("left-context", &left_context, "Number of frames of left "
+                   "context the neural net requires.");
+    opts->Register("right-context", &right_context, "Number of frames of "
+                   "right context the neural net requires.");
+    opts->Register("num-frames", &num_frames, "Number of frames with labels "
+                   "that each example contains.");
+    opts->Register("buffer-size", &buffer_size, "Number of examples held in "
+                   "the buffer used for (partial) randomization of the order "
+                   "of examples; plays the same role as the --buffer-size "
+                   "option of nnet3-shuffle-egs.");
+    opts->Register("minibatch-size", &minibatch_size, "Target size of "
+                   "minibatches (see also --measure-output-frames)");
+    opts->Register("measure-output-frames", &measure_output_frames, "If true, "
+                   "--minibatch-size is a target number of total output "
+                   "frames; if false, --minibatch-size is the number of "
+                   "examples to merge.");
+    opts->Register("num-minibatches-queued", &num_minibatches_queued, "Number "
+                   "of merged minibatches the background thread is allowed "
+                   "to prepare ahead of the trainer (controls memory use).");
+    opts->Register("length-tolerance", &length_tolerance, "Tolerance for "
+                   "difference in num-frames between feat and ivector "
+                   "matrices");
+  }
+};
+
+
+/**
+   This class does, in a single process, what the pipeline
+   nnet3-get-egs | nnet3-shuffle-egs | nnet3-merge-egs does: it reads features
+   and pdf-level posteriors, splits them into examples, randomizes their order
+   using a buffer of --buffer-size examples, and merges them into minibatches.
+   All of this happens in a background thread, and the examples are never
+   compressed or serialized, so the training thread (which calls
+   GetNextMinibatch()) only sees the merged minibatches.
+
+   Note: the random number generator used for the shuffling is seeded from
+   Rand() in the constructor, so call srand() before constructing this
+   object if you want reproducible results.
+ */
+class NnetExampleStream {
+ public:
+  /// The rspecifiers are opened in the constructor.  ivector_rspecifier may be
+  /// empty.
+  NnetExampleStream(const NnetExampleStreamOptions &config,
+                    int32 num_pdfs,
+                    const std::string &feature_rspecifier,
+                    const std::string &pdf_post_rspecifier,
+                    const std::string &ivector_rspecifier);
+
+  /// Gets the next merged minibatch.  Returns false when there is no more
+  /// data; it is an error to call it again after it has returned false.  If
+  /// the background thread failed (e.g. a table reader could not read its
+  /// input), this throws the error in the calling thread once the minibatches
+  /// produced before the failure have been consumed.
+  bool GetNextMinibatch(NnetExample *eg);
+
+  /// Prints statistics about the data that was read; it is only valid to call
+  /// this after GetNextMinibatch() has returned false.  Returns true if we
+  /// processed at least one utterance successfully.
+  bool PrintStats() const;
+
+  /// The destructor stops the background thread (which finishes at most the
+  /// utterance it is working on) and discards any minibatches that have not
+  /// been consumed.
+  ~NnetExampleStream();
+
+ private:
+  // This wrapper can be passed to pthread_create.
+  static void* Run(void *ptr_in);
+
+  // This is what the background thread does: it loops over the utterances and
+  // produces the minibatches.
+  void ProduceMinibatches();
+
+  // Called from the background thread for each new example.  Takes ownership
+  // of the contents of "eg" (it is swapped with an example in the shuffling
+  // buffer, or into the pending minibatch).
+  void AcceptExample(NnetExample *eg);
+
+  // Adds the example to the minibatch under construction, and if the
+  // minibatch is ready, merges it and puts it in the queue.
+  void AddToMinibatch(NnetExample *eg);
+
+  // Merges any examples in pending_egs_ and puts the result in the queue.
+  void FlushMinibatch();
+
+  // Does the work of GetNextMinibatch(), but returns false (without
+  // throwing) at the end of the data even if the background thread failed.
+  bool GetNextMinibatchInternal(NnetExample *eg);
+
+  // Puts a merged minibatch (or NULL, to signal end of data) into the queue;
+  // takes ownership of the pointer.  Blocks if the queue is full.  If the
+  // destructor has been called, it just deletes the minibatch.
+  void QueueMinibatch(NnetExample *eg);
+
+  // Returns stop_ (locks queue_mutex_ to read it).
+  bool Stopped();
+
+  NnetExampleStreamOptions config_;
+  int32 num_pdfs_;
+  bool use_ivectors_;
+
+  SequentialBaseFloatMatrixReader feat_reader_;
+  RandomAccessPosteriorReader pdf_post_reader_;
+  RandomAccessBaseFloatMatrixReader ivector_reader_;
+
+  RandomState random_state_;
+  // The buffer of examples we use for randomization; NULL pointers are
+  // unused slots.
+  std::vector<NnetExample*> shuffle_buffer_;
+  // Examples that will go into the next minibatch.
+  std::vector<NnetExample> pending_egs_;
+  int32 pending_output_frames_;
+
+  pthread_t thread_;
+
+  // queue_ contains merged minibatches; a NULL element marks the end.
+  std::deque<NnetExample*> queue_;
+  // free_minibatches_ contains minibatches the trainer has finished with,
+  // which we reuse to avoid reallocating memory.
+  std::vector<NnetExample*> free_minibatches_;
+  Mutex queue_mutex_;  // guards queue_, free_minibatches_ and stop_.
+  Semaphore minibatches_ready_;  // counts elements of queue_.
+  Semaphore slots_free_;  // counts free places in queue_.
+  bool finished_;
+  // Set by the destructor (guarded by queue_mutex_); tells the background
+  // thread to stop producing minibatches.
+  bool stop_;
+  // Set by the background thread if it caught an exception; error_message_ is
+  // the message.  They are written before the NULL that ends the queue.
+  bool thread_failed_;
+  std::string error_message_;
+
+  // Stats (written by the background thread).
+  int32 num_done_;
+  int32 num_err_;
+  int64 num_egs_;
+  int64 num_frames_;
+  int64 num_minibatches_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetExampleStream);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_EXAMPLE_STREAM_H_
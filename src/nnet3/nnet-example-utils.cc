@@ -80,17 +80,22 @@ static void GetIoSizes(const std::vector<NnetExample> &src,
 
 
 
-// Do the final merging of NnetIo, once we have obtained the names, dims and
-// sizes for each feature/supervision type.
-static void MergeIo(const std::vector<NnetExample> &src,
-                    const std::vector<std::string> &names,
-                    const std::vector<int32> &sizes,
-                    bool compress,
-                    NnetExample *merged_eg) {
+// Sets up the names and indexes of the merged NnetIo, once we have obtained
+// the names, dims and sizes for each feature/supervision type.  Any NnetIo's
+// already present in "merged_eg" are reused, to avoid reallocating memory if
+// this is called repeatedly with the same output.  Outputs to "io_locations",
+// for each feature type f, the list of pairs (example-index, io-index) in
+// "src" whose features are to be appended to get the merged features.
+static void MergeIoIndexes(
+    const std::vector<NnetExample> &src,
+    const std::vector<std::string> &names,
+    const std::vector<int32> &sizes,
+    NnetExample *merged_eg,
+    std::vector<std::vector<std::pair<int32, int32> > > *io_locations) {
   int32 num_feats = names.size();
   std::vector<int32> cur_size(num_feats, 0);
-  std::vector<std::vector<GeneralMatrix const*> > output_lists(num_feats);
-  merged_eg->io.clear();
+  io_locations->clear();
+  io_locations->resize(num_feats);
   merged_eg->io.resize(num_feats);
   for (int32 f = 0; f < num_feats; f++) {
     NnetIo &io = merged_eg->io[f];
@@ -98,6 +103,7 @@ static void MergeIo(const std::vector<NnetExample> &src,
     KALDI_ASSERT(size > 0);
     io.name = names[f];
     io.indexes.resize(size);
+    (*io_locations)[f].reserve(src.size());
   }
 
   std::vector<std::string>::const_iterator names_begin = names.begin(),
@@ -106,7 +112,7 @@ static void MergeIo(const std::vector<NnetExample> &src,
   for (int32 n = 0; iter != end; ++iter,++n) {
     std::vector<NnetIo>::const_iterator iter2 = iter->io.begin(),
                                          end2 = iter->io.end();
-    for (; iter2 != end2; ++iter2) {
+    for (int32 io_index = 0; iter2 != end2; ++iter2, ++io_index) {
       const NnetIo &io = *iter2;
       std::vector<std::string>::const_iterator names_iter =
           std::lower_bound(names_begin, names_end, io.name);
@@ -115,7 +121,7 @@ static void MergeIo(const std::vector<NnetExample> &src,
       int32 this_size = io.indexes.size(),
         &this_offset = cur_size[f];
       KALDI_ASSERT(this_size + this_offset <= sizes[f]);
-      output_lists[f].push_back(&(io.features));
+      (*io_locations)[f].push_back(std::pair<int32, int32>(n, io_index));
       NnetIo &output_io = merged_eg->io[f];
       std::copy(io.indexes.begin(), io.indexes.end(),
                 output_io.indexes.begin() + this_offset);
@@ -132,9 +138,28 @@ static void MergeIo(const std::vector<NnetExample> &src,
     }
   }
   KALDI_ASSERT(cur_size == sizes);
+}
+
+
+
+void MergeExamples(const std::vector<NnetExample> &src,
+                   bool compress,
+                   NnetExample *merged_eg) {
+  KALDI_ASSERT(!src.empty());
+  std::vector<std::string> io_names;
+  GetIoNames(src, &io_names);
+  // the sizes are the total number of Indexes we have across all examples.
+  std::vector<int32> io_sizes;
+  GetIoSizes(src, io_names, &io_sizes);
+  std::vector<std::vector<std::pair<int32, int32> > > io_locations;
+  MergeIoIndexes(src, io_names, io_sizes, merged_eg, &io_locations);
+  int32 num_feats = io_names.size();
   for (int32 f = 0; f < num_feats; f++) {
-    AppendGeneralMatrixRows(output_lists[f],
-                            &(merged_eg->io[f].features));
+    const std::vector<std::pair<int32, int32> > &locations = io_locations[f];
+    std::vector<const GeneralMatrix*> input_list(locations.size());
+    for (size_t j = 0; j < locations.size(); j++)
+      input_list[j] = &(src[locations[j].first].io[locations[j].second].features);
+    AppendGeneralMatrixRows(input_list, &(merged_eg->io[f].features));
     if (compress) {
       // the following won't do anything if the features were sparse.
       merged_eg->io[f].features.Compress();
@@ -143,17 +168,31 @@ static void MergeIo(const std::vector<NnetExample> &src,
 }
 
 
-
-void MergeExamples(const std::vector<NnetExample> &src,
+void MergeExamples(std::vector<NnetExample> *src,
                    bool compress,
                    NnetExample *merged_eg) {
-  KALDI_ASSERT(!src.empty());
+  KALDI_ASSERT(!src->empty());
   std::vector<std::string> io_names;
-  GetIoNames(src, &io_names);
+  GetIoNames(*src, &io_names);
   // the sizes are the total number of Indexes we have across all examples.
   std::vector<int32> io_sizes;
-  GetIoSizes(src, io_names, &io_sizes);
-  MergeIo(src, io_names, io_sizes, compress, merged_eg);
+  GetIoSizes(*src, io_names, &io_sizes);
+  std::vector<std::vector<std::pair<int32, int32> > > io_locations;
+  MergeIoIndexes(*src, io_names, io_sizes, merged_eg, &io_locations);
+  int32 num_feats = io_names.size();
+  for (int32 f = 0; f < num_feats; f++) {
+    const std::vector<std::pair<int32, int32> > &locations = io_locations[f];
+    std::vector<GeneralMatrix*> input_list(locations.size());
+    for (size_t j = 0; j < locations.size(); j++)
+      input_list[j] =
+          &((*src)[locations[j].first].io[locations[j].second].features);
+    // This version of AppendGeneralMatrixRows() moves the rows of sparse
+    // inputs (e.g. the supervision) rather than copying them.
+    AppendGeneralMatrixRows(input_list, &(merged_eg->io[f].features));
+    if (compress)
+      merged_eg->io[f].features.Compress();
+  }
+  src->clear();
 }
 
 
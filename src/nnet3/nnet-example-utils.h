@@ -37,6 +37,16 @@ void MergeExamples(const std::vector<NnetExample> &src,
                    bool compress,
                    NnetExample *dest);
 
+/** This version of MergeExamples() is destructive of its input: "src" is
+    cleared, and sparse features (normally the supervision) are moved rather
+    than copied into "dest".  Both versions reuse the memory already in "dest"
+    where the dimensions allow it, so when merging minibatches in a loop it is
+    more efficient to keep using the same "dest" object.
+ */
+void MergeExamples(std::vector<NnetExample> *src,
+                   bool compress,
+                   NnetExample *dest);
+
 
 /** Shifts the time-index t of everything in the "eg" by adding "t_offset" to
     all "t" values.  This might be useful in things like clockwork RNNs that are
@@ -25,6 +25,7 @@
 #include "hmm/transition-model.h"
 #include "hmm/posterior.h"
 #include "nnet3/nnet-example.h"
+#include "nnet3/nnet-example-stream.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -42,70 +43,24 @@ static void ProcessFile(const MatrixBase<BaseFloat> &feats,
                         int64 *num_frames_written,
                         int64 *num_egs_written,
                         NnetExampleWriter *example_writer) {
-  KALDI_ASSERT(feats.NumRows() == static_cast<int32>(pdf_post.size()));
-  
-  for (int32 t = 0; t < feats.NumRows(); t += frames_per_eg) {
-
-    // actual_frames_per_eg is the number of frames with nonzero
-    // posteriors.  At the end of the file we pad with zero posteriors
-    // so that all examples have the same structure (prevents the need
-    // for recompilations).
-    int32 actual_frames_per_eg = std::min(frames_per_eg,
-                                          feats.NumRows() - t);
-
-
-    int32 tot_frames = left_context + frames_per_eg + right_context;
-
-    Matrix<BaseFloat> input_frames(tot_frames, feats.NumCols());
-    
-    // Set up "input_frames".
-    for (int32 j = -left_context; j < frames_per_eg + right_context; j++) {
-      int32 t2 = j + t;
-      if (t2 < 0) t2 = 0;
-      if (t2 >= feats.NumRows()) t2 = feats.NumRows() - 1;
-      SubVector<BaseFloat> src(feats, t2),
-          dest(input_frames, j + left_context);
-      dest.CopyFromVec(src);
-    }
-
-    NnetExample eg;
-    
-    // call the regular input "input".
-    eg.io.push_back(NnetIo("input", - left_context,
-                           input_frames));
-
-    // if applicable, add the iVector feature.
-    if (ivector_feats != NULL) {
-      // try to get closest frame to middle of window to get
-      // a representative iVector.
-      int32 closest_frame = t + (actual_frames_per_eg / 2);
-      KALDI_ASSERT(ivector_feats->NumRows() > 0);
-      if (closest_frame >= ivector_feats->NumRows())
-        closest_frame = ivector_feats->NumRows() - 1;
-      Matrix<BaseFloat> ivector(1, ivector_feats->NumCols());
-      ivector.Row(0).CopyFromVec(ivector_feats->Row(closest_frame));
-      eg.io.push_back(NnetIo("ivector", 0, ivector));
-    }
-
-    // add the labels.
-    Posterior labels(frames_per_eg);
-    for (int32 i = 0; i < actual_frames_per_eg; i++)
-      labels[i] = pdf_post[t + i];
-    // remaining posteriors for frames are empty.
-    eg.io.push_back(NnetIo("output", num_pdfs, 0, labels));
-    
+  std::vector<NnetExample> egs;
+  std::vector<int32> start_frames;
+  *num_frames_written += GetSimpleNnetExamples(feats, ivector_feats, pdf_post,
+                                               num_pdfs, left_context,
+                                               right_context, frames_per_eg,
+                                               &egs, &start_frames);
+  for (size_t i = 0; i < egs.size(); i++) {
     if (compress)
-      eg.Compress();
-      
+      egs[i].Compress();
+
     std::ostringstream os;
-    os << utt_id << "-" << t;
+    os << utt_id << "-" << start_frames[i];
 
     std::string key = os.str(); // key is <utt_id>-<frame_id>
 
-    *num_frames_written += actual_frames_per_eg;
     *num_egs_written += 1;
 
-    example_writer->Write(key, eg);
+    example_writer->Write(key, egs[i]);
   }
 }
 
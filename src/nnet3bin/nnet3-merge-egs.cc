@@ -89,6 +89,8 @@ int main(int argc, char *argv[]) {
     std::vector<NnetExample> examples;
     examples.reserve(minibatch_size);
 
+    // We keep using the same merged example, so that its memory can be reused.
+    NnetExample merged_eg;
     int32 cur_num_output_frames = 0;
     
     int64 num_read = 0, num_written = 0;
@@ -107,8 +109,8 @@ int main(int argc, char *argv[]) {
       num_read++;
       
       if (minibatch_ready || (example_reader.Done() && !examples.empty())) {
-        NnetExample merged_eg;
-        MergeExamples(examples, compress, &merged_eg);
+        // This version of MergeExamples() consumes "examples".
+        MergeExamples(&examples, compress, &merged_eg);
         std::ostringstream ostr;
         ostr << "merged-" << num_written;
         num_written++;
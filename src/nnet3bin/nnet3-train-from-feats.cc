@@ -0,0 +1,120 @@
+// nnet3bin/nnet3-train-from-feats.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+//           2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-training.h"
+#include "nnet3/nnet-example-stream.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Train nnet3 neural network parameters with backprop and stochastic\n"
+        "gradient descent, reading features and pdf-level posteriors directly.\n"
+        "This does the equivalent of the pipeline\n"
+        "nnet3-get-egs | nnet3-shuffle-egs | nnet3-merge-egs | nnet3-train\n"
+        "in a single process: the examples are generated, shuffled (using a\n"
+        "buffer of --buffer-size examples) and merged into minibatches in a\n"
+        "background thread, without being compressed or serialized.\n"
+        "\n"
+        "Usage:  nnet3-train-from-feats [options] <raw-model-in> "
+        "<features-rspecifier> <pdf-post-rspecifier> <raw-model-out>\n"
+        "\n"
+        "e.g.:\n"
+        "nnet3-train-from-feats --num-pdfs=2658 --left-context=12 "
+        "--right-context=9 --num-frames=8 1.raw \"$feats\" \\\n"
+        "  \"ark:gunzip -c exp/nnet/ali.1.gz | ali-to-pdf exp/nnet/1.nnet "
+        "ark:- ark:- | ali-to-post ark:- ark:- |\" 2.raw\n";
+
+    bool binary_write = true;
+    std::string use_gpu = "yes";
+    int32 num_pdfs = -1, srand_seed = 0;
+    std::string ivector_rspecifier;
+    NnetTrainerOptions train_config;
+    NnetExampleStreamOptions stream_config;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+    po.Register("num-pdfs", &num_pdfs, "Number of pdfs in the acoustic "
+                "model");
+    po.Register("srand", &srand_seed, "Seed for random number generator "
+                "(used for shuffling the examples)");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier of ivector "
+                "features, as matrix.");
+
+    train_config.Register(&po);
+    stream_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    srand(srand_seed);
+
+    if (po.NumArgs() != 4) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    if (num_pdfs <= 0)
+      KALDI_ERR << "--num-pdfs options is required.";
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        feature_rspecifier = po.GetArg(2),
+        pdf_post_rspecifier = po.GetArg(3),
+        nnet_wxfilename = po.GetArg(4);
+
+    Nnet nnet;
+    ReadKaldiObject(nnet_rxfilename, &nnet);
+
+    NnetTrainer trainer(train_config, &nnet);
+
+    NnetExampleStream example_stream(stream_config, num_pdfs,
+                                     feature_rspecifier, pdf_post_rspecifier,
+                                     ivector_rspecifier);
+
+    NnetExample eg;
+    while (example_stream.GetNextMinibatch(&eg))
+      trainer.Train(eg);
+
+    bool ok = example_stream.PrintStats();
+    ok = trainer.PrintTotalStats() && ok;
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
+    KALDI_LOG << "Wrote model to " << nnet_wxfilename;
+    return (ok ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -21,11 +21,14 @@
 #include "nnet/nnet-nnet.h"
 #include "nnet/nnet-loss.h"
 #include "nnet/nnet-randomizer.h"
+#include "nnet/nnet-sequence-bucketer.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "base/timer.h"
 #include "cudamatrix/cu-device.h"
 
+#include <numeric>
+
 int main(int argc, char *argv[]) {
   using namespace kaldi;
   using namespace kaldi::nnet1;
@@ -71,6 +74,9 @@ int main(int argc, char *argv[]) {
     int32 report_step = 100;
     po.Register("report-step", &report_step, "Step (number of sequences) for status reporting");
 
+    SequenceBucketerOptions bucket_opts;
+    bucket_opts.Register(&po);
+
     std::string use_gpu = "yes";
     // po.Register("use-gpu", &use_gpu, "yes|no|optional, only has effect if compiled with CUDA");
 
@@ -133,67 +139,79 @@ int main(int argc, char *argv[]) {
 
     int32 feat_dim = nnet.InputDim();
 
+    // groups utterances of similar length, to reduce the padding,
+    SequenceBucketer bucketer(bucket_opts, num_streams);
+    PaddingStats padding_stats;
+
     int32 num_done = 0, num_no_tgt_mat = 0, num_other_error = 0;
     while (1) {
 
       std::vector<int32> frame_num_utt;
       int32 sequence_index = 0, max_frame_num = 0;
 
-      for ( ; !feature_reader.Done(); feature_reader.Next()) {
-        std::string utt = feature_reader.Key();
-        // Check that we have targets
-        if (!targets_reader.HasKey(utt)) {
-          KALDI_WARN << utt << ", missing targets";
-          num_no_tgt_mat++;
-          continue;
-        }
-        // Get feature / target pair
-        Matrix<BaseFloat> mat = feature_reader.Value();
-        Posterior targets  = targets_reader.Value(utt);
-
-        if (frame_weights != "") {
-          weights = weights_reader.Value(utt);
-        } else {  // all per-frame weights are 1.0
-          weights.Resize(mat.NumRows());
-          weights.Set(1.0);
-        }
-        // correct small length mismatch ... or drop sentence
-        {
-          // add lengths to vector
-          std::vector<int32> lenght;
-          lenght.push_back(mat.NumRows());
-          lenght.push_back(targets.size());
-          lenght.push_back(weights.Dim());
-          // find min, max
-          int32 min = *std::min_element(lenght.begin(), lenght.end());
-          int32 max = *std::max_element(lenght.begin(), lenght.end());
-          // fix or drop ?
-          if (max - min < length_tolerance) {
-            if (mat.NumRows() != min) mat.Resize(min, mat.NumCols(), kCopyData);
-            if (targets.size() != min) targets.resize(min);
-            if (weights.Dim() != min) weights.Resize(min, kCopyData);
-          } else {
-            KALDI_WARN << utt << ", length mismatch of targets " << targets.size()
-                       << " and features " << mat.NumRows();
-            num_other_error++;
+      while (1) {
+        // read utterances into the bucketer (it sorts them by length),
+        for ( ; !bucketer.IsFull() && !feature_reader.Done(); feature_reader.Next()) {
+          std::string utt = feature_reader.Key();
+          // Check that we have targets
+          if (!targets_reader.HasKey(utt)) {
+            KALDI_WARN << utt << ", missing targets";
+            num_no_tgt_mat++;
             continue;
           }
+          // Get feature / target pair
+          Matrix<BaseFloat> mat = feature_reader.Value();
+          Posterior targets  = targets_reader.Value(utt);
+
+          if (frame_weights != "") {
+            weights = weights_reader.Value(utt);
+          } else {  // all per-frame weights are 1.0
+            weights.Resize(mat.NumRows());
+            weights.Set(1.0);
+          }
+          // correct small length mismatch ... or drop sentence
+          {
+            // add lengths to vector
+            std::vector<int32> lenght;
+            lenght.push_back(mat.NumRows());
+            lenght.push_back(targets.size());
+            lenght.push_back(weights.Dim());
+            // find min, max
+            int32 min = *std::min_element(lenght.begin(), lenght.end());
+            int32 max = *std::max_element(lenght.begin(), lenght.end());
+            // fix or drop ?
+            if (max - min < length_tolerance) {
+              if (mat.NumRows() != min) mat.Resize(min, mat.NumCols(), kCopyData);
+              if (targets.size() != min) targets.resize(min);
+              if (weights.Dim() != min) weights.Resize(min, kCopyData);
+            } else {
+              KALDI_WARN << utt << ", length mismatch of targets " << targets.size()
+                         << " and features " << mat.NumRows();
+              num_other_error++;
+              continue;
+            }
+          }
+          bucketer.AcceptSequence(utt, &mat, &targets, &weights);
         }
+        if (bucketer.Empty()) break;  // no more data,
 
-        if (max_frame_num < mat.NumRows()) max_frame_num = mat.NumRows();
-        feats_utt[sequence_index] = mat;
-        labels_utt[sequence_index] = targets;
-        weights_utt[sequence_index] = weights;
+        std::string utt;
+        bucketer.GetSequence(&utt, &feats_utt[sequence_index],
+                             &labels_utt[sequence_index],
+                             &weights_utt[sequence_index]);
+        int32 num_frames = feats_utt[sequence_index].NumRows();
+        if (max_frame_num < num_frames) max_frame_num = num_frames;
 
-        frame_num_utt.push_back(mat.NumRows());
+        frame_num_utt.push_back(num_frames);
         sequence_index++;
         // If the total number of frames reaches frame_limit, then stop adding more sequences, regardless of whether
         // the number of utterances reaches num_sequence or not.
         if (frame_num_utt.size() == num_streams || frame_num_utt.size() * max_frame_num > frame_limit) {
-            feature_reader.Next(); break;
+            break;
         }
       }
       int32 cur_sequence_num = frame_num_utt.size();
+      if (cur_sequence_num == 0) break;  // no more data,
 
       // Create the final feature matrix. Every utterance is padded to the max length within this group of utterances
       Matrix<BaseFloat> feat_mat_host(cur_sequence_num * max_frame_num, feat_dim, kSetZero);
@@ -257,8 +275,10 @@ int main(int argc, char *argv[]) {
 
       num_done += cur_sequence_num;
       total_frames += feats_transf.NumRows();
+      padding_stats.Add(std::accumulate(frame_num_utt.begin(), frame_num_utt.end(), 0),
+                        cur_sequence_num * max_frame_num);
 
-      if (feature_reader.Done()) break;  // end loop of while(1)
+      if (feature_reader.Done() && bucketer.Empty()) break;  // end loop of while(1)
     }
 
     // Check network parameters and gradients when training finishes
@@ -281,6 +301,7 @@ int main(int argc, char *argv[]) {
               << "[" << (crossvalidate?"CROSS-VALIDATION":"TRAINING")
               << ", " << time.Elapsed()/60 << " min, fps" << total_frames/time.Elapsed()
               << "]";
+    KALDI_LOG << padding_stats.Report();
     KALDI_LOG << xent.Report();
 
 #if HAVE_CUDA == 1
@@ -24,6 +24,7 @@
 #include "nnet/nnet-nnet.h"
 #include "nnet/nnet-loss.h"
 #include "nnet/nnet-randomizer.h"
+#include "nnet/nnet-sequence-bucketer.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "base/timer.h"
@@ -84,6 +85,9 @@ int main(int argc, char *argv[]) {
     po.Register("dump-interval", &dump_interval, "---LSTM--- num utts between model dumping [ 0 == disabled ]"); 
     //</jiayu>
 
+    SequenceBucketerOptions bucket_opts;
+    bucket_opts.Register(&po);
+
     // Add dummy randomizer options, to make the tool compatible with standard scripts
     NnetDataRandomizerOptions rnd_opts;
     rnd_opts.Register(&po);
@@ -150,6 +154,10 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_no_tgt_mat = 0, num_other_error = 0;
 
+    // sorts utterances by length, so the streams end at similar time,
+    SequenceBucketer bucketer(bucket_opts, num_stream);
+    PaddingStats padding_stats;
+
     //  book-keeping for multi-streams
     std::vector<std::string> keys(num_stream);
     std::vector<Matrix<BaseFloat> > feats(num_stream);
@@ -169,15 +177,33 @@ int main(int argc, char *argv[]) {
         // loop over all streams, check if any stream reaches the end of its utterance,
         // if any, feed the exhausted stream with a new utterance, update book-keeping infos
         for (int s = 0; s < num_stream; s++) {
+            new_utt_flags[s] = 0;
             // this stream still has valid frames
             if (curt[s] < lent[s]) {
-                new_utt_flags[s] = 0;
                 continue;
             }
             // else, this stream exhausted, need new utterance
-            while (!feature_reader.Done()) {
-                keys[s]  = feature_reader.Key();
-                const Matrix<BaseFloat> &mat = feature_reader.Value();
+            while (1) {
+                // read utterances into the bucketer (it sorts them by length),
+                while (!bucketer.IsFull() && !feature_reader.Done()) {
+                    std::string utt = feature_reader.Key();
+                    if (!target_reader.HasKey(utt)) {
+                        KALDI_WARN << utt << ", missing targets";
+                        num_no_tgt_mat++;
+                        feature_reader.Next();
+                        continue;
+                    }
+                    Matrix<BaseFloat> mat = feature_reader.Value();
+                    Posterior tgt = target_reader.Value(utt);
+                    Vector<BaseFloat> no_weights;
+                    bucketer.AcceptSequence(utt, &mat, &tgt, &no_weights);
+                    feature_reader.Next();
+                }
+                if (bucketer.Empty()) break;  // no more data,
+
+                Matrix<BaseFloat> mat;
+                Vector<BaseFloat> no_weights;
+                bucketer.GetSequence(&keys[s], &mat, &targets[s], &no_weights);
                 { // apply optional feature transform,
                   // Karel: feature transform may contain <Splice> which does clone
                   // frames on sentence boundaries. It is better to apply feature 
@@ -186,22 +212,14 @@ int main(int argc, char *argv[]) {
                   feats[s].Resize(feat_transf.NumRows(), feat_transf.NumCols());
                   feat_transf.CopyToMat(&feats[s]); 
                 }
-                if (!target_reader.HasKey(keys[s])) {
-                    KALDI_WARN << keys[s] << ", missing targets";
-                    num_no_tgt_mat++;
-                    feature_reader.Next();
-                    continue;
-                }
-                targets[s] = target_reader.Value(keys[s]);
                 if (feats[s].NumRows() != targets[s].size()) {
                     KALDI_WARN << keys[s] << ", length miss-match between feats and targets, skip";
-                    feature_reader.Next();
+                    num_other_error++;
                     continue;
                 }
                 curt[s] = 0;
                 lent[s] = feats[s].NumRows();
                 new_utt_flags[s] = 1;  // a new utterance feeded to this stream
-                feature_reader.Next();
                 break;
             }
         }
@@ -270,6 +288,7 @@ int main(int argc, char *argv[]) {
 
         int frame_progress = frame_mask.Sum();
         total_frames += frame_progress;
+        padding_stats.Add(frame_progress, frame_mask.Dim());
 
         int num_done_progress = 0;
         for (int i =0; i < new_utt_flags.size(); i++) {
@@ -334,6 +353,7 @@ int main(int argc, char *argv[]) {
               << ", " << (randomize?"RANDOMIZED":"NOT-RANDOMIZED") 
               << ", " << time.Elapsed()/60 << " min, fps" << total_frames/time.Elapsed()
               << "]";  
+    KALDI_LOG << padding_stats.Report();
 
     if (objective_function == "xent") {
       KALDI_LOG << xent.Report();
@@ -163,6 +163,8 @@ class OnlineFeaturePipeline: public OnlineFeatureInterface {
   virtual bool IsLastFrame(int32 frame) const;
   virtual int32 NumFramesReady() const;
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats);
 
   // This is supplied for debug purposes.
   void GetAsMatrix(Matrix<BaseFloat> *feats);
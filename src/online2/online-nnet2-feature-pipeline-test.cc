@@ -0,0 +1,138 @@
+// online2/online-nnet2-feature-pipeline-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "online2/online-nnet2-feature-pipeline.h"
+
+namespace kaldi {
+
+// Sets up "info" for features of type "feature_type", optionally with pitch,
+// and without iVectors.  We turn off dithering and the noise in the pitch
+// features, so that pipelines with their own features give the same output as
+// ones that share them.
+static void InitInfo(const std::string &feature_type, bool add_pitch,
+                     OnlineNnet2FeaturePipelineInfo *info) {
+  info->feature_type = feature_type;
+  info->mfcc_opts.frame_opts.dither = 0.0;
+  info->fbank_opts.frame_opts.dither = 0.0;
+  info->add_pitch = add_pitch;
+  info->pitch_process_opts.delta_pitch_noise_stddev = 0.0;
+  info->use_ivectors = false;
+}
+
+// Checks that "pipeline" and "ref_pipeline" have the same frames ready, and
+// the same features for the frames from *num_done on; then sets *num_done to
+// the number of frames ready.
+static void CheckNewFrames(OnlineNnet2FeaturePipeline *pipeline,
+                           OnlineNnet2FeaturePipeline *ref_pipeline,
+                           int32 *num_done) {
+  int32 num_ready = pipeline->NumFramesReady();
+  KALDI_ASSERT(num_ready == ref_pipeline->NumFramesReady());
+  KALDI_ASSERT(pipeline->Dim() == ref_pipeline->Dim());
+  if (num_ready > *num_done) {
+    int32 num_frames = num_ready - *num_done;
+    Matrix<BaseFloat> feats(num_frames, pipeline->Dim()),
+        ref_feats(num_frames, pipeline->Dim());
+    pipeline->GetFrames(*num_done, num_frames, &feats);
+    ref_pipeline->GetFrames(*num_done, num_frames, &ref_feats);
+    KALDI_ASSERT(feats.ApproxEqual(ref_feats, 1.0e-05));
+    *num_done = num_ready;
+  }
+}
+
+// Pipelines that share a front end should give the same features as
+// standalone pipelines that are given the same waveform in the same chunks
+// and read in the same order, also when some of the pipelines are destroyed
+// part of the way through.
+void UnitTestOnlineNnet2FeatureFrontEnd() {
+  OnlineNnet2FeaturePipelineInfo mfcc_pitch_info, mfcc_info, fbank_info;
+  InitInfo("mfcc", true, &mfcc_pitch_info);
+  InitInfo("mfcc", false, &mfcc_info);
+  InitInfo("fbank", false, &fbank_info);
+
+  // Pipelines 0 and 3 share all their stages; 1 shares the base features with
+  // them; 2 shares nothing.
+  const OnlineNnet2FeaturePipelineInfo *infos[] = { &mfcc_pitch_info,
+                                                    &mfcc_info, &fbank_info,
+                                                    &mfcc_pitch_info };
+  int32 num_pipelines = 4;
+  OnlineNnet2FeatureFrontEnd front_end;
+  std::vector<OnlineNnet2FeaturePipeline*> pipelines(num_pipelines),
+      ref_pipelines(num_pipelines);
+  for (int32 i = 0; i < num_pipelines; i++) {
+    pipelines[i] = new OnlineNnet2FeaturePipeline(*(infos[i]), &front_end);
+    ref_pipelines[i] = new OnlineNnet2FeaturePipeline(*(infos[i]));
+  }
+  std::vector<int32> num_done(num_pipelines, 0);
+
+  BaseFloat samp_freq = mfcc_pitch_info.mfcc_opts.frame_opts.samp_freq;
+  int32 num_chunks = RandInt(5, 20);
+  for (int32 c = 0; c < num_chunks; c++) {
+    Vector<BaseFloat> waveform(RandInt(400, 4000));
+    waveform.SetRandn();
+    waveform.Scale(1000.0);
+    front_end.AcceptWaveform(samp_freq, waveform);
+    for (int32 i = 0; i < num_pipelines; i++)
+      if (pipelines[i] != NULL)
+        ref_pipelines[i]->AcceptWaveform(samp_freq, waveform);
+    if (c + 1 == num_chunks) {
+      front_end.InputFinished();
+      for (int32 i = 0; i < num_pipelines; i++)
+        if (pipelines[i] != NULL)
+          ref_pipelines[i]->InputFinished();
+    }
+    for (int32 i = 0; i < num_pipelines; i++)
+      if (pipelines[i] != NULL)
+        CheckNewFrames(pipelines[i], ref_pipelines[i], &(num_done[i]));
+
+    if (c == num_chunks / 2) {
+      // Destroy pipeline 0, which shares its stages with pipeline 3, and
+      // pipeline 2, whose stage is then destroyed too.
+      int32 destroy[] = { 0, 2 };
+      for (int32 j = 0; j < 2; j++) {
+        int32 i = destroy[j];
+        delete pipelines[i];
+        delete ref_pipelines[i];
+        pipelines[i] = NULL;
+        ref_pipelines[i] = NULL;
+      }
+    }
+  }
+
+  // Read all the frames again.  OnlinePitchFeature revises the pitch of
+  // earlier frames when it sees more data, so this checks that the shared
+  // pipelines see the revised values, as the standalone ones do.
+  for (int32 i = 0; i < num_pipelines; i++) {
+    if (pipelines[i] != NULL) {
+      int32 zero = 0;
+      CheckNewFrames(pipelines[i], ref_pipelines[i], &zero);
+      KALDI_ASSERT(pipelines[i]->IsLastFrame(num_done[i] - 1));
+    }
+    delete pipelines[i];
+    delete ref_pipelines[i];
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++)
+    UnitTestOnlineNnet2FeatureFrontEnd();
+  KALDI_LOG << "Tests succeeded.";
+}
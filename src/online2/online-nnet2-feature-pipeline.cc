@@ -76,9 +76,226 @@ OnlineNnet2FeaturePipelineInfo::OnlineNnet2FeaturePipelineInfo(
   }
 }
 
+namespace {
+
+// This class writes the values of all the options that are registered with
+// it to a string, so we can tell whether two configurations are the same.
+class OptionsStringWriter: public OptionsItf {
+ public:
+  OptionsStringWriter() { os_.precision(10); }
+  virtual void Register(const std::string &name,
+                        bool *ptr, const std::string &doc) {
+    os_ << name << '=' << *ptr << ' ';
+  }
+  virtual void Register(const std::string &name,
+                        int32 *ptr, const std::string &doc) {
+    os_ << name << '=' << *ptr << ' ';
+  }
+  virtual void Register(const std::string &name,
+                        uint32 *ptr, const std::string &doc) {
+    os_ << name << '=' << *ptr << ' ';
+  }
+  virtual void Register(const std::string &name,
+                        float *ptr, const std::string &doc) {
+    os_ << name << '=' << *ptr << ' ';
+  }
+  virtual void Register(const std::string &name,
+                        double *ptr, const std::string &doc) {
+    os_ << name << '=' << *ptr << ' ';
+  }
+  virtual void Register(const std::string &name,
+                        std::string *ptr, const std::string &doc) {
+    os_ << name << "='" << *ptr << "' ";
+  }
+  std::string Str() const { return os_.str(); }
+ private:
+  std::ostringstream os_;
+};
+
+// Returns a string that identifies the configuration of the base features.
+std::string BaseFeatureKey(const OnlineNnet2FeaturePipelineInfo &info) {
+  OptionsStringWriter writer;
+  if (info.feature_type == "mfcc") {
+    MfccOptions opts(info.mfcc_opts);
+    opts.Register(&writer);
+  } else if (info.feature_type == "plp") {
+    PlpOptions opts(info.plp_opts);
+    opts.Register(&writer);
+  } else if (info.feature_type == "fbank") {
+    FbankOptions opts(info.fbank_opts);
+    opts.Register(&writer);
+  } else {
+    KALDI_ERR << "Code error: invalid feature type " << info.feature_type;
+  }
+  return info.feature_type + ": " + writer.Str();
+}
+
+// Returns a string that identifies the configuration of the pitch features.
+std::string PitchFeatureKey(const OnlineNnet2FeaturePipelineInfo &info) {
+  OptionsStringWriter writer;
+  PitchExtractionOptions pitch_opts(info.pitch_opts);
+  ProcessPitchOptions pitch_process_opts(info.pitch_process_opts);
+  pitch_opts.Register(&writer);
+  pitch_process_opts.Register(&writer);
+  return "pitch: " + writer.Str();
+}
+
+}  // namespace
+
+
+int32 OnlineNnet2FeatureFrontEnd::FindStage(const std::string &key) const {
+  for (size_t i = 0; i < stages_.size(); i++)
+    if (stages_[i].key == key)
+      return i;
+  return -1;
+}
+
+OnlineFeatureInterface *OnlineNnet2FeatureFrontEnd::AddStage(
+    const std::string &key,
+    OnlineBaseFeature *input,
+    OnlineFeatureInterface *feature,
+    bool use_cache,
+    OnlineFeatureInterface *source) {
+  KALDI_ASSERT(input != NULL || feature != NULL);
+  KALDI_ASSERT(!use_cache || feature != NULL);
+  Stage stage;
+  stage.key = key;
+  stage.num_users = 1;
+  stage.input = input;
+  stage.feature = feature;
+  stage.cache = (use_cache ? new OnlineCacheFeature(feature) : NULL);
+  if (stage.cache != NULL)
+    stage.output = stage.cache;
+  else if (feature != NULL)
+    stage.output = feature;
+  else
+    stage.output = input;
+  stage.source = source;
+  stages_.push_back(stage);
+  return stage.output;
+}
+
+OnlineFeatureInterface *OnlineNnet2FeatureFrontEnd::AcquireBaseFeature(
+    const OnlineNnet2FeaturePipelineInfo &info) {
+  std::string key = BaseFeatureKey(info);
+  int32 i = FindStage(key);
+  if (i != -1) {
+    stages_[i].num_users++;
+    return stages_[i].output;
+  }
+  if (waveform_accepted_)
+    KALDI_ERR << "You cannot add features to the front end after giving it "
+              << "data.";
+  OnlineBaseFeature *base_feature;
+  if (info.feature_type == "mfcc") {
+    base_feature = new OnlineMfcc(info.mfcc_opts);
+  } else if (info.feature_type == "plp") {
+    base_feature = new OnlinePlp(info.plp_opts);
+  } else {
+    KALDI_ASSERT(info.feature_type == "fbank");
+    base_feature = new OnlineFbank(info.fbank_opts);
+  }
+  return AddStage(key, base_feature, NULL, false, NULL);
+}
+
+OnlineFeatureInterface *OnlineNnet2FeatureFrontEnd::AcquirePitchFeature(
+    const OnlineNnet2FeaturePipelineInfo &info) {
+  KALDI_ASSERT(info.add_pitch);
+  std::string key = PitchFeatureKey(info);
+  int32 i = FindStage(key);
+  if (i != -1) {
+    stages_[i].num_users++;
+    return stages_[i].output;
+  }
+  if (waveform_accepted_)
+    KALDI_ERR << "You cannot add features to the front end after giving it "
+              << "data.";
+  // We don't cache the processed pitch: OnlinePitchFeature revises the pitch of
+  // earlier frames as it sees more data, and a cache would keep the values
+  // from when the frames were first read.  OnlineProcessPitch is cheap, and
+  // reading it from several pipelines gives each the values it would get from
+  // its own.
+  OnlinePitchFeature *pitch = new OnlinePitchFeature(info.pitch_opts);
+  return AddStage(key, pitch,
+                  new OnlineProcessPitch(info.pitch_process_opts, pitch),
+                  false, NULL);
+}
+
+OnlineFeatureInterface *OnlineNnet2FeatureFrontEnd::AcquireIvectorFeature(
+    const OnlineNnet2FeaturePipelineInfo &info,
+    OnlineIvectorFeature **ivector_feature) {
+  KALDI_ASSERT(info.use_ivectors);
+  // The iVector extractor is identified by its address.
+  std::ostringstream key;
+  key << "ivector: " << &(info.ivector_extractor_info) << ' '
+      << BaseFeatureKey(info);
+  int32 i = FindStage(key.str());
+  if (i != -1) {
+    stages_[i].num_users++;
+    *ivector_feature = static_cast<OnlineIvectorFeature*>(stages_[i].feature);
+    return stages_[i].output;
+  }
+  OnlineFeatureInterface *base_feature = AcquireBaseFeature(info);
+  *ivector_feature = new OnlineIvectorFeature(info.ivector_extractor_info,
+                                              base_feature);
+  return AddStage(key.str(), NULL, *ivector_feature, true, base_feature);
+}
+
+void OnlineNnet2FeatureFrontEnd::Release(OnlineFeatureInterface *feature) {
+  for (size_t i = 0; i < stages_.size(); i++) {
+    Stage &stage = stages_[i];
+    if (stage.output != feature)
+      continue;
+    KALDI_ASSERT(stage.num_users > 0);
+    if (--stage.num_users == 0) {
+      OnlineFeatureInterface *source = stage.source;
+      delete stage.cache;
+      delete stage.feature;
+      delete stage.input;
+      stages_.erase(stages_.begin() + i);
+      if (source != NULL)
+        Release(source);
+    }
+    return;
+  }
+  KALDI_ERR << "Release() called for a feature that is not in use.";
+}
+
+void OnlineNnet2FeatureFrontEnd::AcceptWaveform(
+    BaseFloat sampling_rate,
+    const VectorBase<BaseFloat> &waveform) {
+  if (input_finished_)
+    KALDI_ERR << "AcceptWaveform called after InputFinished() was called.";
+  waveform_accepted_ = true;
+  for (size_t i = 0; i < stages_.size(); i++)
+    if (stages_[i].input != NULL)
+      stages_[i].input->AcceptWaveform(sampling_rate, waveform);
+}
+
+void OnlineNnet2FeatureFrontEnd::InputFinished() {
+  input_finished_ = true;
+  for (size_t i = 0; i < stages_.size(); i++)
+    if (stages_[i].input != NULL)
+      stages_[i].input->InputFinished();
+}
+
+OnlineNnet2FeatureFrontEnd::~OnlineNnet2FeatureFrontEnd() {
+  if (!stages_.empty())
+    KALDI_WARN << "Destroying the feature front end while " << stages_.size()
+               << " of its stages are still in use.";
+  // Delete the stages in the reverse order of creation, so no stage is deleted
+  // before the stages that read from it.
+  for (size_t i = stages_.size(); i > 0; i--) {
+    delete stages_[i - 1].cache;
+    delete stages_[i - 1].feature;
+    delete stages_[i - 1].input;
+  }
+}
+
+
 OnlineNnet2FeaturePipeline::OnlineNnet2FeaturePipeline(
     const OnlineNnet2FeaturePipelineInfo &info):
-    info_(info) {
+    info_(info), front_end_(NULL) {
   if (info_.feature_type == "mfcc") {
     base_feature_ = new OnlineMfcc(info_.mfcc_opts);
   } else if (info_.feature_type == "plp") {
@@ -88,28 +305,56 @@ OnlineNnet2FeaturePipeline::OnlineNnet2FeaturePipeline(
   } else {
     KALDI_ERR << "Code error: invalid feature type " << info_.feature_type;
   }
+  base_output_ = base_feature_;
 
   if (info_.add_pitch) {
     pitch_ = new OnlinePitchFeature(info_.pitch_opts);
     pitch_feature_ = new OnlineProcessPitch(info_.pitch_process_opts,
                                             pitch_);
-    feature_plus_optional_pitch_ = new OnlineAppendFeature(base_feature_,
-                                                           pitch_feature_);
   } else {
     pitch_ = NULL;
     pitch_feature_ = NULL;
-    feature_plus_optional_pitch_ = base_feature_;
   }
+  pitch_output_ = pitch_feature_;
 
   if (info_.use_ivectors) {
     ivector_feature_ = new OnlineIvectorFeature(info_.ivector_extractor_info,
                                                 base_feature_);
-    final_feature_ = new OnlineAppendFeature(feature_plus_optional_pitch_,
-                                             ivector_feature_);
   } else {
     ivector_feature_ = NULL;
-    final_feature_ = feature_plus_optional_pitch_;
   }
+  ivector_output_ = ivector_feature_;
+  InitFinalFeature();
+}
+
+OnlineNnet2FeaturePipeline::OnlineNnet2FeaturePipeline(
+    const OnlineNnet2FeaturePipelineInfo &info,
+    OnlineNnet2FeatureFrontEnd *front_end):
+    info_(info), front_end_(front_end), base_feature_(NULL), pitch_(NULL),
+    pitch_feature_(NULL), pitch_output_(NULL), ivector_output_(NULL),
+    ivector_feature_(NULL) {
+  KALDI_ASSERT(front_end != NULL);
+  base_output_ = front_end_->AcquireBaseFeature(info_);
+  if (info_.add_pitch)
+    pitch_output_ = front_end_->AcquirePitchFeature(info_);
+  if (info_.use_ivectors)
+    ivector_output_ = front_end_->AcquireIvectorFeature(info_,
+                                                        &ivector_feature_);
+  InitFinalFeature();
+}
+
+void OnlineNnet2FeaturePipeline::InitFinalFeature() {
+  if (pitch_output_ != NULL)
+    feature_plus_optional_pitch_ = new OnlineAppendFeature(base_output_,
+                                                           pitch_output_);
+  else
+    feature_plus_optional_pitch_ = base_output_;
+
+  if (ivector_output_ != NULL)
+    final_feature_ = new OnlineAppendFeature(feature_plus_optional_pitch_,
+                                             ivector_output_);
+  else
+    final_feature_ = feature_plus_optional_pitch_;
   dim_ = final_feature_->Dim();
 }
 
@@ -128,6 +373,11 @@ void OnlineNnet2FeaturePipeline::GetFrame(int32 frame,
   return final_feature_->GetFrame(frame, feat);
 }
 
+void OnlineNnet2FeaturePipeline::GetFrames(int32 frame, int32 num_frames,
+                                           MatrixBase<BaseFloat> *feats) {
+  final_feature_->GetFrames(frame, num_frames, feats);
+}
+
 void OnlineNnet2FeaturePipeline::SetAdaptationState(
     const OnlineIvectorExtractorAdaptationState &adaptation_state) {
   if (info_.use_ivectors) {
@@ -152,17 +402,29 @@ OnlineNnet2FeaturePipeline::~OnlineNnet2FeaturePipeline() {
   // and we do have to avoid deleting them in those cases.
   if (final_feature_ != feature_plus_optional_pitch_)
     delete final_feature_;
-  delete ivector_feature_;
-  if (feature_plus_optional_pitch_ != base_feature_)
+  if (feature_plus_optional_pitch_ != base_output_)
     delete feature_plus_optional_pitch_;
-  delete pitch_feature_;
-  delete pitch_;
-  delete base_feature_;
+  if (front_end_ != NULL) {
+    // The features are owned by the front end.
+    if (ivector_output_ != NULL)
+      front_end_->Release(ivector_output_);
+    if (pitch_output_ != NULL)
+      front_end_->Release(pitch_output_);
+    front_end_->Release(base_output_);
+  } else {
+    delete ivector_feature_;
+    delete pitch_feature_;
+    delete pitch_;
+    delete base_feature_;
+  }
 }
 
 void OnlineNnet2FeaturePipeline::AcceptWaveform(
     BaseFloat sampling_rate,
     const VectorBase<BaseFloat> &waveform) {
+  if (front_end_ != NULL)
+    KALDI_ERR << "This pipeline gets its features from a front end; give the "
+              << "waveform to the front end.";
   base_feature_->AcceptWaveform(sampling_rate, waveform);
   if (pitch_)
     pitch_->AcceptWaveform(sampling_rate, waveform);
@@ -175,6 +437,9 @@ void OnlineNnet2FeaturePipeline::UpdateFrameWeights(
 }
 
 void OnlineNnet2FeaturePipeline::InputFinished() {
+  if (front_end_ != NULL)
+    KALDI_ERR << "This pipeline gets its features from a front end; call "
+              << "InputFinished() on the front end.";
   base_feature_->InputFinished();
   if (pitch_)
     pitch_->InputFinished();
@@ -161,6 +161,105 @@ struct OnlineNnet2FeaturePipelineInfo {
 
 
 
+/// OnlineNnet2FeatureFrontEnd computes the expensive stages of the feature
+/// pipeline for one audio stream (the MFCC/PLP/filterbank features, the pitch
+/// features and the iVectors) only once, and shares them between several
+/// OnlineNnet2FeaturePipeline objects, e.g. when we run an ASR model, a
+/// speech activity detection model and a language-id model on the same audio.
+/// You create the front end, create the pipelines with the constructor that
+/// takes a front end, and then give the waveform to the front end rather than
+/// to the pipelines.
+///
+/// Base and pitch features are shared between pipelines whose configurations
+/// for them are the same.  iVectors are shared between pipelines that were
+/// created from the same OnlineNnet2FeaturePipelineInfo object (which holds the
+/// iVector extractor), as the iVector computation also has state that is set
+/// via SetAdaptationState() and UpdateFrameWeights(); calling these on one of
+/// those pipelines affects all of them.
+///
+/// Each stage counts the pipelines that use it; when the last of them is
+/// destroyed, the stage is deleted and we stop giving it the waveform.  The
+/// base and pitch features are read directly, as the pipelines would read
+/// their own; this matters for pitch, as OnlinePitchFeature revises earlier
+/// frames as it sees more data.  The iVectors are read through an
+/// OnlineCacheFeature, so they are computed once however many pipelines read
+/// them.  This means that the iVector for a frame is fixed when it is first
+/// read by any of the pipelines: later reads get the cached value, even with
+/// use_most_recent_ivector == true, and even after UpdateFrameWeights() has
+/// changed the weights of frames up to that one.  (A standalone pipeline would
+/// recompute it in those cases.)  The front end must outlive the pipelines
+/// that use it.  Like the rest of the online feature code, this class is not
+/// thread-safe.
+class OnlineNnet2FeatureFrontEnd {
+ public:
+  OnlineNnet2FeatureFrontEnd(): waveform_accepted_(false),
+                                input_finished_(false) { }
+
+  /// Gives more data to all the stages that are in use.
+  void AcceptWaveform(BaseFloat sampling_rate,
+                      const VectorBase<BaseFloat> &waveform);
+
+  /// Tells all the stages that are in use that there is no more data.
+  void InputFinished();
+
+  /// The following functions are called by the OnlineNnet2FeaturePipeline
+  /// constructor.  They return the output of the stage for the configuration
+  /// in "info", creating the stage if it does not exist yet (which must happen
+  /// before AcceptWaveform() is called), and increment its count of users.
+  /// The caller must call Release() when it no longer needs it.
+  OnlineFeatureInterface *AcquireBaseFeature(
+      const OnlineNnet2FeaturePipelineInfo &info);
+
+  /// Requires info.add_pitch.
+  OnlineFeatureInterface *AcquirePitchFeature(
+      const OnlineNnet2FeaturePipelineInfo &info);
+
+  /// Requires info.use_ivectors.  Outputs to "ivector_feature" the
+  /// OnlineIvectorFeature object itself, for calls such as
+  /// SetAdaptationState(); the returned pointer should be used to get the
+  /// iVectors.
+  OnlineFeatureInterface *AcquireIvectorFeature(
+      const OnlineNnet2FeaturePipelineInfo &info,
+      OnlineIvectorFeature **ivector_feature);
+
+  /// Decrements the count of users of the stage whose output is "feature",
+  /// and deletes it if it has no users left.
+  void Release(OnlineFeatureInterface *feature);
+
+  ~OnlineNnet2FeatureFrontEnd();
+ private:
+  struct Stage {
+    std::string key;  // identifies the configuration.
+    int32 num_users;
+    OnlineBaseFeature *input;  // object we give the waveform to, or NULL.
+    OnlineFeatureInterface *feature;  // processed feature, or NULL.
+    OnlineCacheFeature *cache;  // cache of "feature", or NULL.
+    // What we give to the pipelines: "cache" if it is not NULL, else
+    // "feature" if it is not NULL, else "input".
+    OnlineFeatureInterface *output;
+    // the stage that this stage reads from, which it counts as a user, or
+    // NULL.
+    OnlineFeatureInterface *source;
+  };
+
+  // Returns the index of the stage with this key, or -1.
+  int32 FindStage(const std::string &key) const;
+  // Adds a stage to stages_ with one user, and returns its output.  "input"
+  // and "feature" may be NULL, but not both.  If "use_cache" is true (which
+  // requires "feature"), the output is a cache of "feature".
+  OnlineFeatureInterface *AddStage(const std::string &key,
+                                   OnlineBaseFeature *input,
+                                   OnlineFeatureInterface *feature,
+                                   bool use_cache,
+                                   OnlineFeatureInterface *source);
+
+  std::vector<Stage> stages_;
+  bool waveform_accepted_;
+  bool input_finished_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineNnet2FeatureFrontEnd);
+};
+
+
 /// OnlineNnet2FeaturePipeline is a class that's responsible for putting
 /// together the various parts of the feature-processing pipeline for neural
 /// networks, in an online setting.  The recipe here does not include fMLLR;
@@ -181,6 +280,13 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   explicit OnlineNnet2FeaturePipeline(
       const OnlineNnet2FeaturePipelineInfo &info);
 
+  /// Constructor that gets the base features, pitch features and iVectors
+  /// from "front_end", so they can be shared with other pipelines; see class
+  /// OnlineNnet2FeatureFrontEnd.  The waveform must then be given to the front
+  /// end, not to this object.
+  OnlineNnet2FeaturePipeline(const OnlineNnet2FeaturePipelineInfo &info,
+                             OnlineNnet2FeatureFrontEnd *front_end);
+
   /// Member functions from OnlineFeatureInterface:
 
   /// Dim() will return the base-feature dimension (e.g. 13 for normal MFCC);
@@ -192,6 +298,8 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   virtual bool IsLastFrame(int32 frame) const;
   virtual int32 NumFramesReady() const;
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+  virtual void GetFrames(int32 frame, int32 num_frames,
+                         MatrixBase<BaseFloat> *feats);
 
   /// Set the adaptation state to a particular value, e.g. reflecting previous
   /// utterances of the same speaker; this will generally be called after
@@ -212,7 +320,8 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   /// Accept more data to process.  It won't actually process it until you call
   /// GetFrame() [probably indirectly via (decoder).AdvanceDecoding()], when you
   /// call this function it will just copy it).  sampling_rate is necessary just
-  /// to assert it equals what's in the config.
+  /// to assert it equals what's in the config.  Not for use if this object was
+  /// constructed with a front end.
   void AcceptWaveform(BaseFloat sampling_rate,
                       const VectorBase<BaseFloat> &waveform);
 
@@ -228,29 +337,46 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   /// more waveform.  This will help flush out the last few frames of delta or
   /// LDA features, and finalize the pitch features (making them more
   /// accurate)... although since in neural-net decoding we don't anticipate
-  /// rescoring the lattices, this may not be much of an issue.
+  /// rescoring the lattices, this may not be much of an issue.  Not for use
+  /// if this object was constructed with a front end.
   void InputFinished();
 
   virtual ~OnlineNnet2FeaturePipeline();
  private:
 
+  // Sets up feature_plus_optional_pitch_ and final_feature_, once the other
+  // features have been set up.
+  void InitFinalFeature();
+
   const OnlineNnet2FeaturePipelineInfo &info_;
 
+  // The front end we get the features from, if the second constructor was
+  // used; in that case base_feature_, pitch_ and pitch_feature_ are NULL and
+  // ivector_feature_ is owned by the front end.
+  OnlineNnet2FeatureFrontEnd *front_end_;
+
   OnlineBaseFeature *base_feature_;        // MFCC/PLP/filterbank
   
   OnlinePitchFeature *pitch_;              // Raw pitch, if used
   OnlineProcessPitch *pitch_feature_;  // Processed pitch, if pitch used.
 
-
-  // feature_plus_pitch_ is the base_feature_ appended (OnlineAppendFeature)
-  /// with pitch_feature_, if used; otherwise, points to the same address as
-  /// base_feature_.
+  // base_output_, pitch_output_ and ivector_output_ are the features we read
+  // the base features, the pitch features and the iVectors from: they point
+  // to base_feature_, pitch_feature_ and ivector_feature_, or to the outputs
+  // of the front end's stages.
+  OnlineFeatureInterface *base_output_;
+  OnlineFeatureInterface *pitch_output_;
+  OnlineFeatureInterface *ivector_output_;
+
+  // feature_plus_pitch_ is the base_output_ appended (OnlineAppendFeature)
+  /// with pitch_output_, if used; otherwise, points to the same address as
+  /// base_output_.
   OnlineFeatureInterface *feature_plus_optional_pitch_;  
   
   OnlineIvectorFeature *ivector_feature_;  // iVector feature, if used.
 
   // final_feature_ is feature_plus_optional_pitch_ appended
-  // (OnlineAppendFeature) with ivector_feature_, if ivector_feature_ is used;
+  // (OnlineAppendFeature) with ivector_output_, if iVectors are used;
   // otherwise, points to the same address as feature_plus_optional_pitch_.
   OnlineFeatureInterface *final_feature_;
  
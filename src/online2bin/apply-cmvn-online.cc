@@ -95,10 +95,7 @@ int main(int argc, char *argv[]) {
                                  cmvn_state,
                                  &online_matrix);
 
-          for (int32 t = 0; t < feats.NumRows(); t++) {
-            SubVector<BaseFloat> row(normalized_feats, t);
-            online_cmvn.GetFrame(t, &row);
-          }
+          online_cmvn.GetFrames(0, feats.NumRows(), &normalized_feats);
           online_cmvn.GetState(feats.NumRows() - 1, &cmvn_state);
           
           num_done++;
@@ -120,10 +117,7 @@ int main(int argc, char *argv[]) {
                                cmvn_state,
                                &online_matrix);
 
-        for (int32 t = 0; t < feats.NumRows(); t++) {
-          SubVector<BaseFloat> row(normalized_feats, t);
-          online_cmvn.GetFrame(t, &row);
-        }
+        online_cmvn.GetFrames(0, feats.NumRows(), &normalized_feats);
         num_done++;
         tot_t += feats.NumRows();
         feature_writer.Write(utt, normalized_feats);
@@ -810,6 +810,20 @@ void TestSplitDecisionTree() {
                                                &num_leaves, &impr, &smallest_split);
       KALDI_ASSERT(num_leaves <= max_leaves && smallest_split >= thresh);
 
+      {  // Check that splitting with multiple threads gives the same tree.
+        int32 num_leaves_mt = 1;
+        BaseFloat impr_mt, smallest_split_mt;
+        EventMap *split_tree_mt = SplitDecisionTree(*trivial_tree, stats, qo, thresh, max_leaves,
+                                                    &num_leaves_mt, &impr_mt, &smallest_split_mt,
+                                                    1 + Rand() % 4);
+        KALDI_ASSERT(num_leaves_mt == num_leaves && impr_mt == impr);
+        std::ostringstream os1, os2;
+        split_tree->Write(os1, false);
+        split_tree_mt->Write(os2, false);
+        KALDI_ASSERT(os1.str() == os2.str());
+        delete split_tree_mt;
+      }
+
       {
         BaseFloat impr_check = ObjfGivenMap(stats, *split_tree) - ObjfGivenMap(stats, *trivial_tree);
         std::cout << "Objf impr is " << impr << ", computed differently: " <<impr_check<<'\n';
@@ -19,8 +19,11 @@
 
 #include <set>
 #include <queue>
+#include <pthread.h>
+#include <cstring>
 #include "util/stl-utils.h"
 #include "tree/build-tree-utils.h"
+#include "tree/compact-tree-stats.h"
 
 
 
@@ -46,6 +49,16 @@ void WriteBuildTreeStats(std::ostream &os, bool binary, const BuildTreeStatsType
 void ReadBuildTreeStats(std::istream &is, bool binary, const Clusterable &example, BuildTreeStatsType *stats) {
   KALDI_ASSERT(stats != NULL);
   KALDI_ASSERT(stats->empty());
+  if (PeekToken(is, binary) == 'C') {
+    // The compact format written by CompactTreeStats::Write().
+    if (example.Type() != "gauss")
+      KALDI_ERR << "Compact tree stats can only be read as type \"gauss\", "
+                << "not \"" << example.Type() << "\"";
+    CompactTreeStats compact_stats;
+    compact_stats.Read(is, binary);
+    compact_stats.GetBuildTreeStats(stats);
+    return;
+  }
   ExpectToken(is, binary, "BTS");
   uint32 size;
   ReadBasicType(is, binary, &size);
@@ -343,24 +356,48 @@ BaseFloat ComputeInitialSplit(const std::vector<Clusterable*> &summed_stats,
 }
 
 
-// returns best delta-objf.
-// If key does not exist, returns 0 and sets yes_set_out to empty.
-BaseFloat FindBestSplitForKey(const BuildTreeStatsType &stats,
-                              const Questions &q_opts,
-                              EventKeyType key,
-                              std::vector<EventValueType> *yes_set_out) {
-  if (stats.size()<=1) return 0.0;  // cannot split if only zero or one instance of stats.
-  if (!PossibleValues(key, stats, NULL)) {
-    yes_set_out->clear();
-    return 0.0;  // Can't split as key not always defined.
-  }
-  std::vector<Clusterable*> summed_stats;  // indexed by value corresponding to key. owned here.
-  {  // compute summed_stats
-    std::vector<BuildTreeStatsType> split_stats;
-    SplitStatsByKey(stats, key, &split_stats);
-    SumStatsVec(split_stats, &summed_stats);
+// Gets the value of "key" for each of the stats; returns false if the key was
+// not always defined.
+static bool GetValuesForKey(EventKeyType key,
+                            const BuildTreeStatsType &stats,
+                            std::vector<EventValueType> *values) {
+  values->resize(stats.size());
+  for (size_t i = 0; i < stats.size(); i++)
+    if (!EventMap::Lookup(stats[i].first, key, &((*values)[i])))
+      return false;
+  return true;
+}
+
+// This is equivalent to SplitStatsByKey() followed by SumStatsVec(), but it
+// works from the values of the key (as output by GetValuesForKey()) and does
+// not copy the event vectors.
+static void SumStatsByValue(const BuildTreeStatsType &stats,
+                            const std::vector<EventValueType> &values,
+                            std::vector<Clusterable*> *summed_stats) {
+  KALDI_ASSERT(values.size() == stats.size() && summed_stats->empty());
+  EventValueType max_value = -1;
+  for (size_t i = 0; i < values.size(); i++)
+    max_value = std::max(max_value, values[i]);
+  summed_stats->resize(max_value + 1, NULL);
+  for (size_t i = 0; i < stats.size(); i++) {
+    Clusterable *cl = stats[i].second;
+    KALDI_ASSERT(values[i] >= 0);
+    if (cl != NULL) {
+      Clusterable *&sum = (*summed_stats)[values[i]];
+      if (sum == NULL) sum = cl->Copy();
+      else sum->Add(*cl);
+    }
   }
+}
 
+// This does the work of FindBestSplitForKey() given the stats summed over each
+// value of the key (may contain NULLs; it's modified and the caller deletes it).
+static BaseFloat FindBestSplitGivenSummedStats(
+    std::vector<Clusterable*> *summed_stats_ptr,
+    const Questions &q_opts,
+    EventKeyType key,
+    std::vector<EventValueType> *yes_set_out) {
+  std::vector<Clusterable*> &summed_stats = *summed_stats_ptr;
   std::vector<EventValueType> yes_set;
   BaseFloat improvement = ComputeInitialSplit(summed_stats,
                                                q_opts, key, &yes_set);
@@ -416,6 +453,26 @@ BaseFloat FindBestSplitForKey(const BuildTreeStatsType &stats,
     DeletePointers(&clusters);
   }
 #endif
+  return improvement; // objective-function improvement.
+}
+
+
+// returns best delta-objf.
+// If key does not exist, returns 0 and sets yes_set_out to empty.
+BaseFloat FindBestSplitForKey(const BuildTreeStatsType &stats,
+                              const Questions &q_opts,
+                              EventKeyType key,
+                              std::vector<EventValueType> *yes_set_out) {
+  if (stats.size()<=1) return 0.0;  // cannot split if only zero or one instance of stats.
+  std::vector<EventValueType> values;
+  if (!GetValuesForKey(key, stats, &values)) {
+    yes_set_out->clear();
+    return 0.0;  // Can't split as key not always defined.
+  }
+  std::vector<Clusterable*> summed_stats;  // indexed by value corresponding to key. owned here.
+  SumStatsByValue(stats, values, &summed_stats);
+  BaseFloat improvement = FindBestSplitGivenSummedStats(&summed_stats, q_opts,
+                                                        key, yes_set_out);
   DeletePointers(&summed_stats);
   return improvement; // objective-function improvement.
 }
@@ -423,7 +480,10 @@ BaseFloat FindBestSplitForKey(const BuildTreeStatsType &stats,
 
 
 /*
-  DecisionTreeBuilder is a class used in SplitDecisionTree
+  DecisionTreeSplitter is a class used in SplitDecisionTree.  Each leaf caches,
+  for each key we have questions for, the value of the key for each of its
+  stats, so we only look up the keys in the event vectors once; when a leaf is
+  split, the cached values are divided between the children.
 */
 
 class DecisionTreeSplitter {
@@ -444,15 +504,55 @@ class DecisionTreeSplitter {
       best_split_impr_ = std::max(yes_->BestSplit(), no_->BestSplit());  // may have changed.
     }
   }
-  DecisionTreeSplitter(EventAnswerType leaf, const BuildTreeStatsType &stats,
-                      const Questions &q_opts): q_opts_(q_opts), yes_(NULL), no_(NULL), leaf_(leaf), stats_(stats) {
-    // not, this must work when stats is empty too. [just gives zero improvement, non-splittable].
-    FindBestSplit();
+  // This constructor takes the contents of "stats" and "key_values" (the
+  // values of keys[k] for the stats, or empty if keys[k] is not always
+  // defined; if NULL, they are computed here).  FindBestSplits() must be
+  // called before BestSplit() or DoSplit().
+  DecisionTreeSplitter(EventAnswerType leaf, BuildTreeStatsType *stats,
+                       std::vector<std::vector<EventValueType> > *key_values,
+                       const Questions &q_opts,
+                       const std::vector<EventKeyType> &keys,
+                       int32 num_threads):
+      q_opts_(q_opts), keys_(keys), num_threads_(num_threads),
+      best_split_impr_(0.0), yes_(NULL), no_(NULL), leaf_(leaf),
+      key_(0), best_key_index_(-1) {
+    // note, this must work when stats is empty too. [just gives zero improvement, non-splittable].
+    stats_.swap(*stats);
+    if (key_values != NULL) {
+      key_values_.swap(*key_values);
+    } else {
+      key_values_.resize(keys_.size());
+      for (size_t k = 0; k < keys_.size(); k++)
+        if (!GetValuesForKey(keys_[k], stats_, &(key_values_[k])))
+          key_values_[k].clear();
+    }
+    KALDI_ASSERT(key_values_.size() == keys_.size());
   }
   ~DecisionTreeSplitter() {
     delete yes_;
     delete no_;
   }
+
+  // Finds the best split of each of these (leaf) nodes, by evaluating the
+  // keys of all the nodes in parallel.
+  static void FindBestSplits(const std::vector<DecisionTreeSplitter*> &nodes,
+                             int32 num_threads);
+
+  // Finds the best split of this node on key keys_[k]; called by
+  // FindBestSplits(), possibly from multiple threads at once for different k.
+  void FindBestSplitForKeyIndex(size_t k) {
+    key_impr_[k] = 0.0;
+    key_yes_sets_[k].clear();
+    // cannot split if only zero or one instance of stats, or if the key is not
+    // always defined.
+    if (stats_.size() <= 1 || key_values_[k].size() != stats_.size()) return;
+    std::vector<Clusterable*> summed_stats;  // indexed by value.
+    SumStatsByValue(stats_, key_values_[k], &summed_stats);
+    key_impr_[k] = FindBestSplitGivenSummedStats(&summed_stats, q_opts_,
+                                                  keys_[k],
+                                                  &(key_yes_sets_[k]));
+    DeletePointers(&summed_stats);
+  }
  private:
   void DoSplitInternal(int32 *next_leaf) {
     // Does the split; applicable only to leaf nodes.
@@ -460,15 +560,27 @@ class DecisionTreeSplitter {
     KALDI_ASSERT(best_split_impr_ > 0);
     EventAnswerType yes_leaf = leaf_, no_leaf = (*next_leaf)++;
     leaf_ = -1;  // we now have no leaf.
-    // Now split the stats.
+    // Now split the stats, and the cached key values.
+    const std::vector<EventValueType> &split_values = key_values_[best_key_index_];
+    KALDI_ASSERT(split_values.size() == stats_.size());
     BuildTreeStatsType yes_stats, no_stats;
     yes_stats.reserve(stats_.size()); no_stats.reserve(stats_.size());  //  probably better than multiple resizings.
-    for (BuildTreeStatsType::const_iterator iter = stats_.begin(); iter != stats_.end(); ++iter) {
-      const EventType &vec = iter->first;
-      EventValueType val;
-      if (!EventMap::Lookup(vec, key_, &val)) KALDI_ERR << "DoSplitInternal: key has no value.";
-      if (std::binary_search(yes_set_.begin(), yes_set_.end(), val)) yes_stats.push_back(*iter);
-      else no_stats.push_back(*iter);
+    std::vector<bool> is_yes(stats_.size());
+    for (size_t i = 0; i < stats_.size(); i++) {
+      is_yes[i] = std::binary_search(yes_set_.begin(), yes_set_.end(),
+                                     split_values[i]);
+      if (is_yes[i]) yes_stats.push_back(stats_[i]);
+      else no_stats.push_back(stats_[i]);
+    }
+    std::vector<std::vector<EventValueType> > yes_key_values(keys_.size()),
+        no_key_values(keys_.size());
+    for (size_t k = 0; k < keys_.size(); k++) {
+      const std::vector<EventValueType> &values = key_values_[k];
+      if (values.size() != stats_.size()) continue;  // key not always defined.
+      yes_key_values[k].reserve(yes_stats.size());
+      no_key_values[k].reserve(no_stats.size());
+      for (size_t i = 0; i < values.size(); i++)
+        (is_yes[i] ? yes_key_values[k] : no_key_values[k]).push_back(values[i]);
     }
 #ifdef KALDI_PARANOID
     {  // Check objf improvement.
@@ -481,38 +593,41 @@ class DecisionTreeSplitter {
       delete yes_clust; delete no_clust;
     }
 #endif
-    yes_ = new DecisionTreeSplitter(yes_leaf, yes_stats, q_opts_);
-    no_ = new DecisionTreeSplitter(no_leaf, no_stats, q_opts_);
-    best_split_impr_ = std::max(yes_->BestSplit(), no_->BestSplit());
     stats_.clear();  // note: pointers in stats_ were not owned here.
+    key_values_.clear();
+    yes_ = new DecisionTreeSplitter(yes_leaf, &yes_stats, &yes_key_values,
+                                    q_opts_, keys_, num_threads_);
+    no_ = new DecisionTreeSplitter(no_leaf, &no_stats, &no_key_values,
+                                   q_opts_, keys_, num_threads_);
+    std::vector<DecisionTreeSplitter*> children(2);
+    children[0] = yes_;
+    children[1] = no_;
+    FindBestSplits(children, num_threads_);
+    best_split_impr_ = std::max(yes_->BestSplit(), no_->BestSplit());
   }
-  void FindBestSplit() {
-    // This sets best_split_impr_, key_ and yes_set_.
-    // May just pick best question, or may iterate a bit (depends on
-    // q_opts; see FindBestSplitForKey for details)
-    std::vector<EventKeyType> all_keys;
-    q_opts_.GetKeysWithQuestions(&all_keys);
-    if (all_keys.size() == 0) {
-      KALDI_WARN << "DecisionTreeSplitter::FindBestSplit(), no keys available to split on (maybe no key covered all of your events, or there was a problem with your questions configuration?)";
-    }
+
+  // This sets best_split_impr_, key_ and yes_set_ from the results for the
+  // individual keys.  We go through the keys in order and need a strictly
+  // better improvement to change the choice, so the result does not depend
+  // on the number of threads.
+  void FinishFindBestSplit() {
     best_split_impr_ = 0;
-    for (size_t i = 0; i < all_keys.size(); i++) {
-      if (q_opts_.HasQuestionsForKey(all_keys[i])) {
-        std::vector<EventValueType> temp_yes_set;
-        BaseFloat split_improvement = FindBestSplitForKey(stats_, q_opts_, all_keys[i], &temp_yes_set);
-        if (split_improvement > best_split_impr_) {
-          best_split_impr_ = split_improvement;
-          yes_set_ = temp_yes_set;
-          key_ = all_keys[i];
-        }
+    for (size_t k = 0; k < keys_.size(); k++) {
+      if (key_impr_[k] > best_split_impr_) {
+        best_split_impr_ = key_impr_[k];
+        yes_set_ = key_yes_sets_[k];
+        key_ = keys_[k];
+        best_key_index_ = k;
       }
     }
+    key_impr_.clear();
+    key_yes_sets_.clear();
   }
 
-
-
   // Data members... Always used:
   const Questions &q_opts_;
+  const std::vector<EventKeyType> &keys_;  // the keys we have questions for.
+  int32 num_threads_;
   BaseFloat best_split_impr_;
 
   // If already split:
@@ -522,13 +637,94 @@ class DecisionTreeSplitter {
   // Otherwise:
   EventAnswerType leaf_;
   BuildTreeStatsType stats_;  // vector of stats.  pointers inside there not owned here.
+  // key_values_[k][i] is the value of keys_[k] in stats_[i]; key_values_[k]
+  // is empty if keys_[k] is not defined for all of the stats.
+  std::vector<std::vector<EventValueType> > key_values_;
+
+  // Results for the individual keys, used inside FindBestSplits().
+  std::vector<BaseFloat> key_impr_;
+  std::vector<std::vector<EventValueType> > key_yes_sets_;
 
   // key and "yes set" of best split:
   EventKeyType key_;
+  int32 best_key_index_;  // index of key_ in keys_.
   std::vector<EventValueType> yes_set_;
+};
+
+
+// This class runs the (node, key-index) tasks of
+// DecisionTreeSplitter::FindBestSplits() in multiple threads.  The tree
+// directory does not depend on the thread directory, so we use pthreads
+// directly.
+class DecisionTreeSplitTasks {
+ public:
+  typedef std::pair<DecisionTreeSplitter*, size_t> Task;
 
+  DecisionTreeSplitTasks(const std::vector<Task> &tasks):
+      tasks_(tasks), next_task_(0) {
+    pthread_mutex_init(&mutex_, NULL);
+  }
+  ~DecisionTreeSplitTasks() { pthread_mutex_destroy(&mutex_); }
+
+  void Run(int32 num_threads) {
+    num_threads = std::min<int32>(num_threads, tasks_.size());
+    std::vector<pthread_t> threads(std::max(num_threads - 1, 0));
+    for (size_t i = 0; i < threads.size(); i++) {
+      int32 ret;
+      if ((ret = pthread_create(&(threads[i]), NULL, RunThread, this))) {
+        const char *c = strerror(ret);
+        KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
+      }
+    }
+    RunTasks();  // this thread does its share too.
+    for (size_t i = 0; i < threads.size(); i++)
+      if (pthread_join(threads[i], NULL))
+        KALDI_ERR << "Error rejoining thread.";
+  }
+ private:
+  static void *RunThread(void *ptr) {
+    static_cast<DecisionTreeSplitTasks*>(ptr)->RunTasks();
+    return NULL;
+  }
+  void RunTasks() {
+    while (true) {
+      pthread_mutex_lock(&mutex_);
+      size_t t = next_task_++;
+      pthread_mutex_unlock(&mutex_);
+      if (t >= tasks_.size()) return;
+      tasks_[t].first->FindBestSplitForKeyIndex(tasks_[t].second);
+    }
+  }
+
+  const std::vector<Task> &tasks_;
+  size_t next_task_;
+  pthread_mutex_t mutex_;
 };
 
+
+void DecisionTreeSplitter::FindBestSplits(
+    const std::vector<DecisionTreeSplitter*> &nodes, int32 num_threads) {
+  std::vector<DecisionTreeSplitTasks::Task> tasks;
+  for (size_t n = 0; n < nodes.size(); n++) {
+    DecisionTreeSplitter *node = nodes[n];
+    KALDI_ASSERT(node->yes_ == NULL);
+    node->key_impr_.resize(node->keys_.size());
+    node->key_yes_sets_.resize(node->keys_.size());
+    if (node->stats_.size() > 1)
+      for (size_t k = 0; k < node->keys_.size(); k++)
+        tasks.push_back(std::make_pair(node, k));
+  }
+  if (num_threads <= 1) {
+    for (size_t t = 0; t < tasks.size(); t++)
+      tasks[t].first->FindBestSplitForKeyIndex(tasks[t].second);
+  } else {
+    DecisionTreeSplitTasks runner(tasks);
+    runner.Run(num_threads);
+  }
+  for (size_t n = 0; n < nodes.size(); n++)
+    nodes[n]->FinishFindBestSplit();
+}
+
 EventMap *SplitDecisionTree(const EventMap &input_map,
                             const BuildTreeStatsType &stats,
                             Questions &q_opts,
@@ -536,11 +732,17 @@ EventMap *SplitDecisionTree(const EventMap &input_map,
                             int32 max_leaves,  // max_leaves<=0 -> no maximum.
                             int32 *num_leaves,
                             BaseFloat *obj_impr_out,
-                            BaseFloat *smallest_split_change_out) {
+                            BaseFloat *smallest_split_change_out,
+                            int32 num_threads) {
   KALDI_ASSERT(num_leaves != NULL && *num_leaves > 0);  // can't be 0 or input_map would be empty.
   int32 num_empty_leaves = 0;
   BaseFloat like_impr = 0.0;
   BaseFloat smallest_split_change = 1.0e+20;
+  std::vector<EventKeyType> all_keys;
+  q_opts.GetKeysWithQuestions(&all_keys);
+  if (all_keys.size() == 0) {
+    KALDI_WARN << "SplitDecisionTree(), no keys available to split on (maybe no key covered all of your events, or there was a problem with your questions configuration?)";
+  }
   std::vector<DecisionTreeSplitter*> builders;
   {  // set up "builders" [one for each current leaf].  This array is never extended.
     // the structures generated during splitting remain as trees at each array location.
@@ -551,8 +753,10 @@ EventMap *SplitDecisionTree(const EventMap &input_map,
     for (size_t i = 0;i < split_stats.size();i++) {
       EventAnswerType leaf = static_cast<EventAnswerType>(i);
       if (split_stats[i].size() == 0) num_empty_leaves++;
-      builders[i] = new DecisionTreeSplitter(leaf, split_stats[i], q_opts);
+      builders[i] = new DecisionTreeSplitter(leaf, &(split_stats[i]), NULL,
+                                             q_opts, all_keys, num_threads);
     }
+    DecisionTreeSplitter::FindBestSplits(builders, num_threads);
   }
 
   {  // Do the splitting.
@@ -48,7 +48,9 @@ void WriteBuildTreeStats(std::ostream &os, bool binary,
 /// Reads BuildTreeStats object.  The "example" argument must be of the same
 /// type as the stats on disk, and is needed for access to the correct "Read"
 /// function.  It was organized this way for easier extensibility (so adding new
-/// Clusterable derived classes isn't painful)
+/// Clusterable derived classes isn't painful).  If the stats on disk are in the
+/// format written by CompactTreeStats::Write(), they are converted (this
+/// requires "example" to be of type GaussClusterable).
 void ReadBuildTreeStats(std::istream &is, bool binary,
                         const Clusterable &example, BuildTreeStatsType *stats);
 
@@ -269,6 +271,9 @@ EventMap *ShareEventMapLeaves(const EventMap &e_in, EventKeyType key,
 /// @param smallest_split_change_out If non-NULL, will be set to the smallest objective-function
 ///         improvement that we got from splitting any leaf; useful to provide a threshold
 ///         for ClusterEventMap.
+/// @param num_threads [in] Number of threads used to evaluate the candidate splits
+///         (of the different keys and leaves) in parallel; the result does not
+///         depend on it.
 /// @return The EventMap after splitting is returned; pointer is owned by caller.
 EventMap *SplitDecisionTree(const EventMap &orig,
                             const BuildTreeStatsType &stats,
@@ -277,7 +282,8 @@ EventMap *SplitDecisionTree(const EventMap &orig,
                             int32 max_leaves,  // max_leaves<=0 -> no maximum.
                             int32 *num_leaves,
                             BaseFloat *objf_impr_out,
-                            BaseFloat *smallest_split_change_out);
+                            BaseFloat *smallest_split_change_out,
+                            int32 num_threads = 1);
 
 /// CreateRandomQuestions will initialize a Questions randomly, in a reasonable
 /// way [for testing purposes, or when hand-designed questions are not available].
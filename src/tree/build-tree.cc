@@ -20,6 +20,7 @@
 #include <set>
 #include <queue>
 #include "util/stl-utils.h"
+#include "tree/build-tree.h"
 #include "tree/build-tree-utils.h"
 #include "tree/clusterable-classes.h"
 
@@ -141,7 +142,8 @@ EventMap *BuildTree(Questions &qopts,
                     BaseFloat thresh,
                     int32 max_leaves,
                     BaseFloat cluster_thresh,  // typically == thresh.  If negative, use smallest split.
-                    int32 P) {
+                    int32 P,
+                    int32 num_threads) {
   KALDI_ASSERT(thresh > 0 || max_leaves > 0);
   KALDI_ASSERT(stats.size() != 0);
   KALDI_ASSERT(!phone_sets.empty()
@@ -179,7 +181,8 @@ EventMap *BuildTree(Questions &qopts,
   EventMap *tree_split = SplitDecisionTree(*tree_stub,
                                            filtered_stats,
                                            qopts, thresh, max_leaves,
-                                           &num_leaves, &impr, &smallest_split);
+                                           &num_leaves, &impr, &smallest_split,
+                                           num_threads);
   
   if (cluster_thresh < 0.0) {
     KALDI_LOG <<  "Setting clustering threshold to smallest split " << smallest_split;
@@ -75,6 +75,8 @@ namespace kaldi {
  
  * @param P [in] The central position of the phone context window, e.g. 1 for a
  *                triphone system.
+ * @param num_threads [in] Number of threads used in the decision-tree splitting
+ *                (see SplitDecisionTree()); does not affect the result.
  * @return  Returns a pointer to an EventMap object that is the tree.
 
 */
@@ -88,7 +90,8 @@ EventMap *BuildTree(Questions &qopts,
                     BaseFloat thresh,
                     int32 max_leaves,
                     BaseFloat cluster_thresh,  // typically == thresh.  If negative, use smallest split.
-                    int32 P);
+                    int32 P,
+                    int32 num_threads = 1);
 
 
 /**
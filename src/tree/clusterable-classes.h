@@ -76,6 +76,10 @@ class GaussClusterable: public Clusterable {
                    const Vector<BaseFloat> &x2_stats,
                    BaseFloat var_floor, BaseFloat count);
 
+  GaussClusterable(const VectorBase<double> &x_stats,
+                   const VectorBase<double> &x2_stats,
+                   double var_floor, double count);
+
   virtual std::string Type() const {  return "gauss"; }
   void AddStats(const VectorBase<BaseFloat> &vec, BaseFloat weight = 1.0);
   virtual BaseFloat Objf() const;
@@ -94,6 +98,7 @@ class GaussClusterable: public Clusterable {
   SubVector<double> x_stats() const { return stats_.Row(0); }
   SubVector<double> x2_stats() const { return stats_.Row(1); }
  private:
+  friend class CompactTreeStats;  // accesses the stats in double precision.
   double count_;
   Matrix<double> stats_; // two rows: sum, then sum-squared.
   double var_floor_;  // should be common for all objects created.
@@ -116,6 +121,14 @@ inline GaussClusterable::GaussClusterable(const Vector<BaseFloat> &x_stats,
   stats_.Row(1).CopyFromVec(x2_stats);
 }
 
+inline GaussClusterable::GaussClusterable(const VectorBase<double> &x_stats,
+                                          const VectorBase<double> &x2_stats,
+                                          double var_floor, double count):
+    count_(count), stats_(2, x_stats.Dim()), var_floor_(var_floor) {
+  stats_.Row(0).CopyFromVec(x_stats);
+  stats_.Row(1).CopyFromVec(x2_stats);
+}
+
 
 /// VectorClusterable wraps vectors in a form accessible to generic clustering
 /// algorithms.  Each vector is associated with a weight; these could be 1.0.
@@ -0,0 +1,173 @@
+// tree/compact-tree-stats-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+#include "util/stl-utils.h"
+#include "tree/build-tree.h"
+#include "tree/compact-tree-stats.h"
+
+namespace kaldi {
+
+static void GenRandTreeStats(BuildTreeStatsType *stats) {
+  int32 dim = 1 + Rand() % 10;
+  int32 num_phones = 1 + Rand() % 20;
+  int32 num_stats = 1 + Rand() % 20;
+  int32 N = 2 + Rand() % 2;  // 2 or 3.
+  int32 P = Rand() % N;
+  std::vector<int32> phone_ids(num_phones);
+  for (int32 i = 0; i < num_phones; i++)
+    phone_ids[i] = i + 1;
+  std::vector<int32> hmm_lengths(num_phones + 1);
+  std::vector<bool> is_ctx_dep(num_phones + 1);
+  for (int32 i = 0; i <= num_phones; i++) {
+    hmm_lengths[i] = 1 + Rand() % 3;
+    is_ctx_dep[i] = (RandUniform() < 0.8);
+  }
+  GenRandStats(dim, num_stats, N, P, phone_ids, hmm_lengths, is_ctx_dep,
+               false, stats);
+}
+
+// Checks that "stats" (which must be sorted and uniq) are the same as
+// "compact_stats", times "scale".
+static void AssertEqualStats(const BuildTreeStatsType &stats,
+                             const CompactTreeStats &compact_stats,
+                             BaseFloat scale) {
+  KALDI_ASSERT(static_cast<int32>(stats.size()) == compact_stats.NumEvents());
+  BuildTreeStatsType stats2;
+  compact_stats.GetBuildTreeStats(&stats2);
+  KALDI_ASSERT(stats2.size() == stats.size());
+  for (size_t i = 0; i < stats.size(); i++) {
+    EventType event;
+    compact_stats.GetEvent(i, &event);
+    KALDI_ASSERT(event == stats[i].first && stats2[i].first == event);
+    const GaussClusterable *a =
+        dynamic_cast<const GaussClusterable*>(stats[i].second),
+        *b = dynamic_cast<const GaussClusterable*>(stats2[i].second);
+    KALDI_ASSERT(a != NULL && b != NULL);
+    AssertEqual(scale * a->count(), b->count());
+    Vector<double> x_stats(a->x_stats()), x2_stats(a->x2_stats());
+    x_stats.Scale(scale);
+    x2_stats.Scale(scale);
+    KALDI_ASSERT(x_stats.ApproxEqual(b->x_stats()) &&
+                 x2_stats.ApproxEqual(b->x2_stats()));
+  }
+  DeleteBuildTreeStats(&stats2);
+}
+
+void TestCompactTreeStatsIo() {
+  for (int32 i = 0; i < 10; i++) {
+    BuildTreeStatsType stats;
+    GenRandTreeStats(&stats);
+    std::sort(stats.begin(), stats.end());
+    CompactTreeStats compact_stats;
+    compact_stats.CopyFromBuildTreeStats(stats);
+    AssertEqualStats(stats, compact_stats, 1.0);
+
+    for (int32 j = 0; j < 2; j++) {
+      bool binary = (j == 0);
+      {  // Compact format.
+        std::ostringstream os;
+        compact_stats.Write(os, binary);
+        CompactTreeStats compact_stats2;
+        std::istringstream is(os.str());
+        compact_stats2.Read(is, binary);
+        AssertEqualStats(stats, compact_stats2, 1.0);
+        // ReadBuildTreeStats() should accept the compact format.
+        BuildTreeStatsType stats2;
+        GaussClusterable example;
+        std::istringstream is2(os.str());
+        ReadBuildTreeStats(is2, binary, example, &stats2);
+        CompactTreeStats compact_stats3;
+        compact_stats3.CopyFromBuildTreeStats(stats2);
+        AssertEqualStats(stats, compact_stats3, 1.0);
+        DeleteBuildTreeStats(&stats2);
+      }
+      {  // The format written by WriteBuildTreeStats().
+        std::ostringstream os;
+        WriteBuildTreeStats(os, binary, stats);
+        CompactTreeStats compact_stats2;
+        std::istringstream is(os.str());
+        compact_stats2.Read(is, binary);
+        AssertEqualStats(stats, compact_stats2, 1.0);
+      }
+    }
+    DeleteBuildTreeStats(&stats);
+  }
+}
+
+void TestCompactTreeStatsAdd() {
+  for (int32 i = 0; i < 10; i++) {
+    BuildTreeStatsType stats;
+    GenRandTreeStats(&stats);
+    // Split the stats into two overlapping, unsorted parts.
+    BuildTreeStatsType stats1, stats2;
+    for (size_t j = 0; j < stats.size(); j++) {
+      int32 r = Rand() % 3;
+      if (r != 0) stats1.push_back(stats[j]);
+      if (r != 1) stats2.push_back(stats[j]);
+    }
+    std::random_shuffle(stats1.begin(), stats1.end());
+    CompactTreeStats compact_stats1, compact_stats2;
+    compact_stats1.CopyFromBuildTreeStats(stats1);
+    compact_stats2.CopyFromBuildTreeStats(stats2);
+    compact_stats1.Add(compact_stats2);
+
+    // Work out the sum the old way.
+    BuildTreeStatsType sum;
+    for (size_t j = 0; j < stats1.size(); j++)
+      sum.push_back(std::make_pair(stats1[j].first,
+                                   stats1[j].second->Copy()));
+    for (size_t j = 0; j < stats2.size(); j++)
+      sum.push_back(std::make_pair(stats2[j].first,
+                                   stats2[j].second->Copy()));
+    BuildTreeStatsType summed;
+    std::sort(sum.begin(), sum.end());  // sorts on the events first.
+    for (size_t j = 0; j < sum.size(); j++) {
+      if (!summed.empty() && summed.back().first == sum[j].first) {
+        summed.back().second->Add(*(sum[j].second));
+        delete sum[j].second;
+      } else {
+        summed.push_back(sum[j]);
+      }
+    }
+    AssertEqualStats(summed, compact_stats1, 1.0);
+
+    // Adding to itself doubles the stats.
+    CompactTreeStats compact_stats3;
+    compact_stats3.CopyFromBuildTreeStats(summed);
+    compact_stats3.Add(compact_stats1);
+    AssertEqualStats(summed, compact_stats3, 2.0);
+
+    // Adding to an empty object copies.
+    CompactTreeStats compact_stats4;
+    compact_stats4.Add(compact_stats1);
+    AssertEqualStats(summed, compact_stats4, 1.0);
+
+    DeleteBuildTreeStats(&summed);
+    DeleteBuildTreeStats(&stats);
+  }
+}
+
+}  // end namespace kaldi
+
+int main() {
+  kaldi::TestCompactTreeStatsIo();
+  kaldi::TestCompactTreeStatsAdd();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,336 @@
+// tree/compact-tree-stats.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "tree/compact-tree-stats.h"
+
+namespace kaldi {
+
+void CompactTreeStats::GetEvent(int32 i, EventType *event) const {
+  KALDI_ASSERT(i >= 0 && i < NumEvents());
+  event->assign(event_elems_.begin() + event_begin_[i],
+                event_elems_.begin() + event_begin_[i + 1]);
+}
+
+void CompactTreeStats::AppendEvent(ElemIter begin, ElemIter end,
+                                   double count,
+                                   StatsIter x_stats, StatsIter x2_stats) {
+  event_elems_.insert(event_elems_.end(), begin, end);
+  event_begin_.push_back(event_elems_.size());
+  counts_.push_back(count);
+  x_stats_.insert(x_stats_.end(), x_stats, x_stats + dim_);
+  x2_stats_.insert(x2_stats_.end(), x2_stats, x2_stats + dim_);
+}
+
+int32 CompactTreeStats::CompareEvents(int32 i, const CompactTreeStats &other,
+                                      int32 j) const {
+  // Lexicographical comparison, as for operator < on EventType.
+  ElemIter a = event_elems_.begin() + event_begin_[i],
+      a_end = event_elems_.begin() + event_begin_[i + 1],
+      b = other.event_elems_.begin() + other.event_begin_[j],
+      b_end = other.event_elems_.begin() + other.event_begin_[j + 1];
+  for (; a != a_end && b != b_end; ++a, ++b) {
+    if (*a < *b) return -1;
+    if (*b < *a) return 1;
+  }
+  if (a != a_end) return 1;
+  if (b != b_end) return -1;
+  return 0;
+}
+
+void CompactTreeStats::AppendOrAddEvent(const CompactTreeStats &other,
+                                        int32 i) {
+  StatsIter x_stats = other.x_stats_.begin() + i * dim_,
+      x2_stats = other.x2_stats_.begin() + i * dim_;
+  int32 n = NumEvents();
+  if (n > 0 && CompareEvents(n - 1, other, i) == 0) {
+    counts_[n - 1] += other.counts_[i];
+    std::vector<double>::iterator
+        this_x_stats = x_stats_.begin() + (n - 1) * dim_,
+        this_x2_stats = x2_stats_.begin() + (n - 1) * dim_;
+    for (int32 d = 0; d < dim_; d++) {
+      this_x_stats[d] += x_stats[d];
+      this_x2_stats[d] += x2_stats[d];
+    }
+  } else {
+    AppendEvent(other.event_elems_.begin() + other.event_begin_[i],
+                other.event_elems_.begin() + other.event_begin_[i + 1],
+                other.counts_[i], x_stats, x2_stats);
+  }
+}
+
+bool CompactTreeStats::IsSortedAndUniq() const {
+  for (int32 i = 0; i + 1 < NumEvents(); i++)
+    if (CompareEvents(i, *this, i + 1) >= 0)
+      return false;
+  return true;
+}
+
+namespace {
+// Compares events by their index in a CompactTreeStats object; used
+// in SortAndMerge().
+struct CompactEventIndexLess {
+  typedef std::pair<EventKeyType, EventValueType> EventElem;
+  CompactEventIndexLess(const std::vector<int32> &event_begin,
+                        const std::vector<EventElem> &event_elems):
+      event_begin_(event_begin), event_elems_(event_elems) { }
+  bool operator () (int32 i, int32 j) const {
+    return std::lexicographical_compare(
+        event_elems_.begin() + event_begin_[i],
+        event_elems_.begin() + event_begin_[i + 1],
+        event_elems_.begin() + event_begin_[j],
+        event_elems_.begin() + event_begin_[j + 1]);
+  }
+  const std::vector<int32> &event_begin_;
+  const std::vector<EventElem> &event_elems_;
+};
+}
+
+void CompactTreeStats::SortAndMerge() {
+  if (IsSortedAndUniq())
+    return;
+  int32 num_events = NumEvents();
+  std::vector<int32> order(num_events);
+  for (int32 i = 0; i < num_events; i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   CompactEventIndexLess(event_begin_, event_elems_));
+  CompactTreeStats sorted;
+  sorted.dim_ = dim_;
+  sorted.var_floor_ = var_floor_;
+  sorted.event_begin_.reserve(num_events + 1);
+  sorted.event_elems_.reserve(event_elems_.size());
+  sorted.counts_.reserve(num_events);
+  sorted.x_stats_.reserve(x_stats_.size());
+  sorted.x2_stats_.reserve(x2_stats_.size());
+  for (int32 i = 0; i < num_events; i++)
+    sorted.AppendOrAddEvent(*this, order[i]);
+  Swap(&sorted);
+}
+
+void CompactTreeStats::Swap(CompactTreeStats *other) {
+  std::swap(dim_, other->dim_);
+  std::swap(var_floor_, other->var_floor_);
+  event_begin_.swap(other->event_begin_);
+  event_elems_.swap(other->event_elems_);
+  counts_.swap(other->counts_);
+  x_stats_.swap(other->x_stats_);
+  x2_stats_.swap(other->x2_stats_);
+}
+
+void CompactTreeStats::CopyFromBuildTreeStats(const BuildTreeStatsType &stats) {
+  CompactTreeStats empty;
+  Swap(&empty);
+  size_t num_elems = 0;
+  for (size_t i = 0; i < stats.size(); i++)
+    num_elems += stats[i].first.size();
+  event_elems_.reserve(num_elems);
+  event_begin_.reserve(stats.size() + 1);
+  counts_.reserve(stats.size());
+  bool first = true;
+  for (size_t i = 0; i < stats.size(); i++) {
+    if (stats[i].second == NULL) continue;
+    const GaussClusterable *gc =
+        dynamic_cast<const GaussClusterable*>(stats[i].second);
+    if (gc == NULL)
+      KALDI_ERR << "CompactTreeStats only supports stats of type \"gauss\", "
+                << "got \"" << stats[i].second->Type() << "\"";
+    SubVector<double> x_stats(gc->x_stats()), x2_stats(gc->x2_stats());
+    if (first) {
+      dim_ = x_stats.Dim();
+      var_floor_ = gc->var_floor_;
+      x_stats_.reserve(stats.size() * dim_);
+      x2_stats_.reserve(stats.size() * dim_);
+      first = false;
+    } else if (x_stats.Dim() != dim_) {
+      KALDI_ERR << "Tree stats have inconsistent dimension: "
+                << x_stats.Dim() << " vs. " << dim_;
+    }
+    const EventType &event = stats[i].first;
+    event_elems_.insert(event_elems_.end(), event.begin(), event.end());
+    event_begin_.push_back(event_elems_.size());
+    counts_.push_back(gc->count_);
+    x_stats_.insert(x_stats_.end(), x_stats.Data(), x_stats.Data() + dim_);
+    x2_stats_.insert(x2_stats_.end(), x2_stats.Data(), x2_stats.Data() + dim_);
+  }
+  SortAndMerge();
+}
+
+void CompactTreeStats::GetBuildTreeStats(BuildTreeStatsType *stats) const {
+  int32 num_events = NumEvents();
+  stats->reserve(stats->size() + num_events);
+  for (int32 i = 0; i < num_events; i++) {
+    EventType event;
+    GetEvent(i, &event);
+    SubVector<double> x_stats(const_cast<double*>(&(x_stats_[0])) + i * dim_,
+                              dim_),
+        x2_stats(const_cast<double*>(&(x2_stats_[0])) + i * dim_, dim_);
+    stats->push_back(std::make_pair(event,
+        static_cast<Clusterable*>(new GaussClusterable(
+            x_stats, x2_stats, var_floor_, counts_[i]))));
+  }
+}
+
+void CompactTreeStats::Add(const CompactTreeStats &other) {
+  if (other.NumEvents() == 0)
+    return;
+  if (NumEvents() == 0) {
+    *this = other;
+    return;
+  }
+  if (other.dim_ != dim_)
+    KALDI_ERR << "Adding tree stats with different dimension: "
+              << dim_ << " vs. " << other.dim_;
+  if (other.var_floor_ != var_floor_)
+    KALDI_WARN << "Adding tree stats with different variance floors "
+               << var_floor_ << " vs. " << other.var_floor_;
+  CompactTreeStats sum;
+  sum.dim_ = dim_;
+  sum.var_floor_ = var_floor_;
+  int32 n1 = NumEvents(), n2 = other.NumEvents();
+  sum.counts_.reserve(n1 + n2);
+  sum.event_begin_.reserve(n1 + n2 + 1);
+  sum.event_elems_.reserve(event_elems_.size() + other.event_elems_.size());
+  sum.x_stats_.reserve(x_stats_.size() + other.x_stats_.size());
+  sum.x2_stats_.reserve(x2_stats_.size() + other.x2_stats_.size());
+  // Both lists are sorted and uniq, so a merge gives a sorted, uniq list
+  // (AppendOrAddEvent() sums events that appear in both).
+  int32 i = 0, j = 0;
+  while (i < n1 || j < n2) {
+    if (j == n2 || (i < n1 && CompareEvents(i, other, j) <= 0))
+      sum.AppendOrAddEvent(*this, i++);
+    else
+      sum.AppendOrAddEvent(other, j++);
+  }
+  Swap(&sum);
+}
+
+void CompactTreeStats::Write(std::ostream &os, bool binary) const {
+  int32 num_events = NumEvents();
+  WriteToken(os, binary, "<CompactTreeStats>");
+  WriteToken(os, binary, "<Dim>");
+  WriteBasicType(os, binary, dim_);
+  WriteToken(os, binary, "<VarFloor>");
+  WriteBasicType(os, binary, var_floor_);
+  WriteToken(os, binary, "<NumEvents>");
+  WriteBasicType(os, binary, num_events);
+  if (!binary) os << "\n";
+  WriteToken(os, binary, "<EventBegin>");
+  WriteIntegerVector(os, binary, event_begin_);
+  std::vector<EventKeyType> keys(event_elems_.size());
+  std::vector<EventValueType> values(event_elems_.size());
+  for (size_t i = 0; i < event_elems_.size(); i++) {
+    keys[i] = event_elems_[i].first;
+    values[i] = event_elems_[i].second;
+  }
+  WriteToken(os, binary, "<EventKeys>");
+  WriteIntegerVector(os, binary, keys);
+  WriteToken(os, binary, "<EventValues>");
+  WriteIntegerVector(os, binary, values);
+  if (!binary) os << "\n";
+  // The stats are written as a Vector and two Matrices; for an empty object we
+  // write empty ones.
+  WriteToken(os, binary, "<Counts>");
+  if (num_events == 0) {
+    Vector<double>().Write(os, binary);
+    WriteToken(os, binary, "<XStats>");
+    Matrix<double>().Write(os, binary);
+    WriteToken(os, binary, "<X2Stats>");
+    Matrix<double>().Write(os, binary);
+  } else {
+    SubVector<double>(const_cast<double*>(&(counts_[0])),
+                      num_events).Write(os, binary);
+    WriteToken(os, binary, "<XStats>");
+    SubMatrix<double>(const_cast<double*>(&(x_stats_[0])), num_events,
+                      dim_, dim_).Write(os, binary);
+    WriteToken(os, binary, "<X2Stats>");
+    SubMatrix<double>(const_cast<double*>(&(x2_stats_[0])), num_events,
+                      dim_, dim_).Write(os, binary);
+  }
+  WriteToken(os, binary, "</CompactTreeStats>");
+}
+
+void CompactTreeStats::Read(std::istream &is, bool binary) {
+  if (PeekToken(is, binary) != 'C') {
+    // Assume it's the format written by WriteBuildTreeStats().
+    BuildTreeStatsType stats;
+    GaussClusterable example;
+    ReadBuildTreeStats(is, binary, example, &stats);
+    CopyFromBuildTreeStats(stats);
+    DeleteBuildTreeStats(&stats);
+    return;
+  }
+  CompactTreeStats empty;
+  Swap(&empty);
+  int32 num_events;
+  ExpectToken(is, binary, "<CompactTreeStats>");
+  ExpectToken(is, binary, "<Dim>");
+  ReadBasicType(is, binary, &dim_);
+  ExpectToken(is, binary, "<VarFloor>");
+  ReadBasicType(is, binary, &var_floor_);
+  ExpectToken(is, binary, "<NumEvents>");
+  ReadBasicType(is, binary, &num_events);
+  ExpectToken(is, binary, "<EventBegin>");
+  ReadIntegerVector(is, binary, &event_begin_);
+  std::vector<EventKeyType> keys;
+  std::vector<EventValueType> values;
+  ExpectToken(is, binary, "<EventKeys>");
+  ReadIntegerVector(is, binary, &keys);
+  ExpectToken(is, binary, "<EventValues>");
+  ReadIntegerVector(is, binary, &values);
+  if (num_events < 0 || dim_ < 0 ||
+      event_begin_.size() != static_cast<size_t>(num_events + 1) ||
+      event_begin_[0] != 0 || keys.size() != values.size() ||
+      static_cast<size_t>(event_begin_.back()) != keys.size())
+    KALDI_ERR << "Reading CompactTreeStats: inconsistent event data.";
+  for (int32 i = 0; i < num_events; i++)
+    if (event_begin_[i] > event_begin_[i + 1])
+      KALDI_ERR << "Reading CompactTreeStats: inconsistent event data.";
+  event_elems_.resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++)
+    event_elems_[i] = std::make_pair(keys[i], values[i]);
+
+  Vector<double> counts;
+  Matrix<double> x_stats, x2_stats;
+  ExpectToken(is, binary, "<Counts>");
+  counts.Read(is, binary);
+  ExpectToken(is, binary, "<XStats>");
+  x_stats.Read(is, binary);
+  ExpectToken(is, binary, "<X2Stats>");
+  x2_stats.Read(is, binary);
+  ExpectToken(is, binary, "</CompactTreeStats>");
+  if (counts.Dim() != num_events ||
+      (num_events != 0 &&
+       (x_stats.NumRows() != num_events || x_stats.NumCols() != dim_ ||
+        x2_stats.NumRows() != num_events || x2_stats.NumCols() != dim_)))
+    KALDI_ERR << "Reading CompactTreeStats: inconsistent dimensions.";
+  counts_.assign(counts.Data(), counts.Data() + num_events);
+  x_stats_.resize(static_cast<size_t>(num_events) * dim_);
+  x2_stats_.resize(static_cast<size_t>(num_events) * dim_);
+  for (int32 i = 0; i < num_events; i++) {
+    std::copy(x_stats.RowData(i), x_stats.RowData(i) + dim_,
+              x_stats_.begin() + i * dim_);
+    std::copy(x2_stats.RowData(i), x2_stats.RowData(i) + dim_,
+              x2_stats_.begin() + i * dim_);
+  }
+  // Files written by Write() are sorted, but we make sure.
+  SortAndMerge();
+}
+
+}  // end namespace kaldi
@@ -0,0 +1,127 @@
+// tree/compact-tree-stats.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_TREE_COMPACT_TREE_STATS_H_
+#define KALDI_TREE_COMPACT_TREE_STATS_H_
+
+#include <vector>
+#include "tree/build-tree-utils.h"
+#include "tree/clusterable-classes.h"
+
+namespace kaldi {
+
+/// \addtogroup tree_group
+/// @{
+
+/**
+   CompactTreeStats stores Gaussian tree-building statistics (the same
+   information as a BuildTreeStatsType whose Clusterable pointers are all of
+   type GaussClusterable) in a columnar form: the (key, value) pairs of all
+   the events are in one contiguous array, and the counts, sums and sums of
+   squares are in contiguous arrays of doubles.  Compared with
+   BuildTreeStatsType this avoids several small heap allocations per event,
+   and it can be read and written as a few large blocks.
+
+   The events are always kept sorted (in the same order as
+   std::map<EventType, ...> would give) and unique, so that two sets of stats
+   can be summed by merging them, without any index.
+
+   The on-disk format starts with the token "<CompactTreeStats>", while the
+   format written by WriteBuildTreeStats() starts with "BTS";
+   ReadBuildTreeStats() accepts both formats (for GaussClusterable stats), and
+   so does CompactTreeStats::Read().
+ */
+class CompactTreeStats {
+ public:
+  CompactTreeStats(): dim_(0), var_floor_(0.0), event_begin_(1, 0) { }
+
+  /// Number of distinct events.
+  int32 NumEvents() const { return counts_.size(); }
+
+  /// Feature dimension (zero if there are no stats).
+  int32 Dim() const { return dim_; }
+
+  /// Outputs the i'th event.
+  void GetEvent(int32 i, EventType *event) const;
+
+  /// Returns the count of the i'th event.
+  double Count(int32 i) const { return counts_[i]; }
+
+  /// Sets *this to the stats in "stats", which must be all of type
+  /// GaussClusterable (NULL pointers are ignored).  Stats for the same event
+  /// are summed.
+  void CopyFromBuildTreeStats(const BuildTreeStatsType &stats);
+
+  /// Appends the stats to "stats" in the format used by the tree-building code
+  /// (sorted by event); the GaussClusterable pointers are newly allocated and
+  /// owned by the caller (see DeleteBuildTreeStats()).
+  void GetBuildTreeStats(BuildTreeStatsType *stats) const;
+
+  /// Adds "other" to *this; the stats of events that appear in both are
+  /// summed.
+  void Add(const CompactTreeStats &other);
+
+  void Write(std::ostream &os, bool binary) const;
+
+  /// Reads stats in the format written by Write(), or in the format written by
+  /// WriteBuildTreeStats() (if the stats are of type GaussClusterable).
+  void Read(std::istream &is, bool binary);
+
+  void Swap(CompactTreeStats *other);
+
+ private:
+  typedef std::pair<EventKeyType, EventValueType> EventElem;
+  typedef std::vector<EventElem>::const_iterator ElemIter;
+  typedef std::vector<double>::const_iterator StatsIter;
+
+  /// Appends an event and its stats (no check for sorting).
+  void AppendEvent(ElemIter begin, ElemIter end, double count,
+                   StatsIter x_stats, StatsIter x2_stats);
+
+  /// Appends event i of "other", or adds it to the last event if they are the
+  /// same.
+  void AppendOrAddEvent(const CompactTreeStats &other, int32 i);
+
+  /// Compares event i of *this with event j of "other"; returns -1, 0 or 1.
+  int32 CompareEvents(int32 i, const CompactTreeStats &other, int32 j) const;
+
+  /// Sorts the events and sums the stats of identical events.
+  void SortAndMerge();
+
+  /// Returns true if the events are sorted and unique.
+  bool IsSortedAndUniq() const;
+
+  int32 dim_;
+  double var_floor_;
+  /// Event i is event_elems_[event_begin_[i]] ... event_elems_[event_begin_[i+1] - 1];
+  /// the size of event_begin_ is NumEvents() + 1.
+  std::vector<int32> event_begin_;
+  std::vector<EventElem> event_elems_;
+  std::vector<double> counts_;
+  /// The sums and sums of squares of the features; NumEvents() by Dim(),
+  /// row-major.
+  std::vector<double> x_stats_;
+  std::vector<double> x2_stats_;
+};
+
+/// @} end "addtogroup tree_group"
+
+}  // end namespace kaldi
+
+#endif  // KALDI_TREE_COMPACT_TREE_STATS_H_
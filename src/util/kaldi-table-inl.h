@@ -695,7 +695,7 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     if (!IsToken(key)) // e.g. empty string or has spaces...
       KALDI_ERR << "TableWriter: using invalid key " << key;
     output_.Stream() << key << ' ';
-    if (!Holder::Write(output_.Stream(), opts_.binary, value)) {
+    if (!WriteTableObject<Holder>(output_.Stream(), opts_, value)) {
       KALDI_WARN << "TableWriter: write failure to "
                  << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
@@ -857,7 +857,7 @@ class TableWriterScriptImpl: public TableWriterImplBase<Holder> {
                  << PrintableWxfilename(wxfilename);
       return false;
     }
-    if (!Holder::Write(output.Stream(), opts_.binary, value)
+    if (!WriteTableObject<Holder>(output.Stream(), opts_, value)
         || !output.Close()) {
       KALDI_WARN << "TableWriter: failed to write data to "
                  << PrintableWxfilename(wxfilename);
@@ -1016,7 +1016,7 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
     std::ostream &script_os = script_output_.Stream();
     script_output_.Stream() << key << ' ' << offset_rxfilename << '\n';
 
-    if (!Holder::Write(archive_output_.Stream(), opts_.binary, value)) {
+    if (!WriteTableObject<Holder>(archive_output_.Stream(), opts_, value)) {
       KALDI_WARN << "TableWriter: write failure to"
                  << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
@@ -118,6 +118,18 @@ void UnitTestClassifyWspecifier() {
     KALDI_ASSERT(ans == kBothWspecifier && ark == "a b" && scp == "c,d" && opts.binary == false);
   }
 
+  {
+    std::string a = "ark,packed:foo";
+    std::string ark = "x", scp = "y"; WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kArchiveWspecifier && ark == "foo" && opts.packed &&
+                 !opts.packed_quantize);
+    a = "ark,packed-quantized:foo";
+    ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kArchiveWspecifier && opts.packed &&
+                 opts.packed_quantize);
+  }
+
   {
     std::string a = "";
     std::string ark = "x", scp = "y"; WspecifierOptions opts;
@@ -173,6 +173,10 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       if (opts) opts->binary = false;
     } else if (!strcmp(c, "p")) {
       if (opts) opts->permissive = true;
+    } else if (!strcmp(c, "packed")) {
+      if (opts) opts->packed = true;
+    } else if (!strcmp(c, "packed-quantized")) {
+      if (opts) opts->packed = opts->packed_quantize = true;
     } else if (!strcmp(c, "ark")) {
       if (ws == kNoWspecifier) ws = kArchiveWspecifier;
       else return kNoWspecifier;  // We do not allow "scp, ark", only "ark, scp".
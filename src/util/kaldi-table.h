@@ -70,12 +70,19 @@ typedef std::vector<std::string> KeyList;
 //  p means permissive mode, when writing to an "scp" file only: will ignore
 //     missing scp entries, i.e. won't write anything for those files but will
 //     return success status).
+//  packed means write in a more compact binary format, for types whose Holder
+//     supports one (currently CompactLattice; see lat/kaldi-lattice.h); it is
+//     ignored in text mode and for other types.  The reading code detects the
+//     format automatically.
+//  packed-quantized is as packed, but the weights are also quantized (this
+//     is lossy).
 //
 //  So the following are valid wspecifiers:
 //  ark,b,f:foo
 //  "ark,b,b:| gzip -c > foo"
 //  "ark,scp,t,nf:foo.ark,|gzip -c > foo.scp.gz"
 //  ark,b:-
+//  "ark,packed:| gzip -c > lat.1.gz"
 //
 //  The meanings of rxfilename and wxfilename are as described in
 //  kaldi-stream.h (they are filenames but include pipes, stdin/stdout
@@ -113,9 +120,22 @@ struct WspecifierOptions {
   bool binary;
   bool flush;
   bool permissive; // will ignore absent scp entries.
-  WspecifierOptions(): binary(true), flush(false), permissive(false) { }
+  bool packed;  // write in the Holder's packed format, if it has one.
+  bool packed_quantize;  // quantize the weights in the packed format.
+  WspecifierOptions(): binary(true), flush(false), permissive(false),
+                       packed(false), packed_quantize(false) { }
 };
 
+/// TableWriter writes each object by calling this function, which by default
+/// calls Holder::Write(os, opts.binary, t).  A Holder that has a packed
+/// on-disk format (selected by the "packed" wspecifier option) specializes it;
+/// see CompactLatticeHolder.
+template<class Holder>
+bool WriteTableObject(std::ostream &os, const WspecifierOptions &opts,
+                      const typename Holder::T &t) {
+  return Holder::Write(os, opts.binary, t);
+}
+
 // ClassifyWspecifier returns the type of the wspecifier string,
 // and (if pointers are non-NULL) outputs the extra information
 // about the options, and the script and archive